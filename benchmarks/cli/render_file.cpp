@@ -0,0 +1,239 @@
+#include <effect_player.hpp>
+#include <color_conversion.hpp>
+#include <file_pipeline.hpp>
+#include <video_file.hpp>
+#include <bnb/stub_control.h>
+
+#include "json_writer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Renders a Y4M or raw clip through bnb::oep::effect_player at constant memory:
+ *
+ *   oep_render_file --input in.y4m --output out.y4m
+ *   oep_render_file --input in.nv12 --input-format nv12 --size 1280x720 --output out.bgra --output-format bgra
+ *
+ * With the stub SDK the effect draws nothing, the frame goes through the RGBA render
+ * target unchanged, so the output is the input converted to the output format.
+ */
+
+namespace
+{
+    using bnb::video::pixel_layout;
+    using bnb::oep::interfaces::image_format;
+    using bnb::oep::interfaces::pixel_buffer;
+
+    void usage()
+    {
+        std::cerr << "usage: oep_render_file --input FILE --output FILE\n"
+                     "                       [--input-format i420|nv12|bgra] [--size WxH] [--fps N]\n"
+                     "                       [--output-format i420|nv12|bgra] [--frames N]\n"
+                     "                       [--read-ahead N] [--write-behind N] [--recognition-us N] [--draw-us N]\n"
+                     "raw files need --input-format and --size, .y4m files are i420\n";
+    }
+
+    image_format to_image_format(pixel_layout layout)
+    {
+        switch (layout) {
+            case pixel_layout::i420: return image_format::i420_bt601_full;
+            case pixel_layout::nv12: return image_format::nv12_bt601_full;
+            case pixel_layout::bgra: return image_format::bpc8_bgra;
+        }
+        return image_format::bpc8_bgra;
+    }
+
+    /* planes of a YUV frame in the terms of the colour conversion */
+    bnb::image::yuv_planes yuv_planes(const bnb::video::frame_format& format, uint8_t* frame)
+    {
+        const auto planes = bnb::video::frame_planes(format, frame);
+        return {planes[0].data, planes[0].stride, planes[1].data, planes[1].stride, planes[2].data, planes[2].stride};
+    }
+
+    bnb::image::yuv_format yuv_format(pixel_layout layout)
+    {
+        // Y4M C420jpeg is full range
+        return {layout == pixel_layout::nv12 ? bnb::image::yuv_layout::nv12 : bnb::image::yuv_layout::i420,
+                bnb::image::yuv_matrix::bt601,
+                bnb::image::yuv_range::full};
+    }
+
+    /* effect_player between the file stages, the frame is pushed and drawn synchronously */
+    class clip_renderer
+    {
+    public:
+        clip_renderer(const bnb::video::frame_format& input, const bnb::video::frame_format& output)
+            : m_input(input)
+            , m_output(output)
+            , m_ep(input.width, input.height)
+            , m_keepalive(std::make_shared<int>(0))
+            , m_render_target(static_cast<size_t>(input.width) * input.height * 4)
+        {
+            m_planes.reserve(3);
+            m_ep.surface_created(input.width, input.height);
+        }
+
+        void operator()(uint8_t* in, uint8_t* out)
+        {
+            // the input buffer is recycled when this returns, the SDK releases the image in draw_frame
+            const auto planes = bnb::video::frame_planes(m_input, in);
+            m_planes.clear();
+            for (int32_t i = 0; i < bnb::video::plane_count(m_input.layout); ++i) {
+                m_planes.push_back({pixel_buffer::plane_sptr(m_keepalive, planes[i].data), static_cast<size_t>(planes[i].stride) * planes[i].rows, planes[i].stride});
+            }
+            auto image = pixel_buffer::create(m_planes, to_image_format(m_input.layout), m_input.width, m_input.height);
+            m_ep.push_frame(image, bnb::oep::interfaces::rotation::deg0, false, static_cast<int64_t>(m_frames));
+            image.reset();
+            if (!m_ep.draw_frame().drawn()) {
+                throw std::runtime_error("the effect player did not draw the frame");
+            }
+            ++m_frames;
+
+            render(in);
+            read_back(out);
+        }
+
+    private:
+        /* what the GPU would hold after the draw: the input in the BGRA render target */
+        void render(uint8_t* in)
+        {
+            const int32_t stride = m_input.width * 4;
+            if (m_input.layout == pixel_layout::bgra) {
+                std::memcpy(m_render_target.data(), in, m_render_target.size());
+                return;
+            }
+            bnb::image::yuv_to_rgb(yuv_planes(m_input, in), yuv_format(m_input.layout), m_input.width, m_input.height,
+                                   m_render_target.data(), stride, bnb::image::rgb_layout::bgra);
+        }
+
+        void read_back(uint8_t* out)
+        {
+            const int32_t stride = m_input.width * 4;
+            if (m_output.layout == pixel_layout::bgra) {
+                std::memcpy(out, m_render_target.data(), m_render_target.size());
+                return;
+            }
+            bnb::image::rgb_to_yuv(m_render_target.data(), stride, bnb::image::rgb_layout::bgra, m_input.width, m_input.height,
+                                   yuv_planes(m_output, out), yuv_format(m_output.layout));
+        }
+
+        const bnb::video::frame_format m_input;
+        const bnb::video::frame_format m_output;
+        bnb::oep::effect_player m_ep;
+        std::shared_ptr<int> m_keepalive;
+        std::vector<pixel_buffer::plane_data> m_planes;
+        std::vector<uint8_t> m_render_target;
+        uint64_t m_frames{0};
+    };
+
+    bool parse_size(const std::string& s, bnb::video::frame_format& format)
+    {
+        const auto x = s.find('x');
+        if (x == std::string::npos) {
+            return false;
+        }
+        format.width = std::atoi(s.substr(0, x).c_str());
+        format.height = std::atoi(s.substr(x + 1).c_str());
+        return format.width > 0 && format.height > 0;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string input_path;
+    std::string output_path;
+    std::string output_layout;
+    bnb::video::frame_format raw_format;
+    uint64_t max_frames = 0;
+    size_t read_ahead = 4;
+    size_t write_behind = 4;
+    int64_t recognition_us = 0;
+    int64_t draw_us = 0;
+
+    for (int i = 1; i < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const std::string value = argv[i + 1];
+        try {
+            if (arg == "--input") {
+                input_path = value;
+            } else if (arg == "--output") {
+                output_path = value;
+            } else if (arg == "--input-format") {
+                raw_format.layout = bnb::video::parse_pixel_layout(value);
+            } else if (arg == "--output-format") {
+                output_layout = value;
+            } else if (arg == "--size") {
+                if (!parse_size(value, raw_format)) {
+                    throw std::invalid_argument("bad --size " + value);
+                }
+            } else if (arg == "--fps") {
+                raw_format.fps_num = std::atoi(value.c_str());
+            } else if (arg == "--frames") {
+                max_frames = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (arg == "--read-ahead") {
+                read_ahead = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--write-behind") {
+                write_behind = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (arg == "--recognition-us") {
+                recognition_us = std::atoll(value.c_str());
+            } else if (arg == "--draw-us") {
+                draw_us = std::atoll(value.c_str());
+            } else {
+                usage();
+                return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (input_path.empty() || output_path.empty()) {
+        usage();
+        return 1;
+    }
+
+    try {
+        bnb_stub_set_costs(recognition_us, draw_us);
+
+        auto reader = bnb::video::open_reader(input_path, raw_format);
+        auto output_format = reader->format();
+        if (!output_layout.empty()) {
+            output_format.layout = bnb::video::parse_pixel_layout(output_layout);
+        }
+        auto writer = bnb::video::open_writer(output_path, output_format);
+
+        clip_renderer renderer(reader->format(), output_format);
+        bnb::video::file_pipeline pipeline(*reader, *writer, read_ahead, write_behind);
+        const auto stats = pipeline.run(std::ref(renderer), max_frames);
+
+        bnb::bench::json_writer json(std::cout);
+        json.begin_object();
+        json.field("input", input_path);
+        json.field("output", output_path);
+        json.field("width", reader->format().width);
+        json.field("height", reader->format().height);
+        json.field("input_format", bnb::video::to_string(reader->format().layout));
+        json.field("output_format", bnb::video::to_string(output_format.layout));
+        json.field("frames", stats.frames);
+        json.field("seconds", stats.seconds);
+        json.field("fps", stats.seconds > 0 ? stats.frames / stats.seconds : 0.0);
+        json.field("process_seconds", stats.process_seconds);
+        json.field("input_wait_seconds", stats.input_wait_seconds);
+        json.field("output_wait_seconds", stats.output_wait_seconds);
+        json.field("buffer_bytes", static_cast<uint64_t>(stats.buffer_bytes));
+        json.end_object();
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "egl_context.hpp"
+
+#include <EGL/eglext.h>
+#include <GLES3/gl3.h>
+
+#include <stdexcept>
+#include <string>
+
+using namespace bnb::bench;
+
+namespace
+{
+    EGLDisplay open_display()
+    {
+#if defined(EGL_PLATFORM_SURFACELESS_MESA)
+        auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (get_platform_display != nullptr) {
+            EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+#endif
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+} // namespace
+
+egl_context::egl_context()
+    : egl_context(nullptr)
+{
+}
+
+egl_context::egl_context(const egl_context* share)
+{
+    if (share != nullptr) {
+        m_display = share->m_display;
+        m_owns_display = false;
+    } else {
+        m_display = open_display();
+        EGLint major = 0;
+        EGLint minor = 0;
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+            throw std::runtime_error("eglInitialize failed");
+        }
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint count = 0;
+    eglChooseConfig(m_display, config_attribs, &config, 1, &count);
+
+    const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+    m_context = eglCreateContext(m_display, count != 0 ? config : nullptr, share != nullptr ? share->m_context : EGL_NO_CONTEXT, context_attribs);
+    if (m_context == EGL_NO_CONTEXT) {
+        if (m_owns_display) {
+            eglTerminate(m_display);
+        }
+        throw std::runtime_error("eglCreateContext failed: " + std::to_string(eglGetError()));
+    }
+    // surfaceless, the benchmarks render into their own framebuffers
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        eglDestroyContext(m_display, m_context);
+        if (m_owns_display) {
+            eglTerminate(m_display);
+        }
+        throw std::runtime_error("eglMakeCurrent failed: " + std::to_string(eglGetError()));
+    }
+}
+
+egl_context::~egl_context()
+{
+    if (eglGetCurrentContext() == m_context) {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+    eglDestroyContext(m_display, m_context);
+    if (m_owns_display) {
+        eglTerminate(m_display);
+    }
+}
+
+void egl_context::make_current()
+{
+    if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+        throw std::runtime_error("eglMakeCurrent failed: " + std::to_string(eglGetError()));
+    }
+}
+
+void egl_context::release()
+{
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+const char* egl_context::description() const
+{
+    static const std::string description = std::string(reinterpret_cast<const char*>(glGetString(GL_VENDOR))) + " | "
+                                           + reinterpret_cast<const char*>(glGetString(GL_RENDERER)) + " | "
+                                           + reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    return description.c_str();
+}
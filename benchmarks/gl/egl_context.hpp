@@ -0,0 +1,36 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+namespace bnb::bench
+{
+    /**
+     * Headless GLES 3 context for the GL benchmarks. Uses the Mesa surfaceless platform
+     * when it is there (no display server needed), the default display otherwise.
+     * The context is current on the creating thread until release() or the end of its lifetime.
+     */
+    class egl_context
+    {
+    public:
+        egl_context();
+        /// a context in the share group of `share`, on its display
+        explicit egl_context(const egl_context* share);
+        ~egl_context();
+
+        egl_context(const egl_context&) = delete;
+        egl_context& operator=(const egl_context&) = delete;
+
+        /* GL_VENDOR | GL_RENDERER | GL_VERSION */
+        const char* description() const;
+
+        /// makes the context current on the calling thread, a context is current on one thread at a time
+        void make_current();
+        void release();
+
+    private:
+        EGLDisplay m_display{EGL_NO_DISPLAY};
+        EGLContext m_context{EGL_NO_CONTEXT};
+        bool m_owns_display{true};
+    };
+
+} // namespace bnb::bench
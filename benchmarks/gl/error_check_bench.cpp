@@ -0,0 +1,102 @@
+#include "gl_benchmarks.hpp"
+
+#include <opengl.hpp>
+
+#include <chrono>
+
+/*
+ * Cost of the GL error checking modes per GL_CALL and whether they find an error:
+ * a run of valid calls with one invalid call (GL_INVALID_ENUM) in the middle.
+ * Needs BNB_GL_CHECKS, the benchmarks build ogl_utils with it.
+ */
+
+namespace
+{
+    using bnb::gl::context_info;
+    using bnb::gl::error_check_mode;
+    using clock_type = std::chrono::steady_clock;
+
+    const char* to_string(error_check_mode mode)
+    {
+        switch (mode) {
+            case error_check_mode::off: return "off";
+            case error_check_mode::sampled: return "sampled";
+            case error_check_mode::full: return "full";
+            case error_check_mode::debug_callback: return "debug_callback";
+        }
+        return "";
+    }
+
+    /* the call with the wrong target, the line tells its site from the others */
+    constexpr int bad_call_line = __LINE__ + 3;
+    void bad_call()
+    {
+        GL_CALL(glBindTexture(GL_TEXTURE_2D + 1, 0));
+    }
+} // namespace
+
+void bnb::bench::run_error_check_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    auto& info = context_info::instance();
+    const auto initial_mode = info.get_error_check_mode();
+
+    GLuint textures[2] = {0, 0};
+    glGenTextures(2, textures);
+
+    // the first mode would pay for the warm-up of the driver
+    for (int32_t i = 0; i < cfg.calls; ++i) {
+        glBindTexture(GL_TEXTURE_2D, textures[i & 1]);
+    }
+    glFinish();
+
+    json.key("error_check").begin_object();
+    json.field("calls", cfg.calls);
+    json.field("sample_period", cfg.sample_period);
+    json.key("modes").begin_array();
+    for (auto mode : {error_check_mode::off, error_check_mode::sampled, error_check_mode::full, error_check_mode::debug_callback}) {
+        json.begin_object();
+        json.field("mode", to_string(mode));
+        if (!info.set_error_check_mode(mode, static_cast<uint32_t>(cfg.sample_period))) {
+            json.field("supported", false);
+            json.end_object();
+            continue;
+        }
+        json.field("supported", true);
+        info.reset_error_stats();
+
+        const auto start = clock_type::now();
+        for (int32_t i = 0; i < cfg.calls; ++i) {
+            if (i == cfg.calls / 2) {
+                bad_call();
+            }
+            GL_CALL(glBindTexture(GL_TEXTURE_2D, textures[i & 1]));
+        }
+        glFinish();
+        const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+
+        // whatever is still pending is not a find of the mode
+        while (glGetError() != GL_NO_ERROR) {
+        }
+
+        uint64_t errors = 0;
+        uint64_t at_bad_call = 0;
+        for (const auto& site : info.error_stats()) {
+            errors += site.count;
+            if (site.line == bad_call_line) {
+                at_bad_call += site.count;
+            }
+        }
+        json.field("ns_per_call", cfg.calls > 0 ? ns / cfg.calls : 0.0);
+        json.field("errors", errors);
+        json.field("errors_at_bad_call", at_bad_call);
+        json.end_object();
+    }
+    json.end_array();
+    json.end_object();
+
+    info.set_error_check_mode(initial_mode);
+    info.reset_error_stats();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(2, textures);
+    info.state().invalidate();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "json_writer.hpp"
+
+#include <cstdint>
+#include <string>
+
+/*
+ * Portable stand-ins of the GL paths of offscreen_render_target.mm on a headless EGL context:
+ * they reproduce its ring, resize, readback, orientation and governor steps with plain GLES 3
+ * textures instead of IOSurfaces and EAGL, they do not run the Objective-C++ code. That code is
+ * compiled for the iOS simulator by benchmarks/apple.
+ */
+
+namespace bnb::bench
+{
+    class egl_context;
+
+    struct gl_config
+    {
+        /* distinct programs per program cache pass */
+        int32_t programs{8};
+        /* an empty directory for the binaries, a temporary one is made when not set */
+        std::string cache_dir;
+        /* frames and render target size of the per frame benchmarks */
+        int32_t frames{300};
+        int32_t width{1280};
+        int32_t height{720};
+        /* GL_CALLs per error checking mode and the period of the sampled mode */
+        int32_t calls{200000};
+        int32_t sample_period{64};
+    };
+
+    /* cold compile vs disk binary load vs shared acquire of bnb::gl::program_cache */
+    void run_program_cache_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* GL calls per frame of the render target with and without bnb::gl::state_cache */
+    void run_state_cache_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* cost per GL_CALL and found errors of every bnb::gl::error_check_mode */
+    void run_error_check_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* output rotation as a second pass against the rotation folded into the effect draw */
+    void run_orientation_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* render and readback strictly alternating against a ring of 2 to 4 fenced render targets */
+    void run_render_ring_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* YUV output: RGBA readback plus CPU conversion against bnb::gl::yuv_readback */
+    void run_yuv_readback_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* surface_changed: render targets recreated per size against targets reused up to a capacity */
+    void run_resize_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* frames over the budget under a raised load, at the full size against bnb::resolution_governor */
+    void run_governor_benchmarks(const gl_config& cfg, json_writer& json);
+
+    /* aggregate fps of 1 to 4 players, a context per player in one share group against one context taken in turn */
+    void run_multi_context_benchmarks(egl_context& context, const gl_config& cfg, json_writer& json);
+
+} // namespace bnb::bench
@@ -0,0 +1,295 @@
+#include "gl_benchmarks.hpp"
+
+#include <opengl.hpp>
+#include <program_cache.hpp>
+#include <resolution_governor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/*
+ * bnb::resolution_governor on measured frames, the way BNBOffscreenEffectPlayer drives it: the
+ * effect is drawn at the governor's scale into the corner of the render target, drawn up to the
+ * output size as offscreen_render_target::orient_image does, and the frame time up to glFinish
+ * goes back to the governor. The load is raised in the second quarter of the run, a stand-in for a
+ * throttled GPU, the budget is 1.5x the unthrottled full size frame. Against the same run at a
+ * fixed full size: frames over the budget, the scale reached and how fast it recovers.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // a triangle covering the viewport, no vertex buffer needed
+    const char* vertex_source =
+        "#version 300 es\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;\n"
+        "    gl_Position = vec4(p, 0.0, 1.0);\n"
+        "    vTexCoord = p * 0.5 + 0.5;\n"
+        "}\n";
+
+    /* stand-in of an effect, the cost per pixel grows with uIterations; green is the row, for the upright check */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform int uIterations;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 c = vec3(vTexCoord, 0.5);\n"
+        "    for (int i = 0; i < uIterations; ++i) {\n"
+        "        c = fract(c * 1.7 + c.yzx * 0.3 + 0.1);\n"
+        "    }\n"
+        "    FragColor = vec4(c.x, vTexCoord.y, c.z, 1.0);\n"
+        "}\n";
+
+    /* the output pass, the texture coordinates clamped to the corner as in offscreen_render_target */
+    const char* upscale_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform sampler2D uTexture;\n"
+        "uniform vec2 uTexScale;\n"
+        "uniform vec2 uTexMax;\n"
+        "void main()\n"
+        "{\n"
+        "    FragColor = texture(uTexture, min(vTexCoord * uTexScale, uTexMax));\n"
+        "}\n";
+
+    // the output pass is a large part of a frame on a software rasterizer, far more than on a GPU:
+    // a heavier effect at half the --size keeps the ratio closer to a device and the run short
+    constexpr int32_t base_iterations = 48;
+    constexpr int32_t throttled_iterations = 120;
+    constexpr double budget_factor = 1.5;
+
+    /* the render target at its capacity and the output frame */
+    class scaled_frame
+    {
+    public:
+        scaled_frame(int32_t w, int32_t h)
+            : m_effect(bnb::gl::program_cache::instance().acquire("governor_effect", vertex_source, effect_source))
+            , m_upscale(bnb::gl::program_cache::instance().acquire("governor_upscale", vertex_source, upscale_source))
+            , m_width(w)
+            , m_height(h)
+        {
+            for (GLuint* texture : {&m_color, &m_output}) {
+                glGenTextures(1, texture);
+                glBindTexture(GL_TEXTURE_2D, *texture);
+                glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+            }
+            glBindTexture(GL_TEXTURE_2D, m_color);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glGenFramebuffers(1, &m_framebuffer);
+            glGenFramebuffers(1, &m_output_framebuffer);
+            glGenVertexArrays(1, &m_vao);
+            auto& state = bnb::gl::context_info::instance().state();
+            state.invalidate();
+            state.bind_framebuffer(m_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, m_color);
+            state.bind_framebuffer(m_output_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, m_output);
+            state.bind_framebuffer(0);
+        }
+
+        ~scaled_frame()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            for (GLuint texture : {m_color, m_output}) {
+                state.forget_texture(texture);
+            }
+            state.forget_framebuffer(m_framebuffer);
+            state.forget_framebuffer(m_output_framebuffer);
+            glDeleteVertexArrays(1, &m_vao);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteFramebuffers(1, &m_output_framebuffer);
+            const GLuint textures[] = {m_color, m_output};
+            glDeleteTextures(2, textures);
+        }
+
+        scaled_frame(const scaled_frame&) = delete;
+        scaled_frame& operator=(const scaled_frame&) = delete;
+
+        /// milliseconds until the GPU has finished the frame
+        double render(float scale, int32_t iterations)
+        {
+            const auto start = clock_type::now();
+            // even, as BNBOffscreenEffectPlayer sizes the surface
+            const int32_t w = scale < 1.0f ? std::max(int32_t(m_width * scale) & ~1, 2) : m_width;
+            const int32_t h = scale < 1.0f ? std::max(int32_t(m_height * scale) & ~1, 2) : m_height;
+            auto& state = bnb::gl::context_info::instance().state();
+            state.bind_framebuffer(m_framebuffer);
+            state.viewport(0, 0, w, h);
+            state.use_program(m_effect->handle());
+            glUniform1i(glGetUniformLocation(m_effect->handle(), "uIterations"), iterations);
+            state.bind_vertex_array(m_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            if (w != m_width || h != m_height) {
+                // the output pass of offscreen_render_target, the corner drawn up to the output size
+                const GLuint program = m_upscale->handle();
+                state.bind_framebuffer(m_output_framebuffer);
+                state.viewport(0, 0, m_width, m_height);
+                state.use_program(program);
+                state.active_texture(GL_TEXTURE0);
+                state.bind_texture(GL_TEXTURE_2D, m_color);
+                glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+                glUniform2f(glGetUniformLocation(program, "uTexScale"), float(w) / m_width, float(h) / m_height);
+                glUniform2f(glGetUniformLocation(program, "uTexMax"), (w - 0.5f) / m_width, (h - 0.5f) / m_height);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            glFinish();
+            m_scaled = w != m_width || h != m_height;
+            return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        }
+
+        /// green of the first and the last row of the last output, it grows upwards in an upright frame
+        bool upright()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.bind_framebuffer(m_scaled ? m_output_framebuffer : m_framebuffer);
+            uint8_t bottom[4] = {};
+            uint8_t top[4] = {};
+            glReadPixels(m_width / 2, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, bottom);
+            glReadPixels(m_width / 2, m_height - 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, top);
+            state.bind_framebuffer(0);
+            return bottom[1] < 16 && top[1] > 240;
+        }
+
+    private:
+        std::shared_ptr<bnb::gl::linked_program> m_effect;
+        std::shared_ptr<bnb::gl::linked_program> m_upscale;
+        int32_t m_width;
+        int32_t m_height;
+        GLuint m_color{0};
+        GLuint m_output{0};
+        GLuint m_framebuffer{0};
+        GLuint m_output_framebuffer{0};
+        GLuint m_vao{0};
+        bool m_scaled{false};
+    };
+
+    struct run_result
+    {
+        int32_t over_budget{0};
+        int32_t over_budget_throttled{0};
+        double mean_ms{0};
+        double max_ms{0};
+        double mean_scale{0};
+        float min_scale{1.0f};
+        float final_scale{1.0f};
+        // frames from the start of the throttle to the first drop, from its end back to the full size, -1 none
+        int32_t frames_to_drop{-1};
+        int32_t frames_to_recover{-1};
+        std::vector<bnb::resolution_decision> decisions;
+    };
+
+    run_result run(scaled_frame& frame, int32_t phase, double budget_ms, bool governed)
+    {
+        bnb::resolution_governor_config config;
+        config.target_ms = budget_ms;
+        bnb::resolution_governor governor(config);
+        run_result result;
+        // every step back up takes upscale_after frames, the recovery gets two phases
+        const int32_t frames = 4 * phase;
+        for (int32_t i = 0; i < frames; ++i) {
+            const bool throttled = i >= phase && i < 2 * phase;
+            const float scale = governor.scale();
+            const double ms = frame.render(scale, throttled ? throttled_iterations : base_iterations);
+            if (governed) {
+                governor.record(ms);
+            }
+            result.over_budget += ms > budget_ms;
+            result.over_budget_throttled += throttled && ms > budget_ms;
+            result.mean_ms += ms;
+            result.max_ms = std::max(result.max_ms, ms);
+            result.mean_scale += scale;
+            result.min_scale = std::min(result.min_scale, scale);
+            if (throttled && result.frames_to_drop < 0 && governor.scale() < 1.0f) {
+                result.frames_to_drop = i - phase + 1;
+            }
+            if (i >= 2 * phase && result.frames_to_recover < 0 && result.min_scale < 1.0f && governor.scale() == 1.0f) {
+                result.frames_to_recover = i - 2 * phase + 1;
+            }
+        }
+        result.mean_ms /= frames;
+        result.mean_scale /= frames;
+        result.final_scale = governor.scale();
+        result.decisions = governor.decisions();
+        return result;
+    }
+
+    void field(bnb::bench::json_writer& json, const char* name, const run_result& r)
+    {
+        json.key(name).begin_object();
+        json.field("over_budget", r.over_budget);
+        json.field("over_budget_throttled", r.over_budget_throttled);
+        json.field("mean_ms", r.mean_ms);
+        json.field("max_ms", r.max_ms);
+        json.field("mean_scale", r.mean_scale);
+        json.field("min_scale", double(r.min_scale));
+        json.field("final_scale", double(r.final_scale));
+        json.field("frames_to_drop", r.frames_to_drop);
+        json.field("frames_to_recover", r.frames_to_recover);
+        json.key("decisions").begin_array();
+        for (const auto& d : r.decisions) {
+            json.begin_object();
+            json.field("frame", d.frame);
+            json.field("from", double(d.from_scale));
+            json.field("to", double(d.to_scale));
+            json.field("frame_ms", d.frame_ms);
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+} // namespace
+
+void bnb::bench::run_governor_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    const int32_t w = (cfg.width / 2) & ~1;
+    const int32_t h = (cfg.height / 2) & ~1;
+    scaled_frame frame(w, h);
+
+    // the budget from the unthrottled full size frame, after an untimed first frame at every scale
+    for (float scale : bnb::resolution_governor_config().scales) {
+        frame.render(scale, base_iterations);
+    }
+    double full_ms = 0;
+    constexpr int32_t calibration_frames = 10;
+    for (int32_t i = 0; i < calibration_frames; ++i) {
+        full_ms += frame.render(1.0f, base_iterations);
+    }
+    full_ms /= calibration_frames;
+    const double budget_ms = full_ms * budget_factor;
+
+    // long enough for the default governor to drop and to recover all steps
+    const int32_t phase = std::max(cfg.frames, 300);
+    const auto fixed = run(frame, phase, budget_ms, false);
+    const auto governed = run(frame, phase, budget_ms, true);
+
+    frame.render(0.5f, base_iterations);
+    const bool upright = frame.upright();
+
+    json.key("governor").begin_object();
+    json.field("width", w);
+    json.field("height", h);
+    json.field("frames_per_phase", phase);
+    json.field("full_size_ms", full_ms);
+    json.field("budget_ms", budget_ms);
+    json.field("throttle", double(throttled_iterations) / base_iterations);
+    field(json, "fixed", fixed);
+    field(json, "governed", governed);
+    json.field("upscaled_upright", upright);
+    json.end_object();
+
+    gl::context_info::instance().state().invalidate();
+}
@@ -0,0 +1,147 @@
+#include "egl_context.hpp"
+#include "gl_benchmarks.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+/*
+ * GL side benchmarks of the OEP glue layer on a headless EGL context, Mesa llvmpipe
+ * in CI. Absolute times of a software rasterizer say little, the ratios between the
+ * passes and the counters are what to compare.
+ */
+
+namespace
+{
+    constexpr int32_t schema_version = 1;
+
+    void usage()
+    {
+        std::cerr << "usage: oep_gl_benchmarks [--programs N] [--cache-dir DIR] [--frames N] [--size WxH]\n"
+                     "                         [--calls N] [--sample-period N]\n"
+                     "                         [--skip program_cache|state_cache|error_check|orientation|render_ring|yuv_readback|\n"
+                     "                                resize|multi_context|governor]\n"
+                     "                         [--out FILE]\n";
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bnb::bench::gl_config cfg;
+    std::string out_path;
+    bool skip_program_cache = false;
+    bool skip_state_cache = false;
+    bool skip_error_check = false;
+    bool skip_orientation = false;
+    bool skip_render_ring = false;
+    bool skip_yuv_readback = false;
+    bool skip_resize = false;
+    bool skip_multi_context = false;
+    bool skip_governor = false;
+
+    for (int i = 1; i < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        const char* next = argv[i + 1];
+        if (arg == "--programs") {
+            cfg.programs = std::max(std::atoi(next), 1);
+        } else if (arg == "--cache-dir") {
+            cfg.cache_dir = next;
+        } else if (arg == "--frames") {
+            cfg.frames = std::max(std::atoi(next), 1);
+        } else if (arg == "--size") {
+            const char* x = std::strchr(next, 'x');
+            cfg.width = std::atoi(next);
+            cfg.height = x != nullptr ? std::atoi(x + 1) : 0;
+            if (cfg.width <= 0 || cfg.height <= 0) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--calls") {
+            cfg.calls = std::max(std::atoi(next), 1);
+        } else if (arg == "--sample-period") {
+            cfg.sample_period = std::max(std::atoi(next), 1);
+        } else if (arg == "--skip") {
+            skip_program_cache |= std::strcmp(next, "program_cache") == 0;
+            skip_state_cache |= std::strcmp(next, "state_cache") == 0;
+            skip_error_check |= std::strcmp(next, "error_check") == 0;
+            skip_orientation |= std::strcmp(next, "orientation") == 0;
+            skip_render_ring |= std::strcmp(next, "render_ring") == 0;
+            skip_yuv_readback |= std::strcmp(next, "yuv_readback") == 0;
+            skip_resize |= std::strcmp(next, "resize") == 0;
+            skip_multi_context |= std::strcmp(next, "multi_context") == 0;
+            skip_governor |= std::strcmp(next, "governor") == 0;
+        } else if (arg == "--out") {
+            out_path = next;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    // Mesa implements program binaries on top of its shader cache, so the cache stays on,
+    // in an empty directory of this run: the cold pass is really cold
+    const auto mesa_cache = std::filesystem::temp_directory_path() / ("bnb_mesa_cache_" + std::to_string(getpid()));
+    setenv("MESA_SHADER_CACHE_DIR", mesa_cache.c_str(), 0);
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file) {
+            std::cerr << "can not open " << out_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : file;
+
+    try {
+        bnb::bench::egl_context context;
+
+        bnb::bench::json_writer json(out);
+        json.begin_object();
+        json.field("schema_version", schema_version);
+        json.field("driver", context.description());
+        if (!skip_program_cache) {
+            bnb::bench::run_program_cache_benchmarks(cfg, json);
+        }
+        if (!skip_state_cache) {
+            bnb::bench::run_state_cache_benchmarks(cfg, json);
+        }
+        if (!skip_error_check) {
+            bnb::bench::run_error_check_benchmarks(cfg, json);
+        }
+        if (!skip_orientation) {
+            bnb::bench::run_orientation_benchmarks(cfg, json);
+        }
+        if (!skip_render_ring) {
+            bnb::bench::run_render_ring_benchmarks(cfg, json);
+        }
+        if (!skip_yuv_readback) {
+            bnb::bench::run_yuv_readback_benchmarks(cfg, json);
+        }
+        if (!skip_resize) {
+            bnb::bench::run_resize_benchmarks(cfg, json);
+        }
+        if (!skip_multi_context) {
+            bnb::bench::run_multi_context_benchmarks(context, cfg, json);
+        }
+        if (!skip_governor) {
+            bnb::bench::run_governor_benchmarks(cfg, json);
+        }
+        json.end_object();
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n";
+        std::filesystem::remove_all(mesa_cache);
+        return 1;
+    }
+    std::filesystem::remove_all(mesa_cache);
+    return 0;
+}
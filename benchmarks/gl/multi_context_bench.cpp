@@ -0,0 +1,302 @@
+#include "egl_context.hpp"
+#include "gl_benchmarks.hpp"
+
+#include <nv12_renderer.hpp>
+#include <opengl.hpp>
+#include <program_cache.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/*
+ * Several players at once, the way offscreen_render_target runs them now: a context per
+ * player in the share group of the first one, with its own render targets and state cache,
+ * the programs come from the process wide program_cache and are compiled once. Against
+ * the single context of the process the players used before, taken in turn.
+ * A frame is the effect draw, the NV12 output planes and the wait for its fence, the point
+ * the frame is handed to the consumer. The software rasterizer runs on the CPU, with a
+ * single hardware thread there is nothing to run in parallel and the aggregate rate stays flat.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr int32_t max_players = 4;
+
+    // a triangle covering the viewport, no vertex buffer needed
+    const char* vertex_source =
+        "#version 300 es\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;\n"
+        "    gl_Position = vec4(p, 0.0, 1.0);\n"
+        "    vTexCoord = p * 0.5 + 0.5;\n"
+        "}\n";
+
+    /* stand-in of an effect, some arithmetic per pixel and a frame dependent result */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform float uFrame;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 c = vec3(vTexCoord, fract(uFrame * 0.01));\n"
+        "    for (int i = 0; i < 8; ++i) {\n"
+        "        c = fract(c * 1.7 + c.yzx * 0.3 + 0.1);\n"
+        "    }\n"
+        "    FragColor = vec4(c, 1.0);\n"
+        "}\n";
+
+    /* the render targets of one player, made and used with its context current */
+    class player
+    {
+    public:
+        player(int32_t w, int32_t h)
+            : m_effect(bnb::gl::program_cache::instance().acquire("multi_context_effect", vertex_source, effect_source))
+            , m_width(w)
+            , m_height(h)
+        {
+            const auto storage = [](GLuint& texture, GLenum format, int32_t tw, int32_t th) {
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexStorage2D(GL_TEXTURE_2D, 1, format, tw, th);
+            };
+            storage(m_color, GL_RGBA8, w, h);
+            storage(m_y, GL_R8, w, h);
+            storage(m_uv, GL_RG8, w / 2, h / 2);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glGenFramebuffers(1, &m_framebuffer);
+            glGenVertexArrays(1, &m_vao);
+            bnb::gl::context_info::instance().state().invalidate();
+        }
+
+        ~player()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            for (GLuint texture : {m_color, m_y, m_uv}) {
+                state.forget_texture(texture);
+            }
+            state.forget_framebuffer(m_framebuffer);
+            glDeleteVertexArrays(1, &m_vao);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            const GLuint textures[] = {m_color, m_y, m_uv};
+            glDeleteTextures(3, textures);
+        }
+
+        player(const player&) = delete;
+        player& operator=(const player&) = delete;
+
+        void frame(int32_t index)
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.bind_framebuffer(m_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, m_color);
+            state.viewport(0, 0, m_width, m_height);
+            state.use_program(m_effect->handle());
+            glUniform1f(glGetUniformLocation(m_effect->handle(), "uFrame"), static_cast<float>(index));
+            state.bind_vertex_array(m_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            m_nv12.draw(GL_TEXTURE_2D, m_color, m_width, m_height, m_format, GL_TEXTURE_2D, m_y, GL_TEXTURE_2D, m_uv);
+
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            GLenum status = GL_TIMEOUT_EXPIRED;
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+            }
+            glDeleteSync(fence);
+        }
+
+    private:
+        std::shared_ptr<bnb::gl::linked_program> m_effect;
+        bnb::gl::nv12_renderer m_nv12;
+        const bnb::image::yuv_format m_format{bnb::image::yuv_layout::nv12, bnb::image::yuv_matrix::bt709, bnb::image::yuv_range::video};
+        int32_t m_width;
+        int32_t m_height;
+        GLuint m_color{0};
+        GLuint m_y{0};
+        GLuint m_uv{0};
+        GLuint m_framebuffer{0};
+        GLuint m_vao{0};
+    };
+
+    /* holds the players until all of them are ready, then lets them go at once */
+    class start_gate
+    {
+    public:
+        explicit start_gate(int32_t players)
+            : m_waiting(players)
+        {
+        }
+
+        void arrive_and_wait()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (--m_waiting == 0) {
+                m_start = clock_type::now();
+                m_cv.notify_all();
+            }
+            m_cv.wait(lock, [this]() { return m_waiting == 0; });
+        }
+
+        clock_type::time_point start() const
+        {
+            return m_start;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        int32_t m_waiting;
+        clock_type::time_point m_start;
+    };
+
+    struct pass_result
+    {
+        int32_t players{0};
+        double aggregate_fps{0};
+        double min_player_fps{0};
+        uint64_t programs_compiled{0};
+    };
+
+    /*
+     * `shared == nullptr`: every player makes a context in the share group of `root`.
+     * Otherwise the players take `root` in turn, one frame at a time, with `shared` as its state cache.
+     */
+    pass_result run_pass(bnb::bench::egl_context& root, bnb::gl::state_cache* shared, int32_t players, const bnb::bench::gl_config& cfg)
+    {
+        const int32_t frames = cfg.frames > 0 ? cfg.frames : 1;
+        const auto compiled_before = bnb::gl::program_cache::instance().stats().compiled;
+        std::mutex root_mutex;
+        start_gate gate(players);
+        std::vector<double> seconds(players, 0.0);
+        std::atomic<bool> failed{false};
+
+        if (shared != nullptr) {
+            root.release();
+        }
+        std::vector<std::thread> threads;
+        for (int32_t p = 0; p < players; ++p) {
+            threads.emplace_back([&, p]() {
+                bool arrived = false;
+                try {
+                    if (shared != nullptr) {
+                        std::unique_ptr<player> target;
+                        const auto with_root = [&](auto&& body) {
+                            std::lock_guard<std::mutex> lock(root_mutex);
+                            root.make_current();
+                            bnb::gl::context_info::bind_state(shared);
+                            body();
+                            bnb::gl::context_info::bind_state(nullptr);
+                            root.release();
+                        };
+                        // an untimed first frame, the driver finishes the programs for a context on the first draw
+                        with_root([&]() {
+                            target = std::make_unique<player>(cfg.width, cfg.height);
+                            target->frame(0);
+                        });
+                        arrived = true;
+                        gate.arrive_and_wait();
+                        for (int32_t i = 0; i < frames; ++i) {
+                            with_root([&]() { target->frame(i); });
+                        }
+                        seconds[p] = std::chrono::duration<double>(clock_type::now() - gate.start()).count();
+                        with_root([&]() { target.reset(); });
+                    } else {
+                        bnb::bench::egl_context context(&root);
+                        bnb::gl::state_cache state;
+                        bnb::gl::context_info::bind_state(&state);
+                        {
+                            player target(cfg.width, cfg.height);
+                            target.frame(0);
+                            arrived = true;
+                            gate.arrive_and_wait();
+                            for (int32_t i = 0; i < frames; ++i) {
+                                target.frame(i);
+                            }
+                            seconds[p] = std::chrono::duration<double>(clock_type::now() - gate.start()).count();
+                        }
+                        bnb::gl::context_info::bind_state(nullptr);
+                    }
+                } catch (const std::exception&) {
+                    failed = true;
+                    if (!arrived) {
+                        gate.arrive_and_wait();
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (shared != nullptr) {
+            root.make_current();
+        }
+        if (failed) {
+            throw std::runtime_error("a player of the multi context benchmark failed");
+        }
+
+        pass_result result;
+        result.players = players;
+        // the slowest player ends the pass
+        const double wall = *std::max_element(seconds.begin(), seconds.end());
+        result.aggregate_fps = wall > 0 ? players * frames / wall : 0.0;
+        result.min_player_fps = wall > 0 ? frames / wall : 0.0;
+        result.programs_compiled = bnb::gl::program_cache::instance().stats().compiled - compiled_before;
+        return result;
+    }
+
+    void passes(bnb::bench::json_writer& json, const char* name, const std::vector<pass_result>& results)
+    {
+        json.key(name).begin_array();
+        for (const auto& r : results) {
+            json.begin_object();
+            json.field("players", r.players);
+            json.field("aggregate_fps", r.aggregate_fps);
+            json.field("min_player_fps", r.min_player_fps);
+            json.field("programs_compiled", r.programs_compiled);
+            json.end_object();
+        }
+        json.end_array();
+    }
+} // namespace
+
+void bnb::bench::run_multi_context_benchmarks(egl_context& context, const gl_config& cfg, json_writer& json)
+{
+    // the programs are compiled here once, every player shares them through the program cache
+    const auto effect = gl::program_cache::instance().acquire("multi_context_effect", vertex_source, effect_source);
+    auto nv12 = std::make_unique<gl::nv12_renderer>();
+
+    std::vector<pass_result> independent;
+    std::vector<pass_result> single;
+    gl::state_cache shared_state;
+    for (int32_t players = 1; players <= max_players; ++players) {
+        independent.push_back(run_pass(context, nullptr, players, cfg));
+        single.push_back(run_pass(context, &shared_state, players, cfg));
+    }
+
+    json.key("multi_context").begin_object();
+    json.field("width", cfg.width);
+    json.field("height", cfg.height);
+    json.field("frames_per_player", cfg.frames);
+    json.field("hardware_threads", static_cast<int32_t>(std::thread::hardware_concurrency()));
+    passes(json, "context_per_player", independent);
+    passes(json, "single_context", single);
+    const double base = independent.front().aggregate_fps;
+    json.field("scaling_4_vs_1", base > 0 ? independent.back().aggregate_fps / base : 0.0);
+    json.end_object();
+
+    nv12.reset();
+    gl::context_info::instance().state().invalidate();
+}
@@ -0,0 +1,228 @@
+#include "gl_benchmarks.hpp"
+
+#include <opengl.hpp>
+#include <program_cache.hpp>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+/*
+ * Cost of the output rotation on the GPU, the sample app setup: a landscape camera
+ * frame, rotated by 90 degrees into the portrait effect surface, the output rotated by
+ * 270 degrees (orientation_strategy::gpu_pass, two passes) against the effect drawn
+ * straight into the output orientation (orientation_strategy::in_render, one pass).
+ * Both must produce the same pixels. Time is wall time with glFinish per frame, which
+ * is GPU time on a software rasterizer.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    const char* vertex_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "layout (location = 0) in vec2 aPos;\n"
+        "layout (location = 1) in vec2 aTexCoord;\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(aPos, 0.0, 1.0);\n"
+        "    vTexCoord = aTexCoord;\n"
+        "}\n";
+
+    /* stand-in of an effect: a colour grade of the camera frame */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform sampler2D uTexture;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 c = texture(uTexture, vTexCoord);\n"
+        "    FragColor = vec4(c.bgr, 1.0);\n"
+        "}\n";
+
+    /* the rotation pass of offscreen_render_target */
+    const char* copy_source =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform sampler2D uTexture;\n"
+        "void main()\n"
+        "{\n"
+        "    FragColor = texture(uTexture, vTexCoord);\n"
+        "}\n";
+
+    GLuint make_texture(int32_t width, int32_t height, const void* pixels)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    struct target
+    {
+        target(int32_t w, int32_t h)
+            : width(w)
+            , height(h)
+        {
+            texture = make_texture(w, h, nullptr);
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        }
+
+        ~target()
+        {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &texture);
+        }
+
+        std::vector<uint8_t> read() const
+        {
+            std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            return pixels;
+        }
+
+        int32_t width;
+        int32_t height;
+        GLuint texture{0};
+        GLuint framebuffer{0};
+    };
+
+    /* full screen quads, the texture coordinates turned by 0, 90, 180 and 270 degrees, immutable */
+    class rotation_quads
+    {
+    public:
+        rotation_quads()
+        {
+            const float positions[4][2] = {{-1.0f, 1.0f}, {-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}};
+            const float uvs[4][2] = {{0.0f, 1.0f}, {0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}};
+            float vertices[4][4][4];
+            for (int r = 0; r < 4; ++r) {
+                for (int i = 0; i < 4; ++i) {
+                    vertices[r][i][0] = positions[i][0];
+                    vertices[r][i][1] = positions[i][1];
+                    vertices[r][i][2] = uvs[(i + r) % 4][0];
+                    vertices[r][i][3] = uvs[(i + r) % 4][1];
+                }
+            }
+            glGenVertexArrays(1, &m_vao);
+            glGenBuffers(1, &m_vbo);
+            glBindVertexArray(m_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), reinterpret_cast<void*>(2 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        ~rotation_quads()
+        {
+            glDeleteVertexArrays(1, &m_vao);
+            glDeleteBuffers(1, &m_vbo);
+        }
+
+        void draw(int quarter_turns) const
+        {
+            glBindVertexArray(m_vao);
+            glDrawArrays(GL_TRIANGLE_FAN, (quarter_turns % 4) * 4, 4);
+            glBindVertexArray(0);
+        }
+
+    private:
+        GLuint m_vao{0};
+        GLuint m_vbo{0};
+    };
+
+    void draw_into(const target& to, GLuint program, GLuint texture, const rotation_quads& quads, int quarter_turns)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, to.framebuffer);
+        glViewport(0, 0, to.width, to.height);
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        quads.draw(quarter_turns);
+    }
+
+    template<class Frame>
+    double ms_per_frame(int32_t frames, Frame&& frame)
+    {
+        const auto start = clock_type::now();
+        for (int32_t i = 0; i < frames; ++i) {
+            frame();
+            glFinish();
+        }
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / frames;
+    }
+} // namespace
+
+void bnb::bench::run_orientation_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    // the camera frame is landscape, the effect surface portrait, the output landscape again
+    const int32_t w = cfg.width;
+    const int32_t h = cfg.height;
+    std::vector<uint8_t> camera_pixels(static_cast<size_t>(w) * h * 4);
+    for (size_t i = 0; i < camera_pixels.size(); ++i) {
+        camera_pixels[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+    }
+
+    auto& cache = gl::program_cache::instance();
+    const auto effect = cache.acquire("effect", vertex_source, effect_source);
+    const auto copy = cache.acquire("OrientationChange", vertex_source, copy_source);
+    const GLuint camera = make_texture(w, h, camera_pixels.data());
+    const rotation_quads quads;
+    const target surface(h, w);
+    const target rotated(w, h);
+    const target output(w, h);
+
+    const int input_turns = 1;  // deg90, landscape camera to the portrait surface
+    const int output_turns = 3; // deg270, the output orientation of the sample app
+
+    const int32_t frames = cfg.frames > 0 ? cfg.frames : 1;
+    const double two_pass_ms = ms_per_frame(frames, [&] {
+        draw_into(surface, effect->handle(), camera, quads, input_turns);
+        draw_into(rotated, copy->handle(), surface.texture, quads, output_turns);
+    });
+    const double in_render_ms = ms_per_frame(frames, [&] {
+        draw_into(output, effect->handle(), camera, quads, input_turns + output_turns);
+    });
+    const bool pixels_match = rotated.read() == output.read();
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteTextures(1, &camera);
+    gl::context_info::instance().state().invalidate();
+
+    const double pixels = static_cast<double>(w) * h;
+    json.key("orientation").begin_object();
+    json.field("width", w);
+    json.field("height", h);
+    json.field("frames", frames);
+    json.key("two_pass").begin_object();
+    json.field("ms_per_frame", two_pass_ms);
+    json.field("pixels_written_per_frame", 2 * pixels);
+    json.end_object();
+    json.key("in_render").begin_object();
+    json.field("ms_per_frame", in_render_ms);
+    json.field("pixels_written_per_frame", pixels);
+    json.end_object();
+    json.field("speedup", in_render_ms > 0 ? two_pass_ms / in_render_ms : 0.0);
+    json.field("pixels_match", pixels_match);
+    json.end_object();
+}
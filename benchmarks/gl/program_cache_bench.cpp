@@ -0,0 +1,242 @@
+#include "gl_benchmarks.hpp"
+
+#include <program_cache.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Time to get the programs of a render target ready:
+ *   cold     - empty disk cache, every program is compiled, linked and stored
+ *   shared   - the programs are alive, acquire returns them
+ *   binary   - a new process (the registry is cleared), programs come from the disk cache
+ *   rejected - the cached binaries are corrupt, acquire falls back to compiling (on Mesa
+ *              the fallback compile hits the driver's shader cache warmed by the cold pass)
+ * Every pass draws with the programs and compares the pixels with the cold pass.
+ */
+
+namespace
+{
+    using bnb::gl::program_cache;
+    using clock_type = std::chrono::steady_clock;
+    namespace fs = std::filesystem;
+
+    const char* vertex_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "layout (location = 0) in vec3 aPos;\n"
+        "layout (location = 1) in vec2 aTexCoord;\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(aPos, 1.0);\n"
+        "    vTexCoord = aTexCoord;\n"
+        "}\n";
+
+    /* a few taps and a colour matrix, in the range of the effect post processing shaders */
+    std::string fragment_source(int32_t variant)
+    {
+        return "#version 300 es\n"
+               "precision mediump float;\n"
+               "in vec2 vTexCoord;\n"
+               "out vec4 FragColor;\n"
+               "const float k_variant = "
+               + std::to_string(variant) + ".0;\n"
+               "void main()\n"
+               "{\n"
+               "    vec3 c = vec3(0.0);\n"
+               "    for (int i = 0; i < 9; ++i) {\n"
+               "        vec2 uv = vTexCoord + vec2(float(i % 3) - 1.0, float(i / 3) - 1.0) * 0.01;\n"
+               "        c += vec3(uv, fract(k_variant * 0.125)) * (i == 4 ? 0.2 : 0.1);\n"
+               "    }\n"
+               "    mat3 m = mat3(0.393, 0.349, 0.272, 0.769, 0.686, 0.534, 0.189, 0.168, 0.131);\n"
+               "    FragColor = vec4(mix(c, m * c, 0.5), 1.0);\n"
+               "}\n";
+    }
+
+    struct pass_result
+    {
+        double total_ms{0.0};
+        program_cache::stats_t stats;
+        bool pixels_match{true};
+    };
+
+    /* draws one point into a 1x1 target, enough to tell a wrong program from the right one */
+    class probe
+    {
+    public:
+        probe()
+        {
+            glGenTextures(1, &m_texture);
+            glBindTexture(GL_TEXTURE_2D, m_texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glGenFramebuffers(1, &m_framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+            glGenVertexArrays(1, &m_vao);
+            glBindVertexArray(m_vao);
+            glViewport(0, 0, 1, 1);
+        }
+
+        ~probe()
+        {
+            glDeleteVertexArrays(1, &m_vao);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteTextures(1, &m_texture);
+        }
+
+        uint32_t draw(GLuint program)
+        {
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glUseProgram(program);
+            glVertexAttrib3f(0, 0.0f, 0.0f, 0.0f);
+            glVertexAttrib2f(1, 0.5f, 0.5f);
+            glDrawArrays(GL_POINTS, 0, 1);
+            glUseProgram(0);
+            uint32_t pixel = 0;
+            glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixel);
+            return pixel;
+        }
+
+    private:
+        GLuint m_texture{0};
+        GLuint m_framebuffer{0};
+        GLuint m_vao{0};
+    };
+
+    program_cache::stats_t operator-(const program_cache::stats_t& a, const program_cache::stats_t& b)
+    {
+        return {a.shared - b.shared, a.binary_loaded - b.binary_loaded, a.binary_rejected - b.binary_rejected,
+                a.compiled - b.compiled, a.binary_stored - b.binary_stored};
+    }
+
+    pass_result run_pass(std::vector<std::shared_ptr<bnb::gl::linked_program>>& programs,
+                         const std::vector<std::string>& fragments,
+                         std::vector<uint32_t>& reference,
+                         probe& target)
+    {
+        auto& cache = program_cache::instance();
+        const auto before = cache.stats();
+        std::vector<std::shared_ptr<bnb::gl::linked_program>> acquired;
+        acquired.reserve(fragments.size());
+
+        const auto start = clock_type::now();
+        for (const auto& fragment : fragments) {
+            acquired.push_back(cache.acquire("bench", vertex_source, fragment));
+        }
+        glFinish();
+        pass_result result;
+        result.total_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        result.stats = cache.stats() - before;
+
+        for (size_t i = 0; i < acquired.size(); ++i) {
+            const uint32_t pixel = target.draw(acquired[i]->handle());
+            if (reference.size() <= i) {
+                reference.push_back(pixel);
+            }
+            result.pixels_match &= reference[i] == pixel;
+        }
+        programs = std::move(acquired);
+        return result;
+    }
+
+    void write_pass(bnb::bench::json_writer& json, const char* name, const pass_result& r, int32_t programs)
+    {
+        json.begin_object();
+        json.field("pass", name);
+        json.field("total_ms", r.total_ms);
+        json.field("ms_per_program", programs > 0 ? r.total_ms / programs : 0.0);
+        json.field("shared", r.stats.shared);
+        json.field("binary_loaded", r.stats.binary_loaded);
+        json.field("binary_rejected", r.stats.binary_rejected);
+        json.field("compiled", r.stats.compiled);
+        json.field("binary_stored", r.stats.binary_stored);
+        json.field("pixels_match", r.pixels_match);
+        json.end_object();
+    }
+
+    /* flips the payload bytes, the header stays valid so the driver has to reject it */
+    void corrupt_binaries(const fs::path& dir)
+    {
+        for (const auto& file : fs::directory_iterator(dir)) {
+            std::fstream f(file.path(), std::ios::in | std::ios::out | std::ios::binary);
+            f.seekg(0, std::ios::end);
+            const auto size = static_cast<size_t>(f.tellg());
+            std::vector<char> data(size);
+            f.seekg(0);
+            f.read(data.data(), static_cast<std::streamsize>(size));
+            for (size_t i = 32; i < size; ++i) {
+                data[i] = static_cast<char>(~data[i]);
+            }
+            f.seekp(0);
+            f.write(data.data(), static_cast<std::streamsize>(size));
+        }
+    }
+} // namespace
+
+void bnb::bench::run_program_cache_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    fs::path dir = cfg.cache_dir;
+    const bool temporary = dir.empty();
+    if (temporary) {
+        dir = fs::temp_directory_path() / ("bnb_program_cache_" + std::to_string(clock_type::now().time_since_epoch().count()));
+    }
+    fs::create_directories(dir);
+    if (!fs::is_empty(dir)) {
+        throw std::runtime_error("the program cache directory is not empty: " + dir.string());
+    }
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+    std::vector<std::string> fragments;
+    for (int32_t i = 0; i < cfg.programs; ++i) {
+        fragments.push_back(fragment_source(i));
+    }
+
+    auto& cache = program_cache::instance();
+    cache.clear();
+    cache.set_directory(dir.string());
+
+    probe target;
+    std::vector<uint32_t> reference;
+    std::vector<std::shared_ptr<bnb::gl::linked_program>> programs;
+
+    json.key("program_cache").begin_object();
+    json.field("programs", cfg.programs);
+    json.field("binary_formats", static_cast<int32_t>(formats));
+    json.key("passes").begin_array();
+
+    write_pass(json, "cold", run_pass(programs, fragments, reference, target), cfg.programs);
+
+    // the previous programs stay alive while the pass runs
+    auto alive = programs;
+    write_pass(json, "shared", run_pass(programs, fragments, reference, target), cfg.programs);
+    alive.clear();
+
+    programs.clear();
+    cache.clear();
+    write_pass(json, "binary", run_pass(programs, fragments, reference, target), cfg.programs);
+
+    programs.clear();
+    cache.clear();
+    corrupt_binaries(dir);
+    write_pass(json, "rejected", run_pass(programs, fragments, reference, target), cfg.programs);
+
+    programs.clear();
+    cache.clear();
+    cache.set_directory({});
+
+    json.end_array();
+    json.end_object();
+
+    if (temporary) {
+        fs::remove_all(dir);
+    }
+}
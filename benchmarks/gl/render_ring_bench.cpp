@@ -0,0 +1,282 @@
+#include "gl_benchmarks.hpp"
+
+#include <opengl.hpp>
+#include <program_cache.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * The render target ring of offscreen_render_target: the producer renders frame N+1
+ * into the next free slot while a consumer thread still converts frame N, the way the
+ * completion of BNBOffscreenEffectPlayer converts the handed out pixel buffer. Every
+ * slot is a render target, a pixel pack buffer for the readback and a fence. With a
+ * single slot render and conversion strictly alternate. The slot is handed out once its
+ * fence is signalled, `fence_waits` counts the frames the GPU had not finished by then,
+ * `exhausted` the frames that found every slot still held by the consumer.
+ * The software rasterizer runs on the CPU, with a single hardware thread there is
+ * nothing to overlap and the ring can not be faster.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    const char* vertex_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "layout (location = 0) in vec2 aPos;\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(aPos, 0.0, 1.0);\n"
+        "    vTexCoord = aPos * 0.5 + 0.5;\n"
+        "}\n";
+
+    /* stand-in of an effect, some arithmetic per pixel and a frame dependent result */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform float uFrame;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 c = vec3(vTexCoord, fract(uFrame * 0.01));\n"
+        "    for (int i = 0; i < 8; ++i) {\n"
+        "        c = fract(c * 1.7 + c.yzx * 0.3 + 0.1);\n"
+        "    }\n"
+        "    FragColor = vec4(c, 1.0);\n"
+        "}\n";
+
+    struct slot
+    {
+        GLuint texture{0};
+        GLuint framebuffer{0};
+        GLuint pack_buffer{0};
+        GLsync fence{nullptr};
+        const uint8_t* mapped{nullptr};
+        bool held{false}; // by the consumer, guarded by the ring mutex
+    };
+
+    /* the consumer side of the readback: RGBA to BGRA plus the luma plane, as convertAndOrient does */
+    uint64_t convert(const uint8_t* rgba, size_t pixels, std::vector<uint8_t>& bgra, std::vector<uint8_t>& luma)
+    {
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < pixels; ++i) {
+            const uint8_t r = rgba[i * 4 + 0];
+            const uint8_t g = rgba[i * 4 + 1];
+            const uint8_t b = rgba[i * 4 + 2];
+            bgra[i * 4 + 0] = b;
+            bgra[i * 4 + 1] = g;
+            bgra[i * 4 + 2] = r;
+            bgra[i * 4 + 3] = rgba[i * 4 + 3];
+            luma[i] = static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+            checksum = checksum * 31 + luma[i];
+        }
+        return checksum;
+    }
+
+    struct ring_result
+    {
+        double ms_per_frame{0};
+        double convert_ms{0}; // consumer time per frame, the most the ring can hide
+        uint64_t exhausted{0};
+        uint64_t fence_waits{0};
+        uint64_t checksum{0};
+    };
+
+    ring_result run_ring(size_t slots_count, int32_t frames, int32_t w, int32_t h, GLuint program, GLuint vao)
+    {
+        const size_t pixels = static_cast<size_t>(w) * h;
+        std::vector<slot> slots(slots_count);
+        for (auto& s : slots) {
+            glGenTextures(1, &s.texture);
+            glBindTexture(GL_TEXTURE_2D, s.texture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+            glGenFramebuffers(1, &s.framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, s.framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s.texture, 0);
+            glGenBuffers(1, &s.pack_buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pack_buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(pixels * 4), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<size_t> queue;
+        bool done = false;
+        uint64_t checksum = 0;
+        clock_type::duration converting{};
+
+        std::thread consumer([&] {
+            std::vector<uint8_t> bgra(pixels * 4);
+            std::vector<uint8_t> luma(pixels);
+            for (;;) {
+                size_t index = 0;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&] { return done || !queue.empty(); });
+                    if (queue.empty()) {
+                        return;
+                    }
+                    index = queue.front();
+                    queue.pop_front();
+                }
+                const auto convert_start = clock_type::now();
+                const uint64_t frame_checksum = convert(slots[index].mapped, pixels, bgra, luma);
+                const auto convert_time = clock_type::now() - convert_start;
+                std::lock_guard<std::mutex> lock(mutex);
+                converting += convert_time;
+                checksum = checksum * 1000003 + frame_checksum;
+                slots[index].held = false;
+                changed.notify_all();
+            }
+        });
+
+        ring_result result;
+        const GLint frame_location = glGetUniformLocation(program, "uFrame");
+        size_t current = slots_count - 1;
+        const auto start = clock_type::now();
+        for (int32_t frame = 0; frame < frames; ++frame) {
+            {
+                // the next free slot, waiting for the consumer only when it holds all of them
+                std::unique_lock<std::mutex> lock(mutex);
+                size_t found = slots_count;
+                for (size_t i = 1; i <= slots_count && found == slots_count; ++i) {
+                    if (!slots[(current + i) % slots_count].held) {
+                        found = (current + i) % slots_count;
+                    }
+                }
+                if (found == slots_count) {
+                    ++result.exhausted;
+                    found = (current + 1) % slots_count;
+                    changed.wait(lock, [&] { return !slots[found].held; });
+                }
+                current = found;
+            }
+            auto& s = slots[current];
+            if (s.mapped != nullptr) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pack_buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                s.mapped = nullptr;
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, s.framebuffer);
+            glViewport(0, 0, w, h);
+            glUseProgram(program);
+            glUniform1f(frame_location, static_cast<float>(frame));
+            glBindVertexArray(vao);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            glBindVertexArray(0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pack_buffer);
+            glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+
+            // the pack buffer is mapped on this thread, so the wait is here. offscreen_render_target hands
+            // the IOSurface out at once and waits for the fence in when_rendered, off the render thread
+            if (glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+                ++result.fence_waits;
+                glClientWaitSync(s.fence, 0, GL_TIMEOUT_IGNORED);
+            }
+            glDeleteSync(s.fence);
+            s.fence = nullptr;
+            s.mapped = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(pixels * 4), GL_MAP_READ_BIT));
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            s.held = true;
+            queue.push_back(current);
+            changed.notify_all();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            changed.notify_all();
+        }
+        consumer.join();
+        result.ms_per_frame = std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / frames;
+        result.convert_ms = std::chrono::duration<double, std::milli>(converting).count() / frames;
+        result.checksum = checksum;
+
+        for (auto& s : slots) {
+            if (s.mapped != nullptr) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pack_buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glDeleteBuffers(1, &s.pack_buffer);
+            glDeleteFramebuffers(1, &s.framebuffer);
+            glDeleteTextures(1, &s.texture);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glUseProgram(0);
+        return result;
+    }
+} // namespace
+
+void bnb::bench::run_render_ring_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    const int32_t w = cfg.width;
+    const int32_t h = cfg.height;
+    const int32_t frames = cfg.frames > 0 ? cfg.frames : 1;
+
+    auto& cache = gl::program_cache::instance();
+    const auto effect = cache.acquire("ring_effect", vertex_source, effect_source);
+
+    const float quad[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // warm-up, the first frames pay for the driver's lazy setup
+    run_ring(1, 8, w, h, effect->handle(), vao);
+
+    json.key("render_ring").begin_object();
+    json.field("width", w);
+    json.field("height", h);
+    json.field("frames", frames);
+    json.field("hardware_threads", static_cast<uint64_t>(std::thread::hardware_concurrency()));
+    json.key("rings").begin_array();
+    double alternating_ms = 0;
+    uint64_t alternating_checksum = 0;
+    bool frames_match = true;
+    for (size_t slots = 1; slots <= 4; ++slots) {
+        const auto result = run_ring(slots, frames, w, h, effect->handle(), vao);
+        if (slots == 1) {
+            alternating_ms = result.ms_per_frame;
+            alternating_checksum = result.checksum;
+        }
+        frames_match &= result.checksum == alternating_checksum;
+        json.begin_object();
+        json.field("slots", static_cast<uint64_t>(slots));
+        json.field("ms_per_frame", result.ms_per_frame);
+        json.field("speedup", result.ms_per_frame > 0 ? alternating_ms / result.ms_per_frame : 0.0);
+        json.field("convert_ms_per_frame", result.convert_ms);
+        json.field("exhausted", result.exhausted);
+        json.field("fence_waits", result.fence_waits);
+        json.end_object();
+    }
+    json.end_array();
+    json.field("frames_match", frames_match);
+    json.end_object();
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    gl::context_info::instance().state().invalidate();
+}
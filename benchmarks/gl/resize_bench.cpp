@@ -0,0 +1,277 @@
+#include "gl_benchmarks.hpp"
+
+#include <nv12_renderer.hpp>
+#include <opengl.hpp>
+#include <program_cache.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ * surface_changed of offscreen_render_target, every device rotation and quality change.
+ * `recreate` makes the render targets at the new size every time. `pooled` keeps exact-size
+ * targets of the two sizes used last, as the pixel buffer pool of offscreen_render_target
+ * does. `capacity` draws into the corner of targets allocated at a capacity that only grows,
+ * the design before exact sizes. A step is the resize and the first frame after it (effect
+ * draw, NV12 planes, glFinish), the sizes alternate between WxH, HxW and a lower quality.
+ * `max_step_ms` is the hitch a resize causes. The NV12 planes of a frame in the corner must
+ * match the CPU conversion of the same pixels.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // a triangle covering the viewport, no vertex buffer needed
+    const char* vertex_source =
+        "#version 300 es\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;\n"
+        "    gl_Position = vec4(p, 0.0, 1.0);\n"
+        "    vTexCoord = p * 0.5 + 0.5;\n"
+        "}\n";
+
+    /* stand-in of an effect, a gradient with some detail for the chroma averaging */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform float uFrame;\n"
+        "void main()\n"
+        "{\n"
+        "    float checker = mod(floor(gl_FragCoord.x) + floor(gl_FragCoord.y), 2.0);\n"
+        "    FragColor = vec4(vTexCoord.x, fract(vTexCoord.y + uFrame * 0.01), checker, 1.0);\n"
+        "}\n";
+
+    struct size2
+    {
+        int32_t width;
+        int32_t height;
+
+        bool operator==(const size2& other) const
+        {
+            return width == other.width && height == other.height;
+        }
+    };
+
+    // the render targets of offscreen_render_target keep two sizes in its pool, see setupRing
+    constexpr size_t pooled_sizes = 2;
+
+    /* the color target and the NV12 planes of one frame */
+    class targets
+    {
+    public:
+        targets()
+        {
+            glGenFramebuffers(1, &m_framebuffer);
+            glGenVertexArrays(1, &m_vao);
+        }
+
+        ~targets()
+        {
+            release();
+            auto& state = bnb::gl::context_info::instance().state();
+            state.forget_framebuffer(m_framebuffer);
+            glDeleteFramebuffers(1, &m_framebuffer);
+            glDeleteVertexArrays(1, &m_vao);
+        }
+
+        targets(const targets&) = delete;
+        targets& operator=(const targets&) = delete;
+
+        /// frees the textures and makes them at `size`
+        void allocate(size2 size)
+        {
+            release();
+            const auto storage = [](GLuint& texture, GLenum format, int32_t w, int32_t h) {
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexStorage2D(GL_TEXTURE_2D, 1, format, w, h);
+            };
+            storage(color, GL_RGBA8, size.width, size.height);
+            storage(y, GL_R8, size.width, size.height);
+            storage(uv, GL_RG8, size.width / 2, size.height / 2);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            bnb::gl::context_info::instance().state().invalidate();
+            capacity = size;
+            ++total_allocations;
+        }
+
+        /// the frame in the top left corner
+        void render(GLuint program, bnb::gl::nv12_renderer& nv12, size2 frame, int32_t index)
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.bind_framebuffer(m_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, color);
+            state.viewport(0, 0, frame.width, frame.height);
+            state.use_program(program);
+            glUniform1f(glGetUniformLocation(program, "uFrame"), static_cast<float>(index));
+            state.bind_vertex_array(m_vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            nv12.draw(GL_TEXTURE_2D, color, frame.width, frame.height, format, GL_TEXTURE_2D, y, GL_TEXTURE_2D, uv);
+        }
+
+        /// the first `channels` of the top left w x h pixels of `texture`
+        void read(GLuint texture, int32_t w, int32_t h, int channels, std::vector<uint8_t>& rgba, uint8_t* out)
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.bind_framebuffer(m_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, texture);
+            rgba.resize(static_cast<size_t>(w) * h * 4);
+            glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            for (size_t i = 0, n = static_cast<size_t>(w) * h; i < n; ++i) {
+                for (int c = 0; c < channels; ++c) {
+                    *out++ = rgba[i * 4 + c];
+                }
+            }
+            state.bind_framebuffer(0);
+        }
+
+        const bnb::image::yuv_format format{bnb::image::yuv_layout::nv12, bnb::image::yuv_matrix::bt709, bnb::image::yuv_range::video};
+        size2 capacity{0, 0};
+        static inline uint64_t total_allocations{0};
+        GLuint color{0};
+        GLuint y{0};
+        GLuint uv{0};
+
+    private:
+        void release()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            for (GLuint* texture : {&color, &y, &uv}) {
+                if (*texture != 0) {
+                    state.forget_texture(*texture);
+                    glDeleteTextures(1, texture);
+                    *texture = 0;
+                }
+            }
+        }
+
+        GLuint m_framebuffer{0};
+        GLuint m_vao{0};
+    };
+
+    struct path_result
+    {
+        double ms_per_step{0};
+        double max_step_ms{0};
+        uint64_t allocations{0};
+    };
+
+    /* `resize(size)` returns the targets the frame of that size is drawn into */
+    template<class Resize>
+    path_result run_steps(const std::vector<size2>& steps, GLuint program, bnb::gl::nv12_renderer& nv12, Resize resize)
+    {
+        path_result result;
+        const auto allocations_before = targets::total_allocations;
+        double total = 0;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            const auto start = clock_type::now();
+            targets& t = resize(steps[i]);
+            t.render(program, nv12, steps[i], static_cast<int32_t>(i));
+            glFinish();
+            const double ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+            total += ms;
+            result.max_step_ms = std::max(result.max_step_ms, ms);
+        }
+        result.ms_per_step = total / static_cast<double>(steps.size());
+        result.allocations = targets::total_allocations - allocations_before;
+        return result;
+    }
+
+    void field(bnb::bench::json_writer& json, const char* name, const path_result& r)
+    {
+        json.key(name).begin_object();
+        json.field("ms_per_step", r.ms_per_step);
+        json.field("max_step_ms", r.max_step_ms);
+        json.field("allocations", r.allocations);
+        json.end_object();
+    }
+} // namespace
+
+void bnb::bench::run_resize_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    const int32_t w = cfg.width & ~1;
+    const int32_t h = cfg.height & ~1;
+    // rotations with a quality change in between, the lower quality keeps even sizes
+    const size2 cycle[] = {{w, h}, {h, w}, {w, h}, {(w * 3 / 4) & ~1, (h * 3 / 4) & ~1}, {h, w}, {w, h}};
+    std::vector<size2> steps;
+    const int32_t count = std::max(cfg.frames / 4, 6);
+    for (int32_t i = 0; i < count; ++i) {
+        steps.push_back(cycle[i % 6]);
+    }
+
+    const auto effect = gl::program_cache::instance().acquire("resize_effect", vertex_source, effect_source);
+    gl::nv12_renderer nv12;
+
+    targets recreated;
+    const auto recreate = run_steps(steps, effect->handle(), nv12, [&](size2 size) -> targets& {
+        recreated.allocate(size);
+        return recreated;
+    });
+
+    // the most recently used size last
+    std::vector<std::pair<size2, std::unique_ptr<targets>>> pool;
+    const auto pooled = run_steps(steps, effect->handle(), nv12, [&](size2 size) -> targets& {
+        auto it = std::find_if(pool.begin(), pool.end(), [size](const auto& entry) { return entry.first == size; });
+        if (it != pool.end()) {
+            std::rotate(it, it + 1, pool.end());
+            return *pool.back().second;
+        }
+        if (pool.size() == pooled_sizes) {
+            pool.erase(pool.begin());
+        }
+        auto t = std::make_unique<targets>();
+        t->allocate(size);
+        pool.emplace_back(size, std::move(t));
+        return *pool.back().second;
+    });
+
+    targets reused;
+    const auto capacity = run_steps(steps, effect->handle(), nv12, [&](size2 size) -> targets& {
+        if (size.width > reused.capacity.width || size.height > reused.capacity.height) {
+            // grown to cover the previous size too
+            reused.allocate({std::max(size.width, reused.capacity.width), std::max(size.height, reused.capacity.height)});
+        }
+        return reused;
+    });
+
+    // the lower quality frame in the corner of the grown targets against the CPU conversion
+    const size2 corner = cycle[3];
+    reused.render(effect->handle(), nv12, corner, 0);
+    std::vector<uint8_t> rgba;
+    std::vector<uint8_t> frame(static_cast<size_t>(corner.width) * corner.height * 4);
+    reused.read(reused.color, corner.width, corner.height, 4, rgba, frame.data());
+    const size_t luma_size = static_cast<size_t>(corner.width) * corner.height;
+    std::vector<uint8_t> cpu(luma_size * 3 / 2);
+    std::vector<uint8_t> gpu(luma_size * 3 / 2);
+    image::rgb_to_yuv(frame.data(), corner.width * 4, image::rgb_layout::rgba, corner.width, corner.height,
+                      {cpu.data(), corner.width, cpu.data() + luma_size, corner.width, nullptr, 0}, reused.format);
+    reused.read(reused.y, corner.width, corner.height, 1, rgba, gpu.data());
+    reused.read(reused.uv, corner.width / 2, corner.height / 2, 2, rgba, gpu.data() + luma_size);
+    int max_diff = 0;
+    for (size_t i = 0; i < cpu.size(); ++i) {
+        max_diff = std::max(max_diff, std::abs(int(cpu[i]) - int(gpu[i])));
+    }
+
+    json.key("resize").begin_object();
+    json.field("width", w);
+    json.field("height", h);
+    json.field("steps", static_cast<int32_t>(steps.size()));
+    field(json, "recreate", recreate);
+    field(json, "pooled", pooled);
+    field(json, "capacity", capacity);
+    json.field("capacity_width", reused.capacity.width);
+    json.field("capacity_height", reused.capacity.height);
+    json.field("corner_max_diff", max_diff);
+    json.end_object();
+
+    gl::context_info::instance().state().invalidate();
+}
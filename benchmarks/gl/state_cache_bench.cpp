@@ -0,0 +1,260 @@
+#include "gl_benchmarks.hpp"
+
+#include <opengl.hpp>
+#include <program_cache.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+/*
+ * The per frame GL calls of offscreen_render_target: prepare_rendering, a stand-in of
+ * the SDK draw (own framebuffer, program and texture), then the rotation pass of
+ * orient_image. `direct` issues the calls the way the render target did before
+ * gl::state_cache, `cached` goes through it. Both must produce the same pixels.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    const char* vertex_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "layout (location = 0) in vec3 aPos;\n"
+        "layout (location = 1) in vec2 aTexCoord;\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(aPos, 1.0);\n"
+        "    vTexCoord = aTexCoord;\n"
+        "}\n";
+
+    const char* fragment_source =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform sampler2D uTexture;\n"
+        "void main()\n"
+        "{\n"
+        "    FragColor = texture(uTexture, vTexCoord);\n"
+        "}\n";
+
+    const char* sdk_fragment_source =
+        "#version 300 es\n"
+        "precision mediump float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    FragColor = vec4(vTexCoord, 0.5, 1.0);\n"
+        "}\n";
+
+    /* rotation by 90 degrees, the layout of ort_frame_surface_handler::vertices */
+    const float quad[] = {
+        1.0f,  1.0f,  0.0f, 0.0f, 0.0f,
+        1.0f,  -1.0f, 0.0f, 1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+        -1.0f, 1.0f,  0.0f, 0.0f, 1.0f,
+    };
+    const unsigned int indices[] = {0, 1, 3, 1, 2, 3};
+
+    GLuint make_texture(int32_t width, int32_t height)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        return texture;
+    }
+
+    struct scene
+    {
+        scene(int32_t w, int32_t h)
+            : width(w)
+            , height(h)
+        {
+            auto& cache = bnb::gl::program_cache::instance();
+            program = cache.acquire("OrientationChange", vertex_source, fragment_source);
+            sdk_program = cache.acquire("sdk", vertex_source, sdk_fragment_source);
+
+            render_texture = make_texture(width, height);
+            rotated_texture = make_texture(height, width);
+            sdk_texture = make_texture(16, 16);
+            glGenFramebuffers(1, &framebuffer);
+            glGenFramebuffers(1, &post_processing_framebuffer);
+
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &ebo);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), nullptr);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void*>(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+
+        ~scene()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            for (GLuint texture : {render_texture, rotated_texture, sdk_texture}) {
+                state.forget_texture(texture);
+                glDeleteTextures(1, &texture);
+            }
+            for (GLuint fb : {framebuffer, post_processing_framebuffer}) {
+                state.forget_framebuffer(fb);
+                glDeleteFramebuffers(1, &fb);
+            }
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ebo);
+            state.invalidate();
+        }
+
+        /* what the SDK leaves behind: its program, its texture, the whole target drawn */
+        void sdk_draw()
+        {
+            glUseProgram(sdk_program->handle());
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, sdk_texture);
+            glViewport(0, 0, width, height);
+            glBindVertexArray(vao);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+            glBindVertexArray(0);
+        }
+
+        /* the render target before the state cache, the calls are counted */
+        void direct_frame(uint64_t& calls)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, render_texture, 0);
+            glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            calls += 3;
+
+            sdk_draw();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, post_processing_framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rotated_texture, 0);
+            glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            glViewport(0, 0, height, width);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, render_texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GLfloat(GL_CLAMP_TO_EDGE));
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GLfloat(GL_CLAMP_TO_EDGE));
+            glUseProgram(program->handle());
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(vao);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glFlush();
+            calls += 17;
+        }
+
+        /* the render target with the state cache, the cache counts */
+        void cached_frame()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.invalidate();
+            state.bind_framebuffer(framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, render_texture);
+
+            sdk_draw();
+
+            state.invalidate();
+            state.bind_framebuffer(post_processing_framebuffer);
+            state.attach_color_texture(GL_TEXTURE_2D, rotated_texture);
+            state.viewport(0, 0, height, width);
+            state.active_texture(GL_TEXTURE0);
+            state.bind_texture(GL_TEXTURE_2D, render_texture);
+            state.tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            state.tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            state.tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            state.tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            state.use_program(program->handle());
+            // the vertices are uploaded once, see ort_frame_surface_handler::update_vertices_buffer
+            state.bind_vertex_array(vao);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+            state.bind_vertex_array(0);
+            glFlush();
+        }
+
+        std::vector<uint8_t> read_rotated()
+        {
+            std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+            glBindFramebuffer(GL_FRAMEBUFFER, post_processing_framebuffer);
+            glReadPixels(0, 0, height, width, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            bnb::gl::context_info::instance().state().invalidate();
+            return pixels;
+        }
+
+        int32_t width;
+        int32_t height;
+        std::shared_ptr<bnb::gl::linked_program> program;
+        std::shared_ptr<bnb::gl::linked_program> sdk_program;
+        GLuint render_texture{0};
+        GLuint rotated_texture{0};
+        GLuint sdk_texture{0};
+        GLuint framebuffer{0};
+        GLuint post_processing_framebuffer{0};
+        GLuint vao{0};
+        GLuint vbo{0};
+        GLuint ebo{0};
+    };
+
+    template<class Frame>
+    double frames_ms(int32_t frames, Frame&& frame)
+    {
+        const auto start = clock_type::now();
+        for (int32_t i = 0; i < frames; ++i) {
+            frame();
+        }
+        glFinish();
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+} // namespace
+
+void bnb::bench::run_state_cache_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    auto& state = gl::context_info::instance().state();
+    scene s(cfg.width, cfg.height);
+
+    uint64_t direct_calls = 0;
+    const double direct_ms = frames_ms(cfg.frames, [&] { s.direct_frame(direct_calls); });
+    const auto direct_pixels = s.read_rotated();
+
+    state.reset_counters();
+    const double cached_ms = frames_ms(cfg.frames, [&] { s.cached_frame(); });
+    const auto counters = state.counters();
+    const auto cached_pixels = s.read_rotated();
+
+    const double frames = cfg.frames > 0 ? cfg.frames : 1;
+    json.key("state_cache").begin_object();
+    json.field("width", cfg.width);
+    json.field("height", cfg.height);
+    json.field("frames", cfg.frames);
+    json.key("direct").begin_object();
+    json.field("calls_per_frame", direct_calls / frames);
+    json.field("ms_per_frame", direct_ms / frames);
+    json.end_object();
+    json.key("cached").begin_object();
+    json.field("issued_per_frame", counters.issued / frames);
+    json.field("elided_per_frame", counters.elided / frames);
+    json.field("ms_per_frame", cached_ms / frames);
+    json.end_object();
+    json.field("pixels_match", direct_pixels == cached_pixels);
+    json.end_object();
+}
@@ -0,0 +1,325 @@
+#include "gl_benchmarks.hpp"
+
+#include <nv12_renderer.hpp>
+#include <opengl.hpp>
+#include <program_cache.hpp>
+#include <yuv_readback.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+/*
+ * YUV output of a rendered frame: a synchronous RGBA glReadPixels followed by the
+ * SIMD image::rgb_to_yuv on the CPU, against bnb::gl::yuv_readback, which converts
+ * on the GPU and reads the planes back through a ring of pixel pack buffers one
+ * frame late. `cpu_ms_per_frame` is the time of the calling thread, the software
+ * rasterizer does its work on threads of its own. Both paths must agree within one
+ * code value, the GPU converts in floating point. `nv12_planes` is the zero-copy output
+ * of offscreen_render_target: bnb::gl::nv12_renderer draws the planes into R8 and RG8
+ * render targets, here they are read back only to check them against the CPU path.
+ */
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    const char* vertex_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "layout (location = 0) in vec2 aPos;\n"
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(aPos, 0.0, 1.0);\n"
+        "    vTexCoord = aPos * 0.5 + 0.5;\n"
+        "}\n";
+
+    /* stand-in of an effect, a frame dependent gradient with some detail for the chroma averaging */
+    const char* effect_source =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform float uFrame;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = gl_FragCoord.xy;\n"
+        "    float checker = mod(floor(p.x) + floor(p.y), 2.0);\n"
+        "    FragColor = vec4(vTexCoord.x, fract(vTexCoord.y + uFrame * 0.01), checker, 1.0);\n"
+        "}\n";
+
+    double thread_cpu_ms()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+    }
+
+    struct source_frame
+    {
+        source_frame(int32_t w, int32_t h)
+            : width(w)
+            , height(h)
+        {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h);
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+            const float quad[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+            glEnableVertexAttribArray(0);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        ~source_frame()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.forget_texture(texture);
+            state.forget_framebuffer(framebuffer);
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vbo);
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &texture);
+        }
+
+        void render(GLuint program, int32_t frame)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glViewport(0, 0, width, height);
+            glUseProgram(program);
+            glUniform1f(glGetUniformLocation(program, "uFrame"), static_cast<float>(frame));
+            glBindVertexArray(vao);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            glBindVertexArray(0);
+            // the yuv_readback tracks its bindings in the state cache
+            bnb::gl::context_info::instance().state().invalidate();
+        }
+
+        int32_t width;
+        int32_t height;
+        GLuint texture{0};
+        GLuint framebuffer{0};
+        GLuint vao{0};
+        GLuint vbo{0};
+    };
+
+    bnb::image::yuv_planes planes_of(std::vector<uint8_t>& yuv, int32_t w, int32_t h, bnb::image::yuv_layout layout)
+    {
+        uint8_t* y = yuv.data();
+        uint8_t* c = y + static_cast<size_t>(w) * h;
+        if (layout == bnb::image::yuv_layout::nv12) {
+            return {y, w, c, w, nullptr, 0};
+        }
+        return {y, w, c, w / 2, c + static_cast<size_t>(w / 2) * (h / 2), w / 2};
+    }
+
+    struct path_result
+    {
+        double ms_per_frame{0};
+        double cpu_ms_per_frame{0};
+        uint64_t waits{0};
+    };
+
+    void cpu_convert(source_frame& src, std::vector<uint8_t>& rgba, std::vector<uint8_t>& yuv, const bnb::image::yuv_format& format)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, src.framebuffer);
+        glReadPixels(0, 0, src.width, src.height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        bnb::image::rgb_to_yuv(rgba.data(), src.width * 4, bnb::image::rgb_layout::rgba, src.width, src.height,
+                               planes_of(yuv, src.width, src.height, format.layout), format);
+    }
+
+    /* R8 and RG8 plane targets, the plane textures of a biplanar IOSurface on iOS */
+    struct plane_targets
+    {
+        plane_targets(int32_t w, int32_t h)
+        {
+            glGenTextures(1, &y);
+            glBindTexture(GL_TEXTURE_2D, y);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, w, h);
+            glGenTextures(1, &uv);
+            glBindTexture(GL_TEXTURE_2D, uv);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG8, w / 2, h / 2);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glGenFramebuffers(1, &framebuffer);
+        }
+
+        ~plane_targets()
+        {
+            auto& state = bnb::gl::context_info::instance().state();
+            state.forget_texture(y);
+            state.forget_texture(uv);
+            state.forget_framebuffer(framebuffer);
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &y);
+            glDeleteTextures(1, &uv);
+        }
+
+        /* RGBA is the readback format every color attachment supports, takes the first `channels` */
+        void read(GLuint texture, int32_t w, int32_t h, int channels, std::vector<uint8_t>& rgba, uint8_t* out)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+            glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            for (size_t i = 0, n = static_cast<size_t>(w) * h; i < n; ++i) {
+                for (int c = 0; c < channels; ++c) {
+                    *out++ = rgba[i * 4 + c];
+                }
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            bnb::gl::context_info::instance().state().invalidate();
+        }
+
+        GLuint y{0};
+        GLuint uv{0};
+        GLuint framebuffer{0};
+    };
+
+    void field(bnb::bench::json_writer& json, const char* name, const path_result& r, double bytes)
+    {
+        json.key(name).begin_object();
+        json.field("ms_per_frame", r.ms_per_frame);
+        json.field("cpu_ms_per_frame", r.cpu_ms_per_frame);
+        json.field("readback_bytes_per_frame", bytes);
+        json.field("fence_waits", r.waits);
+        json.end_object();
+    }
+} // namespace
+
+void bnb::bench::run_yuv_readback_benchmarks(const gl_config& cfg, json_writer& json)
+{
+    const int32_t w = cfg.width;
+    const int32_t h = cfg.height;
+    const int32_t frames = cfg.frames > 0 ? cfg.frames : 1;
+
+    auto& cache = gl::program_cache::instance();
+    const auto effect = cache.acquire("yuv_effect", vertex_source, effect_source);
+    source_frame src(w, h);
+    gl::yuv_readback readback;
+
+    const size_t yuv_size = gl::yuv_readback::frame_size(w, h);
+    std::vector<uint8_t> rgba(static_cast<size_t>(w) * h * 4);
+    std::vector<uint8_t> cpu_yuv(yuv_size);
+    std::vector<uint8_t> gpu_yuv(yuv_size);
+
+    json.key("yuv_readback").begin_object();
+    json.field("width", w);
+    json.field("height", h);
+    json.field("frames", frames);
+
+    const image::yuv_format formats[] = {
+        {image::yuv_layout::nv12, image::yuv_matrix::bt709, image::yuv_range::video},
+        {image::yuv_layout::i420, image::yuv_matrix::bt601, image::yuv_range::full}};
+    for (const auto& format : formats) {
+        if (!gl::yuv_readback::supports(w, h, format.layout)) {
+            continue;
+        }
+        const auto copy_out = [&](const gl::yuv_readback::frame& f) {
+            std::memcpy(gpu_yuv.data(), f.data, f.size);
+        };
+
+        // the same frame both ways, the difference of the planes
+        src.render(effect->handle(), 0);
+        cpu_convert(src, rgba, cpu_yuv, format);
+        readback.convert(GL_TEXTURE_2D, src.texture, w, h, format, 0);
+        readback.consume(true, copy_out);
+        int max_diff = 0;
+        uint64_t off_by_more = 0;
+        for (size_t i = 0; i < yuv_size; ++i) {
+            const int diff = std::abs(int(cpu_yuv[i]) - int(gpu_yuv[i]));
+            max_diff = diff > max_diff ? diff : max_diff;
+            off_by_more += diff > 1 ? 1 : 0;
+        }
+
+        path_result cpu;
+        auto start = clock_type::now();
+        double cpu_start = thread_cpu_ms();
+        for (int32_t i = 0; i < frames; ++i) {
+            src.render(effect->handle(), i);
+            cpu_convert(src, rgba, cpu_yuv, format);
+        }
+        cpu.ms_per_frame = std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / frames;
+        cpu.cpu_ms_per_frame = (thread_cpu_ms() - cpu_start) / frames;
+
+        // read_current_buffer: submit frame N, take frame N-1
+        path_result gpu;
+        const auto waits_before = readback.stats().waits;
+        start = clock_type::now();
+        cpu_start = thread_cpu_ms();
+        for (int32_t i = 0; i < frames; ++i) {
+            src.render(effect->handle(), i);
+            readback.convert(GL_TEXTURE_2D, src.texture, w, h, format, static_cast<uint64_t>(i));
+            while (readback.pending() >= readback.depth()) {
+                readback.consume(true, copy_out);
+            }
+        }
+        while (readback.consume(true, copy_out)) {
+        }
+        gpu.ms_per_frame = std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / frames;
+        gpu.cpu_ms_per_frame = (thread_cpu_ms() - cpu_start) / frames;
+        gpu.waits = readback.stats().waits - waits_before;
+
+        json.key(format.layout == image::yuv_layout::nv12 ? "nv12" : "i420").begin_object();
+        field(json, "cpu_convert", cpu, static_cast<double>(w) * h * 4);
+        field(json, "gpu_convert", gpu, static_cast<double>(yuv_size));
+        json.field("speedup", gpu.ms_per_frame > 0 ? cpu.ms_per_frame / gpu.ms_per_frame : 0.0);
+        json.field("max_diff", max_diff);
+        json.field("samples_off_by_more_than_1", off_by_more);
+        json.end_object();
+    }
+
+    // the zero-copy output: the planes stay on the GPU, the consumer samples them
+    const image::yuv_format nv12{image::yuv_layout::nv12, image::yuv_matrix::bt709, image::yuv_range::video};
+    if (w % 2 == 0 && h % 2 == 0) {
+        gl::nv12_renderer renderer;
+        plane_targets planes(w, h);
+
+        src.render(effect->handle(), 0);
+        cpu_convert(src, rgba, cpu_yuv, nv12);
+        const bool complete = renderer.draw(GL_TEXTURE_2D, src.texture, w, h, nv12, GL_TEXTURE_2D, planes.y, GL_TEXTURE_2D, planes.uv);
+        planes.read(planes.y, w, h, 1, rgba, gpu_yuv.data());
+        planes.read(planes.uv, w / 2, h / 2, 2, rgba, gpu_yuv.data() + static_cast<size_t>(w) * h);
+        int max_diff = 0;
+        uint64_t off_by_more = 0;
+        for (size_t i = 0; i < yuv_size; ++i) {
+            const int diff = std::abs(int(cpu_yuv[i]) - int(gpu_yuv[i]));
+            max_diff = diff > max_diff ? diff : max_diff;
+            off_by_more += diff > 1 ? 1 : 0;
+        }
+
+        // glFinish stands in for the consumer of the IOSurface waiting for the frame
+        path_result native;
+        const auto start = clock_type::now();
+        const double cpu_start = thread_cpu_ms();
+        for (int32_t i = 0; i < frames; ++i) {
+            src.render(effect->handle(), i);
+            renderer.draw(GL_TEXTURE_2D, src.texture, w, h, nv12, GL_TEXTURE_2D, planes.y, GL_TEXTURE_2D, planes.uv);
+            glFinish();
+        }
+        native.ms_per_frame = std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / frames;
+        native.cpu_ms_per_frame = (thread_cpu_ms() - cpu_start) / frames;
+
+        json.key("nv12_planes").begin_object();
+        json.field("complete", complete);
+        field(json, "gpu_render", native, 0.0);
+        json.field("max_diff", max_diff);
+        json.field("samples_off_by_more_than_1", off_by_more);
+        json.end_object();
+    }
+    json.end_object();
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl::context_info::instance().state().invalidate();
+}
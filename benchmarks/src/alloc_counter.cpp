@@ -0,0 +1,64 @@
+#include "alloc_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+ * Replaces the global operator new/delete to count the heap allocations made
+ * by the measured code. malloc/free called directly (e.g. by the heap frame
+ * buffer allocator) are not counted, the pooled buffers are checked with the
+ * pool stats instead.
+ */
+
+namespace
+{
+    std::atomic<uint64_t> g_allocations{0};
+
+    void* counted_alloc(size_t size)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (void* p = std::malloc(size != 0 ? size : 1)) {
+            return p;
+        }
+        throw std::bad_alloc();
+    }
+} // namespace
+
+namespace bnb::bench
+{
+    uint64_t allocation_count()
+    {
+        return g_allocations.load(std::memory_order_relaxed);
+    }
+} // namespace bnb::bench
+
+void* operator new(size_t size)
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bnb::bench
+{
+    /* Number of global operator new calls since the start of the process, all threads */
+    uint64_t allocation_count();
+
+} // namespace bnb::bench
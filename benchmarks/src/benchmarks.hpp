@@ -0,0 +1,61 @@
+#pragma once
+
+#include "json_writer.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace bnb::bench
+{
+    struct resolution
+    {
+        int32_t width;
+        int32_t height;
+    };
+
+    struct config
+    {
+        /* measured frames per pipeline run, after the warm-up */
+        int32_t frames{300};
+        int32_t warmup_frames{30};
+        /* simulated SDK costs, see bnb/stub_control.h */
+        int64_t recognition_us{5000};
+        int64_t draw_us{3000};
+        int32_t async_depth{2};
+        std::vector<resolution> resolutions{{640, 480}, {1280, 720}, {1920, 1080}};
+        /* iterations of every colour conversion case */
+        int32_t conversion_iterations{50};
+        int32_t thread_pool_tasks{200000};
+        /* effect folders of `effect_files` files of `effect_file_kb` each, see effect_cache_bench.cpp */
+        int32_t effect_count{8};
+        int32_t effect_files{16};
+        int32_t effect_file_kb{256};
+        int32_t effect_switches{40};
+        /* UI sliders moved faster than the frame rate, see js_bench.cpp */
+        int32_t js_sliders{3};
+        int32_t js_moves_per_frame{4};
+        int64_t js_call_us{100};
+        /* render time of a frame of the pacing simulation, see pacing_bench.cpp */
+        double pacing_render_ms{12.0};
+        double pacing_camera_jitter_ms{6.0};
+    };
+
+    /* push -> draw -> output conversion through bnb::oep::effect_player, per resolution and mode */
+    void run_pipeline_benchmarks(const config& cfg, json_writer& json);
+
+    /* megapixels per second of every colour conversion per available SIMD backend, fused against two pass rotate + convert */
+    void run_conversion_benchmarks(const config& cfg, json_writer& json);
+
+    /* task throughput and dispatch latency of bnb::thread_pool against the mutex and queue pool, 1-16 threads */
+    void run_thread_pool_benchmarks(const config& cfg, json_writer& json);
+
+    /* effect switch stalls without and with bnb::effect_cache, hit rate of a switching pattern */
+    void run_effect_cache_benchmarks(const config& cfg, json_writer& json);
+
+    /* JS calls run on the caller against queued and coalesced by effect_player */
+    void run_js_benchmarks(const config& cfg, json_writer& json);
+
+    /* camera driven against display paced rendering, in virtual time on a manual clock */
+    void run_pacing_benchmarks(const config& cfg, json_writer& json);
+
+} // namespace bnb::bench
@@ -0,0 +1,176 @@
+#include "benchmarks.hpp"
+
+#include <color_conversion.hpp>
+#include <orientation.hpp>
+
+#include <chrono>
+#include <vector>
+
+/*
+ * Megapixels per second of the conversions per SIMD backend. The orientation cases compare, with
+ * the best backend, the fused rotate + convert kernel (orient_rgb_to_yuv) against the two passes it
+ * replaces: the rotation into a BGRA frame (orient_rgb, what the GPU pass produced) and the conversion
+ * of that frame (rgb_to_yuv). `identical` checks that both give the same planes.
+ */
+
+namespace bnb::bench
+{
+    namespace
+    {
+        using bench_clock = std::chrono::steady_clock;
+
+        const char* to_string(image::simd_backend backend)
+        {
+            switch (backend) {
+                case image::simd_backend::best:     return "best";
+                case image::simd_backend::scalar:   return "scalar";
+                case image::simd_backend::sse41:    return "sse41";
+                case image::simd_backend::avx2:     return "avx2";
+                case image::simd_backend::neon:     return "neon";
+            }
+            return "unknown";
+        }
+
+        template<class F>
+        double megapixels_per_second(int32_t width, int32_t height, int32_t iterations, F&& convert)
+        {
+            convert();
+            const auto start = bench_clock::now();
+            for (int32_t i = 0; i < iterations; ++i) {
+                convert();
+            }
+            const double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+            return seconds > 0 ? static_cast<double>(width) * height * iterations / seconds / 1e6 : 0.0;
+        }
+
+        const char* to_string(image::rotation angle)
+        {
+            switch (angle) {
+                case image::rotation::deg0:     return "deg0";
+                case image::rotation::deg90:    return "deg90";
+                case image::rotation::deg180:   return "deg180";
+                case image::rotation::deg270:   return "deg270";
+            }
+            return "unknown";
+        }
+
+        /* fused against two pass rotate + convert of a BGRA frame, see the top of the file */
+        void run_orientation_cases(const config& cfg, json_writer& json, const std::vector<uint8_t>& bgra, int32_t width, int32_t height)
+        {
+            const image::orientation cases[] = {
+                {image::rotation::deg0, false},
+                {image::rotation::deg90, true},
+                {image::rotation::deg180, false},
+                {image::rotation::deg270, true},
+            };
+            const image::yuv_format formats[] = {
+                {image::yuv_layout::nv12, image::yuv_matrix::bt709, image::yuv_range::video},
+                {image::yuv_layout::i420, image::yuv_matrix::bt709, image::yuv_range::video},
+            };
+
+            json.key("orientation").begin_array();
+            for (const auto& orient : cases) {
+                const bool transposed = orient.angle == image::rotation::deg90 || orient.angle == image::rotation::deg270;
+                const int32_t out_width = transposed ? height : width;
+                const int32_t out_height = transposed ? width : height;
+                const int32_t chroma_width = (out_width + 1) / 2;
+                const int32_t chroma_height = (out_height + 1) / 2;
+                std::vector<uint8_t> rotated(static_cast<size_t>(out_width) * out_height * 4);
+
+                for (const auto& format : formats) {
+                    const bool nv12 = format.layout == image::yuv_layout::nv12;
+                    // one set of planes per path, compared after the timing
+                    std::vector<uint8_t> planes[2][3];
+                    image::yuv_planes dst[2];
+                    for (int p = 0; p < 2; ++p) {
+                        planes[p][0].resize(static_cast<size_t>(out_width) * out_height);
+                        planes[p][1].resize(static_cast<size_t>(chroma_width) * chroma_height * (nv12 ? 2 : 1));
+                        planes[p][2].resize(nv12 ? 0 : static_cast<size_t>(chroma_width) * chroma_height);
+                        dst[p] = {planes[p][0].data(), out_width, planes[p][1].data(), nv12 ? chroma_width * 2 : chroma_width,
+                                  nv12 ? nullptr : planes[p][2].data(), nv12 ? 0 : chroma_width};
+                    }
+
+                    const int32_t n = cfg.conversion_iterations;
+                    const double two_pass = megapixels_per_second(width, height, n, [&] {
+                        image::orient_rgb(bgra.data(), width * 4, image::rgb_layout::bgra, width, height, orient,
+                                          rotated.data(), out_width * 4, image::rgb_layout::bgra);
+                        image::rgb_to_yuv(rotated.data(), out_width * 4, image::rgb_layout::bgra, out_width, out_height, dst[0], format);
+                    });
+                    const double fused = megapixels_per_second(width, height, n, [&] {
+                        image::orient_rgb_to_yuv(bgra.data(), width * 4, image::rgb_layout::bgra, width, height, orient, dst[1], format);
+                    });
+
+                    json.begin_object();
+                    json.field("rotation", to_string(orient.angle));
+                    json.field("mirror", orient.mirror);
+                    json.field("format", nv12 ? "nv12" : "i420");
+                    json.field("two_pass_megapixels_per_second", two_pass);
+                    json.field("fused_megapixels_per_second", fused);
+                    json.field("speedup", two_pass > 0 ? fused / two_pass : 0.0);
+                    json.field("identical", planes[0][0] == planes[1][0] && planes[0][1] == planes[1][1] && planes[0][2] == planes[1][2]);
+                    json.end_object();
+                }
+            }
+            json.end_array();
+        }
+    } // namespace
+
+    void run_conversion_benchmarks(const config& cfg, json_writer& json)
+    {
+        const int32_t width = 1920;
+        const int32_t height = 1080;
+        const int32_t chroma_width = (width + 1) / 2;
+        const int32_t chroma_height = (height + 1) / 2;
+
+        std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+        for (size_t i = 0; i < rgba.size(); ++i) {
+            rgba[i] = static_cast<uint8_t>(i * 13 + i / 997);
+        }
+        std::vector<uint8_t> y(static_cast<size_t>(width) * height);
+        std::vector<uint8_t> uv(static_cast<size_t>(chroma_width) * 2 * chroma_height);
+        std::vector<uint8_t> u(static_cast<size_t>(chroma_width) * chroma_height);
+        std::vector<uint8_t> v(static_cast<size_t>(chroma_width) * chroma_height);
+
+        const image::yuv_planes nv12{y.data(), width, uv.data(), chroma_width * 2, nullptr, 0};
+        const image::yuv_planes i420{y.data(), width, u.data(), chroma_width, v.data(), chroma_width};
+        const image::yuv_format nv12_format{image::yuv_layout::nv12, image::yuv_matrix::bt709, image::yuv_range::video};
+        const image::yuv_format i420_format{image::yuv_layout::i420, image::yuv_matrix::bt709, image::yuv_range::video};
+
+        const auto initial = image::current_simd_backend();
+        json.key("conversion").begin_object();
+        json.field("width", width);
+        json.field("height", height);
+        json.key("backends").begin_array();
+        for (auto backend : {image::simd_backend::scalar, image::simd_backend::sse41, image::simd_backend::avx2, image::simd_backend::neon}) {
+            json.begin_object();
+            json.field("backend", to_string(backend));
+            const bool available = image::set_simd_backend(backend);
+            json.field("available", available);
+            if (available) {
+                const int32_t n = cfg.conversion_iterations;
+                json.key("megapixels_per_second").begin_object();
+                json.field("rgba_to_nv12", megapixels_per_second(width, height, n, [&] {
+                    image::rgb_to_yuv(rgba.data(), width * 4, image::rgb_layout::rgba, width, height, nv12, nv12_format);
+                }));
+                json.field("rgba_to_i420", megapixels_per_second(width, height, n, [&] {
+                    image::rgb_to_yuv(rgba.data(), width * 4, image::rgb_layout::rgba, width, height, i420, i420_format);
+                }));
+                json.field("nv12_to_bgra", megapixels_per_second(width, height, n, [&] {
+                    image::yuv_to_rgb(nv12, nv12_format, width, height, rgba.data(), width * 4, image::rgb_layout::bgra);
+                }));
+                json.field("i420_to_bgra", megapixels_per_second(width, height, n, [&] {
+                    image::yuv_to_rgb(i420, i420_format, width, height, rgba.data(), width * 4, image::rgb_layout::bgra);
+                }));
+                json.end_object();
+            }
+            json.end_object();
+        }
+        json.end_array();
+        image::set_simd_backend(image::simd_backend::best);
+        json.field("orientation_backend", to_string(image::current_simd_backend()));
+        run_orientation_cases(cfg, json, rgba, width, height);
+        json.end_object();
+        image::set_simd_backend(initial);
+    }
+
+} // namespace bnb::bench
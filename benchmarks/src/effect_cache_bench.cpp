@@ -0,0 +1,209 @@
+#include "benchmarks.hpp"
+
+#include <effect_cache.h>
+#include <effect_player.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Effect switches through effect_player::load_effect, the SDK stub reads every file of
+ * the effect folder as the real one parses it. `cold` loads effects the OS has not cached,
+ * `preloaded` loads them after bnb::effect_cache read them ahead. The switching run selects
+ * effects as a carousel UI does and preloads the neighbours of the selection, the OS drops
+ * every file not held by the cache before each switch, as under memory pressure.
+ */
+
+namespace bnb::bench
+{
+    namespace
+    {
+        using bench_clock = std::chrono::steady_clock;
+        namespace fs = std::filesystem;
+
+        double milliseconds_since(bench_clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        }
+
+        /* effect folders of random data, removed with the object */
+        class effect_folders
+        {
+        public:
+            effect_folders(int32_t count, int32_t files, int32_t file_kb)
+            {
+                std::string pattern = (fs::temp_directory_path() / "oep_effects_XXXXXX").string();
+                if (::mkdtemp(pattern.data()) == nullptr) {
+                    return;
+                }
+                m_root = pattern;
+                std::mt19937 random(7);
+                std::vector<uint32_t> data(static_cast<size_t>(file_kb) * 1024 / sizeof(uint32_t));
+                for (int32_t e = 0; e < count; ++e) {
+                    const auto folder = m_root / ("effect_" + std::to_string(e));
+                    fs::create_directories(folder / "images");
+                    for (int32_t f = 0; f < files; ++f) {
+                        std::generate(data.begin(), data.end(), random);
+                        // the config and the scripts at the top, the textures below
+                        const auto path = f == 0 ? folder / "config.json" : folder / "images" / ("texture_" + std::to_string(f) + ".ktx");
+                        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                        if (fd >= 0) {
+                            (void) ::write(fd, data.data(), data.size() * sizeof(uint32_t));
+                            ::fsync(fd);
+                            ::close(fd);
+                        }
+                    }
+                    m_names.push_back(folder.filename().string());
+                }
+            }
+
+            ~effect_folders()
+            {
+                std::error_code error;
+                if (!m_root.empty()) {
+                    fs::remove_all(m_root, error);
+                }
+            }
+
+            /// drops the cached pages of every file, the pages mapped by the effect cache stay
+            void drop_caches() const
+            {
+                std::error_code error;
+                for (auto it = fs::recursive_directory_iterator(m_root, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+                    if (!it->is_regular_file(error)) {
+                        continue;
+                    }
+                    const int fd = ::open(it->path().c_str(), O_RDONLY);
+                    if (fd >= 0) {
+                        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+                        ::close(fd);
+                    }
+                }
+            }
+
+            /// the path the SDK loads the effect from
+            std::string path(size_t index) const
+            {
+                return (m_root / m_names[index]).string();
+            }
+
+            const fs::path& root() const
+            {
+                return m_root;
+            }
+
+            const std::vector<std::string>& names() const
+            {
+                return m_names;
+            }
+
+        private:
+            fs::path m_root;
+            std::vector<std::string> m_names;
+        };
+
+        struct stall_stats
+        {
+            double mean_ms{0};
+            double max_ms{0};
+        };
+
+        void field(json_writer& json, const char* name, const stall_stats& s)
+        {
+            json.key(name).begin_object();
+            json.field("mean_ms", s.mean_ms);
+            json.field("max_ms", s.max_ms);
+            json.end_object();
+        }
+
+        stall_stats summarize(const std::vector<double>& stalls)
+        {
+            stall_stats s;
+            for (double ms : stalls) {
+                s.mean_ms += ms;
+                s.max_ms = std::max(s.max_ms, ms);
+            }
+            s.mean_ms /= static_cast<double>(std::max<size_t>(stalls.size(), 1));
+            return s;
+        }
+    } // namespace
+
+    void run_effect_cache_benchmarks(const config& cfg, json_writer& json)
+    {
+        const effect_folders effects(cfg.effect_count, cfg.effect_files, cfg.effect_file_kb);
+        if (effects.names().empty()) {
+            return;
+        }
+        const size_t count = effects.names().size();
+        const size_t effect_bytes = static_cast<size_t>(cfg.effect_files) * cfg.effect_file_kb * 1024;
+
+        oep::effect_player ep(1280, 720);
+        std::vector<double> cold;
+        std::vector<double> preloaded;
+        {
+            // search path and name, as the resource paths of bnb_utility_manager_init
+            auto cache = std::make_shared<effect_cache>(std::vector<std::string>{effects.root().string()}, effect_bytes * count);
+            for (size_t i = 0; i < count; ++i) {
+                effects.drop_caches();
+                auto start = bench_clock::now();
+                ep.load_effect(effects.path(i));
+                cold.push_back(milliseconds_since(start));
+
+                effects.drop_caches();
+                cache->preload(effects.names()[i]);
+                cache->wait_idle();
+                effects.drop_caches();
+                start = bench_clock::now();
+                ep.load_effect(effects.path(i));
+                preloaded.push_back(milliseconds_since(start));
+            }
+        }
+
+        // a carousel: mostly the next effect, now and then a jump, the neighbours of the selection are preloaded
+        auto cache = std::make_shared<effect_cache>(std::vector<std::string>{}, effect_bytes * 3);
+        ep.set_effect_cache(cache);
+        std::mt19937 random(11);
+        std::vector<double> switches;
+        size_t selected = 0;
+        for (int32_t i = 0; i < cfg.effect_switches; ++i) {
+            selected = random() % 4 == 0 ? random() % count : (selected + 1) % count;
+            effects.drop_caches();
+            const auto start = bench_clock::now();
+            ep.load_effect(effects.path(selected));
+            switches.push_back(milliseconds_since(start));
+            cache->preload(effects.path((selected + 1) % count));
+            cache->preload(effects.path((selected + count - 1) % count));
+            // the user looks at the effect for a while
+            cache->wait_idle();
+        }
+        const auto stats = cache->stats();
+
+        json.key("effect_cache").begin_object();
+        json.field("effects", static_cast<uint64_t>(count));
+        json.field("effect_bytes", static_cast<uint64_t>(effect_bytes));
+        field(json, "cold_load", summarize(cold));
+        field(json, "preloaded_load", summarize(preloaded));
+        json.key("switching").begin_object();
+        json.field("switches", cfg.effect_switches);
+        field(json, "load", summarize(switches));
+        json.field("hits", stats.hits);
+        json.field("misses", stats.misses);
+        json.field("hit_rate", static_cast<double>(stats.hits) / static_cast<double>(std::max<uint64_t>(stats.hits + stats.misses, 1)));
+        json.field("preloads", stats.preloads);
+        json.field("evictions", stats.evictions);
+        json.field("entries", static_cast<uint64_t>(stats.entries));
+        json.field("bytes", static_cast<uint64_t>(stats.bytes));
+        json.field("capacity", static_cast<uint64_t>(stats.capacity));
+        json.end_object();
+        json.end_object();
+    }
+
+} // namespace bnb::bench
@@ -0,0 +1,154 @@
+#include "benchmarks.hpp"
+
+#include <effect_player.hpp>
+#include <bnb/stub_control.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Effect parameters driven by UI sliders faster than the frame rate: every frame
+ * `js_sliders` sliders are moved `js_moves_per_frame` times, every 30th frame evaluates
+ * a script. `direct` runs every call on the calling thread as call_js_method did before
+ * the calls were queued, `queued` goes through effect_player, the calls run coalesced
+ * before the draw. The concurrent run pushes from two threads while the render thread
+ * draws and checks that no call is lost: every queued call ran or was coalesced and every
+ * eval delivered its result in order.
+ */
+
+namespace bnb::bench
+{
+    namespace
+    {
+        using bench_clock = std::chrono::steady_clock;
+
+        double milliseconds_since(bench_clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        }
+
+        struct js_result
+        {
+            double js_ms_per_frame{0};
+            double calls_per_frame{0};
+        };
+
+        void field(json_writer& json, const char* name, const js_result& r)
+        {
+            json.key(name).begin_object();
+            json.field("js_ms_per_frame", r.js_ms_per_frame);
+            json.field("calls_per_frame", r.calls_per_frame);
+            json.end_object();
+        }
+
+        std::string slider(int32_t index)
+        {
+            return "setSlider" + std::to_string(index);
+        }
+    } // namespace
+
+    void run_js_benchmarks(const config& cfg, json_writer& json)
+    {
+        bnb_stub_set_js_cost(cfg.js_call_us);
+        const int32_t frames = cfg.frames;
+
+        oep::effect_player ep(1280, 720);
+        ep.load_effect("effects/sliders");
+
+        // every call resolves the effect and runs right away, one flush per call
+        js_result direct;
+        {
+            const int64_t calls_before = bnb_stub_js_calls();
+            double ms = 0;
+            for (int32_t f = 0; f < frames; ++f) {
+                const auto start = bench_clock::now();
+                for (int32_t m = 0; m < cfg.js_moves_per_frame; ++m) {
+                    for (int32_t s = 0; s < cfg.js_sliders; ++s) {
+                        ep.call_js_method(slider(s), std::to_string(m), js_call_kind::command);
+                        ep.flush_js_calls();
+                    }
+                }
+                ms += milliseconds_since(start);
+            }
+            direct = {ms / frames, static_cast<double>(bnb_stub_js_calls() - calls_before) / frames};
+        }
+
+        js_result queued;
+        {
+            const int64_t calls_before = bnb_stub_js_calls();
+            double ms = 0;
+            for (int32_t f = 0; f < frames; ++f) {
+                for (int32_t m = 0; m < cfg.js_moves_per_frame; ++m) {
+                    for (int32_t s = 0; s < cfg.js_sliders; ++s) {
+                        ep.call_js_method(slider(s), std::to_string(m));
+                    }
+                }
+                if (f % 30 == 0) {
+                    ep.eval_js("getState()", nullptr);
+                }
+                // the render thread: draw_frame flushes the calls before the draw
+                const auto start = bench_clock::now();
+                ep.draw_frame();
+                ms += milliseconds_since(start);
+            }
+            queued = {ms / frames, static_cast<double>(bnb_stub_js_calls() - calls_before) / frames};
+        }
+
+        // two producers against the render thread
+        const auto stats_before = ep.js_stats();
+        const int64_t calls_before = bnb_stub_js_calls();
+        const int32_t per_producer = frames * cfg.js_moves_per_frame * cfg.js_sliders;
+        std::atomic<int32_t> producers_done{0};
+        std::vector<int32_t> eval_order;
+        auto produce = [&](int32_t id) {
+            for (int32_t i = 0; i < per_producer; ++i) {
+                ep.call_js_method(slider(id * cfg.js_sliders + i % cfg.js_sliders), std::to_string(i));
+                if (id == 0 && i % 100 == 0) {
+                    // results arrive on the render thread, in push order
+                    ep.eval_js(std::to_string(i), [&eval_order](std::string result) { eval_order.push_back(std::stoi(result)); });
+                }
+            }
+            producers_done.fetch_add(1);
+        };
+        std::thread first(produce, 0);
+        std::thread second(produce, 1);
+        while (producers_done.load() != 2) {
+            ep.draw_frame();
+            std::this_thread::yield();
+        }
+        first.join();
+        second.join();
+        ep.draw_frame();
+        const auto stats = ep.js_stats();
+        const uint64_t pushed = stats.queued - stats_before.queued;
+        const uint64_t coalesced = stats.coalesced - stats_before.coalesced;
+        const uint64_t ran = static_cast<uint64_t>(bnb_stub_js_calls() - calls_before);
+        bool in_order = eval_order.size() == static_cast<size_t>((per_producer + 99) / 100);
+        for (size_t i = 1; i < eval_order.size(); ++i) {
+            in_order &= eval_order[i] > eval_order[i - 1];
+        }
+
+        json.key("js").begin_object();
+        json.field("frames", frames);
+        json.field("sliders", cfg.js_sliders);
+        json.field("moves_per_frame", cfg.js_moves_per_frame);
+        json.field("call_us", cfg.js_call_us);
+        field(json, "direct", direct);
+        field(json, "queued", queued);
+        json.key("concurrent").begin_object();
+        json.field("pushed", pushed);
+        json.field("coalesced", coalesced);
+        json.field("ran", ran);
+        json.field("flushes", stats.flushes - stats_before.flushes);
+        json.field("none_lost", pushed == coalesced + ran);
+        json.field("evals_in_order", in_order);
+        json.end_object();
+        json.end_object();
+
+        bnb_stub_set_js_cost(50);
+    }
+
+} // namespace bnb::bench
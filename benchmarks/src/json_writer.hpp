@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bnb::bench
+{
+    /**
+     * Minimal streaming JSON writer, enough for the benchmark report.
+     * Keys are written with `key()`, commas and indentation are handled here.
+     */
+    class json_writer
+    {
+    public:
+        explicit json_writer(std::ostream& out)
+            : m_out(out)
+        {
+        }
+
+        json_writer& begin_object()
+        {
+            open('{');
+            return *this;
+        }
+
+        json_writer& end_object()
+        {
+            close('}');
+            return *this;
+        }
+
+        json_writer& begin_array()
+        {
+            open('[');
+            return *this;
+        }
+
+        json_writer& end_array()
+        {
+            close(']');
+            return *this;
+        }
+
+        json_writer& key(const std::string& name)
+        {
+            separate();
+            write_string(name);
+            m_out << ": ";
+            m_after_key = true;
+            return *this;
+        }
+
+        json_writer& value(const std::string& v)
+        {
+            separate();
+            write_string(v);
+            return *this;
+        }
+
+        json_writer& value(const char* v)
+        {
+            return value(std::string(v));
+        }
+
+        json_writer& value(bool v)
+        {
+            separate();
+            m_out << (v ? "true" : "false");
+            return *this;
+        }
+
+        json_writer& value(double v)
+        {
+            separate();
+            m_out << v;
+            return *this;
+        }
+
+        json_writer& value(uint64_t v)
+        {
+            separate();
+            m_out << v;
+            return *this;
+        }
+
+        json_writer& value(int64_t v)
+        {
+            separate();
+            m_out << v;
+            return *this;
+        }
+
+        json_writer& value(int32_t v)
+        {
+            return value(static_cast<int64_t>(v));
+        }
+
+        template<class T>
+        json_writer& field(const std::string& name, T v)
+        {
+            return key(name).value(v);
+        }
+
+    private:
+        void open(char bracket)
+        {
+            separate();
+            m_out << bracket;
+            m_first.push_back(true);
+        }
+
+        void close(char bracket)
+        {
+            const bool empty = m_first.back();
+            m_first.pop_back();
+            if (!empty) {
+                newline();
+            }
+            m_out << bracket;
+            if (m_first.empty()) {
+                m_out << '\n';
+            }
+        }
+
+        void separate()
+        {
+            if (m_after_key) {
+                m_after_key = false;
+                return;
+            }
+            if (m_first.empty()) {
+                return;
+            }
+            if (!m_first.back()) {
+                m_out << ',';
+            }
+            m_first.back() = false;
+            newline();
+        }
+
+        void newline()
+        {
+            m_out << '\n'
+                  << std::string(m_first.size() * 2, ' ');
+        }
+
+        void write_string(const std::string& s)
+        {
+            m_out << '"';
+            for (char c : s) {
+                if (c == '"' || c == '\\') {
+                    m_out << '\\';
+                }
+                m_out << c;
+            }
+            m_out << '"';
+        }
+
+        std::ostream& m_out;
+        std::vector<bool> m_first;
+        bool m_after_key{false};
+    };
+
+} // namespace bnb::bench
@@ -0,0 +1,157 @@
+#include "benchmarks.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/*
+ * Headless benchmarks of the OEP glue layer. The SDK is replaced with the stub
+ * from benchmarks/stub, the results are written as JSON to stdout or to --out.
+ */
+
+namespace
+{
+    constexpr int32_t schema_version = 1;
+
+    void usage()
+    {
+        std::cerr << "usage: oep_benchmarks [--frames N] [--warmup N] [--recognition-us N] [--draw-us N]\n"
+                     "                      [--depth N] [--resolutions WxH,WxH...] [--iterations N]\n"
+                     "                      [--tasks N] [--switches N] [--js-us N] [--render-ms N] [--camera-jitter-ms N]\n"
+                     "                      [--skip pipeline|conversion|thread_pool|effect_cache|js|pacing] [--out FILE]\n";
+    }
+
+    bool parse_resolutions(const std::string& list, std::vector<bnb::bench::resolution>& out)
+    {
+        out.clear();
+        std::stringstream ss(list);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            const auto x = item.find('x');
+            if (x == std::string::npos) {
+                return false;
+            }
+            const int32_t w = std::atoi(item.substr(0, x).c_str());
+            const int32_t h = std::atoi(item.substr(x + 1).c_str());
+            if (w <= 0 || h <= 0 || (w % 2) != 0 || (h % 2) != 0) {
+                return false;
+            }
+            out.push_back({w, h});
+        }
+        return !out.empty();
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bnb::bench::config cfg;
+    std::string out_path;
+    bool skip_pipeline = false;
+    bool skip_conversion = false;
+    bool skip_thread_pool = false;
+    bool skip_effect_cache = false;
+    bool skip_js = false;
+    bool skip_pacing = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (next == nullptr) {
+            usage();
+            return 1;
+        }
+        ++i;
+        if (arg == "--frames") {
+            cfg.frames = std::atoi(next);
+        } else if (arg == "--warmup") {
+            cfg.warmup_frames = std::atoi(next);
+        } else if (arg == "--recognition-us") {
+            cfg.recognition_us = std::atoll(next);
+        } else if (arg == "--draw-us") {
+            cfg.draw_us = std::atoll(next);
+        } else if (arg == "--depth") {
+            cfg.async_depth = std::max(std::atoi(next), 1);
+        } else if (arg == "--iterations") {
+            cfg.conversion_iterations = std::atoi(next);
+        } else if (arg == "--tasks") {
+            cfg.thread_pool_tasks = std::atoi(next);
+        } else if (arg == "--switches") {
+            cfg.effect_switches = std::atoi(next);
+        } else if (arg == "--js-us") {
+            cfg.js_call_us = std::atoll(next);
+        } else if (arg == "--render-ms") {
+            cfg.pacing_render_ms = std::atof(next);
+        } else if (arg == "--camera-jitter-ms") {
+            cfg.pacing_camera_jitter_ms = std::atof(next);
+        } else if (arg == "--out") {
+            out_path = next;
+        } else if (arg == "--resolutions") {
+            if (!parse_resolutions(next, cfg.resolutions)) {
+                std::cerr << "bad --resolutions, expected even WxH[,WxH...]\n";
+                return 1;
+            }
+        } else if (arg == "--skip") {
+            skip_pipeline |= std::strcmp(next, "pipeline") == 0;
+            skip_conversion |= std::strcmp(next, "conversion") == 0;
+            skip_thread_pool |= std::strcmp(next, "thread_pool") == 0;
+            skip_effect_cache |= std::strcmp(next, "effect_cache") == 0;
+            skip_js |= std::strcmp(next, "js") == 0;
+            skip_pacing |= std::strcmp(next, "pacing") == 0;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path);
+        if (!file) {
+            std::cerr << "can not open " << out_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : file;
+
+    bnb::bench::json_writer json(out);
+    json.begin_object();
+    json.field("schema_version", schema_version);
+    json.key("config").begin_object();
+    json.field("frames", cfg.frames);
+    json.field("warmup_frames", cfg.warmup_frames);
+    json.field("recognition_us", cfg.recognition_us);
+    json.field("draw_us", cfg.draw_us);
+    json.field("async_depth", cfg.async_depth);
+    json.field("hardware_threads", static_cast<uint64_t>(std::thread::hardware_concurrency()));
+#if defined(BNB_OEP_PROFILING)
+    json.field("profiling", true);
+#else
+    json.field("profiling", false);
+#endif
+    json.end_object();
+
+    if (!skip_pipeline) {
+        bnb::bench::run_pipeline_benchmarks(cfg, json);
+    }
+    if (!skip_conversion) {
+        bnb::bench::run_conversion_benchmarks(cfg, json);
+    }
+    if (!skip_thread_pool) {
+        bnb::bench::run_thread_pool_benchmarks(cfg, json);
+    }
+    if (!skip_effect_cache) {
+        bnb::bench::run_effect_cache_benchmarks(cfg, json);
+    }
+    if (!skip_js) {
+        bnb::bench::run_js_benchmarks(cfg, json);
+    }
+    if (!skip_pacing) {
+        bnb::bench::run_pacing_benchmarks(cfg, json);
+    }
+    json.end_object();
+    return 0;
+}
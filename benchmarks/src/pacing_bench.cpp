@@ -0,0 +1,214 @@
+#include "benchmarks.hpp"
+
+#include <frame_pacer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+ * A camera with +-`pacing_camera_jitter_ms` of callback jitter on a 60 Hz display: 29.97 fps
+ * meant to change the output every other refresh and 59.94 fps meant to change it every refresh.
+ * `camera_driven` renders on every camera callback as processImage does, a frame arriving during
+ * a render waits for it (latest wins). `paced` renders the freshest frame on the ticks of
+ * bnb::frame_pacer at the cadence. A render takes `pacing_render_ms`, its output is shown at the
+ * first refresh after it. Runs in virtual time on a manual_pacing_clock, the results do not
+ * depend on the machine.
+ * `wasted` renders were replaced by a later one before the refresh that would have shown them,
+ * `repeats` are cadence intervals without a new output, `display_jitter` is |time between two
+ * output changes - cadence|.
+ * The last run ticks a pacer on its own thread against the steady clock for a second.
+ */
+
+namespace bnb::bench
+{
+    namespace
+    {
+        constexpr int64_t ms = 1000000;
+        constexpr int64_t refresh = 16666667;
+
+        struct camera_frame
+        {
+            int64_t captured;
+        };
+
+        struct display_result
+        {
+            uint64_t renders{0};
+            uint64_t wasted{0};
+            uint64_t repeats{0};
+            double jitter_mean_ms{0};
+            double jitter_max_ms{0};
+        };
+
+        /* what the display shows of renders finished at `completions`, in order */
+        display_result display(const std::vector<int64_t>& completions, int64_t cadence)
+        {
+            display_result r;
+            r.renders = completions.size();
+            std::vector<int64_t> shown;
+            for (int64_t done : completions) {
+                const int64_t vsync = (done + refresh - 1) / refresh * refresh;
+                if (!shown.empty() && shown.back() == vsync) {
+                    ++r.wasted;
+                    continue;
+                }
+                shown.push_back(vsync);
+            }
+            for (size_t i = 1; i < shown.size(); ++i) {
+                const int64_t interval = shown[i] - shown[i - 1];
+                const double jitter = std::abs(static_cast<double>(interval - cadence)) / ms;
+                r.jitter_mean_ms += jitter;
+                r.jitter_max_ms = std::max(r.jitter_max_ms, jitter);
+                r.repeats += static_cast<uint64_t>(std::max<int64_t>((interval + cadence / 2) / cadence - 1, 0));
+            }
+            r.jitter_mean_ms /= static_cast<double>(std::max<size_t>(shown.size(), 2) - 1);
+            return r;
+        }
+
+        void field(json_writer& json, const char* name, const display_result& r)
+        {
+            json.key(name).begin_object();
+            json.field("renders", r.renders);
+            json.field("wasted", r.wasted);
+            json.field("repeats", r.repeats);
+            json.field("display_jitter_mean_ms", r.jitter_mean_ms);
+            json.field("display_jitter_max_ms", r.jitter_max_ms);
+            json.end_object();
+        }
+
+        std::vector<int64_t> camera_arrivals(int32_t count, int64_t period, double jitter_ms)
+        {
+            std::mt19937 random(3);
+            const auto spread = static_cast<int64_t>(jitter_ms * ms);
+            std::uniform_int_distribution<int64_t> jitter(-spread, spread);
+            std::vector<int64_t> arrivals;
+            for (int32_t i = 0; i < count; ++i) {
+                arrivals.push_back(spread + i * period + jitter(random));
+            }
+            std::sort(arrivals.begin(), arrivals.end());
+            return arrivals;
+        }
+
+        /* every callback renders, unless the previous frame still renders */
+        std::vector<int64_t> render_camera_driven(const std::vector<int64_t>& arrivals, int64_t cost)
+        {
+            std::vector<int64_t> completions;
+            int64_t busy_until = 0;
+            // arrival of the frame waiting for the render, arrivals are never negative
+            int64_t waiting = -1;
+            for (int64_t t : arrivals) {
+                if (waiting >= 0 && busy_until <= t) {
+                    busy_until = std::max(busy_until, waiting) + cost;
+                    completions.push_back(busy_until);
+                    waiting = -1;
+                }
+                if (busy_until <= t) {
+                    busy_until = t + cost;
+                    completions.push_back(busy_until);
+                } else {
+                    waiting = t;
+                }
+            }
+            if (waiting >= 0) {
+                completions.push_back(busy_until + cost);
+            }
+            return completions;
+        }
+
+        std::vector<int64_t> render_paced(const std::vector<int64_t>& arrivals, int64_t cost, int64_t cadence, frame_pacing_stats& stats)
+        {
+            std::vector<int64_t> completions;
+            auto clock = std::make_shared<manual_pacing_clock>();
+            int64_t busy_until = 0;
+            frame_pacer<camera_frame> pacer(
+                clock, cadence,
+                [&](camera_frame&) {
+                    if (busy_until > clock->now()) {
+                        return false;
+                    }
+                    busy_until = clock->now() + cost;
+                    completions.push_back(busy_until);
+                    return true;
+                },
+                [](camera_frame&&, frame_drop_reason) {});
+            size_t next = 0;
+            while (next < arrivals.size() || pacer.next_tick() <= arrivals.back() + cadence) {
+                if (next < arrivals.size() && arrivals[next] < pacer.next_tick()) {
+                    clock->set(arrivals[next]);
+                    pacer.submit({arrivals[next++]});
+                } else {
+                    clock->set(pacer.next_tick());
+                    pacer.tick();
+                }
+            }
+            stats = pacer.stats();
+            return completions;
+        }
+
+        void run_scenario(const config& cfg, json_writer& json, const char* name, int64_t camera_period, int64_t cadence)
+        {
+            const int32_t count = std::max(cfg.frames, 30);
+            const int64_t cost = static_cast<int64_t>(cfg.pacing_render_ms * ms);
+            const auto arrivals = camera_arrivals(count, camera_period, cfg.pacing_camera_jitter_ms);
+            frame_pacing_stats stats;
+            const auto paced = render_paced(arrivals, cost, cadence, stats);
+
+            json.key(name).begin_object();
+            json.field("camera_frames", count);
+            json.field("cadence_ms", static_cast<double>(cadence) / ms);
+            field(json, "camera_driven", display(render_camera_driven(arrivals, cost), cadence));
+            field(json, "paced", display(paced, cadence));
+            json.key("pacer").begin_object();
+            json.field("ticks", stats.ticks);
+            json.field("stale", stats.stale);
+            json.field("idle_ticks", stats.idle_ticks);
+            json.field("busy_ticks", stats.busy_ticks);
+            json.field("jitter_mean_ms", stats.jitter_mean_ms);
+            json.field("jitter_max_ms", stats.jitter_max_ms);
+            json.field("latency_mean_ms", stats.latency_mean_ms);
+            json.field("latency_max_ms", stats.latency_max_ms);
+            json.end_object();
+            json.end_object();
+        }
+    } // namespace
+
+    void run_pacing_benchmarks(const config& cfg, json_writer& json)
+    {
+        json.key("pacing").begin_object();
+        json.field("render_ms", cfg.pacing_render_ms);
+        json.field("camera_jitter_ms", cfg.pacing_camera_jitter_ms);
+        run_scenario(cfg, json, "camera_30", 33366667, 2 * refresh);
+        run_scenario(cfg, json, "camera_60", 16683333, refresh);
+
+        // the thread of the pacer against the steady clock, a 47 fps producer
+        frame_pacing_stats threaded;
+        {
+            auto clock = std::make_shared<steady_pacing_clock>();
+            frame_pacer<camera_frame> pacer(
+                clock, refresh, [](camera_frame&) { return true; }, [](camera_frame&&, frame_drop_reason) {});
+            pacer.start();
+            const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            while (std::chrono::steady_clock::now() < end) {
+                pacer.submit({clock->now()});
+                std::this_thread::sleep_for(std::chrono::milliseconds(21));
+            }
+            pacer.stop();
+            threaded = pacer.stats();
+        }
+        json.key("steady_clock").begin_object();
+        json.field("ticks", threaded.ticks);
+        json.field("renders", threaded.renders);
+        json.field("idle_ticks", threaded.idle_ticks);
+        json.field("missed_ticks", threaded.missed_ticks);
+        json.field("lateness_mean_ms", threaded.lateness_mean_ms);
+        json.field("lateness_max_ms", threaded.lateness_max_ms);
+        json.end_object();
+        json.end_object();
+    }
+
+} // namespace bnb::bench
@@ -0,0 +1,243 @@
+#include "benchmarks.hpp"
+#include "alloc_counter.hpp"
+
+#include <effect_player.hpp>
+#include <color_conversion.hpp>
+#include <frame_buffer_pool.h>
+#include <stage_profiler.h>
+#include <bnb/stub_control.h>
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace bnb::bench
+{
+    namespace
+    {
+        using bench_clock = std::chrono::steady_clock;
+        using oep::interfaces::image_format;
+        using oep::interfaces::pixel_buffer;
+
+        constexpr uint32_t nv12_buffer_format = 1;
+        constexpr size_t max_tracked_frames = 64;
+
+        uint64_t nanoseconds_since(bench_clock::time_point start)
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count());
+        }
+
+        /* NV12 buffer of `width` x `height` in one allocation, the UV plane follows the Y plane */
+        frame_buffer_desc nv12_desc(int32_t width, int32_t height)
+        {
+            return {static_cast<uint32_t>(width), static_cast<uint32_t>(height + (height + 1) / 2), nv12_buffer_format, static_cast<uint32_t>(width)};
+        }
+
+        image::yuv_planes nv12_planes(uint8_t* buffer, int32_t width, int32_t height)
+        {
+            image::yuv_planes planes;
+            planes.y = buffer;
+            planes.y_stride = width;
+            planes.u = buffer + static_cast<size_t>(width) * height;
+            planes.u_stride = width;
+            return planes;
+        }
+
+        void write_latency(json_writer& json, const std::string& name, const latency_snapshot& s)
+        {
+            json.key(name).begin_object();
+            json.field("count", s.count);
+            json.field("mean_us", s.mean / 1000.0);
+            json.field("p50_us", s.p50 / 1000.0);
+            json.field("p95_us", s.p95 / 1000.0);
+            json.field("p99_us", s.p99 / 1000.0);
+            json.field("max_us", s.max / 1000.0);
+            json.end_object();
+        }
+
+        /**
+         * One camera -> effect_player -> output run. The camera frame is copied into a
+         * pooled NV12 buffer, the "rendered" RGBA frame is converted to NV12 as the
+         * offscreen render target does for a YUV output.
+         */
+        class pipeline_run
+        {
+        public:
+            pipeline_run(resolution res, oep::processing_mode mode, size_t depth)
+                : m_res(res)
+                , m_input_desc(nv12_desc(res.width, res.height))
+                , m_input_pool(std::make_shared<heap_frame_buffer_allocator>(1), depth + 2)
+                , m_output_pool(std::make_shared<heap_frame_buffer_allocator>(1), 2)
+                , m_ep(res.width, res.height, mode, depth)
+                , m_keepalive(std::make_shared<int>(0))
+                , m_planes(2)
+            {
+                const size_t pixels = static_cast<size_t>(res.width) * res.height;
+                m_render_target.resize(pixels * 4);
+                for (size_t i = 0; i < m_render_target.size(); ++i) {
+                    m_render_target[i] = static_cast<uint8_t>(i * 7 + i / 4096);
+                }
+                m_camera_frame.resize(m_input_desc.stride * m_input_desc.height);
+                image::rgb_to_yuv(m_render_target.data(), res.width * 4, image::rgb_layout::rgba, res.width, res.height,
+                                  nv12_planes(m_camera_frame.data(), res.width, res.height), m_format);
+            }
+
+            void push_one()
+            {
+                auto* buffer = static_cast<uint8_t*>(m_input_pool.acquire(m_input_desc));
+                std::memcpy(buffer, m_camera_frame.data(), m_camera_frame.size());
+
+                const auto start = bench_clock::now();
+                const auto planes = nv12_planes(buffer, m_res.width, m_res.height);
+                // aliasing pointers, the pooled buffer is returned by the destroyed callback;
+                // create allocates the buffer itself, the one allocation per frame of this run
+                m_planes[0] = {pixel_buffer::plane_sptr(m_keepalive, planes.y), static_cast<size_t>(planes.y_stride) * m_res.height, planes.y_stride};
+                m_planes[1] = {pixel_buffer::plane_sptr(m_keepalive, planes.u), static_cast<size_t>(planes.u_stride) * ((m_res.height + 1) / 2), planes.u_stride};
+                auto image = pixel_buffer::create(m_planes, image_format::nv12_bt601_full, m_res.width, m_res.height, [this](pixel_buffer* pb) {
+                    m_input_pool.release(pb->get_base_sptr_of_plane(0).get(), m_input_desc);
+                });
+                const auto id = m_ep.push_frame(image, oep::interfaces::rotation::deg0, false, 0).id;
+                m_histograms[static_cast<size_t>(pipeline_stage::push_frame)].record(nanoseconds_since(start));
+                m_start[id % max_tracked_frames] = start;
+            }
+
+            void draw_one()
+            {
+                auto start = bench_clock::now();
+                const auto result = m_ep.draw_frame();
+                if (!result.drawn()) {
+                    return;
+                }
+                m_histograms[static_cast<size_t>(pipeline_stage::draw)].record(nanoseconds_since(start));
+
+                start = bench_clock::now();
+                auto* out = static_cast<uint8_t*>(m_output_pool.acquire(m_input_desc));
+                image::rgb_to_yuv(m_render_target.data(), m_res.width * 4, image::rgb_layout::rgba, m_res.width, m_res.height,
+                                  nv12_planes(out, m_res.width, m_res.height), m_format);
+                m_output_pool.release(out, m_input_desc);
+                m_histograms[static_cast<size_t>(pipeline_stage::convert_output)].record(nanoseconds_since(start));
+
+                m_histograms[static_cast<size_t>(pipeline_stage::end_to_end)].record(nanoseconds_since(m_start[result.frame.id % max_tracked_frames]));
+                ++m_drawn;
+            }
+
+            void drain()
+            {
+                while (m_ep.frames_in_flight() != 0) {
+                    draw_one();
+                }
+            }
+
+            void reset_measurements()
+            {
+                for (auto& h : m_histograms) {
+                    h.reset();
+                }
+                m_drawn = 0;
+            }
+
+            uint64_t drawn() const
+            {
+                return m_drawn;
+            }
+
+            latency_snapshot snapshot(pipeline_stage stage) const
+            {
+                return m_histograms[static_cast<size_t>(stage)].snapshot();
+            }
+
+            frame_buffer_pool::stats_t input_pool_stats() const
+            {
+                return m_input_pool.stats();
+            }
+
+        private:
+            const resolution m_res;
+            const image::yuv_format m_format{image::yuv_layout::nv12, image::yuv_matrix::bt601, image::yuv_range::full};
+            const frame_buffer_desc m_input_desc;
+            frame_buffer_pool m_input_pool;
+            frame_buffer_pool m_output_pool;
+            oep::effect_player m_ep;
+
+            std::shared_ptr<int> m_keepalive;
+            std::vector<pixel_buffer::plane_data> m_planes;
+            std::vector<uint8_t> m_camera_frame;
+            std::vector<uint8_t> m_render_target;
+
+            std::array<bench_clock::time_point, max_tracked_frames> m_start{};
+            std::array<latency_histogram, static_cast<size_t>(pipeline_stage::count)> m_histograms;
+            uint64_t m_drawn{0};
+        };
+
+        void run_one(const config& cfg, resolution res, oep::processing_mode mode, size_t depth, json_writer& json)
+        {
+            uint64_t allocations = 0;
+            double seconds = 0;
+            int64_t live_images = 0;
+            frame_buffer_pool::stats_t pool_before;
+            frame_buffer_pool::stats_t pool_after;
+            std::array<latency_snapshot, static_cast<size_t>(pipeline_stage::count)> stages;
+            uint64_t drawn = 0;
+            {
+                pipeline_run run(res, mode, depth);
+                for (int32_t i = 0; i < cfg.warmup_frames; ++i) {
+                    run.push_one();
+                    run.draw_one();
+                }
+                run.drain();
+                run.reset_measurements();
+
+                pool_before = run.input_pool_stats();
+                const auto allocations_before = allocation_count();
+                const auto start = bench_clock::now();
+                for (int32_t i = 0; i < cfg.frames; ++i) {
+                    run.push_one();
+                    run.draw_one();
+                }
+                run.drain();
+                seconds = nanoseconds_since(start) / 1e9;
+                allocations = allocation_count() - allocations_before;
+                pool_after = run.input_pool_stats();
+
+                drawn = run.drawn();
+                for (size_t s = 0; s < stages.size(); ++s) {
+                    stages[s] = run.snapshot(static_cast<pipeline_stage>(s));
+                }
+            }
+            live_images = bnb_stub_live_images();
+
+            json.begin_object();
+            json.field("resolution", std::to_string(res.width) + "x" + std::to_string(res.height));
+            json.field("width", res.width);
+            json.field("height", res.height);
+            json.field("mode", mode == oep::processing_mode::async ? "async" : "sync");
+            json.field("pipeline_depth", static_cast<uint64_t>(depth));
+            json.field("frames", drawn);
+            json.field("seconds", seconds);
+            json.field("fps", seconds > 0 ? drawn / seconds : 0.0);
+            json.field("allocations", allocations);
+            json.field("allocations_per_frame", drawn != 0 ? static_cast<double>(allocations) / drawn : 0.0);
+            json.field("input_pool_misses", pool_after.misses - pool_before.misses);
+            json.field("leaked_images", live_images);
+            json.key("latency").begin_object();
+            for (auto stage : {pipeline_stage::push_frame, pipeline_stage::draw, pipeline_stage::convert_output, pipeline_stage::end_to_end}) {
+                write_latency(json, to_string(stage), stages[static_cast<size_t>(stage)]);
+            }
+            json.end_object();
+            json.end_object();
+        }
+    } // namespace
+
+    void run_pipeline_benchmarks(const config& cfg, json_writer& json)
+    {
+        bnb_stub_set_costs(cfg.recognition_us, cfg.draw_us);
+        json.key("pipeline").begin_array();
+        for (const auto& res : cfg.resolutions) {
+            run_one(cfg, res, oep::processing_mode::sync, 1, json);
+            run_one(cfg, res, oep::processing_mode::async, static_cast<size_t>(cfg.async_depth), json);
+        }
+        json.end_array();
+    }
+
+} // namespace bnb::bench
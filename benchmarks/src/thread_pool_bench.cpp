@@ -0,0 +1,196 @@
+#include "benchmarks.hpp"
+
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+ * bnb::thread_pool against `mutex_queue_pool`, the pool it replaced: one std::queue of
+ * std::function behind one mutex, a shared packaged_task per enqueue. Swept over 1-16
+ * threads. `execute` submits fire-and-forget tasks (enqueue with the future dropped for the
+ * baseline, which has no execute), `enqueue` keeps every future and waits for them. The
+ * latency is submit to start of a task, measured in bursts of one task per thread, so it
+ * is the dispatch and wake-up cost rather than the time spent behind a backlog.
+ */
+
+namespace bnb::bench
+{
+    namespace
+    {
+        using bench_clock = std::chrono::steady_clock;
+
+        double seconds_since(bench_clock::time_point start)
+        {
+            return std::chrono::duration<double>(bench_clock::now() - start).count();
+        }
+
+        /* the thread_pool before the work-stealing deques, kept as the baseline */
+        class mutex_queue_pool
+        {
+        public:
+            explicit mutex_queue_pool(size_t threads)
+            {
+                for (size_t i = 0; i < threads; ++i) {
+                    m_workers.emplace_back([this] {
+                        for (;;) {
+                            std::function<void()> task;
+                            {
+                                std::unique_lock<std::mutex> lock(m_mutex);
+                                m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                                if (m_stop && m_tasks.empty()) {
+                                    return;
+                                }
+                                task = std::move(m_tasks.front());
+                                m_tasks.pop();
+                            }
+                            task();
+                        }
+                    });
+                }
+            }
+
+            ~mutex_queue_pool()
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+                m_condition.notify_all();
+                for (auto& worker : m_workers) {
+                    worker.join();
+                }
+            }
+
+            template<class F>
+            std::future<void> enqueue(F&& f)
+            {
+                auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+                auto res = task->get_future();
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_tasks.emplace([task]() { (*task)(); });
+                }
+                m_condition.notify_one();
+                return res;
+            }
+
+            template<class F>
+            void execute(F&& f)
+            {
+                enqueue(std::forward<F>(f));
+            }
+
+        private:
+            std::vector<std::thread> m_workers;
+            std::queue<std::function<void()>> m_tasks;
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            bool m_stop{false};
+        };
+
+        struct pool_result
+        {
+            double execute_rate{0};
+            double enqueue_rate{0};
+            double latency_p50_us{0};
+            double latency_p99_us{0};
+        };
+
+        void field(json_writer& json, const char* name, const pool_result& r)
+        {
+            json.key(name).begin_object();
+            json.field("execute_tasks_per_second", r.execute_rate);
+            json.field("enqueue_tasks_per_second", r.enqueue_rate);
+            json.field("latency_p50_us", r.latency_p50_us);
+            json.field("latency_p99_us", r.latency_p99_us);
+            json.end_object();
+        }
+
+        double percentile_us(std::vector<int64_t>& ns, double p)
+        {
+            if (ns.empty()) {
+                return 0;
+            }
+            const auto index = static_cast<size_t>(p * static_cast<double>(ns.size() - 1));
+            std::nth_element(ns.begin(), ns.begin() + static_cast<std::ptrdiff_t>(index), ns.end());
+            return static_cast<double>(ns[index]) / 1000.0;
+        }
+
+        template<class Pool>
+        pool_result measure(size_t threads, int32_t tasks)
+        {
+            pool_result r;
+            Pool pool(threads);
+            std::atomic<int32_t> done{0};
+
+            auto start = bench_clock::now();
+            for (int32_t i = 0; i < tasks; ++i) {
+                pool.execute([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+            while (done.load() != tasks) {
+                std::this_thread::yield();
+            }
+            r.execute_rate = tasks / seconds_since(start);
+
+            std::vector<std::future<void>> results;
+            results.reserve(static_cast<size_t>(tasks));
+            start = bench_clock::now();
+            for (int32_t i = 0; i < tasks; ++i) {
+                results.push_back(pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); }));
+            }
+            for (auto& f : results) {
+                f.wait();
+            }
+            r.enqueue_rate = tasks / seconds_since(start);
+
+            const auto samples = static_cast<size_t>(std::min(tasks, 20000));
+            std::vector<int64_t> latency(samples);
+            for (size_t i = 0; i < samples;) {
+                const size_t burst = std::min(threads, samples - i);
+                done = 0;
+                for (size_t b = 0; b < burst; ++b, ++i) {
+                    pool.execute([&done, &latency, i, submitted = bench_clock::now()] {
+                        latency[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - submitted).count();
+                        done.fetch_add(1, std::memory_order_release);
+                    });
+                }
+                while (done.load(std::memory_order_acquire) != static_cast<int32_t>(burst)) {
+                    std::this_thread::yield();
+                }
+            }
+            r.latency_p50_us = percentile_us(latency, 0.50);
+            r.latency_p99_us = percentile_us(latency, 0.99);
+            return r;
+        }
+    } // namespace
+
+    void run_thread_pool_benchmarks(const config& cfg, json_writer& json)
+    {
+        const int32_t tasks = cfg.thread_pool_tasks;
+
+        json.key("thread_pool").begin_object();
+        json.field("tasks", tasks);
+        json.field("hardware_threads", static_cast<uint64_t>(std::max(std::thread::hardware_concurrency(), 1u)));
+        json.key("sweep").begin_array();
+        for (size_t threads : {1, 2, 4, 8, 16}) {
+            json.begin_object();
+            json.field("threads", static_cast<uint64_t>(threads));
+            field(json, "work_stealing", measure<thread_pool>(threads, tasks));
+            field(json, "mutex_queue", measure<mutex_queue_pool>(threads, tasks));
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+
+} // namespace bnb::bench
@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Stub of the Banuba SDK C API, the subset used by oep_framework.
+ * Only for the headless benchmarks, the real header comes with BNBEffectPlayerC.framework.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct bnb_error bnb_error;
+
+typedef enum
+{
+    bnb_yuv_video_range,
+    bnb_yuv_full_range
+} bnb_yuv_color_range_t;
+
+typedef enum
+{
+    bnb_bt601,
+    bnb_bt709
+} bnb_yuv_color_space_t;
+
+typedef enum
+{
+    BNB_RGB,
+    BNB_BGR,
+    BNB_RGBA,
+    BNB_BGRA,
+    BNB_ARGB
+} bnb_pixel_format_t;
+
+typedef enum
+{
+    BNB_DEG_0,
+    BNB_DEG_90,
+    BNB_DEG_180,
+    BNB_DEG_270
+} bnb_image_orientation_t;
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    bnb_image_orientation_t orientation;
+    bool require_mirroring;
+    int32_t face_orientation;
+} bnb_image_format_t;
+
+const char* bnb_error_get_message(bnb_error* error);
+void bnb_error_destroy(bnb_error* error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+/*
+ * Stub of the Banuba SDK C API, the subset used by oep_framework.
+ * Recognition and drawing only burn the configured time, see bnb/stub_control.h
+ */
+
+#include "common_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct effect_player_holder effect_player_holder_t;
+typedef struct frame_processor frame_processor_t;
+typedef struct full_image_holder full_image_holder_t;
+typedef struct frame_data frame_data_t;
+typedef struct effect_manager_holder effect_manager_holder_t;
+typedef struct effect_holder effect_holder_t;
+typedef struct processor_configuration processor_configuration_t;
+
+typedef enum
+{
+    bnb_render_backend_opengl
+} bnb_render_backend_t;
+
+typedef enum
+{
+    bnb_nn_mode_automatically,
+    bnb_nn_mode_enable,
+    bnb_nn_mode_disable
+} bnb_nn_mode_t;
+
+typedef enum
+{
+    bnb_bad,
+    bnb_medium,
+    bnb_good
+} bnb_face_search_mode_t;
+
+typedef struct
+{
+    int32_t fx_width;
+    int32_t fx_height;
+    bnb_nn_mode_t nn_enable;
+    bnb_face_search_mode_t face_search;
+    bool js_debugger_enable;
+    bool manual_audio;
+} bnb_effect_player_configuration_t;
+
+typedef enum
+{
+    bnb_realtime_processor_mode_sync,
+    bnb_realtime_processor_mode_async
+} bnb_realtime_processor_mode_t;
+
+typedef enum
+{
+    bnb_processor_status_ok,
+    bnb_processor_status_empty
+} bnb_processor_status_t;
+
+typedef struct
+{
+    frame_data_t* frame_data;
+    bnb_processor_status_t status;
+} bnb_processor_result_t;
+
+typedef void (*bnb_image_release_cb)(void* user_data);
+
+void bnb_effect_player_set_render_backend(bnb_render_backend_t backend, bnb_error** error);
+effect_player_holder_t* bnb_effect_player_create(bnb_effect_player_configuration_t* cfg, bnb_error** error);
+void bnb_effect_player_destroy(effect_player_holder_t* ep, bnb_error** error);
+
+processor_configuration_t* bnb_processor_configuration_create(bnb_error** error);
+void bnb_processor_configuration_destroy(processor_configuration_t* config, bnb_error** error);
+void bnb_processor_configuration_set_use_future_filter(processor_configuration_t* config, bool use, bnb_error** error);
+
+frame_processor_t* bnb_frame_processor_create_realtime_processor(bnb_realtime_processor_mode_t mode, processor_configuration_t* config, bnb_error** error);
+void bnb_frame_processor_destroy(frame_processor_t* fp, bnb_error** error);
+void bnb_effect_player_set_frame_processor(effect_player_holder_t* ep, frame_processor_t* fp, bnb_error** error);
+void bnb_frame_processor_push(frame_processor_t* fp, frame_data_t* fd, bnb_error** error);
+bnb_processor_result_t bnb_frame_processor_pop(frame_processor_t* fp, bnb_error** error);
+
+void bnb_effect_player_surface_created(effect_player_holder_t* ep, int32_t width, int32_t height, bnb_error** error);
+void bnb_effect_player_surface_changed(effect_player_holder_t* ep, int32_t width, int32_t height, bnb_error** error);
+void bnb_effect_player_surface_destroyed(effect_player_holder_t* ep, bnb_error** error);
+
+effect_manager_holder_t* bnb_effect_player_get_effect_manager(effect_player_holder_t* ep, bnb_error** error);
+void bnb_effect_manager_set_effect_size(effect_manager_holder_t* em, int32_t width, int32_t height, bnb_error** error);
+effect_holder_t* bnb_effect_manager_load_effect(effect_manager_holder_t* em, const char* name, bnb_error** error);
+effect_holder_t* bnb_effect_manager_get_current_effect(effect_manager_holder_t* em, bnb_error** error);
+void bnb_effect_call_js_method(effect_holder_t* effect, const char* method, const char* param, bnb_error** error);
+// not in every SDK release, the glue calls it only when built with BNB_SDK_HAS_EVAL_JS
+typedef void (*bnb_effect_eval_js_result_cb)(const char* result, void* user_data);
+void bnb_effect_eval_js(effect_holder_t* effect, const char* script, bnb_effect_eval_js_result_cb callback, void* user_data, bnb_error** error);
+
+void bnb_effect_player_playback_pause(effect_player_holder_t* ep, bnb_error** error);
+void bnb_effect_player_playback_play(effect_player_holder_t* ep, bnb_error** error);
+void bnb_effect_player_playback_stop(effect_player_holder_t* ep, bnb_error** error);
+
+full_image_holder_t* bnb_full_image_from_bpc8_img_no_copy(
+    bnb_image_format_t format, bnb_pixel_format_t pixel_format, uint8_t* data, int32_t stride,
+    bnb_image_release_cb release, void* user_data, bnb_error** error);
+full_image_holder_t* bnb_full_image_from_yuv_nv12_img_no_copy_ex(
+    bnb_image_format_t* format, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space,
+    uint8_t* y_plane, int32_t y_stride, uint8_t* uv_plane, int32_t uv_stride,
+    bnb_image_release_cb release, void* user_data, bnb_error** error);
+full_image_holder_t* bnb_full_image_from_yuv_i420_img_no_copy_ex(
+    bnb_image_format_t* format, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space,
+    uint8_t* y_plane, int32_t y_row_stride, int32_t y_pixel_stride,
+    uint8_t* u_plane, int32_t u_row_stride, int32_t u_pixel_stride,
+    uint8_t* v_plane, int32_t v_row_stride, int32_t v_pixel_stride,
+    bnb_image_release_cb release, void* user_data, bnb_error** error);
+void bnb_full_image_release(full_image_holder_t* image, bnb_error** error);
+
+frame_data_t* bnb_frame_data_init(bnb_error** error);
+void bnb_frame_data_release(frame_data_t* fd, bnb_error** error);
+void bnb_frame_data_add_full_img(frame_data_t* fd, full_image_holder_t* image, bnb_error** error);
+
+int64_t bnb_effect_player_draw_with_external_frame_data(effect_player_holder_t* ep, frame_data_t* fd, bnb_error** error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * Knobs of the stub SDK, not a part of the real C API.
+ */
+
+#include "common_types.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Busy time of the face recognition of one frame (the frame processor) and of one draw call */
+void bnb_stub_set_costs(int64_t recognition_us, int64_t draw_us);
+
+/* Busy time of one JS method call or script evaluation by the effect */
+void bnb_stub_set_js_cost(int64_t call_us);
+
+/* JS method calls and script evaluations the effect ran */
+int64_t bnb_stub_js_calls(void);
+
+/* Images created and not released yet, 0 after a run means the glue released every frame */
+int64_t bnb_stub_live_images(void);
+
+typedef enum
+{
+    bnb_stub_image_bpc8,
+    bnb_stub_image_nv12,
+    bnb_stub_image_i420
+} bnb_stub_image_kind_t;
+
+/* The arguments of the last bnb_full_image_from_* call, unused fields are 0 */
+typedef struct
+{
+    bnb_stub_image_kind_t kind;
+    bnb_pixel_format_t pixel_format;
+    bnb_yuv_color_range_t range;
+    bnb_yuv_color_space_t space;
+    const uint8_t* planes[3];
+    int32_t row_strides[3];
+    int32_t pixel_strides[3];
+    bnb_image_format_t format;
+} bnb_stub_image_info_t;
+
+bnb_stub_image_info_t bnb_stub_last_image(void);
+
+#ifdef __cplusplus
+}
+#endif
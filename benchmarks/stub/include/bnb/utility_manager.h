@@ -0,0 +1,22 @@
+#pragma once
+
+/*
+ * Stub of the Banuba SDK C API utility manager. Only for the compile check of the
+ * Objective-C++ sources, see benchmarks/apple.
+ */
+
+#include "common_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct utility_manager_holder utility_manager_holder_t;
+
+/// `paths` is null terminated
+utility_manager_holder_t* bnb_utility_manager_init(const char** paths, const char* client_token, bnb_error** error);
+void bnb_utility_manager_release(utility_manager_holder_t* utility, bnb_error** error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * Stub of the OEP-module effect_player interface. Only for the headless benchmarks.
+ */
+
+#include "pixel_buffer.hpp"
+
+#include <string>
+
+using oep_eval_js_result_cb = std::function<void(std::string result)>;
+
+namespace bnb::oep::interfaces
+{
+    class effect_player;
+}
+
+using effect_player_sptr = std::shared_ptr<bnb::oep::interfaces::effect_player>;
+
+namespace bnb::oep::interfaces
+{
+    class effect_player
+    {
+    public:
+        static effect_player_sptr create(int32_t width, int32_t height);
+
+        virtual ~effect_player() = default;
+
+        virtual void surface_created(int32_t width, int32_t height) = 0;
+        virtual void surface_changed(int32_t width, int32_t height) = 0;
+        virtual void surface_destroyed() = 0;
+        virtual bool load_effect(const std::string& effect) = 0;
+        virtual bool call_js_method(const std::string& method, const std::string& param) = 0;
+        virtual void eval_js(const std::string& script, oep_eval_js_result_cb result_callback) = 0;
+        virtual void pause() = 0;
+        virtual void resume() = 0;
+        virtual void stop() = 0;
+        virtual void push_frame(pixel_buffer_sptr image, bnb::oep::interfaces::rotation image_orientation, bool require_mirroring) = 0;
+        virtual int64_t draw() = 0;
+    };
+} // namespace bnb::oep::interfaces
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+ * Stub of the OEP-module offscreen_effect_player interface. Only for the compile check of the
+ * Objective-C++ sources, see benchmarks/apple.
+ */
+
+#include "effect_player.hpp"
+#include "offscreen_render_target.hpp"
+
+#include <optional>
+#include <string>
+
+namespace bnb::oep::interfaces
+{
+    class image_processing_result;
+    class offscreen_effect_player;
+}
+
+using image_processing_result_sptr = std::shared_ptr<bnb::oep::interfaces::image_processing_result>;
+using offscreen_effect_player_sptr = std::shared_ptr<bnb::oep::interfaces::offscreen_effect_player>;
+
+using oep_image_process_cb = std::function<void(image_processing_result_sptr result)>;
+using oep_image_ready_pb_cb = std::function<void(std::optional<pixel_buffer_sptr> image)>;
+using oep_texture_cb = std::function<void(std::optional<rendered_texture_t> texture_id)>;
+
+namespace bnb::oep::interfaces
+{
+    class image_processing_result
+    {
+    public:
+        virtual ~image_processing_result() = default;
+
+        virtual void get_image(bnb::oep::interfaces::image_format format, oep_image_ready_pb_cb callback) = 0;
+        virtual void get_texture(oep_texture_cb callback) = 0;
+    };
+
+    class offscreen_effect_player
+    {
+    public:
+        static offscreen_effect_player_sptr create(effect_player_sptr ep, offscreen_render_target_sptr ort, int32_t width, int32_t height);
+
+        virtual ~offscreen_effect_player() = default;
+
+        virtual void process_image_async(pixel_buffer_sptr image, bnb::oep::interfaces::rotation input_rotation, bool require_mirroring,
+                                         oep_image_process_cb callback, std::optional<bnb::oep::interfaces::rotation> target_orientation = std::nullopt) = 0;
+        virtual void surface_changed(int32_t width, int32_t height) = 0;
+        virtual void load_effect(const std::string& effect) = 0;
+        virtual void unload_effect() = 0;
+        virtual void pause() = 0;
+        virtual void resume() = 0;
+        virtual void stop() = 0;
+        virtual void call_js_method(const std::string& method, const std::string& param) = 0;
+        virtual void eval_js(const std::string& script, oep_eval_js_result_cb result_callback) = 0;
+    };
+} // namespace bnb::oep::interfaces
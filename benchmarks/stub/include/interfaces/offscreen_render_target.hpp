@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+ * Stub of the OEP-module offscreen_render_target interface. Only for the compile check of the
+ * Objective-C++ sources, see benchmarks/apple.
+ */
+
+#include "pixel_buffer.hpp"
+
+using rendered_texture_t = void*;
+
+namespace bnb::oep::interfaces
+{
+    class offscreen_render_target;
+}
+
+using offscreen_render_target_sptr = std::shared_ptr<bnb::oep::interfaces::offscreen_render_target>;
+
+namespace bnb::oep::interfaces
+{
+    class offscreen_render_target
+    {
+    public:
+        virtual ~offscreen_render_target() = default;
+
+        virtual void init(int32_t width, int32_t height) = 0;
+        virtual void deinit() = 0;
+        virtual void surface_changed(int32_t width, int32_t height) = 0;
+        virtual void activate_context() = 0;
+        virtual void deactivate_context() = 0;
+        virtual void prepare_rendering() = 0;
+        virtual void orient_image(bnb::oep::interfaces::rotation orientation) = 0;
+        virtual pixel_buffer_sptr read_current_buffer(bnb::oep::interfaces::image_format format) = 0;
+        virtual rendered_texture_t get_current_buffer_texture() = 0;
+    };
+} // namespace bnb::oep::interfaces
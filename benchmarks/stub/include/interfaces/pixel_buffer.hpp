@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+ * Stub of the OEP-module pixel_buffer interface, the subset used by oep_framework
+ * and image_utils. Only for the headless benchmarks.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace bnb::oep::interfaces
+{
+    enum class image_format
+    {
+        bpc8_rgb,
+        bpc8_bgr,
+        bpc8_rgba,
+        bpc8_bgra,
+        bpc8_argb,
+        nv12_bt601_full,
+        nv12_bt601_video,
+        nv12_bt709_full,
+        nv12_bt709_video,
+        i420_bt601_full,
+        i420_bt601_video,
+        i420_bt709_full,
+        i420_bt709_video
+    };
+
+    enum class rotation
+    {
+        deg0,
+        deg90,
+        deg180,
+        deg270
+    };
+
+    class pixel_buffer;
+} // namespace bnb::oep::interfaces
+
+using pixel_buffer_sptr = std::shared_ptr<bnb::oep::interfaces::pixel_buffer>;
+using oep_pixel_buffer_destroyed_cb = std::function<void(bnb::oep::interfaces::pixel_buffer*)>;
+
+namespace bnb::oep::interfaces
+{
+    class pixel_buffer
+    {
+    public:
+        using plane_sptr = std::shared_ptr<uint8_t>;
+
+        struct plane_data
+        {
+            plane_sptr data;
+            size_t size;
+            int32_t bytes_per_row;
+        };
+
+        static pixel_buffer_sptr create(const std::vector<plane_data>& planes, image_format fmt, int32_t width, int32_t height, oep_pixel_buffer_destroyed_cb destroyed_cb = nullptr);
+
+        virtual ~pixel_buffer() = default;
+
+        virtual image_format get_image_format() = 0;
+        virtual int32_t get_plane_count() = 0;
+        virtual plane_sptr get_base_sptr() = 0;
+        virtual plane_sptr get_base_sptr_of_plane(int32_t num) = 0;
+        virtual int32_t get_bytes_per_row() = 0;
+        virtual int32_t get_bytes_per_row_of_plane(int32_t num) = 0;
+        virtual int32_t get_width() = 0;
+        virtual int32_t get_height() = 0;
+    };
+} // namespace bnb::oep::interfaces
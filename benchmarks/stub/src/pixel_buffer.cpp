@@ -0,0 +1,90 @@
+#include <interfaces/pixel_buffer.hpp>
+
+#include <memory>
+
+namespace
+{
+    using bnb::oep::interfaces::image_format;
+
+    class pixel_buffer_impl : public bnb::oep::interfaces::pixel_buffer
+    {
+    public:
+        pixel_buffer_impl(const std::vector<plane_data>& planes, image_format fmt, int32_t width, int32_t height, oep_pixel_buffer_destroyed_cb destroyed_cb)
+            : m_plane_count(static_cast<int32_t>(planes.size() < max_planes ? planes.size() : max_planes))
+            , m_format(fmt)
+            , m_width(width)
+            , m_height(height)
+            , m_destroyed_cb(std::move(destroyed_cb))
+        {
+            for (int32_t i = 0; i < m_plane_count; ++i) {
+                m_planes[i] = planes[i];
+            }
+        }
+
+        ~pixel_buffer_impl() override
+        {
+            if (m_destroyed_cb) {
+                m_destroyed_cb(this);
+            }
+        }
+
+        image_format get_image_format() override
+        {
+            return m_format;
+        }
+
+        int32_t get_plane_count() override
+        {
+            return m_plane_count;
+        }
+
+        plane_sptr get_base_sptr() override
+        {
+            return get_base_sptr_of_plane(0);
+        }
+
+        plane_sptr get_base_sptr_of_plane(int32_t num) override
+        {
+            return num < m_plane_count ? m_planes[num].data : nullptr;
+        }
+
+        int32_t get_bytes_per_row() override
+        {
+            return get_bytes_per_row_of_plane(0);
+        }
+
+        int32_t get_bytes_per_row_of_plane(int32_t num) override
+        {
+            return num < m_plane_count ? m_planes[num].bytes_per_row : 0;
+        }
+
+        int32_t get_width() override
+        {
+            return m_width;
+        }
+
+        int32_t get_height() override
+        {
+            return m_height;
+        }
+
+    private:
+        static constexpr size_t max_planes = 3;
+
+        plane_data m_planes[max_planes];
+        int32_t m_plane_count;
+        image_format m_format;
+        int32_t m_width;
+        int32_t m_height;
+        oep_pixel_buffer_destroyed_cb m_destroyed_cb;
+    };
+} // namespace
+
+namespace bnb::oep::interfaces
+{
+    pixel_buffer_sptr pixel_buffer::create(const std::vector<plane_data>& planes, image_format fmt, int32_t width, int32_t height, oep_pixel_buffer_destroyed_cb destroyed_cb)
+    {
+        // one heap allocation per buffer, like the OEP module: the glue does not control this one
+        return std::make_shared<pixel_buffer_impl>(planes, fmt, width, height, std::move(destroyed_cb));
+    }
+} // namespace bnb::oep::interfaces
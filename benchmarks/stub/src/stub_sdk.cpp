@@ -0,0 +1,484 @@
+#include <bnb/effect_player.h>
+#include <bnb/stub_control.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <thread>
+
+/*
+ * Headless stand-in for BNBEffectPlayerC. The realtime frame processor keeps the
+ * real threading model (recognition inside pop in sync mode, on a worker thread in
+ * async mode), recognition and drawing burn the configured CPU time. Frame objects
+ * come from fixed pools, so the stub does not show up in the allocation counts.
+ */
+
+struct full_image_holder
+{
+    std::atomic<int32_t> refs{1};
+    bnb_image_release_cb release{nullptr};
+    void* user_data{nullptr};
+    const uint8_t* probe{nullptr};
+};
+
+struct frame_data
+{
+    std::atomic<int32_t> refs{1};
+    full_image_holder_t* image{nullptr};
+};
+
+struct effect_holder
+{
+};
+
+struct effect_manager_holder
+{
+    effect_holder effect;
+    bool loaded{false};
+};
+
+struct processor_configuration
+{
+};
+
+namespace
+{
+    std::atomic<int64_t> g_recognition_us{5000};
+    std::atomic<int64_t> g_draw_us{3000};
+    std::atomic<int64_t> g_live_images{0};
+    std::atomic<int64_t> g_js_us{50};
+    std::atomic<int64_t> g_js_calls{0};
+
+    std::mutex g_last_image_mutex;
+    bnb_stub_image_info_t g_last_image{};
+
+    void record_image(const bnb_stub_image_info_t& info)
+    {
+        std::lock_guard<std::mutex> lock(g_last_image_mutex);
+        g_last_image = info;
+    }
+
+    /* busy wait, the costs model CPU/GPU work, not idle time */
+    void burn(int64_t us)
+    {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+        while (std::chrono::steady_clock::now() < end) {
+        }
+    }
+
+    template<class T, size_t N>
+    class object_pool
+    {
+    public:
+        object_pool()
+        {
+            for (size_t i = 0; i < N; ++i) {
+                m_free[i] = reinterpret_cast<T*>(&m_storage[i]);
+            }
+            m_free_count = N;
+        }
+
+        T* acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_free_count != 0) {
+                    return new (m_free[--m_free_count]) T;
+                }
+            }
+            return new T;
+        }
+
+        void release(T* object)
+        {
+            object->~T();
+            auto* raw = reinterpret_cast<std::byte*>(object);
+            auto* begin = reinterpret_cast<std::byte*>(&m_storage[0]);
+            if (raw < begin || raw >= begin + sizeof(m_storage)) {
+                ::operator delete(object);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free[m_free_count++] = object;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::array<std::aligned_storage_t<sizeof(T), alignof(T)>, N> m_storage;
+        std::array<T*, N> m_free;
+        size_t m_free_count{0};
+    };
+
+    object_pool<full_image_holder, 64>& image_pool()
+    {
+        static object_pool<full_image_holder, 64> pool;
+        return pool;
+    }
+
+    object_pool<frame_data, 64>& frame_pool()
+    {
+        static object_pool<frame_data, 64> pool;
+        return pool;
+    }
+
+    template<size_t N>
+    class frame_ring
+    {
+    public:
+        bool push(frame_data_t* fd)
+        {
+            if (m_size == N) {
+                return false;
+            }
+            m_items[(m_head + m_size++) % N] = fd;
+            return true;
+        }
+
+        frame_data_t* pop()
+        {
+            if (m_size == 0) {
+                return nullptr;
+            }
+            auto* fd = m_items[m_head];
+            m_head = (m_head + 1) % N;
+            --m_size;
+            return fd;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+    private:
+        std::array<frame_data_t*, N> m_items{};
+        size_t m_head{0};
+        size_t m_size{0};
+    };
+
+    full_image_holder_t* make_image(const uint8_t* probe, bnb_image_release_cb release, void* user_data)
+    {
+        auto* image = image_pool().acquire();
+        image->release = release;
+        image->user_data = user_data;
+        image->probe = probe;
+        ++g_live_images;
+        return image;
+    }
+
+    void recognize(frame_data_t* fd)
+    {
+        // touches the image like a real detector reading the luma would
+        volatile uint8_t sink = fd->image != nullptr && fd->image->probe != nullptr ? fd->image->probe[0] : 0;
+        (void) sink;
+        burn(g_recognition_us.load(std::memory_order_relaxed));
+    }
+} // namespace
+
+struct frame_processor
+{
+    bnb_realtime_processor_mode_t mode;
+    std::mutex mutex;
+    std::condition_variable wake;
+    frame_ring<64> input;
+    frame_ring<64> output;
+    bool stop{false};
+    std::thread worker;
+};
+
+struct effect_player_holder
+{
+    frame_processor_t* fp{nullptr};
+    int64_t frame_number{0};
+    effect_manager_holder em;
+};
+
+extern "C" {
+
+void bnb_stub_set_costs(int64_t recognition_us, int64_t draw_us)
+{
+    g_recognition_us = recognition_us;
+    g_draw_us = draw_us;
+}
+
+int64_t bnb_stub_live_images(void)
+{
+    return g_live_images.load();
+}
+
+void bnb_stub_set_js_cost(int64_t call_us)
+{
+    g_js_us = call_us;
+}
+
+int64_t bnb_stub_js_calls(void)
+{
+    return g_js_calls.load();
+}
+
+bnb_stub_image_info_t bnb_stub_last_image(void)
+{
+    std::lock_guard<std::mutex> lock(g_last_image_mutex);
+    return g_last_image;
+}
+
+const char* bnb_error_get_message(bnb_error*)
+{
+    return "stub error";
+}
+
+void bnb_error_destroy(bnb_error*)
+{
+}
+
+void bnb_effect_player_set_render_backend(bnb_render_backend_t, bnb_error**)
+{
+}
+
+effect_player_holder_t* bnb_effect_player_create(bnb_effect_player_configuration_t*, bnb_error**)
+{
+    return new effect_player_holder;
+}
+
+void bnb_effect_player_destroy(effect_player_holder_t* ep, bnb_error**)
+{
+    delete ep;
+}
+
+processor_configuration_t* bnb_processor_configuration_create(bnb_error**)
+{
+    return new processor_configuration;
+}
+
+void bnb_processor_configuration_destroy(processor_configuration_t* config, bnb_error**)
+{
+    delete config;
+}
+
+void bnb_processor_configuration_set_use_future_filter(processor_configuration_t*, bool, bnb_error**)
+{
+}
+
+frame_processor_t* bnb_frame_processor_create_realtime_processor(bnb_realtime_processor_mode_t mode, processor_configuration_t*, bnb_error**)
+{
+    auto* fp = new frame_processor;
+    fp->mode = mode;
+    if (mode == bnb_realtime_processor_mode_async) {
+        fp->worker = std::thread([fp] {
+            std::unique_lock<std::mutex> lock(fp->mutex);
+            while (true) {
+                fp->wake.wait(lock, [fp] { return fp->stop || !fp->input.empty(); });
+                if (fp->stop) {
+                    return;
+                }
+                auto* fd = fp->input.pop();
+                lock.unlock();
+                recognize(fd);
+                lock.lock();
+                fp->output.push(fd);
+            }
+        });
+    }
+    return fp;
+}
+
+void bnb_frame_processor_destroy(frame_processor_t* fp, bnb_error**)
+{
+    {
+        std::lock_guard<std::mutex> lock(fp->mutex);
+        fp->stop = true;
+    }
+    fp->wake.notify_all();
+    if (fp->worker.joinable()) {
+        fp->worker.join();
+    }
+    while (auto* fd = fp->input.pop()) {
+        bnb_frame_data_release(fd, nullptr);
+    }
+    while (auto* fd = fp->output.pop()) {
+        bnb_frame_data_release(fd, nullptr);
+    }
+    delete fp;
+}
+
+void bnb_effect_player_set_frame_processor(effect_player_holder_t* ep, frame_processor_t* fp, bnb_error**)
+{
+    ep->fp = fp;
+}
+
+void bnb_frame_processor_push(frame_processor_t* fp, frame_data_t* fd, bnb_error**)
+{
+    ++fd->refs;
+    {
+        std::lock_guard<std::mutex> lock(fp->mutex);
+        if (!fp->input.push(fd)) {
+            // the realtime processor drops frames it can not keep up with
+            --fd->refs;
+            return;
+        }
+    }
+    fp->wake.notify_one();
+}
+
+bnb_processor_result_t bnb_frame_processor_pop(frame_processor_t* fp, bnb_error**)
+{
+    frame_data_t* fd = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(fp->mutex);
+        fd = fp->mode == bnb_realtime_processor_mode_async ? fp->output.pop() : fp->input.pop();
+    }
+    if (fd == nullptr) {
+        return {nullptr, bnb_processor_status_empty};
+    }
+    if (fp->mode == bnb_realtime_processor_mode_sync) {
+        recognize(fd);
+    }
+    return {fd, bnb_processor_status_ok};
+}
+
+void bnb_effect_player_surface_created(effect_player_holder_t*, int32_t, int32_t, bnb_error**)
+{
+}
+
+void bnb_effect_player_surface_changed(effect_player_holder_t*, int32_t, int32_t, bnb_error**)
+{
+}
+
+void bnb_effect_player_surface_destroyed(effect_player_holder_t*, bnb_error**)
+{
+}
+
+effect_manager_holder_t* bnb_effect_player_get_effect_manager(effect_player_holder_t* ep, bnb_error**)
+{
+    return &ep->em;
+}
+
+void bnb_effect_manager_set_effect_size(effect_manager_holder_t*, int32_t, int32_t, bnb_error**)
+{
+}
+
+effect_holder_t* bnb_effect_manager_load_effect(effect_manager_holder_t* em, const char* name, bnb_error**)
+{
+    // the parsing of an effect given by its folder reads every file of it, as the SDK does
+    std::error_code error;
+    if (name != nullptr && std::filesystem::is_directory(name, error)) {
+        char buffer[64 * 1024];
+        for (auto it = std::filesystem::recursive_directory_iterator(name, error);
+             !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            std::ifstream file(it->path(), std::ios::binary);
+            while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+            }
+        }
+    }
+    em->loaded = true;
+    return &em->effect;
+}
+
+effect_holder_t* bnb_effect_manager_get_current_effect(effect_manager_holder_t* em, bnb_error**)
+{
+    return em->loaded ? &em->effect : nullptr;
+}
+
+void bnb_effect_call_js_method(effect_holder_t*, const char*, const char*, bnb_error**)
+{
+    g_js_calls.fetch_add(1, std::memory_order_relaxed);
+    burn(g_js_us.load(std::memory_order_relaxed));
+}
+
+void bnb_effect_eval_js(effect_holder_t*, const char* script, bnb_effect_eval_js_result_cb callback, void* user_data, bnb_error**)
+{
+    g_js_calls.fetch_add(1, std::memory_order_relaxed);
+    burn(g_js_us.load(std::memory_order_relaxed));
+    // the result of a script is the script itself
+    if (callback != nullptr) {
+        callback(script, user_data);
+    }
+}
+
+void bnb_effect_player_playback_pause(effect_player_holder_t*, bnb_error**)
+{
+}
+
+void bnb_effect_player_playback_play(effect_player_holder_t*, bnb_error**)
+{
+}
+
+void bnb_effect_player_playback_stop(effect_player_holder_t*, bnb_error**)
+{
+}
+
+full_image_holder_t* bnb_full_image_from_bpc8_img_no_copy(
+    bnb_image_format_t format, bnb_pixel_format_t pixel_format, uint8_t* data, int32_t stride,
+    bnb_image_release_cb release, void* user_data, bnb_error**)
+{
+    record_image({bnb_stub_image_bpc8, pixel_format, bnb_yuv_video_range, bnb_bt601, {data}, {stride}, {}, format});
+    return make_image(data, release, user_data);
+}
+
+full_image_holder_t* bnb_full_image_from_yuv_nv12_img_no_copy_ex(
+    bnb_image_format_t* format, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space,
+    uint8_t* y_plane, int32_t y_stride, uint8_t* uv_plane, int32_t uv_stride,
+    bnb_image_release_cb release, void* user_data, bnb_error**)
+{
+    record_image({bnb_stub_image_nv12, BNB_RGB, range, space, {y_plane, uv_plane}, {y_stride, uv_stride}, {}, *format});
+    return make_image(y_plane, release, user_data);
+}
+
+full_image_holder_t* bnb_full_image_from_yuv_i420_img_no_copy_ex(
+    bnb_image_format_t* format, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space,
+    uint8_t* y_plane, int32_t y_row_stride, int32_t y_pixel_stride,
+    uint8_t* u_plane, int32_t u_row_stride, int32_t u_pixel_stride,
+    uint8_t* v_plane, int32_t v_row_stride, int32_t v_pixel_stride,
+    bnb_image_release_cb release, void* user_data, bnb_error**)
+{
+    record_image({bnb_stub_image_i420, BNB_RGB, range, space, {y_plane, u_plane, v_plane},
+                  {y_row_stride, u_row_stride, v_row_stride}, {y_pixel_stride, u_pixel_stride, v_pixel_stride}, *format});
+    return make_image(y_plane, release, user_data);
+}
+
+void bnb_full_image_release(full_image_holder_t* image, bnb_error**)
+{
+    if (image == nullptr || --image->refs != 0) {
+        return;
+    }
+    if (image->release != nullptr) {
+        image->release(image->user_data);
+    }
+    --g_live_images;
+    image_pool().release(image);
+}
+
+frame_data_t* bnb_frame_data_init(bnb_error**)
+{
+    return frame_pool().acquire();
+}
+
+void bnb_frame_data_release(frame_data_t* fd, bnb_error**)
+{
+    if (fd == nullptr || --fd->refs != 0) {
+        return;
+    }
+    bnb_full_image_release(fd->image, nullptr);
+    frame_pool().release(fd);
+}
+
+void bnb_frame_data_add_full_img(frame_data_t* fd, full_image_holder_t* image, bnb_error**)
+{
+    ++image->refs;
+    bnb_full_image_release(fd->image, nullptr);
+    fd->image = image;
+}
+
+int64_t bnb_effect_player_draw_with_external_frame_data(effect_player_holder_t* ep, frame_data_t*, bnb_error**)
+{
+    burn(g_draw_us.load(std::memory_order_relaxed));
+    return ep->frame_number++;
+}
+
+} // extern "C"
@@ -0,0 +1,93 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include "alloc_counter.hpp"
+
+#include <block_pool.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    using bnb::bench::allocation_count;
+
+    /* a plane of convertImage: the pixels belong to somebody else, the deleter gives them back */
+    std::shared_ptr<uint8_t> make_plane(uint8_t* pixels, int& released)
+    {
+        return std::shared_ptr<uint8_t>(pixels, [&released](uint8_t*) { ++released; }, bnb::pool_allocator<uint8_t>());
+    }
+} // namespace
+
+TEST_CASE("the control blocks of a frame come from the pool after the warm-up")
+{
+    uint8_t pixels[2]{};
+    int released = 0;
+    for (int i = 0; i < 4; ++i) {
+        auto y = make_plane(pixels, released);
+        auto uv = make_plane(pixels + 1, released);
+    }
+
+    const uint64_t before = allocation_count();
+    for (int i = 0; i < 1000; ++i) {
+        auto y = make_plane(pixels, released);
+        auto uv = make_plane(pixels + 1, released);
+        auto copy = y;
+    }
+    CHECK(allocation_count() - before == 0);
+    CHECK(released == 2 * 1004);
+}
+
+TEST_CASE("frames in flight at once are served without the heap once the pool has seen them")
+{
+    constexpr size_t in_flight = 8;
+    uint8_t pixels[in_flight]{};
+    int released = 0;
+    std::vector<std::shared_ptr<uint8_t>> planes;
+    planes.reserve(in_flight);
+    for (size_t i = 0; i < in_flight; ++i) {
+        planes.push_back(make_plane(pixels + i, released));
+    }
+    planes.clear();
+
+    const uint64_t before = allocation_count();
+    for (int frame = 0; frame < 100; ++frame) {
+        for (size_t i = 0; i < in_flight; ++i) {
+            planes.push_back(make_plane(pixels + i, released));
+        }
+        planes.clear();
+    }
+    CHECK(allocation_count() - before == 0);
+}
+
+TEST_CASE("blocks beyond max_free and arrays go to the heap")
+{
+    using pool = bnb::block_pool<48, 8>;
+    constexpr size_t blocks = pool::max_free + 1;
+    std::vector<void*> live;
+    live.reserve(blocks);
+    for (size_t i = 0; i < blocks; ++i) {
+        live.push_back(pool::instance().allocate());
+    }
+    for (void* block : live) {
+        pool::instance().deallocate(block);
+    }
+    live.clear();
+
+    // the pool kept max_free blocks, the last one of a second round is new
+    uint64_t before = allocation_count();
+    for (size_t i = 0; i < blocks; ++i) {
+        live.push_back(pool::instance().allocate());
+    }
+    CHECK(allocation_count() - before == 1);
+    for (void* block : live) {
+        pool::instance().deallocate(block);
+    }
+
+    bnb::pool_allocator<uint64_t> allocator;
+    before = allocation_count();
+    uint64_t* array = allocator.allocate(4);
+    CHECK(allocation_count() - before == 1);
+    allocator.deallocate(array, 4);
+}
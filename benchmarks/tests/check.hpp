@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * A minimal test harness without dependencies, so the tests build wherever the benchmarks do.
+ * TEST_CASE registers a function, CHECK records a failure and goes on, REQUIRE ends the test.
+ * The file defining BNB_TEST_MAIN gets a main() that runs every case and returns the failures.
+ */
+
+namespace bnb::test
+{
+    struct test_case
+    {
+        const char* name;
+        std::function<void()> body;
+    };
+
+    struct require_failed
+    {
+    };
+
+    inline std::vector<test_case>& registry()
+    {
+        static std::vector<test_case> cases;
+        return cases;
+    }
+
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    inline bool report(bool ok, const char* expression, const char* file, int line)
+    {
+        if (!ok) {
+            ++failures();
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        }
+        return ok;
+    }
+
+    struct registrar
+    {
+        registrar(const char* name, std::function<void()> body)
+        {
+            registry().push_back({name, std::move(body)});
+        }
+    };
+
+    inline int run_all()
+    {
+        for (const auto& c : registry()) {
+            const int before = failures();
+            try {
+                c.body();
+            } catch (const require_failed&) {
+            } catch (const std::exception& e) {
+                ++failures();
+                std::fprintf(stderr, "%s: exception: %s\n", c.name, e.what());
+            }
+            std::printf("%s %s\n", failures() == before ? "[ OK ]" : "[FAIL]", c.name);
+        }
+        return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+} // namespace bnb::test
+
+#define BNB_TEST_CONCAT2(a, b) a##b
+#define BNB_TEST_CONCAT(a, b) BNB_TEST_CONCAT2(a, b)
+
+#define TEST_CASE(name)                                                                              \
+    static void BNB_TEST_CONCAT(test_fn_, __LINE__)();                                               \
+    static const bnb::test::registrar BNB_TEST_CONCAT(test_reg_, __LINE__)(name, &BNB_TEST_CONCAT(test_fn_, __LINE__)); \
+    static void BNB_TEST_CONCAT(test_fn_, __LINE__)()
+
+#define CHECK(expression) bnb::test::report(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#define REQUIRE(expression)                                                        \
+    do {                                                                           \
+        if (!bnb::test::report(static_cast<bool>(expression), #expression, __FILE__, __LINE__)) { \
+            throw bnb::test::require_failed{};                                     \
+        }                                                                          \
+    } while (false)
+
+#ifdef BNB_TEST_MAIN
+int main()
+{
+    return bnb::test::run_all();
+}
+#endif
@@ -0,0 +1,361 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include <color_conversion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/*
+ * Every SIMD backend the CPU supports against the scalar one, on the widths around the vector
+ * sizes and odd heights: the results must be bit-exact (see yuv_coefficients) and the kernels
+ * must not write past the row ends, the padding of every row is checked.
+ * The scalar results are checked against the published BT.601/BT.709 equations in floating point.
+ */
+
+namespace
+{
+    using namespace bnb::image;
+
+    constexpr int32_t widths[] = {1, 2, 3, 7, 15, 16, 17, 31, 32, 33, 63, 65};
+    constexpr int32_t heights[] = {1, 2, 3, 5, 17};
+    constexpr int32_t padding = 32;
+    constexpr uint8_t guard = 0xa5;
+
+    const yuv_format formats[] = {
+        {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::video},
+        {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::full},
+        {yuv_layout::i420, yuv_matrix::bt601, yuv_range::full},
+        {yuv_layout::i420, yuv_matrix::bt709, yuv_range::video},
+    };
+
+    const char* name(simd_backend backend)
+    {
+        switch (backend) {
+            case simd_backend::best: return "best";
+            case simd_backend::scalar: return "scalar";
+            case simd_backend::sse41: return "sse41";
+            case simd_backend::avx2: return "avx2";
+            case simd_backend::neon: return "neon";
+        }
+        return "";
+    }
+
+    std::vector<simd_backend> simd_backends()
+    {
+        std::vector<simd_backend> supported;
+        for (auto backend : {simd_backend::sse41, simd_backend::avx2, simd_backend::neon}) {
+            if (set_simd_backend(backend)) {
+                supported.push_back(backend);
+            }
+        }
+        set_simd_backend(simd_backend::scalar);
+        return supported;
+    }
+
+    /* the planes of a width x height image, every row followed by `padding` guard bytes */
+    struct yuv_image
+    {
+        yuv_image(int32_t width, int32_t height, yuv_layout layout)
+        {
+            const int32_t cw = (width + 1) / 2;
+            const int32_t ch = (height + 1) / 2;
+            planes.y_stride = width + padding;
+            planes.u_stride = (layout == yuv_layout::nv12 ? 2 * cw : cw) + padding;
+            planes.v_stride = layout == yuv_layout::nv12 ? 0 : cw + padding;
+            y.assign(static_cast<size_t>(planes.y_stride) * height, guard);
+            u.assign(static_cast<size_t>(planes.u_stride) * ch, guard);
+            v.assign(static_cast<size_t>(planes.v_stride) * ch, guard);
+            planes.y = y.data();
+            planes.u = u.data();
+            planes.v = layout == yuv_layout::nv12 ? nullptr : v.data();
+        }
+
+        std::vector<uint8_t> y, u, v;
+        yuv_planes planes;
+    };
+
+    bool guards_intact(const std::vector<uint8_t>& plane, int32_t stride, int32_t row_bytes)
+    {
+        for (size_t row = 0; stride != 0 && row < plane.size() / stride; ++row) {
+            for (int32_t i = row_bytes; i < stride; ++i) {
+                if (plane[row * stride + i] != guard) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> random_bytes(size_t size, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<uint8_t> bytes(size);
+        for (auto& b : bytes) {
+            b = static_cast<uint8_t>(random());
+        }
+        return bytes;
+    }
+
+    /* The published equations with their published constants, in floating point */
+    struct reference_matrix
+    {
+        double yr, yg, yb;
+        double ur, ug, ub;
+        double vr, vg, vb;
+        double rv, gu, gv, bu;
+    };
+
+    const reference_matrix& reference(yuv_matrix matrix)
+    {
+        static const reference_matrix bt601{0.299, 0.587, 0.114, -0.168736, -0.331264, 0.5, 0.5, -0.418688, -0.081312,
+                                            1.402, -0.344136, -0.714136, 1.772};
+        static const reference_matrix bt709{0.2126, 0.7152, 0.0722, -0.114572, -0.385428, 0.5, 0.5, -0.454153, -0.045847,
+                                            1.5748, -0.187324, -0.468124, 1.8556};
+        return matrix == yuv_matrix::bt601 ? bt601 : bt709;
+    }
+
+    int reference_u8(double v)
+    {
+        return static_cast<int>(std::lround(std::clamp(v, 0.0, 255.0)));
+    }
+
+    /* Y, U, V of a full range R, G, B */
+    std::array<int, 3> reference_yuv(const yuv_format& format, int r, int g, int b)
+    {
+        const auto& m = reference(format.matrix);
+        const bool video = format.range == yuv_range::video;
+        const double ys = video ? 219.0 / 255.0 : 1.0;
+        const double cs = video ? 224.0 / 255.0 : 1.0;
+        return {reference_u8((video ? 16 : 0) + ys * (m.yr * r + m.yg * g + m.yb * b)),
+                reference_u8(128 + cs * (m.ur * r + m.ug * g + m.ub * b)),
+                reference_u8(128 + cs * (m.vr * r + m.vg * g + m.vb * b))};
+    }
+
+    /* R, G, B of a Y, U, V sample */
+    std::array<int, 3> reference_rgb(const yuv_format& format, int y, int u, int v)
+    {
+        const auto& m = reference(format.matrix);
+        const bool video = format.range == yuv_range::video;
+        const double yy = video ? (y - 16) * 255.0 / 219.0 : y;
+        const double uu = (u - 128) * (video ? 255.0 / 224.0 : 1.0);
+        const double vv = (v - 128) * (video ? 255.0 / 224.0 : 1.0);
+        return {reference_u8(yy + m.rv * vv), reference_u8(yy + m.gu * uu + m.gv * vv), reference_u8(yy + m.bu * uu)};
+    }
+
+    bool within_one(int actual, int expected)
+    {
+        return std::abs(actual - expected) <= 1;
+    }
+
+    const yuv_format all_formats[] = {
+        {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::video},
+        {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::full},
+        {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::video},
+        {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::full},
+        {yuv_layout::i420, yuv_matrix::bt601, yuv_range::video},
+        {yuv_layout::i420, yuv_matrix::bt601, yuv_range::full},
+        {yuv_layout::i420, yuv_matrix::bt709, yuv_range::video},
+        {yuv_layout::i420, yuv_matrix::bt709, yuv_range::full},
+    };
+
+    void report(simd_backend backend, const char* what, int32_t width, int32_t height, const yuv_format& format)
+    {
+        std::fprintf(stderr, "  %s %s %dx%d layout %d matrix %d range %d\n", name(backend), what, width, height,
+                     static_cast<int>(format.layout), static_cast<int>(format.matrix), static_cast<int>(format.range));
+    }
+} // namespace
+
+TEST_CASE("rgb_to_yuv of every SIMD backend is bit-exact with the scalar one")
+{
+    for (auto backend : simd_backends()) {
+        for (int32_t width : widths) {
+            for (int32_t height : heights) {
+                const int32_t stride = width * 4 + padding;
+                const auto rgb = random_bytes(static_cast<size_t>(stride) * height, static_cast<uint32_t>(width * 131 + height));
+                for (const auto& format : formats) {
+                    for (auto layout : {rgb_layout::rgba, rgb_layout::bgra}) {
+                        yuv_image expected(width, height, format.layout);
+                        yuv_image actual(width, height, format.layout);
+                        set_simd_backend(simd_backend::scalar);
+                        rgb_to_yuv(rgb.data(), stride, layout, width, height, expected.planes, format);
+                        set_simd_backend(backend);
+                        rgb_to_yuv(rgb.data(), stride, layout, width, height, actual.planes, format);
+
+                        const int32_t chroma_row = format.layout == yuv_layout::nv12 ? 2 * ((width + 1) / 2) : (width + 1) / 2;
+                        const bool same = CHECK(actual.y == expected.y) & CHECK(actual.u == expected.u) & CHECK(actual.v == expected.v)
+                                          & CHECK(guards_intact(actual.y, actual.planes.y_stride, width))
+                                          & CHECK(guards_intact(actual.u, actual.planes.u_stride, chroma_row))
+                                          & CHECK(guards_intact(actual.v, actual.planes.v_stride, (width + 1) / 2));
+                        if (!same) {
+                            report(backend, "rgb_to_yuv", width, height, format);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    set_simd_backend(simd_backend::best);
+}
+
+TEST_CASE("yuv_to_rgb of every SIMD backend is bit-exact with the scalar one")
+{
+    for (auto backend : simd_backends()) {
+        for (int32_t width : widths) {
+            for (int32_t height : heights) {
+                for (const auto& format : formats) {
+                    yuv_image src(width, height, format.layout);
+                    const auto y = random_bytes(src.y.size(), static_cast<uint32_t>(width * 7 + height));
+                    const auto u = random_bytes(src.u.size(), static_cast<uint32_t>(width * 11 + height));
+                    const auto v = random_bytes(src.v.size(), static_cast<uint32_t>(width * 13 + height));
+                    src.y.assign(y.begin(), y.end());
+                    src.u.assign(u.begin(), u.end());
+                    src.v.assign(v.begin(), v.end());
+                    src.planes.y = src.y.data();
+                    src.planes.u = src.u.data();
+                    src.planes.v = format.layout == yuv_layout::nv12 ? nullptr : src.v.data();
+
+                    for (auto layout : {rgb_layout::rgba, rgb_layout::bgra}) {
+                        const int32_t stride = width * 4 + padding;
+                        std::vector<uint8_t> expected(static_cast<size_t>(stride) * height, guard);
+                        std::vector<uint8_t> actual(expected);
+                        set_simd_backend(simd_backend::scalar);
+                        yuv_to_rgb(src.planes, format, width, height, expected.data(), stride, layout);
+                        set_simd_backend(backend);
+                        yuv_to_rgb(src.planes, format, width, height, actual.data(), stride, layout);
+
+                        if (!(CHECK(actual == expected) & CHECK(guards_intact(actual, stride, width * 4)))) {
+                            report(backend, "yuv_to_rgb", width, height, format);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    set_simd_backend(simd_backend::best);
+}
+
+TEST_CASE("the scalar converter keeps grey and round-trips within the quantization")
+{
+    // independent of the backends: grey has no chroma, a video range grey of 128 is Y = 126
+    set_simd_backend(simd_backend::scalar);
+    for (int32_t width : {1, 17}) {
+        const int32_t height = 3;
+        std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 4, 128);
+        for (const auto& format : formats) {
+            yuv_image yuv(width, height, format.layout);
+            rgb_to_yuv(rgb.data(), width * 4, rgb_layout::rgba, width, height, yuv.planes, format);
+            const int expected_y = format.range == yuv_range::full ? 128 : 126;
+            CHECK(yuv.y[0] == expected_y);
+            CHECK(yuv.u[0] == 128);
+
+            std::vector<uint8_t> back(rgb.size());
+            yuv_to_rgb(yuv.planes, format, width, height, back.data(), width * 4, rgb_layout::rgba);
+            for (size_t i = 0; i < back.size(); ++i) {
+                const int expected = i % 4 == 3 ? 255 : 128;
+                REQUIRE(back[i] >= expected - 1 && back[i] <= expected + 1);
+            }
+        }
+    }
+    set_simd_backend(simd_backend::best);
+}
+
+TEST_CASE("rgb_to_yuv of every backend is within 1 of the floating point BT.601/BT.709 equations")
+{
+    // 2x2 blocks of one colour, the chroma subsampling does not blur them
+    constexpr int32_t width = 34;
+    constexpr int32_t height = 6;
+    const auto colours = random_bytes(static_cast<size_t>(width / 2) * (height / 2) * 3, 601);
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 4);
+    for (int32_t row = 0; row < height; ++row) {
+        for (int32_t x = 0; x < width; ++x) {
+            const uint8_t* colour = &colours[static_cast<size_t>((row / 2) * (width / 2) + x / 2) * 3];
+            uint8_t* px = &rgb[static_cast<size_t>(row * width + x) * 4];
+            px[0] = colour[0];
+            px[1] = colour[1];
+            px[2] = colour[2];
+            px[3] = 255;
+        }
+    }
+
+    auto backends = simd_backends();
+    backends.insert(backends.begin(), simd_backend::scalar);
+    for (auto backend : backends) {
+        set_simd_backend(backend);
+        for (const auto& format : all_formats) {
+            yuv_image yuv(width, height, format.layout);
+            rgb_to_yuv(rgb.data(), width * 4, rgb_layout::rgba, width, height, yuv.planes, format);
+
+            bool close = true;
+            for (int32_t row = 0; row < height; ++row) {
+                for (int32_t x = 0; x < width; ++x) {
+                    const uint8_t* px = &rgb[static_cast<size_t>(row * width + x) * 4];
+                    const auto expected = reference_yuv(format, px[0], px[1], px[2]);
+                    const size_t c = static_cast<size_t>(row / 2);
+                    const size_t i = static_cast<size_t>(x / 2);
+                    const bool nv12 = format.layout == yuv_layout::nv12;
+                    const int u = nv12 ? yuv.u[c * yuv.planes.u_stride + 2 * i] : yuv.u[c * yuv.planes.u_stride + i];
+                    const int v = nv12 ? yuv.u[c * yuv.planes.u_stride + 2 * i + 1] : yuv.v[c * yuv.planes.v_stride + i];
+                    close = close && within_one(yuv.y[static_cast<size_t>(row) * yuv.planes.y_stride + x], expected[0])
+                            && within_one(u, expected[1]) && within_one(v, expected[2]);
+                }
+            }
+            if (!CHECK(close)) {
+                report(backend, "rgb_to_yuv reference", width, height, format);
+            }
+        }
+    }
+    set_simd_backend(simd_backend::best);
+}
+
+TEST_CASE("yuv_to_rgb of every backend is within 1 of the floating point BT.601/BT.709 equations")
+{
+    constexpr int32_t width = 37;
+    constexpr int32_t height = 5;
+    auto backends = simd_backends();
+    backends.insert(backends.begin(), simd_backend::scalar);
+    for (auto backend : backends) {
+        set_simd_backend(backend);
+        for (const auto& format : all_formats) {
+            yuv_image src(width, height, format.layout);
+            const auto y = random_bytes(src.y.size(), 709);
+            const auto u = random_bytes(src.u.size(), 710);
+            const auto v = random_bytes(src.v.size(), 711);
+            std::copy(y.begin(), y.end(), src.y.begin());
+            std::copy(u.begin(), u.end(), src.u.begin());
+            std::copy(v.begin(), v.end(), src.v.begin());
+
+            for (auto layout : {rgb_layout::rgba, rgb_layout::bgra}) {
+                std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 4);
+                yuv_to_rgb(src.planes, format, width, height, rgb.data(), width * 4, layout);
+
+                const size_t ro = layout == rgb_layout::rgba ? 0 : 2;
+                const size_t bo = layout == rgb_layout::rgba ? 2 : 0;
+                bool close = true;
+                for (int32_t row = 0; row < height; ++row) {
+                    for (int32_t x = 0; x < width; ++x) {
+                        const size_t c = static_cast<size_t>(row / 2);
+                        const size_t i = static_cast<size_t>(x / 2);
+                        const bool nv12 = format.layout == yuv_layout::nv12;
+                        const int uu = nv12 ? src.u[c * src.planes.u_stride + 2 * i] : src.u[c * src.planes.u_stride + i];
+                        const int vv = nv12 ? src.u[c * src.planes.u_stride + 2 * i + 1] : src.v[c * src.planes.v_stride + i];
+                        const auto expected = reference_rgb(format, src.y[static_cast<size_t>(row) * src.planes.y_stride + x], uu, vv);
+                        const uint8_t* px = &rgb[static_cast<size_t>(row * width + x) * 4];
+                        close = close && within_one(px[ro], expected[0]) && within_one(px[1], expected[1])
+                                && within_one(px[bo], expected[2]) && px[3] == 255;
+                    }
+                }
+                if (!CHECK(close)) {
+                    report(backend, "yuv_to_rgb reference", width, height, format);
+                }
+            }
+        }
+    }
+    set_simd_backend(simd_backend::best);
+}
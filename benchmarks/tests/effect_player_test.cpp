@@ -0,0 +1,266 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include "alloc_counter.hpp"
+
+#include <effect_player.hpp>
+#include <bnb/stub_control.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using bnb::bench::allocation_count;
+    using bnb::oep::effect_player;
+    using bnb::oep::processing_mode;
+    using bnb::oep::interfaces::image_format;
+    using bnb::oep::interfaces::pixel_buffer;
+    using bnb::oep::interfaces::rotation;
+
+    constexpr int32_t width = 64;
+    constexpr int32_t height = 48;
+
+    /* an NV12 frame with its own planes */
+    std::shared_ptr<pixel_buffer> make_frame()
+    {
+        auto y = std::shared_ptr<uint8_t>(new uint8_t[width * height](), std::default_delete<uint8_t[]>());
+        auto uv = std::shared_ptr<uint8_t>(new uint8_t[width * height / 2](), std::default_delete<uint8_t[]>());
+        std::vector<pixel_buffer::plane_data> planes{
+            {y, static_cast<size_t>(width * height), width},
+            {uv, static_cast<size_t>(width * height / 2), width}};
+        return pixel_buffer::create(planes, image_format::nv12_bt601_full, width, height, nullptr);
+    }
+
+    /* NV12 planes shared by the frames of a test, the pixels are not looked at */
+    std::vector<pixel_buffer::plane_data> make_planes()
+    {
+        auto y = std::shared_ptr<uint8_t>(new uint8_t[width * height](), std::default_delete<uint8_t[]>());
+        auto uv = std::shared_ptr<uint8_t>(new uint8_t[width * height / 2](), std::default_delete<uint8_t[]>());
+        return {{y, static_cast<size_t>(width * height), width}, {uv, static_cast<size_t>(width * height / 2), width}};
+    }
+
+    /* draws until a frame comes out, the recognition runs on the processor thread */
+    bnb::oep::draw_frame_result draw_next(effect_player& ep)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        auto result = ep.draw_frame();
+        while (!result.drawn() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            result = ep.draw_frame();
+        }
+        return result;
+    }
+
+    /* 2x2 integer matrices of the quarter turns and the horizontal mirror */
+    using transform = std::array<int, 4>;
+
+    transform multiply(const transform& a, const transform& b)
+    {
+        return {a[0] * b[0] + a[1] * b[2], a[0] * b[1] + a[1] * b[3], a[2] * b[0] + a[3] * b[2], a[2] * b[1] + a[3] * b[3]};
+    }
+
+    transform quarter_turns(int count)
+    {
+        transform t{1, 0, 0, 1};
+        for (int i = 0; i < count % 4; ++i) {
+            t = multiply({0, -1, 1, 0}, t);
+        }
+        return t;
+    }
+
+    const transform mirror{-1, 0, 0, 1};
+
+    struct stub_costs
+    {
+        stub_costs(int64_t recognition_us, int64_t draw_us)
+        {
+            bnb_stub_set_costs(recognition_us, draw_us);
+        }
+
+        ~stub_costs()
+        {
+            bnb_stub_set_costs(5000, 3000);
+        }
+    };
+} // namespace
+
+TEST_CASE("sync frames are drawn with the identity of their push")
+{
+    stub_costs costs(0, 0);
+    effect_player ep(width, height);
+    const auto pushed = ep.push_frame(make_frame(), rotation::deg0, false, 1234);
+    const auto result = ep.draw_frame();
+    REQUIRE(result.drawn());
+    CHECK(result.frame.id == pushed.id);
+    CHECK(result.frame.timestamp == 1234);
+    CHECK(ep.frames_in_flight() == 0);
+    CHECK(!ep.draw_frame().drawn());
+}
+
+TEST_CASE("async frames are drawn in push order with their identities")
+{
+    stub_costs costs(1000, 0);
+    effect_player ep(width, height, processing_mode::async, 3);
+    std::vector<bnb::oep::frame_identity> pushed;
+    for (int64_t ts = 0; ts < 3; ++ts) {
+        pushed.push_back(ep.push_frame(make_frame(), rotation::deg0, false, ts));
+    }
+    for (const auto& frame : pushed) {
+        const auto result = draw_next(ep);
+        REQUIRE(result.drawn());
+        CHECK(result.frame.id == frame.id);
+        CHECK(result.frame.timestamp == frame.timestamp);
+    }
+    CHECK(ep.frames_in_flight() == 0);
+}
+
+TEST_CASE("a full pipeline waits at most max_draw_wait for its oldest frame")
+{
+    // the recognition outlasts the wait by far
+    stub_costs costs(300000, 0);
+    effect_player ep(width, height, processing_mode::async, 1);
+    ep.set_max_draw_wait(std::chrono::milliseconds(10));
+    const auto pushed = ep.push_frame(make_frame(), rotation::deg0, false, 7);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto timed_out = ep.draw_frame();
+    const auto waited = std::chrono::steady_clock::now() - start;
+    CHECK(!timed_out.drawn());
+    CHECK(waited >= std::chrono::milliseconds(10));
+    CHECK(waited < std::chrono::milliseconds(200));
+    CHECK(ep.frames_in_flight() == 1);
+
+    ep.set_max_draw_wait(std::chrono::seconds(5));
+    const auto result = ep.draw_frame();
+    REQUIRE(result.drawn());
+    CHECK(result.frame.id == pushed.id);
+}
+
+TEST_CASE("a waiting draw wakes up when the recognition thread finishes the frame")
+{
+    stub_costs costs(20000, 0);
+    effect_player ep(width, height, processing_mode::async, 1);
+    ep.set_max_draw_wait(std::chrono::seconds(5));
+    const auto pushed = ep.push_frame(make_frame(), rotation::deg0, false, 3);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto result = ep.draw_frame();
+    const auto waited = std::chrono::steady_clock::now() - start;
+    REQUIRE(result.drawn());
+    CHECK(result.frame.id == pushed.id);
+    // the recognition takes 20 ms, the deadline is far
+    CHECK(waited < std::chrono::seconds(1));
+}
+
+TEST_CASE("eval_js results arrive at the frame boundary in call order")
+{
+    stub_costs costs(0, 0);
+    effect_player ep(width, height);
+    REQUIRE(ep.load_effect("effects/test"));
+    std::vector<std::string> results;
+    for (int i = 0; i < 3; ++i) {
+        ep.call_js_method("setValue", std::to_string(i));
+        ep.eval_js(std::to_string(i), [&results](std::string result) { results.push_back(std::move(result)); });
+    }
+    CHECK(results.empty());
+
+    ep.push_frame(make_frame(), rotation::deg0, false, 0);
+    REQUIRE(ep.draw_frame().drawn());
+    // the stub returns the script as the result
+    REQUIRE(results.size() == 3);
+    for (int i = 0; i < 3; ++i) {
+        CHECK(results[static_cast<size_t>(i)] == std::to_string(i));
+    }
+}
+
+TEST_CASE("push_frame and draw_frame do not allocate per frame after the warm-up")
+{
+    // allocations of the SDK are out of scope: the stub takes its images and frame data from fixed pools
+    stub_costs costs(0, 0);
+    constexpr int warmup = 8;
+    constexpr int frames = 200;
+    const auto planes = make_planes();
+    for (auto mode : {processing_mode::sync, processing_mode::async}) {
+        effect_player ep(width, height, mode, 2);
+        for (int i = 0; i < warmup; ++i) {
+            ep.push_frame(pixel_buffer::create(planes, image_format::nv12_bt601_full, width, height, nullptr), rotation::deg0, false, i);
+            REQUIRE(draw_next(ep).drawn());
+        }
+
+        // the buffers are created by the OEP module, outside of the counted glue code
+        std::vector<std::shared_ptr<pixel_buffer>> images;
+        images.reserve(frames);
+        for (int i = 0; i < frames; ++i) {
+            images.push_back(pixel_buffer::create(planes, image_format::nv12_bt601_full, width, height, nullptr));
+        }
+
+        int drawn = 0;
+        const uint64_t before = allocation_count();
+        for (auto& image : images) {
+            ep.push_frame(image, rotation::deg90, true, 0);
+            image.reset();
+            drawn += draw_next(ep).drawn() ? 1 : 0;
+        }
+        CHECK(allocation_count() - before == 0);
+        CHECK(drawn == frames);
+        CHECK(bnb_stub_live_images() == 0);
+    }
+}
+
+TEST_CASE("the only allocation of a pushed and drawn frame is the module's pixel_buffer::create")
+{
+    stub_costs costs(0, 0);
+    constexpr int frames = 200;
+    const auto planes = make_planes();
+    effect_player ep(width, height);
+    for (int i = 0; i < 8; ++i) {
+        ep.push_frame(pixel_buffer::create(planes, image_format::nv12_bt601_full, width, height, nullptr), rotation::deg0, false, i);
+        REQUIRE(ep.draw_frame().drawn());
+    }
+
+    const uint64_t before = allocation_count();
+    for (int i = 0; i < frames; ++i) {
+        ep.push_frame(pixel_buffer::create(planes, image_format::nv12_bt601_full, width, height, nullptr), rotation::deg0, false, i);
+        CHECK(ep.draw_frame().drawn());
+    }
+    // one make_shared per buffer, see stub/src/pixel_buffer.cpp
+    CHECK(allocation_count() - before == frames);
+}
+
+TEST_CASE("the output rotation is folded into the image format for every rotation and mirroring")
+{
+    stub_costs costs(0, 0);
+    effect_player ep(width, height);
+    for (int output = 0; output < 4; ++output) {
+        ep.set_output_rotation(static_cast<rotation>(output));
+        for (int camera = 0; camera < 4; ++camera) {
+            for (bool mirrored : {false, true}) {
+                ep.push_frame(make_frame(), static_cast<rotation>(camera), mirrored, 0);
+                REQUIRE(ep.draw_frame().drawn());
+                const auto format = bnb_stub_last_image().format;
+
+                // the SDK rotates by the orientation, then mirrors; the output rotation comes after both
+                const transform camera_only = mirrored ? multiply(mirror, quarter_turns(camera)) : quarter_turns(camera);
+                const transform wanted = multiply(quarter_turns(output), camera_only);
+                const int orientation = static_cast<int>(format.orientation);
+                const transform sent = mirrored ? multiply(mirror, quarter_turns(orientation)) : quarter_turns(orientation);
+                const int added = (orientation - camera + 4) % 4;
+
+                const bool ok = CHECK(sent == wanted) & CHECK(format.require_mirroring == mirrored)
+                                & CHECK(format.face_orientation == added * 90)
+                                & CHECK(format.width == static_cast<uint32_t>(width)) & CHECK(format.height == static_cast<uint32_t>(height));
+                if (!ok) {
+                    std::fprintf(stderr, "  output %d camera %d mirrored %d: orientation %d face %d\n", output * 90, camera * 90,
+                                 mirrored ? 1 : 0, orientation * 90, format.face_orientation);
+                }
+            }
+        }
+    }
+}
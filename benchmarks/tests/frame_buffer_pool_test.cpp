@@ -0,0 +1,166 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include <frame_buffer_pool.h>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+    /* hands out distinct addresses and counts the live buffers */
+    class counting_allocator : public bnb::frame_buffer_allocator
+    {
+    public:
+        void* allocate(const bnb::frame_buffer_desc&) override
+        {
+            ++allocated;
+            ++live;
+            return new char;
+        }
+
+        void deallocate(void* buffer) override
+        {
+            --live;
+            delete static_cast<char*>(buffer);
+        }
+
+        int allocated{0};
+        int live{0};
+    };
+
+    /* a buffer lives until the pool and every lease have dropped their reference, like a CVPixelBuffer */
+    class ref_counting_allocator : public bnb::frame_buffer_allocator
+    {
+    public:
+        void* allocate(const bnb::frame_buffer_desc&) override
+        {
+            ++live;
+            return new int(1); // the pool's reference
+        }
+
+        void deallocate(void* buffer) override
+        {
+            unref(buffer);
+        }
+
+        bool reference_counted() const override
+        {
+            return true;
+        }
+
+        void retain(void* buffer)
+        {
+            ++*static_cast<int*>(buffer);
+        }
+
+        void unref(void* buffer)
+        {
+            auto* refs = static_cast<int*>(buffer);
+            if (--*refs == 0) {
+                --live;
+                delete refs;
+            }
+        }
+
+        int live{0};
+    };
+
+    const bnb::frame_buffer_desc hd{1280, 720, 1, 0};
+    const bnb::frame_buffer_desc fhd{1920, 1080, 1, 0};
+} // namespace
+
+TEST_CASE("a leased buffer is not handed out again before its release")
+{
+    auto allocator = std::make_shared<counting_allocator>();
+    bnb::frame_buffer_pool pool(allocator, 4);
+    void* first = pool.acquire(hd);
+    void* second = pool.acquire(hd);
+    CHECK(first != second);
+    CHECK(allocator->allocated == 2);
+
+    pool.release(first, hd);
+    CHECK(pool.acquire(hd) == first);
+    CHECK(allocator->allocated == 2);
+    CHECK(pool.stats().hits == 1);
+    CHECK(pool.stats().leased == 2);
+}
+
+TEST_CASE("buffers are reused for the same desc only")
+{
+    auto allocator = std::make_shared<counting_allocator>();
+    bnb::frame_buffer_pool pool(allocator, 4);
+    void* small = pool.acquire(hd);
+    pool.release(small, hd);
+    void* large = pool.acquire(fhd);
+    CHECK(large != small);
+    pool.release(large, fhd);
+    CHECK(pool.acquire(hd) == small);
+    CHECK(pool.acquire(fhd) == large);
+    CHECK(allocator->allocated == 2);
+}
+
+TEST_CASE("the high-water mark evicts the least recently released buffers")
+{
+    auto allocator = std::make_shared<counting_allocator>();
+    bnb::frame_buffer_pool pool(allocator, 2);
+    void* a = pool.acquire(hd);
+    void* b = pool.acquire(hd);
+    pool.release(a, hd);
+    pool.release(b, hd);
+    // a new size makes room by destroying the free buffer released first
+    void* c = pool.acquire(fhd);
+    CHECK(allocator->live == 2);
+    CHECK(pool.acquire(hd) == b);
+    // over the mark, the released buffer is destroyed
+    void* d = pool.acquire(hd);
+    pool.release(d, hd);
+    CHECK(allocator->live == 2);
+    CHECK(pool.stats().evictions == 2);
+    pool.release(c, fhd);
+}
+
+TEST_CASE("a lease held by a shared pointer ends when the last copy is dropped")
+{
+    auto allocator = std::make_shared<counting_allocator>();
+    auto pool = std::make_shared<bnb::frame_buffer_pool>(allocator, 2);
+    void* raw = pool->acquire(hd);
+    std::shared_ptr<void> lease(raw, [pool](void* p) { pool->release(p, hd); });
+    auto consumer = lease;
+    lease.reset();
+    CHECK(pool->acquire(hd) != raw);
+    consumer.reset();
+    CHECK(pool->acquire(hd) == raw);
+}
+
+TEST_CASE("the pool destroys the free buffers and the returned leases")
+{
+    auto allocator = std::make_shared<counting_allocator>();
+    {
+        bnb::frame_buffer_pool pool(allocator, 4);
+        pool.release(pool.acquire(hd), hd);
+        auto* leased = pool.acquire(fhd);
+        CHECK(allocator->live == 2);
+        pool.release(leased, fhd);
+    }
+    CHECK(allocator->live == 0);
+}
+
+TEST_CASE("a reference counted lease outlives the pool")
+{
+    auto allocator = std::make_shared<ref_counting_allocator>();
+    void* leased = nullptr;
+    {
+        bnb::frame_buffer_pool pool(allocator, 4);
+        // the user retains the buffer for as long as it is in use, see createPixelBuffer
+        leased = pool.acquire(hd);
+        allocator->retain(leased);
+        pool.release(pool.acquire(fhd), fhd);
+        CHECK(allocator->live == 2);
+    }
+    // the pool dropped its reference only, the buffer is still valid for the lease
+    CHECK(allocator->live == 1);
+    CHECK(*static_cast<int*>(leased) == 1);
+    allocator->unref(leased);
+    CHECK(allocator->live == 0);
+}
@@ -0,0 +1,131 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include <effect_player.hpp>
+#include <image_format_traits.hpp>
+#include <bnb/stub_control.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    using bnb::oep::image_layout;
+    using bnb::oep::interfaces::image_format;
+    using bnb::oep::interfaces::pixel_buffer;
+
+    /* written from the SDK documentation of every format, not from image_format_table */
+    struct expected_format
+    {
+        image_format format;
+        image_layout layout;
+        int32_t plane_count;
+        // of the first plane
+        int32_t bytes_per_pixel;
+        bnb_pixel_format_t pixel_format;
+        bnb_yuv_color_range_t range;
+        bnb_yuv_color_space_t space;
+    };
+
+    const std::vector<expected_format> expected{
+        {image_format::bpc8_rgb, image_layout::bpc8, 1, 3, BNB_RGB, {}, {}},
+        {image_format::bpc8_bgr, image_layout::bpc8, 1, 3, BNB_BGR, {}, {}},
+        {image_format::bpc8_rgba, image_layout::bpc8, 1, 4, BNB_RGBA, {}, {}},
+        {image_format::bpc8_bgra, image_layout::bpc8, 1, 4, BNB_BGRA, {}, {}},
+        {image_format::bpc8_argb, image_layout::bpc8, 1, 4, BNB_ARGB, {}, {}},
+        {image_format::nv12_bt601_full, image_layout::nv12, 2, 1, {}, bnb_yuv_full_range, bnb_bt601},
+        {image_format::nv12_bt601_video, image_layout::nv12, 2, 1, {}, bnb_yuv_video_range, bnb_bt601},
+        {image_format::nv12_bt709_full, image_layout::nv12, 2, 1, {}, bnb_yuv_full_range, bnb_bt709},
+        {image_format::nv12_bt709_video, image_layout::nv12, 2, 1, {}, bnb_yuv_video_range, bnb_bt709},
+        {image_format::i420_bt601_full, image_layout::i420, 3, 1, {}, bnb_yuv_full_range, bnb_bt601},
+        {image_format::i420_bt601_video, image_layout::i420, 3, 1, {}, bnb_yuv_video_range, bnb_bt601},
+        {image_format::i420_bt709_full, image_layout::i420, 3, 1, {}, bnb_yuv_full_range, bnb_bt709},
+        {image_format::i420_bt709_video, image_layout::i420, 3, 1, {}, bnb_yuv_video_range, bnb_bt709},
+    };
+
+    constexpr int32_t width = 32;
+    constexpr int32_t height = 16;
+
+    /* planes as a camera would lay them out, rows padded by 16 bytes so the strides are not implied by the width */
+    std::shared_ptr<pixel_buffer> make_image(const expected_format& e)
+    {
+        std::vector<pixel_buffer::plane_data> planes;
+        for (int32_t i = 0; i < e.plane_count; ++i) {
+            const bool chroma = i > 0;
+            // an NV12 UV row has width / 2 samples of 2 bytes, an I420 U or V row width / 2 of 1 byte
+            const int32_t row = chroma ? (e.layout == image_layout::nv12 ? width : width / 2) : width * e.bytes_per_pixel;
+            const int32_t rows = chroma ? height / 2 : height;
+            const int32_t stride = row + 16;
+            const auto size = static_cast<size_t>(stride * rows);
+            planes.push_back({std::shared_ptr<uint8_t>(new uint8_t[size](), std::default_delete<uint8_t[]>()), size, stride});
+        }
+        return pixel_buffer::create(planes, e.format, width, height);
+    }
+} // namespace
+
+TEST_CASE("every image_format has the row the SDK expects")
+{
+    CHECK(bnb::oep::image_format_table.size() == expected.size());
+    for (const auto& e : expected) {
+        const auto* traits = bnb::oep::find_image_format_traits(e.format);
+        if (!CHECK(traits != nullptr)) {
+            continue;
+        }
+        CHECK(traits->format == e.format);
+        CHECK(traits->layout == e.layout);
+        CHECK(traits->plane_count == e.plane_count);
+        if (e.layout == image_layout::bpc8) {
+            CHECK(traits->pixel_format == e.pixel_format);
+            CHECK(traits->chroma_shift_x == 0);
+            CHECK(traits->chroma_shift_y == 0);
+        } else {
+            CHECK(traits->range == e.range);
+            CHECK(traits->space == e.space);
+            CHECK(traits->chroma_shift_x == 1);
+            CHECK(traits->chroma_shift_y == 1);
+        }
+    }
+    CHECK(bnb::oep::find_image_format_traits(static_cast<image_format>(expected.size())) == nullptr);
+}
+
+TEST_CASE("the SDK gets the constructor, the enums and the planes of every format")
+{
+    bnb_stub_set_costs(0, 0);
+    bnb::oep::effect_player ep(width, height);
+    for (const auto& e : expected) {
+        auto image = make_image(e);
+        ep.push_frame(image, bnb::oep::interfaces::rotation::deg0, false, 0);
+        const auto info = bnb_stub_last_image();
+
+        switch (e.layout) {
+            case image_layout::bpc8:
+                CHECK(info.kind == bnb_stub_image_bpc8);
+                CHECK(info.pixel_format == e.pixel_format);
+                break;
+            case image_layout::nv12:
+                CHECK(info.kind == bnb_stub_image_nv12);
+                break;
+            case image_layout::i420:
+                CHECK(info.kind == bnb_stub_image_i420);
+                break;
+        }
+        if (e.layout != image_layout::bpc8) {
+            CHECK(info.range == e.range);
+            CHECK(info.space == e.space);
+        }
+        for (int32_t i = 0; i < e.plane_count; ++i) {
+            CHECK(info.planes[i] == image->get_base_sptr_of_plane(i).get());
+            CHECK(info.row_strides[i] == image->get_bytes_per_row_of_plane(i));
+        }
+        CHECK(info.row_strides[0] == width * e.bytes_per_pixel + 16);
+        if (e.layout == image_layout::i420) {
+            for (int32_t i = 0; i < 3; ++i) {
+                CHECK(info.pixel_strides[i] == 1);
+            }
+        }
+        ep.draw_frame();
+    }
+    bnb_stub_set_costs(5000, 3000);
+    CHECK(bnb_stub_live_images() == 0);
+}
@@ -0,0 +1,197 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include <orientation.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+ * orient_rgb against a naive mirror-then-rotate of every pixel, and the fused
+ * orient_rgb_to_yuv against orient_rgb followed by rgb_to_yuv. The sizes are odd
+ * and cross the 64 x 16 tiles of the kernels.
+ */
+
+namespace
+{
+    using namespace bnb::image;
+
+    struct size
+    {
+        int32_t width, height;
+    };
+
+    constexpr size sizes[] = {{1, 1}, {1, 3}, {3, 1}, {5, 3}, {37, 23}, {65, 17}, {130, 33}};
+    constexpr rotation angles[] = {rotation::deg0, rotation::deg90, rotation::deg180, rotation::deg270};
+
+    bool transposed(rotation angle)
+    {
+        return angle == rotation::deg90 || angle == rotation::deg270;
+    }
+
+    /* every pixel tells where it comes from: x, y, a per image tag, 255 */
+    std::vector<uint8_t> coordinate_image(size s, uint8_t tag)
+    {
+        std::vector<uint8_t> px(static_cast<size_t>(s.width) * s.height * 4);
+        for (int32_t y = 0; y < s.height; ++y) {
+            for (int32_t x = 0; x < s.width; ++x) {
+                uint8_t* p = &px[static_cast<size_t>(y * s.width + x) * 4];
+                p[0] = static_cast<uint8_t>(x);
+                p[1] = static_cast<uint8_t>(y);
+                p[2] = tag;
+                p[3] = 255;
+            }
+        }
+        return px;
+    }
+
+    /* where the source pixel (x, y) lands: mirrored horizontally first, then turned clockwise */
+    void naive_position(size s, orientation orient, int32_t x, int32_t y, int32_t& out_x, int32_t& out_y)
+    {
+        const int32_t mx = orient.mirror ? s.width - 1 - x : x;
+        switch (orient.angle) {
+            case rotation::deg0:   out_x = mx;                 out_y = y;                  break;
+            case rotation::deg90:  out_x = s.height - 1 - y;   out_y = mx;                 break;
+            case rotation::deg180: out_x = s.width - 1 - mx;   out_y = s.height - 1 - y;   break;
+            case rotation::deg270: out_x = y;                  out_y = s.width - 1 - mx;   break;
+        }
+    }
+
+    const uint8_t* pixel(const std::vector<uint8_t>& image, int32_t width, int32_t x, int32_t y)
+    {
+        return &image[static_cast<size_t>(y * width + x) * 4];
+    }
+
+    void report(const char* what, size s, orientation orient)
+    {
+        std::fprintf(stderr, "  %s %dx%d angle %d mirror %d\n", what, s.width, s.height,
+                     static_cast<int>(orient.angle) * 90, orient.mirror ? 1 : 0);
+    }
+} // namespace
+
+TEST_CASE("the corners of a 3x2 image land where a clockwise turn after the mirror puts them")
+{
+    // A B C      rotated 90:  D A      mirrored, then 90:  F C
+    // D E F                   E B                          E B
+    //                         F C                          D A
+    const size s{3, 2};
+    const auto src = coordinate_image(s, 0);
+    struct expectation
+    {
+        orientation orient;
+        int32_t out_x, out_y; // where A, the source (0, 0), goes
+        int32_t f_x, f_y;     // where F, the source (2, 1), goes
+    };
+    const expectation cases[] = {
+        {{rotation::deg0, false}, 0, 0, 2, 1},
+        {{rotation::deg90, false}, 1, 0, 0, 2},
+        {{rotation::deg180, false}, 2, 1, 0, 0},
+        {{rotation::deg270, false}, 0, 2, 1, 0},
+        {{rotation::deg0, true}, 2, 0, 0, 1},
+        {{rotation::deg90, true}, 1, 2, 0, 0},
+        {{rotation::deg180, true}, 0, 1, 2, 0},
+        {{rotation::deg270, true}, 0, 0, 1, 2},
+    };
+    for (const auto& e : cases) {
+        const int32_t out_w = transposed(e.orient.angle) ? s.height : s.width;
+        const int32_t out_h = transposed(e.orient.angle) ? s.width : s.height;
+        std::vector<uint8_t> dst(static_cast<size_t>(out_w) * out_h * 4);
+        orient_rgb(src.data(), s.width * 4, rgb_layout::rgba, s.width, s.height, e.orient, dst.data(), out_w * 4, rgb_layout::rgba);
+
+        const uint8_t* a = pixel(dst, out_w, e.out_x, e.out_y);
+        const uint8_t* f = pixel(dst, out_w, e.f_x, e.f_y);
+        if (!(CHECK(a[0] == 0 && a[1] == 0) & CHECK(f[0] == 2 && f[1] == 1))) {
+            report("corners", s, e.orient);
+        }
+    }
+}
+
+TEST_CASE("orient_rgb moves every pixel like the naive mirror and rotation")
+{
+    for (const auto& s : sizes) {
+        const auto src = coordinate_image(s, 7);
+        for (auto angle : angles) {
+            for (bool mirror : {false, true}) {
+                const orientation orient{angle, mirror};
+                const int32_t out_w = transposed(angle) ? s.height : s.width;
+                const int32_t out_h = transposed(angle) ? s.width : s.height;
+                // a padded destination stride, the kernel must keep to the rows
+                const int32_t dst_stride = out_w * 4 + 12;
+                for (auto dst_layout : {rgb_layout::rgba, rgb_layout::bgra}) {
+                    std::vector<uint8_t> dst(static_cast<size_t>(dst_stride) * out_h, 0xa5);
+                    orient_rgb(src.data(), s.width * 4, rgb_layout::rgba, s.width, s.height, orient, dst.data(), dst_stride, dst_layout);
+
+                    const int32_t ro = dst_layout == rgb_layout::rgba ? 0 : 2;
+                    const int32_t bo = dst_layout == rgb_layout::rgba ? 2 : 0;
+                    bool moved = true;
+                    for (int32_t y = 0; y < s.height; ++y) {
+                        for (int32_t x = 0; x < s.width; ++x) {
+                            int32_t ox = 0, oy = 0;
+                            naive_position(s, orient, x, y, ox, oy);
+                            const uint8_t* p = &dst[static_cast<size_t>(oy) * dst_stride + ox * 4];
+                            moved = moved && p[ro] == x && p[1] == y && p[bo] == 7 && p[3] == 255;
+                        }
+                    }
+                    bool padding_intact = true;
+                    for (int32_t y = 0; y < out_h; ++y) {
+                        for (int32_t i = out_w * 4; i < dst_stride; ++i) {
+                            padding_intact = padding_intact && dst[static_cast<size_t>(y) * dst_stride + i] == 0xa5;
+                        }
+                    }
+                    if (!(CHECK(moved) & CHECK(padding_intact))) {
+                        report(dst_layout == rgb_layout::rgba ? "orient_rgb rgba" : "orient_rgb bgra", s, orient);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("orient_rgb_to_yuv is identical to orient_rgb followed by rgb_to_yuv for NV12 and I420")
+{
+    const yuv_format formats[] = {
+        {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::full},
+        {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::video},
+        {yuv_layout::i420, yuv_matrix::bt601, yuv_range::video},
+        {yuv_layout::i420, yuv_matrix::bt709, yuv_range::full},
+    };
+    for (const auto& s : sizes) {
+        // varied colours, the coordinate image has no chroma to speak of
+        std::vector<uint8_t> src(static_cast<size_t>(s.width) * s.height * 4);
+        for (size_t i = 0; i < src.size(); ++i) {
+            src[i] = static_cast<uint8_t>(i * 37 + i / 5);
+        }
+        for (auto angle : angles) {
+            for (bool mirror : {false, true}) {
+                const orientation orient{angle, mirror};
+                const int32_t out_w = transposed(angle) ? s.height : s.width;
+                const int32_t out_h = transposed(angle) ? s.width : s.height;
+                const int32_t cw = (out_w + 1) / 2;
+                const int32_t ch = (out_h + 1) / 2;
+
+                std::vector<uint8_t> rotated(static_cast<size_t>(out_w) * out_h * 4);
+                orient_rgb(src.data(), s.width * 4, rgb_layout::bgra, s.width, s.height, orient, rotated.data(), out_w * 4, rgb_layout::bgra);
+
+                for (const auto& format : formats) {
+                    const bool nv12 = format.layout == yuv_layout::nv12;
+                    std::vector<uint8_t> planes[2][3];
+                    yuv_planes dst[2];
+                    for (int p = 0; p < 2; ++p) {
+                        planes[p][0].assign(static_cast<size_t>(out_w) * out_h, 0);
+                        planes[p][1].assign(static_cast<size_t>(cw) * ch * (nv12 ? 2 : 1), 0);
+                        planes[p][2].assign(nv12 ? 0 : static_cast<size_t>(cw) * ch, 0);
+                        dst[p] = {planes[p][0].data(), out_w, planes[p][1].data(), nv12 ? cw * 2 : cw,
+                                  nv12 ? nullptr : planes[p][2].data(), nv12 ? 0 : cw};
+                    }
+                    rgb_to_yuv(rotated.data(), out_w * 4, rgb_layout::bgra, out_w, out_h, dst[0], format);
+                    orient_rgb_to_yuv(src.data(), s.width * 4, rgb_layout::bgra, s.width, s.height, orient, dst[1], format);
+
+                    if (!(CHECK(planes[1][0] == planes[0][0]) & CHECK(planes[1][1] == planes[0][1]) & CHECK(planes[1][2] == planes[0][2]))) {
+                        report(nv12 ? "orient_rgb_to_yuv nv12" : "orient_rgb_to_yuv i420", s, orient);
+                    }
+                }
+            }
+        }
+    }
+}
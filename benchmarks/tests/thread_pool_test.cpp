@@ -0,0 +1,88 @@
+#define BNB_TEST_MAIN
+#include "check.hpp"
+
+#include <thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST_CASE("a pool of one thread runs external submissions in submission order")
+{
+    bnb::thread_pool pool(1);
+    std::vector<int> order;
+    // holds the worker, so every task below is queued before the first one runs
+    std::promise<void> gate;
+    pool.execute([opened = gate.get_future().share()]() { opened.wait(); });
+    for (int i = 0; i < 64; ++i) {
+        pool.execute([&order, i]() { order.push_back(i); });
+    }
+    gate.set_value();
+    pool.enqueue([]() {}).get();
+
+    REQUIRE(order.size() == 64);
+    for (int i = 0; i < 64; ++i) {
+        CHECK(order[i] == i);
+    }
+}
+
+TEST_CASE("enqueue().get() is a barrier for the earlier submissions")
+{
+    bnb::thread_pool pool(1);
+    int value = -1;
+    for (int i = 0; i < 16; ++i) {
+        pool.execute([&value, i]() { value = i; });
+        CHECK(pool.enqueue([&value]() { return value; }).get() == i);
+    }
+}
+
+TEST_CASE("tasks spawned by the workers all run")
+{
+    std::atomic<int> done{0};
+    {
+        bnb::thread_pool pool(4);
+        std::vector<std::future<void>> outer;
+        for (int i = 0; i < 8; ++i) {
+            outer.push_back(pool.enqueue([&pool, &done]() {
+                for (int j = 0; j < 8; ++j) {
+                    pool.execute([&done]() { done.fetch_add(1); });
+                }
+            }));
+        }
+        for (auto& f : outer) {
+            f.get();
+        }
+        // the destructor drains the tasks spawned by the workers
+    }
+    CHECK(done.load() == 64);
+}
+
+TEST_CASE("external submissions reach every worker and a parked worker wakes up for the next one")
+{
+    constexpr int threads = 4;
+    bnb::thread_pool pool(threads);
+    for (int round = 0; round < 2; ++round) {
+        // every task waits for all of them, so they only finish when each runs on its own worker
+        std::mutex mutex;
+        std::condition_variable arrived;
+        std::vector<std::thread::id> ids;
+        std::vector<std::future<bool>> results;
+        for (int i = 0; i < threads; ++i) {
+            results.push_back(pool.enqueue([&]() {
+                std::unique_lock<std::mutex> lock(mutex);
+                ids.push_back(std::this_thread::get_id());
+                arrived.notify_all();
+                return arrived.wait_for(lock, std::chrono::seconds(5), [&] { return ids.size() == threads; });
+            }));
+        }
+        for (auto& r : results) {
+            CHECK(r.get());
+        }
+        // the workers are parked between the rounds
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
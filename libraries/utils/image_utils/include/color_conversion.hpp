@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+
+#include <interfaces/pixel_buffer.hpp>
+
+namespace bnb::image
+{
+    /**
+     * @addtogroup utils
+     * @{
+     */
+
+    /// Byte order of the 8 bit per channel 4 channel pixel in memory
+    enum class rgb_layout
+    {
+        rgba,
+        bgra
+    };
+
+    enum class yuv_matrix
+    {
+        bt601,
+        bt709
+    };
+
+    enum class yuv_range
+    {
+        video,
+        full
+    };
+
+    enum class yuv_layout
+    {
+        nv12,
+        i420
+    };
+
+    /// Implementation used by the conversion functions, `best` picks the fastest one supported by the CPU
+    enum class simd_backend
+    {
+        best,
+        scalar,
+        sse41,
+        avx2,
+        neon
+    };
+
+    /**
+     * Fixed point (Q14) conversion coefficients for one (matrix, range) pair.
+     * All backends compute exactly the same integer expression, so the results
+     * of the SIMD paths are bit-exact with the scalar one.
+     */
+    struct yuv_coefficients
+    {
+        // RGB -> YUV
+        int16_t yr, yg, yb;
+        int16_t ur, ug, ub;
+        int16_t vr, vg, vb;
+        int32_t y_bias; // (y offset << 14) + rounding
+        int32_t c_bias; // (128 << 14) + rounding
+
+        // YUV -> RGB
+        int32_t y_offset;
+        int32_t ry, rv;
+        int32_t gy, gu, gv;
+        int32_t by, bu;
+    };
+
+    /// coefficients are computed once per (matrix, range) pair and cached
+    const yuv_coefficients& coefficients(yuv_matrix matrix, yuv_range range);
+
+    struct yuv_format
+    {
+        yuv_layout layout;
+        yuv_matrix matrix;
+        yuv_range range;
+    };
+
+    /// returns false for the non-YUV formats
+    bool to_yuv_format(oep::interfaces::image_format format, yuv_format& out);
+
+    /**
+     * Destination or source planes of the YUV image. For NV12 `u` points to the
+     * interleaved UV plane and `v` is not used.
+     */
+    struct yuv_planes
+    {
+        uint8_t* y{nullptr};
+        int32_t y_stride{0};
+        uint8_t* u{nullptr};
+        int32_t u_stride{0};
+        uint8_t* v{nullptr};
+        int32_t v_stride{0};
+    };
+
+    /// Odd sizes are supported, the last chroma sample then covers a single column or row.
+    void rgb_to_yuv(const uint8_t* src, int32_t src_stride, rgb_layout src_layout,
+                    int32_t width, int32_t height, const yuv_planes& dst, const yuv_format& format);
+
+    /// The alpha channel of the destination is set to 255.
+    void yuv_to_rgb(const yuv_planes& src, const yuv_format& format,
+                    int32_t width, int32_t height, uint8_t* dst, int32_t dst_stride, rgb_layout dst_layout);
+
+    /// returns false when the backend is not supported by the CPU, the current one is kept then
+    bool set_simd_backend(simd_backend backend);
+    simd_backend current_simd_backend();
+
+    /** @} */ // endgroup utils
+} // namespace bnb::image
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "color_conversion.hpp"
+
+namespace bnb::image
+{
+    /**
+     * @addtogroup utils
+     * @{
+     */
+
+    /// Clockwise rotation of the image
+    enum class rotation
+    {
+        deg0,
+        deg90,
+        deg180,
+        deg270
+    };
+
+    /**
+     * Rotation applied after the optional horizontal mirroring of the source.
+     * For 90 and 270 degrees the destination is `height` x `width`.
+     */
+    struct orientation
+    {
+        rotation angle{rotation::deg0};
+        bool mirror{false};
+    };
+
+    /**
+     * Fused single pass kernels: the source is read in cache sized tiles, every tile
+     * is rotated and written in the destination format while it is still in cache.
+     * `width` and `height` are the source dimensions.
+     */
+    void orient_rgb(const uint8_t* src, int32_t src_stride, rgb_layout src_layout, int32_t width, int32_t height,
+                    orientation orient, uint8_t* dst, int32_t dst_stride, rgb_layout dst_layout);
+
+    void orient_rgb_to_yuv(const uint8_t* src, int32_t src_stride, rgb_layout src_layout, int32_t width, int32_t height,
+                           orientation orient, const yuv_planes& dst, const yuv_format& format);
+
+    /** @} */ // endgroup utils
+} // namespace bnb::image
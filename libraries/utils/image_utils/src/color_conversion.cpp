@@ -0,0 +1,247 @@
+#include "color_conversion.hpp"
+#include "color_conversion_kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+namespace bnb::image
+{
+    namespace
+    {
+        constexpr int32_t q_bits = 14;
+        constexpr double q_one = 1 << q_bits;
+        constexpr int32_t q_half = 1 << (q_bits - 1);
+
+        int16_t q14_16(double v)
+        {
+            return static_cast<int16_t>(std::lround(v * q_one));
+        }
+
+        int32_t q14_32(double v)
+        {
+            return static_cast<int32_t>(std::lround(v * q_one));
+        }
+
+        yuv_coefficients make_coefficients(yuv_matrix matrix, yuv_range range)
+        {
+            const double kr = matrix == yuv_matrix::bt601 ? 0.299 : 0.2126;
+            const double kb = matrix == yuv_matrix::bt601 ? 0.114 : 0.0722;
+            const double kg = 1.0 - kr - kb;
+
+            const bool video = range == yuv_range::video;
+            const double ys = video ? 219.0 / 255.0 : 1.0;
+            const double cs = video ? 224.0 / 255.0 : 1.0;
+            const int32_t y_offset = video ? 16 : 0;
+
+            const double cu = cs / (2.0 * (1.0 - kb));
+            const double cv = cs / (2.0 * (1.0 - kr));
+
+            yuv_coefficients c{};
+            c.yr = q14_16(kr * ys);
+            c.yg = q14_16(kg * ys);
+            c.yb = q14_16(kb * ys);
+            c.ur = q14_16(-kr * cu);
+            c.ug = q14_16(-kg * cu);
+            c.ub = q14_16(0.5 * cs);
+            c.vr = q14_16(0.5 * cs);
+            c.vg = q14_16(-kg * cv);
+            c.vb = q14_16(-kb * cv);
+            c.y_bias = (y_offset << q_bits) + q_half;
+            c.c_bias = (128 << q_bits) + q_half;
+
+            c.y_offset = y_offset;
+            c.ry = q14_32(1.0 / ys);
+            c.rv = q14_32(2.0 * (1.0 - kr) / cs);
+            c.gy = c.ry;
+            c.gu = q14_32(-2.0 * (1.0 - kb) * kb / kg / cs);
+            c.gv = q14_32(-2.0 * (1.0 - kr) * kr / kg / cs);
+            c.by = c.ry;
+            c.bu = q14_32(2.0 * (1.0 - kb) / cs);
+            return c;
+        }
+
+        struct backends
+        {
+            std::array<detail::kernels, 5> table{};
+            std::array<bool, 5> supported{};
+            std::atomic<simd_backend> current{simd_backend::scalar};
+
+            backends()
+            {
+                table.fill(detail::scalar_kernels());
+                supported[size_t(simd_backend::scalar)] = true;
+                supported[size_t(simd_backend::sse41)] = detail::sse41_kernels(table[size_t(simd_backend::sse41)]);
+                supported[size_t(simd_backend::avx2)] = detail::avx2_kernels(table[size_t(simd_backend::avx2)]);
+                supported[size_t(simd_backend::neon)] = detail::neon_kernels(table[size_t(simd_backend::neon)]);
+                current = best();
+            }
+
+            simd_backend best() const
+            {
+                for (auto b : {simd_backend::avx2, simd_backend::sse41, simd_backend::neon}) {
+                    if (supported[size_t(b)]) {
+                        return b;
+                    }
+                }
+                return simd_backend::scalar;
+            }
+
+            const detail::kernels& active() const
+            {
+                return table[size_t(current.load(std::memory_order_relaxed))];
+            }
+        };
+
+        backends& get_backends()
+        {
+            static backends instance;
+            return instance;
+        }
+    } // namespace
+
+    const yuv_coefficients& coefficients(yuv_matrix matrix, yuv_range range)
+    {
+        static const std::array<yuv_coefficients, 4> cache{
+            make_coefficients(yuv_matrix::bt601, yuv_range::video),
+            make_coefficients(yuv_matrix::bt601, yuv_range::full),
+            make_coefficients(yuv_matrix::bt709, yuv_range::video),
+            make_coefficients(yuv_matrix::bt709, yuv_range::full)};
+        return cache[size_t(matrix) * 2 + size_t(range)];
+    }
+
+    bool to_yuv_format(oep::interfaces::image_format format, yuv_format& out)
+    {
+        using ns = oep::interfaces::image_format;
+        switch (format) {
+            case ns::nv12_bt601_full:  out = {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::full}; return true;
+            case ns::nv12_bt601_video: out = {yuv_layout::nv12, yuv_matrix::bt601, yuv_range::video}; return true;
+            case ns::nv12_bt709_full:  out = {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::full}; return true;
+            case ns::nv12_bt709_video: out = {yuv_layout::nv12, yuv_matrix::bt709, yuv_range::video}; return true;
+            case ns::i420_bt601_full:  out = {yuv_layout::i420, yuv_matrix::bt601, yuv_range::full}; return true;
+            case ns::i420_bt601_video: out = {yuv_layout::i420, yuv_matrix::bt601, yuv_range::video}; return true;
+            case ns::i420_bt709_full:  out = {yuv_layout::i420, yuv_matrix::bt709, yuv_range::full}; return true;
+            case ns::i420_bt709_video: out = {yuv_layout::i420, yuv_matrix::bt709, yuv_range::video}; return true;
+            default:
+                return false;
+        }
+    }
+
+    void rgb_to_yuv(const uint8_t* src, int32_t src_stride, rgb_layout src_layout,
+                    int32_t width, int32_t height, const yuv_planes& dst, const yuv_format& format)
+    {
+        const auto& c = coefficients(format.matrix, format.range);
+        const auto& k = detail::active_kernels();
+
+        const bool nv12 = format.layout == yuv_layout::nv12;
+        const int32_t step = nv12 ? 2 : 1;
+
+        for (int32_t row = 0; row < height; row += 2) {
+            const uint8_t* src0 = src + row * src_stride;
+            const uint8_t* src1 = row + 1 < height ? src0 + src_stride : src0;
+
+            k.rgb_to_y_row(src0, dst.y + row * dst.y_stride, width, src_layout, c);
+            if (row + 1 < height) {
+                k.rgb_to_y_row(src1, dst.y + (row + 1) * dst.y_stride, width, src_layout, c);
+            }
+
+            uint8_t* u = dst.u + (row / 2) * dst.u_stride;
+            uint8_t* v = nv12 ? u + 1 : dst.v + (row / 2) * dst.v_stride;
+            k.rgb_to_uv_row(src0, src1, u, v, step, width, src_layout, c);
+        }
+    }
+
+    void yuv_to_rgb(const yuv_planes& src, const yuv_format& format,
+                    int32_t width, int32_t height, uint8_t* dst, int32_t dst_stride, rgb_layout dst_layout)
+    {
+        const auto& c = coefficients(format.matrix, format.range);
+        const auto& k = detail::active_kernels();
+
+        const bool nv12 = format.layout == yuv_layout::nv12;
+        const int32_t step = nv12 ? 2 : 1;
+
+        for (int32_t row = 0; row < height; ++row) {
+            const uint8_t* u = src.u + (row / 2) * src.u_stride;
+            const uint8_t* v = nv12 ? u + 1 : src.v + (row / 2) * src.v_stride;
+            k.yuv_to_rgb_row(src.y + row * src.y_stride, u, v, step, dst + row * dst_stride, width, dst_layout, c);
+        }
+    }
+
+    bool set_simd_backend(simd_backend backend)
+    {
+        auto& b = get_backends();
+        if (backend == simd_backend::best) {
+            backend = b.best();
+        }
+        if (!b.supported[size_t(backend)]) {
+            return false;
+        }
+        b.current = backend;
+        return true;
+    }
+
+    simd_backend current_simd_backend()
+    {
+        return get_backends().current;
+    }
+
+    namespace detail
+    {
+        const kernels& active_kernels()
+        {
+            return get_backends().active();
+        }
+
+        kernels scalar_kernels()
+        {
+            return {&rgb_to_y_row_scalar, &rgb_to_uv_row_scalar, &yuv_to_rgb_row_scalar};
+        }
+
+        void rgb_to_y_row_scalar(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int32_t ro = red_offset(layout);
+            const int32_t bo = blue_offset(layout);
+            for (int32_t x = 0; x < width; ++x) {
+                const int32_t r = src[ro], g = src[1], b = src[bo];
+                y[x] = clamp_u8((c.yr * r + c.yg * g + c.yb * b + c.y_bias) >> q_bits);
+                src += 4;
+            }
+        }
+
+        void rgb_to_uv_row_scalar(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int32_t step,
+                                  int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int32_t ro = red_offset(layout);
+            const int32_t bo = blue_offset(layout);
+            const int32_t count = (width + 1) / 2;
+            for (int32_t i = 0; i < count; ++i) {
+                const int32_t x0 = 8 * i;
+                const int32_t x1 = 2 * i + 1 < width ? x0 + 4 : x0;
+                const int32_t r = (src0[x0 + ro] + src0[x1 + ro] + src1[x0 + ro] + src1[x1 + ro] + 2) >> 2;
+                const int32_t g = (src0[x0 + 1] + src0[x1 + 1] + src1[x0 + 1] + src1[x1 + 1] + 2) >> 2;
+                const int32_t b = (src0[x0 + bo] + src0[x1 + bo] + src1[x0 + bo] + src1[x1 + bo] + 2) >> 2;
+                u[i * step] = clamp_u8((c.ur * r + c.ug * g + c.ub * b + c.c_bias) >> q_bits);
+                v[i * step] = clamp_u8((c.vr * r + c.vg * g + c.vb * b + c.c_bias) >> q_bits);
+            }
+        }
+
+        void yuv_to_rgb_row_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                                   uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int32_t ro = red_offset(layout);
+            const int32_t bo = blue_offset(layout);
+            for (int32_t x = 0; x < width; ++x) {
+                const int32_t yy = y[x] - c.y_offset;
+                const int32_t uu = u[(x / 2) * step] - 128;
+                const int32_t vv = v[(x / 2) * step] - 128;
+
+                dst[ro] = clamp_u8((c.ry * yy + c.rv * vv + q_half) >> q_bits);
+                dst[1] = clamp_u8((c.gy * yy + c.gu * uu + c.gv * vv + q_half) >> q_bits);
+                dst[bo] = clamp_u8((c.by * yy + c.bu * uu + q_half) >> q_bits);
+                dst[3] = 255;
+                dst += 4;
+            }
+        }
+    } // namespace detail
+} // namespace bnb::image
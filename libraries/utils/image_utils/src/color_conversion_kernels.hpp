@@ -0,0 +1,56 @@
+#pragma once
+
+#include "color_conversion.hpp"
+
+namespace bnb::image::detail
+{
+    /**
+     * Row kernels. `rgb_to_uv_row` averages 2x2 blocks of `src0` and `src1` rows
+     * and writes `count` chroma samples to `u` and `v` with `step` bytes between
+     * samples (2 for the interleaved NV12 plane, 1 for I420). `width` is the source
+     * row width in pixels, the scalar kernels use it to handle the odd tail.
+     * `yuv_to_rgb_row` writes `width` pixels of one row, `u` and `v` point to the
+     * first chroma sample of the row, `step` apart like above.
+     */
+    using rgb_to_y_row_fn = void (*)(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c);
+    using rgb_to_uv_row_fn = void (*)(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int32_t step,
+                                      int32_t width, rgb_layout layout, const yuv_coefficients& c);
+    using yuv_to_rgb_row_fn = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                                       uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c);
+
+    struct kernels
+    {
+        rgb_to_y_row_fn rgb_to_y_row;
+        rgb_to_uv_row_fn rgb_to_uv_row;
+        yuv_to_rgb_row_fn yuv_to_rgb_row;
+    };
+
+    /// kernels of the backend selected by set_simd_backend
+    const kernels& active_kernels();
+
+    kernels scalar_kernels();
+    bool sse41_kernels(kernels& out);
+    bool avx2_kernels(kernels& out);
+    bool neon_kernels(kernels& out);
+
+    void rgb_to_y_row_scalar(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c);
+    void rgb_to_uv_row_scalar(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int32_t step,
+                              int32_t width, rgb_layout layout, const yuv_coefficients& c);
+    void yuv_to_rgb_row_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                               uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c);
+
+    inline uint8_t clamp_u8(int32_t v)
+    {
+        return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    inline int32_t red_offset(rgb_layout layout)
+    {
+        return layout == rgb_layout::rgba ? 0 : 2;
+    }
+
+    inline int32_t blue_offset(rgb_layout layout)
+    {
+        return layout == rgb_layout::rgba ? 2 : 0;
+    }
+} // namespace bnb::image::detail
@@ -0,0 +1,184 @@
+#include "color_conversion_kernels.hpp"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+    #include <arm_neon.h>
+
+namespace bnb::image::detail
+{
+    namespace
+    {
+        struct channels
+        {
+            uint8x16_t r, g, b;
+        };
+
+        channels load16(const uint8_t* src, rgb_layout layout)
+        {
+            uint8x16x4_t px = vld4q_u8(src);
+            return layout == rgb_layout::rgba
+                       ? channels{px.val[0], px.val[1], px.val[2]}
+                       : channels{px.val[2], px.val[1], px.val[0]};
+        }
+
+        int16x8_t widen(uint8x8_t v)
+        {
+            return vreinterpretq_s16_u16(vmovl_u8(v));
+        }
+
+        /* (cr * r + cg * g + cb * b + bias) >> 14 for 4 values */
+        int32x4_t combine4(int16x4_t r, int16x4_t g, int16x4_t b, int16_t cr, int16_t cg, int16_t cb, int32x4_t bias)
+        {
+            int32x4_t acc = vmull_n_s16(r, cr);
+            acc = vmlal_n_s16(acc, g, cg);
+            acc = vmlal_n_s16(acc, b, cb);
+            return vshrq_n_s32(vaddq_s32(acc, bias), 14);
+        }
+
+        uint8x8_t combine8(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb, int32x4_t bias)
+        {
+            int32x4_t lo = combine4(vget_low_s16(r), vget_low_s16(g), vget_low_s16(b), cr, cg, cb, bias);
+            int32x4_t hi = combine4(vget_high_s16(r), vget_high_s16(g), vget_high_s16(b), cr, cg, cb, bias);
+            return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+
+        void rgb_to_y_row_neon(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int32x4_t bias = vdupq_n_s32(c.y_bias);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                channels px = load16(src + x * 4, layout);
+                uint8x8_t lo = combine8(widen(vget_low_u8(px.r)), widen(vget_low_u8(px.g)), widen(vget_low_u8(px.b)), c.yr, c.yg, c.yb, bias);
+                uint8x8_t hi = combine8(widen(vget_high_u8(px.r)), widen(vget_high_u8(px.g)), widen(vget_high_u8(px.b)), c.yr, c.yg, c.yb, bias);
+                vst1q_u8(y + x, vcombine_u8(lo, hi));
+            }
+            if (x < width) {
+                rgb_to_y_row_scalar(src + x * 4, y + x, width - x, layout, c);
+            }
+        }
+
+        /* Rounded 2x2 average, (sum + 2) >> 2 */
+        int16x8_t average2x2(uint8x16_t a, uint8x16_t b)
+        {
+            return vreinterpretq_s16_u16(vrshrq_n_u16(vaddq_u16(vpaddlq_u8(a), vpaddlq_u8(b)), 2));
+        }
+
+        void rgb_to_uv_row_neon(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int32_t step,
+                                int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int32x4_t bias = vdupq_n_s32(c.c_bias);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                channels p0 = load16(src0 + x * 4, layout);
+                channels p1 = load16(src1 + x * 4, layout);
+                int16x8_t r = average2x2(p0.r, p1.r);
+                int16x8_t g = average2x2(p0.g, p1.g);
+                int16x8_t b = average2x2(p0.b, p1.b);
+
+                uint8x8_t u8 = combine8(r, g, b, c.ur, c.ug, c.ub, bias);
+                uint8x8_t v8 = combine8(r, g, b, c.vr, c.vg, c.vb, bias);
+
+                const int32_t i = x / 2;
+                if (step == 2) {
+                    vst2_u8(u + i * 2, (uint8x8x2_t{{u8, v8}}));
+                } else {
+                    vst1_u8(u + i, u8);
+                    vst1_u8(v + i, v8);
+                }
+            }
+            if (x < width) {
+                const int32_t i = x / 2;
+                rgb_to_uv_row_scalar(src0 + x * 4, src1 + x * 4, u + i * step, v + i * step, step, width - x, layout, c);
+            }
+        }
+
+        /* (cy * y + cu * u + cv * v + 2^13) >> 14 for 4 values, 32 bit products: the YUV -> RGB coefficients do not fit 16 bits */
+        int32x4_t channel4(int16x4_t y, int16x4_t u, int16x4_t v, int32_t cy, int32_t cu, int32_t cv)
+        {
+            int32x4_t acc = vmlaq_n_s32(vdupq_n_s32(1 << 13), vmovl_s16(y), cy);
+            acc = vmlaq_n_s32(acc, vmovl_s16(u), cu);
+            acc = vmlaq_n_s32(acc, vmovl_s16(v), cv);
+            return vshrq_n_s32(acc, 14);
+        }
+
+        /* the saturating narrows are the clamp to 0..255 of the scalar kernel */
+        uint8x8_t narrow8(int32x4_t lo, int32x4_t hi)
+        {
+            return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        }
+
+        uint8x8_t channel8(int16x8_t y, int16x8_t u, int16x8_t v, int32_t cy, int32_t cu, int32_t cv)
+        {
+            return narrow8(channel4(vget_low_s16(y), vget_low_s16(u), vget_low_s16(v), cy, cu, cv),
+                           channel4(vget_high_s16(y), vget_high_s16(u), vget_high_s16(v), cy, cu, cv));
+        }
+
+        void yuv_to_rgb_row_neon(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                                 uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const int16x8_t y_offset = vdupq_n_s16(static_cast<int16_t>(c.y_offset));
+            const int16x8_t c_offset = vdupq_n_s16(128);
+            const int32_t ro = red_offset(layout);
+            const int32_t bo = blue_offset(layout);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                const int32_t i = x / 2;
+                uint8x8_t u8, v8;
+                if (step == 2) {
+                    const uint8x8x2_t uv = vld2_u8(u + i * 2);
+                    u8 = uv.val[0];
+                    v8 = uv.val[1];
+                } else {
+                    u8 = vld1_u8(u + i);
+                    v8 = vld1_u8(v + i);
+                }
+                // every chroma sample covers two pixels
+                const uint8x8x2_t u_px = vzip_u8(u8, u8);
+                const uint8x8x2_t v_px = vzip_u8(v8, v8);
+                const uint8x16_t y_px = vld1q_u8(y + x);
+
+                uint8x8_t r[2], g[2], b[2];
+                for (int32_t h = 0; h < 2; ++h) {
+                    const int16x8_t yy = vsubq_s16(widen(h == 0 ? vget_low_u8(y_px) : vget_high_u8(y_px)), y_offset);
+                    const int16x8_t uu = vsubq_s16(widen(u_px.val[h]), c_offset);
+                    const int16x8_t vv = vsubq_s16(widen(v_px.val[h]), c_offset);
+                    r[h] = channel8(yy, uu, vv, c.ry, 0, c.rv);
+                    g[h] = channel8(yy, uu, vv, c.gy, c.gu, c.gv);
+                    b[h] = channel8(yy, uu, vv, c.by, c.bu, 0);
+                }
+
+                uint8x16x4_t px;
+                px.val[ro] = vcombine_u8(r[0], r[1]);
+                px.val[1] = vcombine_u8(g[0], g[1]);
+                px.val[bo] = vcombine_u8(b[0], b[1]);
+                px.val[3] = vdupq_n_u8(255);
+                vst4q_u8(dst + x * 4, px);
+            }
+            if (x < width) {
+                const int32_t i = x / 2;
+                yuv_to_rgb_row_scalar(y + x, u + i * step, v + i * step, step, dst + x * 4, width - x, layout, c);
+            }
+        }
+    } // namespace
+
+    bool neon_kernels(kernels& out)
+    {
+        out = {&rgb_to_y_row_neon, &rgb_to_uv_row_neon, &yuv_to_rgb_row_neon};
+        return true;
+    }
+} // namespace bnb::image::detail
+
+#else
+
+namespace bnb::image::detail
+{
+    bool neon_kernels(kernels&)
+    {
+        return false;
+    }
+} // namespace bnb::image::detail
+
+#endif
@@ -0,0 +1,352 @@
+#include "color_conversion_kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    #include <immintrin.h>
+
+    #define BNB_TARGET_SSE41 __attribute__((target("sse4.1")))
+    #define BNB_TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace bnb::image::detail
+{
+    namespace
+    {
+        constexpr char z = char(0x80); // shuffle index that produces zero
+
+        /* Shuffle masks turning 4 pixels into (R, G) and (B, 0) 16 bit pairs for _mm_madd_epi16 */
+        BNB_TARGET_SSE41 __m128i rg_mask(rgb_layout layout)
+        {
+            const char r = char(red_offset(layout));
+            return _mm_setr_epi8(r, z, 1, z, r + 4, z, 5, z, r + 8, z, 9, z, r + 12, z, 13, z);
+        }
+
+        BNB_TARGET_SSE41 __m128i b_mask(rgb_layout layout)
+        {
+            const char b = char(blue_offset(layout));
+            return _mm_setr_epi8(b, z, z, z, b + 4, z, z, z, b + 8, z, z, z, b + 12, z, z, z);
+        }
+
+        BNB_TARGET_SSE41 __m128i pair(int16_t lo, int16_t hi)
+        {
+            return _mm_set1_epi32(int32_t(uint32_t(uint16_t(lo)) | (uint32_t(uint16_t(hi)) << 16)));
+        }
+
+        /* Coefficients in the memory order of the channels, alpha gets 0 */
+        BNB_TARGET_SSE41 __m128i channel_coefficients(rgb_layout layout, int16_t r, int16_t g, int16_t b)
+        {
+            return layout == rgb_layout::rgba
+                       ? _mm_setr_epi16(r, g, b, 0, r, g, b, 0)
+                       : _mm_setr_epi16(b, g, r, 0, b, g, r, 0);
+        }
+
+        BNB_TARGET_SSE41 __m128i luma4(__m128i px, __m128i rg_shuffle, __m128i b_shuffle, __m128i rg_coef, __m128i b_coef, __m128i bias)
+        {
+            __m128i y = _mm_add_epi32(
+                _mm_madd_epi16(_mm_shuffle_epi8(px, rg_shuffle), rg_coef),
+                _mm_madd_epi16(_mm_shuffle_epi8(px, b_shuffle), b_coef));
+            return _mm_srai_epi32(_mm_add_epi32(y, bias), 14);
+        }
+
+        BNB_TARGET_SSE41 void rgb_to_y_row_sse41(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const __m128i rg_shuffle = rg_mask(layout);
+            const __m128i b_shuffle = b_mask(layout);
+            const __m128i rg_coef = pair(c.yr, c.yg);
+            const __m128i b_coef = pair(c.yb, 0);
+            const __m128i bias = _mm_set1_epi32(c.y_bias);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                const __m128i* p = reinterpret_cast<const __m128i*>(src + x * 4);
+                __m128i y0 = luma4(_mm_loadu_si128(p + 0), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m128i y1 = luma4(_mm_loadu_si128(p + 1), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m128i y2 = luma4(_mm_loadu_si128(p + 2), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m128i y3 = luma4(_mm_loadu_si128(p + 3), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m128i packed = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), packed);
+            }
+            if (x < width) {
+                rgb_to_y_row_scalar(src + x * 4, y + x, width - x, layout, c);
+            }
+        }
+
+        /* Rounded 2x2 averages of 4 columns of two rows: channels of two chroma samples as 16 bit values */
+        BNB_TARGET_SSE41 __m128i average2x2(const uint8_t* src0, const uint8_t* src1)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src0));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            __m128i sum = _mm_unpacklo_epi64(lo, hi);
+            return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+        }
+
+        BNB_TARGET_SSE41 __m128i chroma4(__m128i avg0, __m128i avg1, __m128i coef, __m128i bias)
+        {
+            __m128i v = _mm_hadd_epi32(_mm_madd_epi16(avg0, coef), _mm_madd_epi16(avg1, coef));
+            return _mm_srai_epi32(_mm_add_epi32(v, bias), 14);
+        }
+
+        BNB_TARGET_SSE41 void rgb_to_uv_row_sse41(const uint8_t* src0, const uint8_t* src1, uint8_t* u, uint8_t* v, int32_t step,
+                                                 int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const __m128i u_coef = channel_coefficients(layout, c.ur, c.ug, c.ub);
+            const __m128i v_coef = channel_coefficients(layout, c.vr, c.vg, c.vb);
+            const __m128i bias = _mm_set1_epi32(c.c_bias);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                const uint8_t* s0 = src0 + x * 4;
+                const uint8_t* s1 = src1 + x * 4;
+                __m128i a0 = average2x2(s0, s1);
+                __m128i a1 = average2x2(s0 + 16, s1 + 16);
+                __m128i a2 = average2x2(s0 + 32, s1 + 32);
+                __m128i a3 = average2x2(s0 + 48, s1 + 48);
+
+                __m128i u16 = _mm_packs_epi32(chroma4(a0, a1, u_coef, bias), chroma4(a2, a3, u_coef, bias));
+                __m128i v16 = _mm_packs_epi32(chroma4(a0, a1, v_coef, bias), chroma4(a2, a3, v_coef, bias));
+                __m128i u8 = _mm_packus_epi16(u16, u16);
+                __m128i v8 = _mm_packus_epi16(v16, v16);
+
+                const int32_t i = x / 2;
+                if (step == 2) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i * 2), _mm_unpacklo_epi8(u8, v8));
+                } else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(u + i), u8);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i), v8);
+                }
+            }
+            if (x < width) {
+                const int32_t i = x / 2;
+                rgb_to_uv_row_scalar(src0 + x * 4, src1 + x * 4, u + i * step, v + i * step, step, width - x, layout, c);
+            }
+        }
+
+        BNB_TARGET_AVX2 __m256i luma8(__m256i px, __m256i rg_shuffle, __m256i b_shuffle, __m256i rg_coef, __m256i b_coef, __m256i bias)
+        {
+            __m256i y = _mm256_add_epi32(
+                _mm256_madd_epi16(_mm256_shuffle_epi8(px, rg_shuffle), rg_coef),
+                _mm256_madd_epi16(_mm256_shuffle_epi8(px, b_shuffle), b_coef));
+            return _mm256_srai_epi32(_mm256_add_epi32(y, bias), 14);
+        }
+
+        BNB_TARGET_AVX2 void rgb_to_y_row_avx2(const uint8_t* src, uint8_t* y, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const __m256i rg_shuffle = _mm256_broadcastsi128_si256(rg_mask(layout));
+            const __m256i b_shuffle = _mm256_broadcastsi128_si256(b_mask(layout));
+            const __m256i rg_coef = _mm256_broadcastsi128_si256(pair(c.yr, c.yg));
+            const __m256i b_coef = _mm256_broadcastsi128_si256(pair(c.yb, 0));
+            const __m256i bias = _mm256_set1_epi32(c.y_bias);
+            // the packs work per 128 bit lane, this restores the pixel order
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+            int32_t x = 0;
+            for (; x + 32 <= width; x += 32) {
+                const __m256i* p = reinterpret_cast<const __m256i*>(src + x * 4);
+                __m256i y0 = luma8(_mm256_loadu_si256(p + 0), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m256i y1 = luma8(_mm256_loadu_si256(p + 1), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m256i y2 = luma8(_mm256_loadu_si256(p + 2), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m256i y3 = luma8(_mm256_loadu_si256(p + 3), rg_shuffle, b_shuffle, rg_coef, b_coef, bias);
+                __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), _mm256_permutevar8x32_epi32(packed, order));
+            }
+            if (x < width) {
+                rgb_to_y_row_sse41(src + x * 4, y + x, width - x, layout, c);
+            }
+        }
+
+        /* 8 chroma samples of 16 pixels, every sample repeated for the two pixels it covers */
+        BNB_TARGET_SSE41 void load_chroma16(const uint8_t* u, const uint8_t* v, int32_t step, __m128i& u_px, __m128i& v_px)
+        {
+            if (step == 2) {
+                const __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u));
+                u_px = _mm_shuffle_epi8(uv, _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 8, 8, 10, 10, 12, 12, 14, 14));
+                v_px = _mm_shuffle_epi8(uv, _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 9, 9, 11, 11, 13, 13, 15, 15));
+            } else {
+                const __m128i repeat = _mm_setr_epi8(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+                u_px = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(u)), repeat);
+                v_px = _mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v)), repeat);
+            }
+        }
+
+        /* 16 pixels of 8 bit channels to RGBA or BGRA, alpha is 255 */
+        BNB_TARGET_SSE41 void store_rgb16(uint8_t* dst, __m128i r, __m128i g, __m128i b, rgb_layout layout)
+        {
+            const __m128i alpha = _mm_set1_epi8(char(0xff));
+            const __m128i first = layout == rgb_layout::rgba ? r : b;
+            const __m128i third = layout == rgb_layout::rgba ? b : r;
+            const __m128i fg_lo = _mm_unpacklo_epi8(first, g);
+            const __m128i fg_hi = _mm_unpackhi_epi8(first, g);
+            const __m128i ta_lo = _mm_unpacklo_epi8(third, alpha);
+            const __m128i ta_hi = _mm_unpackhi_epi8(third, alpha);
+            __m128i* out = reinterpret_cast<__m128i*>(dst);
+            _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(fg_lo, ta_lo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(fg_lo, ta_lo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(fg_hi, ta_hi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(fg_hi, ta_hi));
+        }
+
+        /*
+         * The YUV -> RGB coefficients do not fit 16 bits (bu is over 2 in video range),
+         * the kernels multiply in 32 bits like the scalar one.
+         */
+        struct yuv_to_rgb_sse41
+        {
+            __m128i y_offset, c_offset, half;
+            __m128i ry, rv, gu, gv, bu;
+
+            BNB_TARGET_SSE41 explicit yuv_to_rgb_sse41(const yuv_coefficients& c)
+                : y_offset(_mm_set1_epi32(c.y_offset))
+                , c_offset(_mm_set1_epi32(128))
+                , half(_mm_set1_epi32(1 << 13))
+                , ry(_mm_set1_epi32(c.ry))
+                , rv(_mm_set1_epi32(c.rv))
+                , gu(_mm_set1_epi32(c.gu))
+                , gv(_mm_set1_epi32(c.gv))
+                , bu(_mm_set1_epi32(c.bu))
+            {
+            }
+
+            /* 4 pixels from the low 4 bytes of the Y, U and V vectors, the channels as 16 bit values in the low half */
+            BNB_TARGET_SSE41 void convert4(__m128i y_px, __m128i u_px, __m128i v_px, __m128i& r, __m128i& g, __m128i& b) const
+            {
+                const __m128i yy = _mm_mullo_epi32(_mm_sub_epi32(_mm_cvtepu8_epi32(y_px), y_offset), ry);
+                const __m128i uu = _mm_sub_epi32(_mm_cvtepu8_epi32(u_px), c_offset);
+                const __m128i vv = _mm_sub_epi32(_mm_cvtepu8_epi32(v_px), c_offset);
+                // ry == gy == by, the luma term is shared
+                const __m128i base = _mm_add_epi32(yy, half);
+                r = _mm_srai_epi32(_mm_add_epi32(base, _mm_mullo_epi32(vv, rv)), 14);
+                g = _mm_srai_epi32(_mm_add_epi32(base, _mm_add_epi32(_mm_mullo_epi32(uu, gu), _mm_mullo_epi32(vv, gv))), 14);
+                b = _mm_srai_epi32(_mm_add_epi32(base, _mm_mullo_epi32(uu, bu)), 14);
+            }
+        };
+
+        BNB_TARGET_SSE41 void yuv_to_rgb_row_sse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                                                  uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const yuv_to_rgb_sse41 k(c);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                __m128i y_px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+                __m128i u_px, v_px;
+                load_chroma16(u + (x / 2) * step, v + (x / 2) * step, step, u_px, v_px);
+
+                __m128i r[4], g[4], b[4];
+                k.convert4(y_px, u_px, v_px, r[0], g[0], b[0]);
+                k.convert4(_mm_srli_si128(y_px, 4), _mm_srli_si128(u_px, 4), _mm_srli_si128(v_px, 4), r[1], g[1], b[1]);
+                k.convert4(_mm_srli_si128(y_px, 8), _mm_srli_si128(u_px, 8), _mm_srli_si128(v_px, 8), r[2], g[2], b[2]);
+                k.convert4(_mm_srli_si128(y_px, 12), _mm_srli_si128(u_px, 12), _mm_srli_si128(v_px, 12), r[3], g[3], b[3]);
+
+                // the saturating packs are the clamp to 0..255 of the scalar kernel
+                store_rgb16(dst + x * 4,
+                            _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3])),
+                            _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), _mm_packs_epi32(g[2], g[3])),
+                            _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), _mm_packs_epi32(b[2], b[3])),
+                            layout);
+            }
+            if (x < width) {
+                const int32_t i = x / 2;
+                yuv_to_rgb_row_scalar(y + x, u + i * step, v + i * step, step, dst + x * 4, width - x, layout, c);
+            }
+        }
+
+        /* 8 values of one channel, saturated to 16 bits in pixel order */
+        BNB_TARGET_AVX2 __m128i pack8(__m256i v)
+        {
+            return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        }
+
+        BNB_TARGET_AVX2 void yuv_to_rgb_row_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t step,
+                                                uint8_t* dst, int32_t width, rgb_layout layout, const yuv_coefficients& c)
+        {
+            const __m256i y_offset = _mm256_set1_epi32(c.y_offset);
+            const __m256i c_offset = _mm256_set1_epi32(128);
+            const __m256i half = _mm256_set1_epi32(1 << 13);
+            const __m256i ry = _mm256_set1_epi32(c.ry);
+            const __m256i rv = _mm256_set1_epi32(c.rv);
+            const __m256i gu = _mm256_set1_epi32(c.gu);
+            const __m256i gv = _mm256_set1_epi32(c.gv);
+            const __m256i bu = _mm256_set1_epi32(c.bu);
+
+            int32_t x = 0;
+            for (; x + 16 <= width; x += 16) {
+                const __m128i y_px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+                __m128i u_px, v_px;
+                load_chroma16(u + (x / 2) * step, v + (x / 2) * step, step, u_px, v_px);
+
+                __m128i r16[2], g16[2], b16[2];
+                for (int32_t half_index = 0; half_index < 2; ++half_index) {
+                    // pixels 0-7, then 8-15
+                    const __m128i y8 = half_index == 0 ? y_px : _mm_srli_si128(y_px, 8);
+                    const __m128i u8 = half_index == 0 ? u_px : _mm_srli_si128(u_px, 8);
+                    const __m128i v8 = half_index == 0 ? v_px : _mm_srli_si128(v_px, 8);
+                    const __m256i yy = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvtepu8_epi32(y8), y_offset), ry);
+                    const __m256i uu = _mm256_sub_epi32(_mm256_cvtepu8_epi32(u8), c_offset);
+                    const __m256i vv = _mm256_sub_epi32(_mm256_cvtepu8_epi32(v8), c_offset);
+                    const __m256i base = _mm256_add_epi32(yy, half);
+                    r16[half_index] = pack8(_mm256_srai_epi32(_mm256_add_epi32(base, _mm256_mullo_epi32(vv, rv)), 14));
+                    g16[half_index] = pack8(_mm256_srai_epi32(
+                        _mm256_add_epi32(base, _mm256_add_epi32(_mm256_mullo_epi32(uu, gu), _mm256_mullo_epi32(vv, gv))), 14));
+                    b16[half_index] = pack8(_mm256_srai_epi32(_mm256_add_epi32(base, _mm256_mullo_epi32(uu, bu)), 14));
+                }
+                store_rgb16(dst + x * 4, _mm_packus_epi16(r16[0], r16[1]), _mm_packus_epi16(g16[0], g16[1]), _mm_packus_epi16(b16[0], b16[1]), layout);
+            }
+            if (x < width) {
+                const int32_t i = x / 2;
+                yuv_to_rgb_row_scalar(y + x, u + i * step, v + i * step, step, dst + x * 4, width - x, layout, c);
+            }
+        }
+
+        bool cpu_supports_sse41()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1");
+        }
+
+        bool cpu_supports_avx2()
+        {
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        }
+    } // namespace
+
+    bool sse41_kernels(kernels& out)
+    {
+        if (!cpu_supports_sse41()) {
+            return false;
+        }
+        out = {&rgb_to_y_row_sse41, &rgb_to_uv_row_sse41, &yuv_to_rgb_row_sse41};
+        return true;
+    }
+
+    bool avx2_kernels(kernels& out)
+    {
+        if (!cpu_supports_avx2()) {
+            return false;
+        }
+        // the chroma rows are a quarter of the work, they stay on the 128 bit kernel
+        out = {&rgb_to_y_row_avx2, &rgb_to_uv_row_sse41, &yuv_to_rgb_row_avx2};
+        return true;
+    }
+} // namespace bnb::image::detail
+
+#else
+
+namespace bnb::image::detail
+{
+    bool sse41_kernels(kernels&)
+    {
+        return false;
+    }
+
+    bool avx2_kernels(kernels&)
+    {
+        return false;
+    }
+} // namespace bnb::image::detail
+
+#endif
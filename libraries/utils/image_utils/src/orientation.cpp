@@ -0,0 +1,161 @@
+#include "orientation.hpp"
+#include "color_conversion_kernels.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace bnb::image
+{
+    namespace
+    {
+        // 64 x 16 pixels is 4 KB: for 90/270 degrees every tile row reads one cache line from 16 source rows
+        constexpr int32_t tile_w = 64;
+        constexpr int32_t tile_h = 16;
+
+        /// Address of the destination pixel (r, c) in the source is `origin + r * row_step + c * col_step`
+        struct walker
+        {
+            const uint8_t* origin;
+            ptrdiff_t row_step;
+            ptrdiff_t col_step;
+
+            const uint8_t* at(int32_t r, int32_t c) const
+            {
+                return origin + r * row_step + c * col_step;
+            }
+        };
+
+        walker make_walker(const uint8_t* src, int32_t stride, int32_t width, int32_t height, orientation orient)
+        {
+            auto offset = [&](int32_t r, int32_t c) -> ptrdiff_t {
+                int32_t sy = r, sx = c;
+                switch (orient.angle) {
+                    case rotation::deg0:
+                        break;
+                    case rotation::deg90:
+                        sy = height - 1 - c;
+                        sx = r;
+                        break;
+                    case rotation::deg180:
+                        sy = height - 1 - r;
+                        sx = width - 1 - c;
+                        break;
+                    case rotation::deg270:
+                        sy = c;
+                        sx = width - 1 - r;
+                        break;
+                }
+                if (orient.mirror) {
+                    sx = width - 1 - sx;
+                }
+                return ptrdiff_t(sy) * stride + ptrdiff_t(sx) * 4;
+            };
+            const ptrdiff_t origin = offset(0, 0);
+            return {src + origin, offset(1, 0) - origin, offset(0, 1) - origin};
+        }
+
+        bool is_transposed(rotation angle)
+        {
+            return angle == rotation::deg90 || angle == rotation::deg270;
+        }
+
+        inline uint32_t swap_red_blue(uint32_t v)
+        {
+            return (v & 0xff00ff00u) | ((v >> 16) & 0xffu) | ((v & 0xffu) << 16);
+        }
+
+        template<bool swap>
+        void gather_row(const uint8_t* src, ptrdiff_t col_step, int32_t count, uint8_t* dst)
+        {
+            for (int32_t c = 0; c < count; ++c) {
+                uint32_t v;
+                std::memcpy(&v, src, 4);
+                if constexpr (swap) {
+                    v = swap_red_blue(v);
+                }
+                std::memcpy(dst, &v, 4);
+                src += col_step;
+                dst += 4;
+            }
+        }
+
+        template<class F>
+        void for_each_tile(int32_t width, int32_t height, F&& f)
+        {
+            for (int32_t ty = 0; ty < height; ty += tile_h) {
+                for (int32_t tx = 0; tx < width; tx += tile_w) {
+                    f(tx, ty, std::min(tile_w, width - tx), std::min(tile_h, height - ty));
+                }
+            }
+        }
+    } // namespace
+
+    void orient_rgb(const uint8_t* src, int32_t src_stride, rgb_layout src_layout, int32_t width, int32_t height,
+                    orientation orient, uint8_t* dst, int32_t dst_stride, rgb_layout dst_layout)
+    {
+        const bool swap = src_layout != dst_layout;
+        const bool transposed = is_transposed(orient.angle);
+        const int32_t out_w = transposed ? height : width;
+        const int32_t out_h = transposed ? width : height;
+        const auto w = make_walker(src, src_stride, width, height, orient);
+
+        if (orient.angle == rotation::deg0 && !orient.mirror && !swap) {
+            for (int32_t r = 0; r < out_h; ++r) {
+                std::memcpy(dst + r * dst_stride, w.at(r, 0), size_t(out_w) * 4);
+            }
+            return;
+        }
+
+        const auto gather = swap ? &gather_row<true> : &gather_row<false>;
+        for_each_tile(out_w, out_h, [&](int32_t tx, int32_t ty, int32_t cols, int32_t rows) {
+            for (int32_t r = ty; r < ty + rows; ++r) {
+                gather(w.at(r, tx), w.col_step, cols, dst + r * dst_stride + tx * 4);
+            }
+        });
+    }
+
+    void orient_rgb_to_yuv(const uint8_t* src, int32_t src_stride, rgb_layout src_layout, int32_t width, int32_t height,
+                           orientation orient, const yuv_planes& dst, const yuv_format& format)
+    {
+        if (orient.angle == rotation::deg0 && !orient.mirror) {
+            // nothing to gather, the rows are converted in place
+            rgb_to_yuv(src, src_stride, src_layout, width, height, dst, format);
+            return;
+        }
+
+        const auto& c = coefficients(format.matrix, format.range);
+        const auto& k = detail::active_kernels();
+
+        const bool nv12 = format.layout == yuv_layout::nv12;
+        const int32_t step = nv12 ? 2 : 1;
+        const bool transposed = is_transposed(orient.angle);
+        const int32_t out_w = transposed ? height : width;
+        const int32_t out_h = transposed ? width : height;
+        const auto w = make_walker(src, src_stride, width, height, orient);
+
+        alignas(64) uint8_t tile[tile_h][tile_w * 4];
+
+        // tile origins are even, so the chroma of a tile never straddles two tiles
+        for_each_tile(out_w, out_h, [&](int32_t tx, int32_t ty, int32_t cols, int32_t rows) {
+            for (int32_t r = 0; r < rows; ++r) {
+                gather_row<false>(w.at(ty + r, tx), w.col_step, cols, tile[r]);
+            }
+
+            for (int32_t r = 0; r < rows; r += 2) {
+                const uint8_t* src0 = tile[r];
+                const uint8_t* src1 = r + 1 < rows ? tile[r + 1] : src0;
+                const int32_t row = ty + r;
+
+                k.rgb_to_y_row(src0, dst.y + row * dst.y_stride + tx, cols, src_layout, c);
+                if (r + 1 < rows) {
+                    k.rgb_to_y_row(src1, dst.y + (row + 1) * dst.y_stride + tx, cols, src_layout, c);
+                }
+
+                uint8_t* u = dst.u + (row / 2) * dst.u_stride + (tx / 2) * step;
+                uint8_t* v = nv12 ? u + 1 : dst.v + (row / 2) * dst.v_stride + tx / 2;
+                k.rgb_to_uv_row(src0, src1, u, v, step, cols, src_layout, c);
+            }
+        });
+    }
+} // namespace bnb::image
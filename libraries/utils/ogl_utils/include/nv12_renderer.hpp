@@ -0,0 +1,43 @@
+#pragma once
+
+#include "opengl.hpp"
+#include "program_cache.hpp"
+
+#include <color_conversion.hpp>
+
+#include <memory>
+
+namespace bnb::gl
+{
+    /**
+     * Draws a RGBA texture as NV12 into two render targets, the Y plane (R8, width x height)
+     * and the interleaved UV plane (RG8, width/2 x height/2), e.g. the plane textures of a
+     * biplanar IOSurface, so the frame needs no readback and no CPU conversion at all.
+     * Chroma is the average of 2x2 pixels, as in image::rgb_to_yuv. Width and height must be even.
+     * The frame is the top left width x height corner of the texture and of the planes, which
+     * may be larger.
+     * Must be used on the GL thread.
+     */
+    class nv12_renderer
+    {
+    public:
+        nv12_renderer();
+        ~nv12_renderer();
+
+        nv12_renderer(const nv12_renderer&) = delete;
+        nv12_renderer& operator=(const nv12_renderer&) = delete;
+
+        /**
+         * Returns false when a plane is not renderable. Leaves the framebuffer, program
+         * and vertex array unbound.
+         */
+        bool draw(GLenum target, GLuint texture, int32_t width, int32_t height, const image::yuv_format& format,
+                  GLenum y_target, GLuint y_texture, GLenum uv_target, GLuint uv_texture);
+
+    private:
+        std::shared_ptr<linked_program> m_luma;
+        std::shared_ptr<linked_program> m_chroma;
+        GLuint m_vao{0};
+        GLuint m_framebuffer{0};
+    };
+} // namespace bnb::gl
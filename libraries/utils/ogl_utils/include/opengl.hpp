@@ -1,13 +1,38 @@
 #pragma once
 
 // #include <glad/glad.h>
+#if defined(__APPLE__)
 #include <OpenGLES/ES3/gl.h>
+#else
+#include <GLES3/gl32.h>
+#endif
 //#import <OpenGLES/ES3/gl.h>
 #define BNB_GL
 // #include <OpenGL/gl.h>
 
 #include "singleton.hpp"
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * GL_CALL reports GL errors only in builds with BNB_GL_CHECKS, on by default in debug
+ * builds. Without it GL_CALL is the bare call, the debug_callback mode still works.
+ */
+#if !defined(BNB_GL_CHECKS)
+    #if defined(NDEBUG)
+        #define BNB_GL_CHECKS 0
+    #else
+        #define BNB_GL_CHECKS 1
+    #endif
+#endif
+
 namespace bnb::gl
 {
     enum class mali_gpu_family
@@ -22,6 +47,111 @@ namespace bnb::gl
         _61x,
     };
 
+    /**
+     * Shadow copy of the GL state the glue layer changes per frame, a call that would set
+     * the value GL already has is skipped. Bindings are forgotten with invalidate() whenever
+     * code that does not go through the cache (the SDK draw) has run, object state (the
+     * color attachment of a framebuffer, texture sampling parameters) is kept until the
+     * object is forgotten, the caller must not let that code change it.
+     * One per context, used on the thread the context is current on, see context_info::state.
+     * Programs deleted through another context of the share group are forgotten with the
+     * next invalidate().
+     */
+    class state_cache
+    {
+    public:
+        struct counters_t
+        {
+            uint64_t issued{0};
+            uint64_t elided{0};
+        };
+
+        /// forget the bindings and the viewport, the next call of each one is issued
+        void invalidate();
+        /// the object is deleted (its name may come back), forgets its state and unbinds it
+        void forget_framebuffer(GLuint framebuffer);
+        void forget_texture(GLuint texture);
+        void forget_program(GLuint program);
+
+        void bind_framebuffer(GLuint framebuffer);
+        /**
+         * Attaches the texture as the color attachment 0 of the bound framebuffer. The
+         * completeness is checked only when the attachment changes, false if incomplete.
+         */
+        bool attach_color_texture(GLenum target, GLuint texture);
+        void use_program(GLuint program);
+        void bind_vertex_array(GLuint vao);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        void active_texture(GLenum unit);
+        /// GL_TEXTURE_2D bindings of the first texture units are tracked, the rest is issued
+        void bind_texture(GLenum target, GLuint texture);
+        /// filters and wraps of the texture bound to `target` on the active unit
+        void tex_parameter(GLenum target, GLenum name, GLint value);
+
+        counters_t counters() const
+        {
+            return m_counters;
+        }
+
+        void reset_counters()
+        {
+            m_counters = {};
+        }
+
+    private:
+        static constexpr GLuint unknown = ~GLuint(0);
+        static constexpr size_t tracked_units = 8;
+
+        struct framebuffer_state
+        {
+            GLuint color_texture{unknown};
+            bool complete{false};
+        };
+
+        /* min filter, mag filter, wrap s, wrap t */
+        using sampler_state = std::array<GLint, 4>;
+
+        bool elide(bool same);
+        GLuint bound_texture_2d() const;
+
+        GLuint m_framebuffer{unknown};
+        GLuint m_program{unknown};
+        GLuint m_vao{unknown};
+        std::array<GLint, 4> m_viewport{-1, -1, -1, -1};
+        GLenum m_active_unit{unknown};
+        std::array<GLuint, tracked_units> m_textures_2d{};
+
+        std::unordered_map<GLuint, framebuffer_state> m_framebuffers;
+        std::unordered_map<GLuint, sampler_state> m_samplers;
+        counters_t m_counters;
+    };
+
+    /**
+     * How GL errors are found:
+     * `off` - not checked;
+     * `sampled` - glGetError after every Nth GL_CALL, an error is charged to the sampled site;
+     * `full` - glGetError after every GL_CALL, each one may sync the CPU with the GPU;
+     * `debug_callback` - KHR_debug messages of the driver, no polling. Synchronous output,
+     * so a message is charged to the GL_CALL it came from (to "unknown" outside one).
+     */
+    enum class error_check_mode
+    {
+        off,
+        sampled,
+        full,
+        debug_callback
+    };
+
+    /// errors of one call site, `code` is the glGetError code or the KHR_debug message id
+    struct error_site
+    {
+        const char* file;
+        int line;
+        GLenum code;
+        uint64_t count;
+    };
+
     class context_info : public bnb::singleton<context_info>
     {
     public:
@@ -38,23 +168,131 @@ namespace bnb::gl
 
         std::pair<int, int> gl_version{};
 
+
     public:
         context_info();
         virtual ~context_info() = default;
 
-        void check_error(const char* file, int line);
+        /**
+         * The state cache of the context current on the calling thread, as bound with
+         * bind_state. A process wide one on threads with no bound cache, enough for a
+         * single context.
+         */
+        state_cache& state()
+        {
+            return t_state != nullptr ? *t_state : m_default_state;
+        }
+
+        /**
+         * The owner of a context binds its state cache whenever it makes the context
+         * current on a thread, nullptr when it releases it.
+         */
+        static void bind_state(state_cache* state)
+        {
+            t_state = state;
+        }
+
+        /**
+         * `full` in debug builds, `off` otherwise. `sample_period` is for `sampled` only.
+         * Returns false and keeps the mode if the context has no KHR_debug for `debug_callback`,
+         * the callback is installed into the context current on the calling thread.
+         */
+        bool set_error_check_mode(error_check_mode mode, uint32_t sample_period = 64);
+        error_check_mode get_error_check_mode() const
+        {
+            return m_error_mode.load(std::memory_order_relaxed);
+        }
+
+        /// errors since the last reset, one row per call site and code
+        std::vector<error_site> error_stats() const;
+        void reset_error_stats();
+
+        void check_error(const char* file, int line)
+        {
+            switch (m_error_mode.load(std::memory_order_relaxed)) {
+                case error_check_mode::off:
+                case error_check_mode::debug_callback:
+                    return;
+                case error_check_mode::sampled:
+                    if (++t_calls % m_sample_period != 0) {
+                        return;
+                    }
+                    break;
+                case error_check_mode::full:
+                    break;
+            }
+            poll_errors(file, line);
+        }
+
+        /// the GL_CALL being made on this thread, see debug_callback
+        static void enter_call(const char* file, int line)
+        {
+            t_call_file = file;
+            t_call_line = line;
+        }
+
+        static void leave_call()
+        {
+            t_call_file = nullptr;
+        }
 
     private:
+        struct site_key
+        {
+            const char* file;
+            int line;
+            GLenum code;
+
+            bool operator==(const site_key& other) const
+            {
+                return file == other.file && line == other.line && code == other.code;
+            }
+        };
+
+        struct site_hash
+        {
+            size_t operator()(const site_key& key) const
+            {
+                return std::hash<const void*>()(key.file) ^ (size_t(key.line) << 16) ^ key.code;
+            }
+        };
+
         bool is_rgba16f_available();
+        bool enable_debug_callback(bool enable);
 
         const char* error_code_to_string(GLenum error_code) const;
-        void on_error(GLenum error_code, const char* file, int line);
+        void poll_errors(const char* file, int line);
+        void on_error(GLenum error_code, const char* file, int line, const char* message = nullptr);
+
+#if !defined(__APPLE__)
+        // EAGL has no KHR_debug
+        static void GL_APIENTRY on_debug_message(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                                 GLsizei length, const GLchar* message, const void* user_param);
+#endif
+
+        std::atomic<error_check_mode> m_error_mode{error_check_mode::off};
+        uint32_t m_sample_period{64};
+        static inline thread_local uint32_t t_calls{0};
+
+        mutable std::mutex m_errors_mutex;
+        std::unordered_map<site_key, uint64_t, site_hash> m_errors;
+
+        state_cache m_default_state;
+        static inline thread_local state_cache* t_state{nullptr};
+
+        static inline thread_local const char* t_call_file{nullptr};
+        static inline thread_local int t_call_line{0};
     };
 
 } // namespace bnb::gl
 
-#define GL_CHECK_ERROR() bnb::gl::context_info::instance().check_error(__FILE__, __LINE__)
-#define GL_CALL(FUNC) [&]() {FUNC; GL_CHECK_ERROR(); }()
+#if BNB_GL_CHECKS
+    #define GL_CHECK_ERROR() bnb::gl::context_info::instance().check_error(__FILE__, __LINE__)
+    #define GL_CALL(FUNC) [&]() { bnb::gl::context_info::enter_call(__FILE__, __LINE__); FUNC; bnb::gl::context_info::leave_call(); GL_CHECK_ERROR(); }()
+#else
+    #define GL_CHECK_ERROR() ((void) 0)
+    #define GL_CALL(FUNC) [&]() { FUNC; }()
+#endif
 
 #define BNB_GL_INIT() ((void) 0)
 #define BNB_GL_START_GROUP(name) ((void) 0)
@@ -1,10 +1,17 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <unordered_map>
 
 namespace bnb
 {
+    namespace gl
+    {
+        class linked_program;
+    }
+
+    /// Programs with identical sources share one GL object, see gl::program_cache
     class program
     {
     public:
@@ -26,6 +33,7 @@ namespace bnb
         unsigned int handle() const { return m_handle; }
 
     private:
+        std::shared_ptr<gl::linked_program> m_program;
         unsigned int m_handle;
         mutable std::unordered_map<const void*, unsigned int> m_uniforms;
     };
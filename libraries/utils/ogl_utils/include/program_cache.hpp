@@ -0,0 +1,88 @@
+#pragma once
+
+#include "opengl.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace bnb::gl
+{
+    /// Owns a linked GL program object, the object is deleted with the last reference
+    class linked_program
+    {
+    public:
+        explicit linked_program(GLuint handle)
+            : m_handle(handle)
+        {
+        }
+
+        ~linked_program();
+
+        linked_program(const linked_program&) = delete;
+        linked_program& operator=(const linked_program&) = delete;
+
+        GLuint handle() const
+        {
+            return m_handle;
+        }
+
+    private:
+        GLuint m_handle;
+    };
+
+    /**
+     * Process wide registry of linked programs. Identical sources are compiled once and
+     * shared while anybody holds the program. With a cache directory set, linked binaries
+     * are stored with glGetProgramBinary and loaded with glProgramBinary on the next start,
+     * keyed by the sources and the GL vendor, renderer and version strings. A binary the
+     * driver rejects is replaced by a compiled one.
+     * All callers must share GL objects, i.e. use one context or one share group.
+     */
+    class program_cache : public bnb::singleton<program_cache>
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t shared{0};          // served from a live program
+            uint64_t binary_loaded{0};   // linked from the disk cache
+            uint64_t binary_rejected{0}; // disk cache entry refused by the driver or corrupt
+            uint64_t compiled{0};        // compiled and linked from the sources
+            uint64_t binary_stored{0};
+        };
+
+        program_cache() = default;
+
+        /// an empty path (the default) disables the disk cache, the directory must exist
+        void set_directory(std::string path);
+
+        /// the sources are complete shaders, `name` is used in error messages only
+        std::shared_ptr<linked_program> acquire(const char* name, const std::string& vertex_source, const std::string& fragment_source);
+
+        stats_t stats() const;
+
+        /// forgets the live programs, the disk cache is kept
+        void clear();
+
+    private:
+        struct entry
+        {
+            std::string vertex_source;
+            std::string fragment_source;
+            std::weak_ptr<linked_program> program;
+        };
+
+        GLuint load_binary(const std::string& path, uint64_t source_hash);
+        void store_binary(const std::string& path, uint64_t source_hash, GLuint program);
+        std::string binary_path(uint64_t source_hash);
+
+        mutable std::mutex m_mutex;
+        std::unordered_multimap<uint64_t, entry> m_programs;
+        std::string m_directory;
+        std::string m_driver;
+        stats_t m_stats;
+    };
+
+} // namespace bnb::gl
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "opengl.hpp"
+#include "program_cache.hpp"
+
+#include <color_conversion.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace bnb::gl
+{
+    /**
+     * Converts a RGBA texture to NV12 or I420 on the GPU and reads the planes back
+     * through a ring of pixel pack buffers, so the CPU never waits for the frame it
+     * has just submitted. The planes are packed into one RGBA8 target of width/4 by
+     * height*3/2 texels, four 8 bit samples per texel. A single glReadPixels then
+     * returns the planes back to back with tight strides: Y (stride width), then
+     * the interleaved UV plane (stride width) for NV12 or U and V (stride width/2)
+     * for I420. Chroma is the average of 2x2 pixels, as in image::rgb_to_yuv.
+     * Must be used on the GL thread.
+     */
+    class yuv_readback
+    {
+    public:
+        struct frame
+        {
+            image::yuv_format format;
+            int32_t width;
+            int32_t height;
+            uint64_t tag;
+            const uint8_t* data; // mapped, valid during the consumer call only
+            size_t size;
+        };
+
+        struct stats_t
+        {
+            uint64_t submitted{0};
+            uint64_t consumed{0};
+            uint64_t waits{0}; // the GPU had not finished the readback when it was consumed with wait
+        };
+
+        /// `depth` readbacks may be in flight, at least 2
+        explicit yuv_readback(size_t depth = 2);
+        ~yuv_readback();
+
+        yuv_readback(const yuv_readback&) = delete;
+        yuv_readback& operator=(const yuv_readback&) = delete;
+
+        /// NV12 needs a width divisible by 4 and an even height, I420 a width divisible by 8 and a height divisible by 4
+        static bool supports(int32_t width, int32_t height, image::yuv_layout layout);
+
+        /// bytes of all planes of a frame
+        static size_t frame_size(int32_t width, int32_t height);
+
+        /**
+         * Converts `texture` (RGBA, the frame is its top left width x height corner) and starts the readback, `tag` comes back
+         * with the frame. Returns false for unsupported sizes and while `depth` readbacks are
+         * in flight. Leaves the framebuffer, program, vertex array and the pack buffer unbound.
+         */
+        bool convert(GLenum target, GLuint texture, int32_t width, int32_t height, const image::yuv_format& format, uint64_t tag);
+
+        /**
+         * Hands the oldest readback to `consume` and returns true. Without `wait` it returns
+         * false while the GPU has not finished it yet.
+         */
+        bool consume(bool wait, const std::function<void(const frame&)>& consume);
+
+        size_t pending() const
+        {
+            return m_pending.size();
+        }
+
+        size_t depth() const
+        {
+            return m_slots.size();
+        }
+
+        stats_t stats() const
+        {
+            return m_stats;
+        }
+
+    private:
+        struct slot
+        {
+            GLuint buffer{0};
+            size_t capacity{0};
+            GLsync fence{nullptr};
+            image::yuv_format format{};
+            int32_t width{0};
+            int32_t height{0};
+            uint64_t tag{0};
+        };
+
+        void reserve_target(int32_t width, int32_t height);
+
+        std::shared_ptr<linked_program> m_luma;
+        std::shared_ptr<linked_program> m_chroma_nv12;
+        std::shared_ptr<linked_program> m_chroma_i420;
+        GLuint m_vao{0};
+
+        GLuint m_texture{0};
+        GLuint m_framebuffer{0};
+        int32_t m_target_width{0};
+        int32_t m_target_height{0};
+
+        std::vector<slot> m_slots;
+        std::deque<size_t> m_pending; // oldest first
+        size_t m_next{0};
+        stats_t m_stats;
+    };
+} // namespace bnb::gl
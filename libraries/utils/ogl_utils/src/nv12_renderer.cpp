@@ -0,0 +1,112 @@
+#include "nv12_renderer.hpp"
+
+namespace
+{
+    // a triangle covering the viewport, no vertex buffer needed
+    const char* vs_fullscreen =
+        "#version 300 es\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;\n"
+        "    gl_Position = vec4(p, 0.0, 1.0);\n"
+        "}\n";
+
+    const char* ps_luma =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "uniform sampler2D uTexture;\n"
+        "uniform vec4 uY;\n"
+        "out vec4 FragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 c = texelFetch(uTexture, ivec2(gl_FragCoord.xy), 0).rgb;\n"
+        "    FragColor = vec4(dot(c, uY.rgb) + uY.a, 0.0, 0.0, 1.0);\n"
+        "}\n";
+
+    // the bilinear sample at the center of a 2x2 block is its average
+    const char* ps_chroma =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "uniform sampler2D uTexture;\n"
+        "uniform vec4 uU;\n"
+        "uniform vec4 uV;\n"
+        "out vec4 FragColor;\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 texel = 1.0 / vec2(textureSize(uTexture, 0));\n"
+        "    vec3 c = texture(uTexture, (floor(gl_FragCoord.xy) * 2.0 + 1.0) * texel).rgb;\n"
+        "    FragColor = vec4(dot(c, uU.rgb) + uU.a, dot(c, uV.rgb) + uV.a, 0.0, 1.0);\n"
+        "}\n";
+
+    constexpr float q14 = 1.0f / 16384.0f;
+
+    void set_coefficients(GLint location, int16_t r, int16_t g, int16_t b, int32_t offset)
+    {
+        GL_CALL(glUniform4f(location, r * q14, g * q14, b * q14, offset / 255.0f));
+    }
+} // namespace
+
+namespace bnb::gl
+{
+    nv12_renderer::nv12_renderer()
+        : m_luma(program_cache::instance().acquire("Nv12Luma", vs_fullscreen, ps_luma))
+        , m_chroma(program_cache::instance().acquire("Nv12Chroma", vs_fullscreen, ps_chroma))
+    {
+        auto& state = context_info::instance().state();
+        for (const auto& program : {m_luma, m_chroma}) {
+            state.use_program(program->handle());
+            GL_CALL(glUniform1i(glGetUniformLocation(program->handle(), "uTexture"), 0));
+        }
+        state.use_program(0);
+
+        GL_CALL(glGenVertexArrays(1, &m_vao));
+        GL_CALL(glGenFramebuffers(1, &m_framebuffer));
+    }
+
+    nv12_renderer::~nv12_renderer()
+    {
+        context_info::instance().state().forget_framebuffer(m_framebuffer);
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+
+    bool nv12_renderer::draw(GLenum target, GLuint texture, int32_t width, int32_t height, const image::yuv_format& format,
+                             GLenum y_target, GLuint y_texture, GLenum uv_target, GLuint uv_texture)
+    {
+        auto& state = context_info::instance().state();
+        const auto& c = image::coefficients(format.matrix, format.range);
+
+        state.active_texture(GL_TEXTURE0);
+        state.bind_texture(target, texture);
+        state.tex_parameter(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state.bind_vertex_array(m_vao);
+        state.bind_framebuffer(m_framebuffer);
+
+        bool complete = state.attach_color_texture(y_target, y_texture);
+        if (complete) {
+            const GLuint program = m_luma->handle();
+            state.use_program(program);
+            state.viewport(0, 0, width, height);
+            set_coefficients(glGetUniformLocation(program, "uY"), c.yr, c.yg, c.yb, c.y_offset);
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        }
+
+        complete = complete && state.attach_color_texture(uv_target, uv_texture);
+        if (complete) {
+            const GLuint program = m_chroma->handle();
+            state.use_program(program);
+            state.viewport(0, 0, width / 2, height / 2);
+            set_coefficients(glGetUniformLocation(program, "uU"), c.ur, c.ug, c.ub, 128);
+            set_coefficients(glGetUniformLocation(program, "uV"), c.vr, c.vg, c.vb, 128);
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        }
+
+        state.bind_vertex_array(0);
+        state.use_program(0);
+        state.bind_framebuffer(0);
+        return complete;
+    }
+} // namespace bnb::gl
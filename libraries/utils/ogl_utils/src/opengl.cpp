@@ -1,5 +1,5 @@
 #ifndef BNB_WRITE_LOG_MESSAGE
-    #define WRITE_LOG_MESSAGE(severity, message) std::cout << #severity << message << std::endl
+    #define WRITE_LOG_MESSAGE(severity, message) std::cerr << #severity << ": " << message << std::endl
 #else
     #define WRITE_LOG_MESSAGE(severity, message) BNB_WRITE_LOG_MESSAGE(severity) << message
 #endif
@@ -10,6 +10,7 @@
     #define WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity, message) BNB_WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity) << message
 #endif
 
+#include <cstring>
 #include <iostream>
 #include <string>
 #include "opengl.hpp"
@@ -26,6 +27,11 @@ gl::context_info::context_info()
 
      glGetIntegerv(GL_MAX_TEXTURE_SIZE, &caps.max_texture_size);
      caps.has_rgba16f = is_rgba16f_available();
+     m_default_state.invalidate();
+
+#if BNB_GL_CHECKS && !defined(NDEBUG)
+     m_error_mode = error_check_mode::full;
+#endif
 }
 
 bool gl::context_info::is_rgba16f_available()
@@ -54,16 +60,257 @@ const char* gl::context_info::error_code_to_string(GLenum error_code) const
     }
 }
 
-void gl::context_info::on_error(GLenum error_code, const char* file, int line)
+void gl::context_info::on_error(GLenum error_code, const char* file, int line, const char* message)
 {
-    WRITE_LOG_MESSAGE(
-        warning, "glGetError: " << error_code_to_string(error_code) << " | " << file << " (" << line << ") ");
+    uint64_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_errors_mutex);
+        count = ++m_errors[{file, line, error_code}];
+    }
+    // once per site, error_stats() has the counts
+    if (count != 1) {
+        return;
+    }
+    if (message != nullptr) {
+        WRITE_LOG_MESSAGE(warning, "KHR_debug " << error_code << ": " << message << " | " << file << " (" << line << ") ");
+    } else {
+        WRITE_LOG_MESSAGE(warning, "glGetError: " << error_code_to_string(error_code) << " | " << file << " (" << line << ") ");
+    }
 }
 
-void gl::context_info::check_error(const char* file, int line)
+void gl::context_info::poll_errors(const char* file, int line)
 {
     GLenum error_code;
     while ((error_code = glGetError()) != GL_NO_ERROR) {
-        context_info::instance().on_error(error_code, file, line);
+        on_error(error_code, file, line);
+    }
+}
+
+bool gl::context_info::set_error_check_mode(error_check_mode mode, uint32_t sample_period)
+{
+    const bool callback = mode == error_check_mode::debug_callback;
+    if (callback != (get_error_check_mode() == error_check_mode::debug_callback) && !enable_debug_callback(callback)) {
+        return false;
+    }
+    m_sample_period = sample_period != 0 ? sample_period : 1;
+    t_calls = 0;
+    m_error_mode = mode;
+    return true;
+}
+
+std::vector<gl::error_site> gl::context_info::error_stats() const
+{
+    std::lock_guard<std::mutex> lock(m_errors_mutex);
+    std::vector<error_site> stats;
+    stats.reserve(m_errors.size());
+    for (const auto& [key, count] : m_errors) {
+        stats.push_back({key.file, key.line, key.code, count});
+    }
+    return stats;
+}
+
+void gl::context_info::reset_error_stats()
+{
+    std::lock_guard<std::mutex> lock(m_errors_mutex);
+    m_errors.clear();
+}
+
+#if defined(__APPLE__)
+
+bool gl::context_info::enable_debug_callback(bool enable)
+{
+    return !enable;
+}
+
+#else
+
+bool gl::context_info::enable_debug_callback(bool enable)
+{
+    // core in GLES 3.2, the KHR suffixed entry points of older contexts are not looked up
+    if (gl_version < std::make_pair(3, 2)) {
+        return !enable;
+    }
+    if (!enable) {
+        glDebugMessageCallback(nullptr, nullptr);
+        glDisable(GL_DEBUG_OUTPUT);
+        return true;
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+    // in the thread and the call that caused it, that is what attributes it to a call site
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    glDebugMessageCallback(&context_info::on_debug_message, this);
+    return glGetError() == GL_NO_ERROR;
+}
+
+void GL_APIENTRY gl::context_info::on_debug_message(GLenum, GLenum, GLuint id, GLenum, GLsizei, const GLchar* message, const void* user_param)
+{
+    auto* self = static_cast<context_info*>(const_cast<void*>(user_param));
+    if (t_call_file != nullptr) {
+        self->on_error(id, t_call_file, t_call_line, message);
+    } else {
+        self->on_error(id, "unknown", 0, message);
+    }
+}
+
+#endif
+
+bool gl::state_cache::elide(bool same)
+{
+    ++(same ? m_counters.elided : m_counters.issued);
+    return same;
+}
+
+void gl::state_cache::invalidate()
+{
+    m_framebuffer = unknown;
+    m_program = unknown;
+    m_vao = unknown;
+    m_viewport = {-1, -1, -1, -1};
+    m_active_unit = unknown;
+    m_textures_2d.fill(unknown);
+}
+
+void gl::state_cache::forget_framebuffer(GLuint framebuffer)
+{
+    m_framebuffers.erase(framebuffer);
+    if (m_framebuffer == framebuffer) {
+        m_framebuffer = 0;
+    }
+}
+
+void gl::state_cache::forget_texture(GLuint texture)
+{
+    m_samplers.erase(texture);
+    for (auto& bound : m_textures_2d) {
+        if (bound == texture) {
+            bound = 0;
+        }
+    }
+    // GL detaches a deleted texture from the bound framebuffer only, re-attach everywhere
+    for (auto& [framebuffer, state] : m_framebuffers) {
+        if (state.color_texture == texture) {
+            state.color_texture = unknown;
+        }
+    }
+}
+
+void gl::state_cache::forget_program(GLuint program)
+{
+    if (m_program == program) {
+        m_program = unknown;
+    }
+}
+
+void gl::state_cache::bind_framebuffer(GLuint framebuffer)
+{
+    if (elide(m_framebuffer == framebuffer)) {
+        return;
+    }
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+    m_framebuffer = framebuffer;
+}
+
+bool gl::state_cache::attach_color_texture(GLenum target, GLuint texture)
+{
+    if (m_framebuffer == unknown) {
+        // bound behind the cache, nothing to compare with
+        m_counters.issued += 2;
+        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, 0));
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    auto& state = m_framebuffers[m_framebuffer];
+    if (state.color_texture == texture) {
+        // the attachment and the completeness check
+        m_counters.elided += 2;
+        return state.complete;
+    }
+    m_counters.issued += 2;
+    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, 0));
+    state.color_texture = texture;
+    state.complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    return state.complete;
+}
+
+void gl::state_cache::use_program(GLuint program)
+{
+    if (elide(m_program == program)) {
+        return;
+    }
+    GL_CALL(glUseProgram(program));
+    m_program = program;
+}
+
+void gl::state_cache::bind_vertex_array(GLuint vao)
+{
+    if (elide(m_vao == vao)) {
+        return;
+    }
+    GL_CALL(glBindVertexArray(vao));
+    m_vao = vao;
+}
+
+void gl::state_cache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    const std::array<GLint, 4> viewport{x, y, width, height};
+    if (elide(m_viewport == viewport)) {
+        return;
+    }
+    GL_CALL(glViewport(x, y, width, height));
+    m_viewport = viewport;
+}
+
+void gl::state_cache::active_texture(GLenum unit)
+{
+    if (elide(m_active_unit == unit)) {
+        return;
+    }
+    GL_CALL(glActiveTexture(unit));
+    m_active_unit = unit;
+}
+
+GLuint gl::state_cache::bound_texture_2d() const
+{
+    const size_t unit = m_active_unit - GL_TEXTURE0;
+    return m_active_unit != unknown && unit < tracked_units ? m_textures_2d[unit] : unknown;
+}
+
+void gl::state_cache::bind_texture(GLenum target, GLuint texture)
+{
+    const size_t unit = m_active_unit - GL_TEXTURE0;
+    const bool tracked = target == GL_TEXTURE_2D && m_active_unit != unknown && unit < tracked_units;
+    if (elide(tracked && m_textures_2d[unit] == texture)) {
+        return;
+    }
+    GL_CALL(glBindTexture(target, texture));
+    if (tracked) {
+        m_textures_2d[unit] = texture;
+    }
+}
+
+void gl::state_cache::tex_parameter(GLenum target, GLenum name, GLint value)
+{
+    size_t index = 0;
+    switch (name) {
+        case GL_TEXTURE_MIN_FILTER: index = 0; break;
+        case GL_TEXTURE_MAG_FILTER: index = 1; break;
+        case GL_TEXTURE_WRAP_S: index = 2; break;
+        case GL_TEXTURE_WRAP_T: index = 3; break;
+        default: index = 4; break;
+    }
+    const GLuint texture = target == GL_TEXTURE_2D ? bound_texture_2d() : unknown;
+    if (index == 4 || texture == unknown) {
+        elide(false);
+        GL_CALL(glTexParameteri(target, name, value));
+        return;
+    }
+    // the GL defaults are not assumed, the first call per texture is always issued
+    auto [it, inserted] = m_samplers.try_emplace(texture, sampler_state{-1, -1, -1, -1});
+    if (elide(it->second[index] == value)) {
+        return;
     }
+    GL_CALL(glTexParameteri(target, name, value));
+    it->second[index] = value;
 }
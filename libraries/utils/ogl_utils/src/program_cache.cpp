@@ -0,0 +1,258 @@
+#include "program_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+using namespace bnb;
+using namespace std;
+
+namespace
+{
+    constexpr uint32_t binary_magic = 0x504e4e42; // "BNNP"
+    constexpr uint32_t binary_version = 1;
+
+    struct binary_header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_hash;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    uint64_t fnv1a(const string& s, uint64_t hash = 14695981039346656037ull)
+    {
+        for (unsigned char c : s) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        // keeps "ab" + "c" and "a" + "bc" apart
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+        return hash;
+    }
+
+    string gl_string(GLenum name)
+    {
+        auto* s = reinterpret_cast<const char*>(glGetString(name));
+        return s != nullptr ? s : "";
+    }
+
+    GLuint compile_shader(GLenum type, const string& source, const char* name)
+    {
+        GLuint shader = glCreateShader(type);
+        const char* source_c = source.c_str();
+        GL_CALL(glShaderSource(shader, 1, &source_c, nullptr));
+        GL_CALL(glCompileShader(shader));
+
+        GLint success = 0;
+        GL_CALL(glGetShaderiv(shader, GL_COMPILE_STATUS, &success));
+        if (!success) {
+            char info_log[512];
+            GL_CALL(glGetShaderInfoLog(shader, sizeof(info_log), nullptr, info_log));
+            GL_CALL(glDeleteShader(shader));
+            throw runtime_error(string(type == GL_VERTEX_SHADER ? "ERROR::SHADER::VERTEX::COMPILATION_FAILED " : "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED ")
+                                + name + " " + info_log);
+        }
+        return shader;
+    }
+
+    bool is_linked(GLuint program)
+    {
+        GLint success = 0;
+        GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &success));
+        return success != 0;
+    }
+
+    GLuint compile_and_link(const char* name, const string& vertex_source, const string& fragment_source, bool retrievable)
+    {
+        GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source, name);
+        GLuint fragment_shader = 0;
+        try {
+            fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source, name);
+        } catch (...) {
+            GL_CALL(glDeleteShader(vertex_shader));
+            throw;
+        }
+
+        GLuint program = glCreateProgram();
+        if (retrievable) {
+            GL_CALL(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
+        GL_CALL(glAttachShader(program, vertex_shader));
+        GL_CALL(glAttachShader(program, fragment_shader));
+        GL_CALL(glLinkProgram(program));
+        GL_CALL(glDeleteShader(vertex_shader));
+        GL_CALL(glDeleteShader(fragment_shader));
+
+        if (!is_linked(program)) {
+            char info_log[512];
+            GL_CALL(glGetProgramInfoLog(program, sizeof(info_log), nullptr, info_log));
+            GL_CALL(glDeleteProgram(program));
+            throw runtime_error("ERROR::SHADER::PROGRAM::LINKING_FAILED "s + name + " " + info_log);
+        }
+        return program;
+    }
+} // namespace
+
+gl::linked_program::~linked_program()
+{
+    context_info::instance().state().forget_program(m_handle);
+    GL_CALL(glDeleteProgram(m_handle));
+}
+
+void gl::program_cache::set_directory(string path)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_directory = std::move(path);
+    if (!m_directory.empty() && m_directory.back() != '/') {
+        m_directory.push_back('/');
+    }
+}
+
+shared_ptr<gl::linked_program> gl::program_cache::acquire(const char* name, const string& vertex_source, const string& fragment_source)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    const uint64_t source_hash = fnv1a(fragment_source, fnv1a(vertex_source));
+    auto range = m_programs.equal_range(source_hash);
+    for (auto it = range.first; it != range.second;) {
+        auto program = it->second.program.lock();
+        if (!program) {
+            it = m_programs.erase(it);
+            continue;
+        }
+        if (it->second.vertex_source == vertex_source && it->second.fragment_source == fragment_source) {
+            ++m_stats.shared;
+            return program;
+        }
+        ++it;
+    }
+
+    GLuint handle = 0;
+    std::string path;
+    if (!m_directory.empty()) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats > 0) {
+            path = binary_path(source_hash);
+            handle = load_binary(path, source_hash);
+        }
+    }
+    if (handle == 0) {
+        handle = compile_and_link(name, vertex_source, fragment_source, !path.empty());
+        ++m_stats.compiled;
+        if (!path.empty()) {
+            store_binary(path, source_hash, handle);
+        }
+    }
+
+    auto program = make_shared<linked_program>(handle);
+    m_programs.emplace(source_hash, entry{vertex_source, fragment_source, program});
+    return program;
+}
+
+gl::program_cache::stats_t gl::program_cache::stats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void gl::program_cache::clear()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_programs.clear();
+}
+
+string gl::program_cache::binary_path(uint64_t source_hash)
+{
+    // the driver string is read once, binaries are only valid for the driver that made them
+    if (m_driver.empty()) {
+        m_driver = gl_string(GL_VENDOR) + "|" + gl_string(GL_RENDERER) + "|" + gl_string(GL_VERSION);
+    }
+    char file_name[40];
+    snprintf(file_name, sizeof(file_name), "%016llx.glbin", static_cast<unsigned long long>(fnv1a(m_driver, source_hash)));
+    return m_directory + file_name;
+}
+
+GLuint gl::program_cache::load_binary(const string& path, uint64_t source_hash)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+    binary_header header{};
+    vector<uint8_t> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1
+                 && header.magic == binary_magic
+                 && header.version == binary_version
+                 && header.source_hash == source_hash
+                 && header.length != 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+
+    if (valid) {
+        // a format the driver does not list would only raise GL_INVALID_ENUM
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        vector<GLint> formats(static_cast<size_t>(count));
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        valid = find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) != formats.end();
+    }
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        // a binary of an older driver build may still raise an error, that is an expected miss
+        while (glGetError() != GL_NO_ERROR) {
+        }
+        if (!is_linked(program)) {
+            GL_CALL(glDeleteProgram(program));
+            program = 0;
+        }
+    }
+    if (program == 0) {
+        ++m_stats.binary_rejected;
+        remove(path.c_str());
+        return 0;
+    }
+    ++m_stats.binary_loaded;
+    return program;
+}
+
+void gl::program_cache::store_binary(const string& path, uint64_t source_hash, GLuint program)
+{
+    GLint length = 0;
+    GL_CALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0) {
+        return;
+    }
+    vector<uint8_t> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    GL_CALL(glGetProgramBinary(program, length, &written, &format, binary.data()));
+    if (written <= 0) {
+        return;
+    }
+
+    // written under a temporary name, a concurrent reader never sees a partial file
+    const string tmp_path = path + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (file == nullptr) {
+        return;
+    }
+    const binary_header header{binary_magic, binary_version, source_hash, format, static_cast<uint32_t>(written)};
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                    && fwrite(binary.data(), 1, static_cast<size_t>(written), file) == static_cast<size_t>(written);
+    if (fclose(file) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return;
+    }
+    ++m_stats.binary_stored;
+}
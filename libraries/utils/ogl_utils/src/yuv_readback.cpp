@@ -0,0 +1,276 @@
+#include "yuv_readback.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+    // a triangle covering the viewport, no vertex buffer needed
+    const char* vs_fullscreen =
+        "#version 300 es\n"
+        "void main()\n"
+        "{\n"
+        "    vec2 p = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;\n"
+        "    gl_Position = vec4(p, 0.0, 1.0);\n"
+        "}\n";
+
+    // four luma samples of a row per texel
+    const char* ps_luma =
+        "#version 300 es\n"
+        "precision highp float;\n"
+        "precision highp int;\n"
+        "uniform sampler2D uTexture;\n"
+        "uniform vec4 uY;\n"
+        "out vec4 FragColor;\n"
+        "float luma(ivec2 p)\n"
+        "{\n"
+        "    return dot(texelFetch(uTexture, p, 0).rgb, uY.rgb) + uY.a;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    ivec2 p = ivec2(int(gl_FragCoord.x) * 4, int(gl_FragCoord.y));\n"
+        "    FragColor = vec4(luma(p), luma(p + ivec2(1, 0)), luma(p + ivec2(2, 0)), luma(p + ivec2(3, 0)));\n"
+        "}\n";
+
+    // the bilinear sample at the center of a 2x2 block is its average
+    const char* ps_chroma_common =
+        "uniform sampler2D uTexture;\n"
+        "uniform int uOrigin;\n"
+        "out vec4 FragColor;\n"
+        "vec3 block(int x, int y)\n"
+        "{\n"
+        "    return texture(uTexture, (vec2(x, y) * 2.0 + 1.0) / vec2(textureSize(uTexture, 0))).rgb;\n"
+        "}\n";
+
+    // two UV pairs of a chroma row per texel
+    const char* ps_chroma_nv12 =
+        "uniform vec4 uU;\n"
+        "uniform vec4 uV;\n"
+        "void main()\n"
+        "{\n"
+        "    int x = int(gl_FragCoord.x) * 2;\n"
+        "    int y = int(gl_FragCoord.y) - uOrigin;\n"
+        "    vec3 c0 = block(x, y);\n"
+        "    vec3 c1 = block(x + 1, y);\n"
+        "    FragColor = vec4(dot(c0, uU.rgb), dot(c0, uV.rgb), dot(c1, uU.rgb), dot(c1, uV.rgb)) + vec4(uU.a, uV.a, uU.a, uV.a);\n"
+        "}\n";
+
+    // four samples of one chroma plane per texel, a texel row holds two rows of the plane
+    const char* ps_chroma_i420 =
+        "uniform vec4 uC;\n"
+        "uniform int uHalfWidth;\n"
+        "float chroma(int i)\n"
+        "{\n"
+        "    int y = i / uHalfWidth;\n"
+        "    return dot(block(i - y * uHalfWidth, y), uC.rgb) + uC.a;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    int i = (int(gl_FragCoord.y) - uOrigin) * uHalfWidth * 2 + int(gl_FragCoord.x) * 4;\n"
+        "    FragColor = vec4(chroma(i), chroma(i + 1), chroma(i + 2), chroma(i + 3));\n"
+        "}\n";
+
+    std::string chroma_source(const char* body)
+    {
+        return std::string("#version 300 es\n"
+                           "precision highp float;\n"
+                           "precision highp int;\n")
+               + ps_chroma_common + body;
+    }
+
+    constexpr float q14 = 1.0f / 16384.0f;
+
+    void set_coefficients(GLint location, int16_t r, int16_t g, int16_t b, int32_t offset)
+    {
+        GL_CALL(glUniform4f(location, r * q14, g * q14, b * q14, offset / 255.0f));
+    }
+} // namespace
+
+namespace bnb::gl
+{
+    yuv_readback::yuv_readback(size_t depth)
+        : m_luma(program_cache::instance().acquire("YuvLuma", vs_fullscreen, ps_luma))
+        , m_chroma_nv12(program_cache::instance().acquire("YuvChromaNv12", vs_fullscreen, chroma_source(ps_chroma_nv12)))
+        , m_chroma_i420(program_cache::instance().acquire("YuvChromaI420", vs_fullscreen, chroma_source(ps_chroma_i420)))
+        , m_slots(std::max<size_t>(depth, 2))
+    {
+        auto& state = context_info::instance().state();
+        for (const auto& program : {m_luma, m_chroma_nv12, m_chroma_i420}) {
+            state.use_program(program->handle());
+            GL_CALL(glUniform1i(glGetUniformLocation(program->handle(), "uTexture"), 0));
+        }
+        state.use_program(0);
+
+        GL_CALL(glGenVertexArrays(1, &m_vao));
+        GL_CALL(glGenFramebuffers(1, &m_framebuffer));
+        for (auto& s : m_slots) {
+            GL_CALL(glGenBuffers(1, &s.buffer));
+        }
+    }
+
+    yuv_readback::~yuv_readback()
+    {
+        auto& state = context_info::instance().state();
+        for (auto& s : m_slots) {
+            if (s.fence != nullptr) {
+                glDeleteSync(s.fence);
+            }
+            glDeleteBuffers(1, &s.buffer);
+        }
+        if (m_texture != 0) {
+            state.forget_texture(m_texture);
+            glDeleteTextures(1, &m_texture);
+        }
+        state.forget_framebuffer(m_framebuffer);
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+
+    bool yuv_readback::supports(int32_t width, int32_t height, image::yuv_layout layout)
+    {
+        if (width <= 0 || height <= 0) {
+            return false;
+        }
+        return layout == image::yuv_layout::nv12 ? width % 4 == 0 && height % 2 == 0
+                                                 : width % 8 == 0 && height % 4 == 0;
+    }
+
+    size_t yuv_readback::frame_size(int32_t width, int32_t height)
+    {
+        return static_cast<size_t>(width) * height * 3 / 2;
+    }
+
+    void yuv_readback::reserve_target(int32_t width, int32_t height)
+    {
+        // grows only, the planes of a smaller frame are packed into the corner
+        if (width / 4 <= m_target_width && height * 3 / 2 <= m_target_height) {
+            return;
+        }
+        m_target_width = std::max(m_target_width, width / 4);
+        m_target_height = std::max(m_target_height, height * 3 / 2);
+        auto& state = context_info::instance().state();
+        if (m_texture != 0) {
+            state.forget_texture(m_texture);
+            glDeleteTextures(1, &m_texture);
+        }
+        GL_CALL(glGenTextures(1, &m_texture));
+        state.active_texture(GL_TEXTURE0);
+        state.bind_texture(GL_TEXTURE_2D, m_texture);
+        GL_CALL(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, m_target_width, m_target_height));
+    }
+
+    bool yuv_readback::convert(GLenum target, GLuint texture, int32_t width, int32_t height, const image::yuv_format& format, uint64_t tag)
+    {
+        if (!supports(width, height, format.layout) || m_pending.size() == m_slots.size()) {
+            return false;
+        }
+        reserve_target(width, height);
+
+        auto& state = context_info::instance().state();
+        state.bind_framebuffer(m_framebuffer);
+        if (!state.attach_color_texture(GL_TEXTURE_2D, m_texture)) {
+            state.bind_framebuffer(0);
+            return false;
+        }
+        state.active_texture(GL_TEXTURE0);
+        state.bind_texture(target, texture);
+        state.tex_parameter(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        state.bind_vertex_array(m_vao);
+
+        const auto& c = image::coefficients(format.matrix, format.range);
+        const GLsizei texels = width / 4;
+
+        GLuint program = m_luma->handle();
+        state.use_program(program);
+        state.viewport(0, 0, texels, height);
+        set_coefficients(glGetUniformLocation(program, "uY"), c.yr, c.yg, c.yb, c.y_offset);
+        GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+
+        if (format.layout == image::yuv_layout::nv12) {
+            program = m_chroma_nv12->handle();
+            state.use_program(program);
+            state.viewport(0, height, texels, height / 2);
+            GL_CALL(glUniform1i(glGetUniformLocation(program, "uOrigin"), height));
+            set_coefficients(glGetUniformLocation(program, "uU"), c.ur, c.ug, c.ub, 128);
+            set_coefficients(glGetUniformLocation(program, "uV"), c.vr, c.vg, c.vb, 128);
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        } else {
+            program = m_chroma_i420->handle();
+            state.use_program(program);
+            GL_CALL(glUniform1i(glGetUniformLocation(program, "uHalfWidth"), width / 2));
+            const GLint origin = glGetUniformLocation(program, "uOrigin");
+            const GLint coefficients = glGetUniformLocation(program, "uC");
+
+            state.viewport(0, height, texels, height / 4);
+            GL_CALL(glUniform1i(origin, height));
+            set_coefficients(coefficients, c.ur, c.ug, c.ub, 128);
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+
+            state.viewport(0, height + height / 4, texels, height / 4);
+            GL_CALL(glUniform1i(origin, height + height / 4));
+            set_coefficients(coefficients, c.vr, c.vg, c.vb, 128);
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        }
+
+        auto& s = m_slots[m_next];
+        const size_t size = frame_size(width, height);
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer));
+        if (s.capacity < size) {
+            GL_CALL(glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_READ));
+            s.capacity = size;
+        }
+        GL_CALL(glReadPixels(0, 0, texels, height * 3 / 2, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+        // a bound pack buffer would redirect the SDK's own glReadPixels
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        s.format = format;
+        s.width = width;
+        s.height = height;
+        s.tag = tag;
+        m_pending.push_back(m_next);
+        m_next = (m_next + 1) % m_slots.size();
+        ++m_stats.submitted;
+
+        state.bind_vertex_array(0);
+        state.use_program(0);
+        state.bind_framebuffer(0);
+        return true;
+    }
+
+    bool yuv_readback::consume(bool wait, const std::function<void(const frame&)>& consume)
+    {
+        if (m_pending.empty()) {
+            return false;
+        }
+        auto& s = m_slots[m_pending.front()];
+        GLenum status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            if (!wait) {
+                return false;
+            }
+            ++m_stats.waits;
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(s.fence, 0, 1'000'000'000);
+            }
+        }
+        glDeleteSync(s.fence);
+        s.fence = nullptr;
+        m_pending.pop_front();
+
+        const size_t size = frame_size(s.width, s.height);
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer));
+        const auto* data = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(size), GL_MAP_READ_BIT));
+        if (data != nullptr) {
+            consume({s.format, s.width, s.height, s.tag, data, size});
+            GL_CALL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+            ++m_stats.consumed;
+        }
+        GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        return data != nullptr;
+    }
+} // namespace bnb::gl
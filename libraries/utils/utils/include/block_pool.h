@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Free list of fixed size blocks. Blocks released to the pool are handed out
+     * again instead of going back to the heap, so a steady per frame
+     * allocate/deallocate pattern stops touching the heap after the warm-up.
+     * The pool keeps at most `max_free` blocks, extra blocks are deleted.
+     */
+    template<size_t Size, size_t Align>
+    class block_pool
+    {
+        static_assert(Align <= alignof(std::max_align_t), "over-aligned blocks are not supported");
+
+    public:
+        static constexpr size_t max_free = 64;
+
+        /// never destroyed, blocks may be returned during static destruction
+        static block_pool& instance()
+        {
+            static auto* pool = new block_pool;
+            return *pool;
+        }
+
+        void* allocate()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_free.empty()) {
+                    void* block = m_free.back();
+                    m_free.pop_back();
+                    return block;
+                }
+            }
+            return ::operator new(Size);
+        }
+
+        void deallocate(void* block)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_free.size() < max_free) {
+                    m_free.push_back(block);
+                    return;
+                }
+            }
+            ::operator delete(block);
+        }
+
+    private:
+        block_pool()
+        {
+            m_free.reserve(max_free);
+        }
+
+        std::mutex m_mutex;
+        std::vector<void*> m_free;
+    };
+
+    /**
+     * Allocator on top of block_pool for single objects, e.g. the control blocks
+     * of std::shared_ptr(ptr, deleter, pool_allocator<T>()). Arrays go to the heap.
+     */
+    template<class T>
+    class pool_allocator
+    {
+    public:
+        using value_type = T;
+
+        pool_allocator() noexcept = default;
+
+        template<class U>
+        pool_allocator(const pool_allocator<U>&) noexcept
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            if (n != 1) {
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            }
+            return static_cast<T*>(block_pool<sizeof(T), alignof(T)>::instance().allocate());
+        }
+
+        void deallocate(T* p, size_t n) noexcept
+        {
+            if (n != 1) {
+                ::operator delete(p);
+                return;
+            }
+            block_pool<sizeof(T), alignof(T)>::instance().deallocate(p);
+        }
+
+        template<class U>
+        bool operator==(const pool_allocator<U>&) const noexcept
+        {
+            return true;
+        }
+
+        template<class U>
+        bool operator!=(const pool_allocator<U>&) const noexcept
+        {
+            return false;
+        }
+    };
+
+} // namespace bnb
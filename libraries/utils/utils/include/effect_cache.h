@@ -0,0 +1,264 @@
+#pragma once
+
+#include "thread_pool.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bnb
+{
+    struct effect_cache_stats
+    {
+        uint64_t hits{0};      // activated effects that were prepared
+        uint64_t misses{0};    // activated effects the SDK read from storage
+        uint64_t preloads{0};  // effects prepared in the background
+        uint64_t evictions{0};
+        size_t entries{0};
+        size_t bytes{0};       // mapped by the prepared effects
+        size_t capacity{0};
+    };
+
+    /**
+     * Effects prepared ahead of their activation, e.g. the ones next to the selected effect in the UI.
+     * Preparing an effect maps every file of its folder and reads it on a background thread, so the
+     * load by the SDK at activation finds the assets in memory and does no I/O on the render thread.
+     * The prepared effects are kept in LRU order up to `capacity` bytes, an effect larger than that is
+     * read ahead once and not kept. Activating a prepared effect makes it the most recently used one.
+     * Effects are found by name in the search paths (the resource paths of the SDK) or by a full path.
+     */
+    class effect_cache
+    {
+    public:
+        effect_cache(std::vector<std::string> search_paths, size_t capacity)
+            : m_search_paths(std::move(search_paths))
+            , m_capacity(capacity)
+            , m_loader(1)
+        {
+        }
+
+        effect_cache(const effect_cache&) = delete;
+        effect_cache& operator=(const effect_cache&) = delete;
+
+        ~effect_cache()
+        {
+            // the loader may still be running, it must not find the cache gone
+            wait_idle();
+        }
+
+        /// prepares the effect in the background, does nothing when it is prepared or being prepared
+        void preload(const std::string& name)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_entries.count(name) != 0 || !m_loading.insert(name).second) {
+                    return;
+                }
+            }
+            m_loader.execute([this, name]() {
+                auto effect = prepare(name);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_loading.erase(name);
+                if (effect != nullptr) {
+                    ++m_preloads;
+                    insert(name, std::move(effect));
+                }
+                m_idle.notify_all();
+            });
+        }
+
+        /**
+         * Counts the activation of the effect as a hit when it is prepared and makes it the most
+         * recently used one, as a miss otherwise. Does not wait for an effect still being prepared.
+         */
+        bool activate(const std::string& name)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(name);
+            if (it == m_entries.end()) {
+                ++m_misses;
+                return false;
+            }
+            m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+            ++m_hits;
+            return true;
+        }
+
+        /// drops the least recently used effects until the rest fit
+        void set_capacity(size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_capacity = capacity;
+            evict(0);
+        }
+
+        /// waits until every requested preload is done
+        void wait_idle()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idle.wait(lock, [this]() { return m_loading.empty(); });
+        }
+
+        effect_cache_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return {m_hits, m_misses, m_preloads, m_evictions, m_entries.size(), m_bytes, m_capacity};
+        }
+
+    private:
+        /// read only mapping of one file, the pages stay resident while it lives unless memory runs low
+        class mapped_file
+        {
+        public:
+            explicit mapped_file(const std::filesystem::path& path)
+            {
+                const int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return;
+                }
+                struct stat st {};
+                if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                    void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data != MAP_FAILED) {
+                        m_data = data;
+                        m_size = static_cast<size_t>(st.st_size);
+                    }
+                }
+                ::close(fd);
+                if (m_data != nullptr) {
+                    ::madvise(m_data, m_size, MADV_WILLNEED);
+                    // the read happens here, on the loader thread, not in the SDK on the render thread
+                    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                    const auto* bytes = static_cast<const volatile uint8_t*>(m_data);
+                    uint8_t sink = 0;
+                    for (size_t offset = 0; offset < m_size; offset += page) {
+                        sink ^= bytes[offset];
+                    }
+                    (void) sink;
+                }
+            }
+
+            ~mapped_file()
+            {
+                if (m_data != nullptr) {
+                    ::munmap(m_data, m_size);
+                }
+            }
+
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            size_t size() const
+            {
+                return m_size;
+            }
+
+        private:
+            void* m_data{nullptr};
+            size_t m_size{0};
+        };
+
+        struct prepared_effect
+        {
+            std::vector<std::unique_ptr<mapped_file>> files;
+            size_t bytes{0};
+        };
+
+        struct entry
+        {
+            std::unique_ptr<prepared_effect> effect;
+            std::list<std::string>::iterator position;
+        };
+
+        std::filesystem::path locate(const std::string& name) const
+        {
+            std::error_code error;
+            for (const auto& root : m_search_paths) {
+                auto candidate = std::filesystem::path(root) / name;
+                if (std::filesystem::is_directory(candidate, error)) {
+                    return candidate;
+                }
+            }
+            if (std::filesystem::is_directory(name, error)) {
+                return name;
+            }
+            return {};
+        }
+
+        /// on the loader thread, without the lock
+        std::unique_ptr<prepared_effect> prepare(const std::string& name) const
+        {
+            const auto folder = locate(name);
+            if (folder.empty()) {
+                return nullptr;
+            }
+            auto effect = std::make_unique<prepared_effect>();
+            std::error_code error;
+            for (auto it = std::filesystem::recursive_directory_iterator(folder, error);
+                 !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+                if (!it->is_regular_file(error)) {
+                    continue;
+                }
+                auto file = std::make_unique<mapped_file>(it->path());
+                effect->bytes += file->size();
+                effect->files.push_back(std::move(file));
+            }
+            return effect;
+        }
+
+        void insert(const std::string& name, std::unique_ptr<prepared_effect> effect)
+        {
+            if (effect->bytes > m_capacity) {
+                // read ahead all the same, the OS keeps what it can
+                return;
+            }
+            evict(effect->bytes);
+            m_bytes += effect->bytes;
+            m_lru.push_front(name);
+            m_entries[name] = {std::move(effect), m_lru.begin()};
+        }
+
+        /// until `incoming` more bytes fit
+        void evict(size_t incoming)
+        {
+            while (!m_lru.empty() && m_bytes + incoming > m_capacity) {
+                auto it = m_entries.find(m_lru.back());
+                m_bytes -= it->second.effect->bytes;
+                m_entries.erase(it);
+                m_lru.pop_back();
+                ++m_evictions;
+            }
+        }
+
+        const std::vector<std::string> m_search_paths;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_idle;
+        size_t m_capacity;
+        size_t m_bytes{0};
+        // most recently used first
+        std::list<std::string> m_lru;
+        std::unordered_map<std::string, entry> m_entries;
+        std::unordered_set<std::string> m_loading;
+        uint64_t m_hits{0};
+        uint64_t m_misses{0};
+        uint64_t m_preloads{0};
+        uint64_t m_evictions{0};
+
+        // last, stopped first
+        thread_pool m_loader;
+    };
+} // namespace bnb
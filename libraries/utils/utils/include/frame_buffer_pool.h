@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Key of the pooled buffer. `format` is an allocator defined value
+     * (e.g. an OSType of the CVPixelBuffer), `stride` equal to 0 means
+     * the allocator picks the row alignment itself.
+     */
+    struct frame_buffer_desc
+    {
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t format{0};
+        uint32_t stride{0};
+
+        bool operator==(const frame_buffer_desc& other) const
+        {
+            return width == other.width && height == other.height && format == other.format && stride == other.stride;
+        }
+        bool operator!=(const frame_buffer_desc& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    /// Platform specific storage behind the frame_buffer_pool.
+    class frame_buffer_allocator
+    {
+    public:
+        virtual ~frame_buffer_allocator() = default;
+
+        /// returns nullptr on failure
+        virtual void* allocate(const frame_buffer_desc& desc) = 0;
+        virtual void deallocate(void* buffer) = 0;
+
+        /// true when `deallocate` only drops the pool's reference and the buffer lives on
+        /// while its users retain it, e.g. a CVPixelBuffer
+        virtual bool reference_counted() const
+        {
+            return false;
+        }
+    };
+
+    /**
+     * Recycles frame buffers between frames. `acquire` leases a buffer, `release`
+     * ends the lease and the buffer goes back to the free list, it is handed out
+     * again by the next `acquire` of the same desc. The lease lasts until the last
+     * user is done with the buffer, e.g. the release is the deleter of the
+     * shared pointer handed to the consumer: the pool never guesses whether a
+     * buffer is still in use.
+     * The pool keeps at most `high_water_mark` buffers, extra buffers are
+     * destroyed when they are released.
+     */
+    class frame_buffer_pool
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t hits{0};
+            uint64_t misses{0};
+            uint64_t evictions{0};
+            size_t pooled{0}; // buffers owned by the pool, free and leased
+            size_t leased{0};
+        };
+
+        frame_buffer_pool(std::shared_ptr<frame_buffer_allocator> allocator, size_t high_water_mark = 4)
+            : m_allocator(std::move(allocator))
+            , m_high_water_mark(high_water_mark)
+        {
+        }
+
+        /// leased buffers are handed to the allocator only when it is reference counted, it just drops the pool's
+        /// reference then and a lease ending after the pool is gone must not call `release`. Other allocators
+        /// free the memory itself, all leases must end before the pool is destroyed: the ones still out are
+        /// left to their users rather than freed under them
+        ~frame_buffer_pool()
+        {
+            clear();
+            if (m_allocator->reference_counted()) {
+                for (auto* buffer : m_leased) {
+                    m_allocator->deallocate(buffer);
+                }
+                return;
+            }
+            assert(m_leased.empty() && "a frame_buffer_pool was destroyed with buffers still leased");
+        }
+
+        frame_buffer_pool(const frame_buffer_pool&) = delete;
+        frame_buffer_pool& operator=(const frame_buffer_pool&) = delete;
+
+        /// returns nullptr when the allocator fails
+        void* acquire(const frame_buffer_desc& desc)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+                if (it->desc == desc) {
+                    auto* buffer = it->buffer;
+                    m_free.erase(it);
+                    m_leased.push_back(buffer);
+                    ++m_stats.hits;
+                    return buffer;
+                }
+            }
+
+            ++m_stats.misses;
+            // make room for the new buffer, the least recently released go first
+            for (auto it = m_free.begin(); it != m_free.end() && size() >= m_high_water_mark;) {
+                m_allocator->deallocate(it->buffer);
+                it = m_free.erase(it);
+                ++m_stats.evictions;
+            }
+
+            auto* buffer = m_allocator->allocate(desc);
+            if (buffer != nullptr) {
+                m_leased.push_back(buffer);
+            }
+            return buffer;
+        }
+
+        /// `desc` must be the one the buffer was acquired with
+        void release(void* buffer, const frame_buffer_desc& desc)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = std::find(m_leased.begin(), m_leased.end(), buffer);
+            if (it == m_leased.end()) {
+                return;
+            }
+            m_leased.erase(it);
+            if (size() >= m_high_water_mark) {
+                m_allocator->deallocate(buffer);
+                ++m_stats.evictions;
+                return;
+            }
+            m_free.push_back({buffer, desc});
+        }
+
+        /// destroys all free buffers, leased ones stay valid
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& entry : m_free) {
+                m_allocator->deallocate(entry.buffer);
+            }
+            m_free.clear();
+        }
+
+        void set_high_water_mark(size_t high_water_mark)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_high_water_mark = high_water_mark;
+        }
+
+        stats_t stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto s = m_stats;
+            s.pooled = size();
+            s.leased = m_leased.size();
+            return s;
+        }
+
+    private:
+        struct entry
+        {
+            void* buffer;
+            frame_buffer_desc desc;
+        };
+
+        size_t size() const
+        {
+            return m_free.size() + m_leased.size();
+        }
+
+        std::shared_ptr<frame_buffer_allocator> m_allocator;
+        size_t m_high_water_mark;
+
+        mutable std::mutex m_mutex;
+        // both lists are tiny (bounded by the high-water mark), linear search is fine
+        std::vector<entry> m_free;
+        std::vector<void*> m_leased;
+        stats_t m_stats;
+    };
+
+    /// Heap backed allocator, used where no platform buffers are available.
+    class heap_frame_buffer_allocator : public frame_buffer_allocator
+    {
+    public:
+        /// allocates `stride * height` bytes, the stride defaults to `width * bytes_per_pixel`
+        explicit heap_frame_buffer_allocator(uint32_t bytes_per_pixel = 4)
+            : m_bytes_per_pixel(bytes_per_pixel)
+        {
+        }
+
+        void* allocate(const frame_buffer_desc& desc) override
+        {
+            size_t stride = desc.stride != 0 ? desc.stride : desc.width * m_bytes_per_pixel;
+            return std::malloc(stride * desc.height);
+        }
+
+        void deallocate(void* buffer) override
+        {
+            std::free(buffer);
+        }
+
+    private:
+        uint32_t m_bytes_per_pixel;
+    };
+
+} // namespace bnb
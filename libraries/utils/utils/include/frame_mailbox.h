@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * What the mailbox does with a frame pushed while it is full.
+     * latest_wins - single slot, the waiting frame is replaced by the new one
+     * drop_oldest - bounded FIFO, the oldest waiting frame is dropped
+     * block       - bounded FIFO, the producer waits for a free slot
+     */
+    enum class backpressure_policy
+    {
+        latest_wins,
+        drop_oldest,
+        block
+    };
+
+    enum class frame_drop_reason
+    {
+        coalesced, // replaced by a newer frame, latest_wins
+        evicted,   // pushed out of the full queue, drop_oldest
+        closed     // the mailbox was closed before the frame was taken
+    };
+
+    /**
+     * Bounded input stage between a producer (e.g. the camera) and a consumer
+     * that takes one frame at a time. The queue never grows past `capacity`,
+     * so the latency added by the mailbox stays bounded under overload.
+     * Dropped frames are handed back to the caller's `on_drop` outside of the lock.
+     * The slots are allocated once, push and pop do not allocate.
+     */
+    template<class T>
+    class frame_mailbox
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t accepted{0};
+            uint64_t dropped{0};   // evicted and closed
+            uint64_t coalesced{0};
+            size_t queued{0};
+        };
+
+        /// `capacity` is ignored for latest_wins, it always has one slot
+        explicit frame_mailbox(backpressure_policy policy, size_t capacity = 1)
+            : m_policy(policy)
+            , m_capacity(policy == backpressure_policy::latest_wins ? 1 : std::max<size_t>(capacity, 1))
+            , m_slots(m_capacity)
+        {
+        }
+
+        frame_mailbox(const frame_mailbox&) = delete;
+        frame_mailbox& operator=(const frame_mailbox&) = delete;
+
+        /**
+         * `on_drop(T&&, frame_drop_reason)` receives the frame that did not make it.
+         * It is called with the pushed frame itself if the mailbox is closed.
+         * Returns false in that case.
+         */
+        template<class OnDrop>
+        bool push(T frame, OnDrop&& on_drop)
+        {
+            std::optional<T> dropped;
+            frame_drop_reason reason{frame_drop_reason::closed};
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_policy == backpressure_policy::block) {
+                    m_not_full.wait(lock, [this] { return m_closed || m_size < m_capacity; });
+                }
+                if (m_closed) {
+                    ++m_stats.dropped;
+                    lock.unlock();
+                    on_drop(std::move(frame), frame_drop_reason::closed);
+                    return false;
+                }
+                if (m_size >= m_capacity) {
+                    reason = m_policy == backpressure_policy::latest_wins ? frame_drop_reason::coalesced : frame_drop_reason::evicted;
+                    ++(reason == frame_drop_reason::coalesced ? m_stats.coalesced : m_stats.dropped);
+                    dropped.emplace(pop_front());
+                }
+                m_slots[(m_head + m_size) % m_capacity].emplace(std::move(frame));
+                ++m_size;
+                ++m_stats.accepted;
+            }
+            if (dropped) {
+                on_drop(std::move(*dropped), reason);
+            }
+            return true;
+        }
+
+        std::optional<T> try_pop()
+        {
+            std::optional<T> frame;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_size == 0) {
+                    return frame;
+                }
+                frame.emplace(pop_front());
+            }
+            m_not_full.notify_one();
+            return frame;
+        }
+
+        bool empty() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_size == 0;
+        }
+
+        /// rejects further pushes, wakes blocked producers and drops the waiting frames
+        template<class OnDrop>
+        void close(OnDrop&& on_drop)
+        {
+            std::vector<T> rest;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+                m_stats.dropped += m_size;
+                rest.reserve(m_size);
+                while (m_size != 0) {
+                    rest.push_back(pop_front());
+                }
+            }
+            m_not_full.notify_all();
+            for (auto& frame : rest) {
+                on_drop(std::move(frame), frame_drop_reason::closed);
+            }
+        }
+
+        backpressure_policy policy() const
+        {
+            return m_policy;
+        }
+
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        stats_t stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto s = m_stats;
+            s.queued = m_size;
+            return s;
+        }
+
+    private:
+        /// under the lock, the mailbox is not empty
+        T pop_front()
+        {
+            T frame(std::move(*m_slots[m_head]));
+            m_slots[m_head].reset();
+            m_head = (m_head + 1) % m_capacity;
+            --m_size;
+            return frame;
+        }
+
+        const backpressure_policy m_policy;
+        const size_t m_capacity;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_not_full;
+        std::vector<std::optional<T>> m_slots;
+        size_t m_head{0};
+        size_t m_size{0};
+        bool m_closed{false};
+        stats_t m_stats;
+    };
+
+} // namespace bnb
@@ -0,0 +1,332 @@
+#pragma once
+
+#include "frame_mailbox.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+namespace bnb
+{
+    /**
+     * Time source of frame_pacer, nanoseconds on a monotonic timeline. It is injected, so the
+     * pacing runs against manual_pacing_clock in tests and benchmarks.
+     */
+    class pacing_clock
+    {
+    public:
+        virtual ~pacing_clock() = default;
+
+        virtual int64_t now() const = 0;
+
+        /// blocks until now() reaches `deadline`, returns false when wake() ended the wait first
+        virtual bool wait_until(int64_t deadline) = 0;
+
+        /// ends the current wait_until, or the next one when nobody waits
+        virtual void wake() = 0;
+    };
+
+    class steady_pacing_clock : public pacing_clock
+    {
+    public:
+        int64_t now() const override
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        bool wait_until(int64_t deadline) override
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            const auto time = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline));
+            const bool woken = m_cv.wait_until(lock, time, [this]() { return m_woken; });
+            m_woken = false;
+            return !woken;
+        }
+
+        void wake() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_woken = true;
+            }
+            m_cv.notify_all();
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_woken{false};
+    };
+
+    /// time moves only when it is told to, wait_until returns once advance() or set() reached the deadline
+    class manual_pacing_clock : public pacing_clock
+    {
+    public:
+        explicit manual_pacing_clock(int64_t start = 0)
+            : m_now(start)
+        {
+        }
+
+        int64_t now() const override
+        {
+            return m_now.load();
+        }
+
+        bool wait_until(int64_t deadline) override
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this, deadline]() { return m_woken || m_now.load() >= deadline; });
+            return !std::exchange(m_woken, false);
+        }
+
+        void wake() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_woken = true;
+            }
+            m_cv.notify_all();
+        }
+
+        /// never goes back
+        void set(int64_t time)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_now = std::max(m_now.load(), time);
+            }
+            m_cv.notify_all();
+        }
+
+        void advance(int64_t duration)
+        {
+            set(now() + duration);
+        }
+
+    private:
+        std::atomic<int64_t> m_now;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_woken{false};
+    };
+
+    struct frame_pacing_stats
+    {
+        uint64_t ticks{0};
+        uint64_t renders{0};
+        uint64_t stale{0};        // frames replaced by a fresher one before a tick took them
+        uint64_t idle_ticks{0};   // no new frame, the previous output stays on screen
+        uint64_t busy_ticks{0};   // the previous frame was still rendering, the frame waits for the next tick
+        uint64_t missed_ticks{0}; // the ticks passed before the pacer got to them, e.g. a stalled thread
+        // |interval between two renders - the tick interval|, a repeated frame counts one interval
+        double jitter_mean_ms{0};
+        double jitter_max_ms{0};
+        // the tick ran after its time
+        double lateness_mean_ms{0};
+        double lateness_max_ms{0};
+        // submit to render, the age of the frame when it is rendered
+        double latency_mean_ms{0};
+        double latency_max_ms{0};
+    };
+
+    /**
+     * Renders at a fixed cadence instead of on every camera callback: the camera frames only replace
+     * the frame waiting in the pacer, every tick renders the freshest one. A camera out of phase with
+     * the display renders neither two frames within one interval, of which only the second is seen,
+     * nor frames already replaced by a newer one.
+     * Ticks come from tick(), called at next_tick() by the owner, or from the thread of start() that
+     * waits for them on the clock.
+     * `render(T&)` returns false when the frame can not be rendered now, it is kept for the next tick
+     * unless a fresher one arrives. `drop(T&&, frame_drop_reason)` gets the frames that are not
+     * rendered, outside of the lock: `coalesced` for the stale ones, `closed` for the frame waiting
+     * when the pacer is destroyed.
+     */
+    template<class T>
+    class frame_pacer
+    {
+    public:
+        using render_fn = std::function<bool(T&)>;
+        using drop_fn = std::function<void(T&&, frame_drop_reason)>;
+
+        frame_pacer(std::shared_ptr<pacing_clock> clock, int64_t interval, render_fn render, drop_fn drop)
+            : m_clock(std::move(clock))
+            , m_interval(std::max<int64_t>(interval, 1))
+            , m_render(std::move(render))
+            , m_drop(std::move(drop))
+            , m_next_tick(m_clock->now() + m_interval)
+        {
+        }
+
+        frame_pacer(const frame_pacer&) = delete;
+        frame_pacer& operator=(const frame_pacer&) = delete;
+
+        ~frame_pacer()
+        {
+            stop();
+            if (m_frame) {
+                m_drop(std::move(*m_frame), frame_drop_reason::closed);
+            }
+        }
+
+        /// any thread, the frame replaces the one waiting for the tick
+        void submit(T frame)
+        {
+            std::optional<T> stale;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_frame) {
+                    stale.emplace(std::move(*m_frame));
+                    ++m_stats.stale;
+                }
+                m_frame.emplace(std::move(frame));
+                m_submitted = m_clock->now();
+            }
+            if (stale) {
+                m_drop(std::move(*stale), frame_drop_reason::coalesced);
+            }
+        }
+
+        int64_t next_tick() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_next_tick;
+        }
+
+        int64_t interval() const
+        {
+            return m_interval;
+        }
+
+        /// renders the waiting frame, if any. Called at next_tick() on one thread at a time
+        void tick()
+        {
+            const int64_t now = m_clock->now();
+            std::optional<T> frame;
+            int64_t submitted = 0;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                const int64_t behind = now - m_next_tick;
+                if (behind >= m_interval) {
+                    const int64_t missed = behind / m_interval;
+                    m_stats.missed_ticks += static_cast<uint64_t>(missed);
+                    m_next_tick += missed * m_interval;
+                }
+                const double lateness = std::max<int64_t>(now - m_next_tick, 0) / 1e6;
+                m_lateness_sum += lateness;
+                m_stats.lateness_max_ms = std::max(m_stats.lateness_max_ms, lateness);
+                m_next_tick += m_interval;
+                ++m_stats.ticks;
+                if (!m_frame) {
+                    ++m_stats.idle_ticks;
+                    return;
+                }
+                frame.emplace(std::move(*m_frame));
+                m_frame.reset();
+                submitted = m_submitted;
+            }
+
+            if (!m_render(*frame)) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                ++m_stats.busy_ticks;
+                if (!m_frame) {
+                    m_frame.emplace(std::move(*frame));
+                    m_submitted = submitted;
+                    return;
+                }
+                // a fresher frame came in during the render call
+                ++m_stats.stale;
+                lock.unlock();
+                m_drop(std::move(*frame), frame_drop_reason::coalesced);
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.renders;
+            if (m_last_render >= 0) {
+                const double jitter = std::abs(static_cast<double>(now - m_last_render - m_interval)) / 1e6;
+                m_jitter_sum += jitter;
+                m_stats.jitter_max_ms = std::max(m_stats.jitter_max_ms, jitter);
+            }
+            m_last_render = now;
+            const double latency = (now - submitted) / 1e6;
+            m_latency_sum += latency;
+            m_stats.latency_max_ms = std::max(m_stats.latency_max_ms, latency);
+        }
+
+        /// ticks on a thread of the pacer until stop(), the first one an interval from now
+        void start()
+        {
+            if (m_thread.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_next_tick = m_clock->now() + m_interval;
+            }
+            m_running = true;
+            m_thread = std::thread([this]() {
+                while (m_running) {
+                    if (m_clock->wait_until(next_tick()) && m_running) {
+                        tick();
+                    }
+                }
+            });
+        }
+
+        /// not from `render`, it runs on the thread stop() joins
+        void stop()
+        {
+            if (!m_thread.joinable()) {
+                return;
+            }
+            m_running = false;
+            m_clock->wake();
+            m_thread.join();
+        }
+
+        /// the frame waiting for the tick, the pacer keeps none. E.g. to hand it on after stop()
+        std::optional<T> take()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return std::exchange(m_frame, std::nullopt);
+        }
+
+        frame_pacing_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto s = m_stats;
+            s.lateness_mean_ms = s.ticks != 0 ? m_lateness_sum / s.ticks : 0;
+            s.jitter_mean_ms = s.renders > 1 ? m_jitter_sum / (s.renders - 1) : 0;
+            s.latency_mean_ms = s.renders != 0 ? m_latency_sum / s.renders : 0;
+            return s;
+        }
+
+    private:
+        const std::shared_ptr<pacing_clock> m_clock;
+        const int64_t m_interval;
+        const render_fn m_render;
+        const drop_fn m_drop;
+
+        mutable std::mutex m_mutex;
+        std::optional<T> m_frame;
+        int64_t m_submitted{0};
+        int64_t m_next_tick;
+        int64_t m_last_render{-1};
+        frame_pacing_stats m_stats;
+        double m_lateness_sum{0};
+        double m_jitter_sum{0};
+        double m_latency_sum{0};
+
+        std::atomic<bool> m_running{false};
+        std::thread m_thread;
+    };
+} // namespace bnb
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace bnb
+{
+    enum class js_call_kind
+    {
+        /// sets a value of the effect, a later call of the same method replaces it
+        setter,
+        /// runs in order with every other call, e.g. a method that adds an item
+        command,
+        /// a script evaluated for its result, runs in order with every other call
+        eval
+    };
+
+    struct js_call
+    {
+        js_call_kind kind{js_call_kind::setter};
+        /// the method, the script of an eval
+        std::string method;
+        std::string param;
+        /// gets the result of an eval
+        std::function<void(std::string)> result;
+    };
+
+    struct js_call_stats
+    {
+        uint64_t queued{0};
+        uint64_t coalesced{0}; // setters replaced by a later call of the same method
+        uint64_t flushes{0};   // drains that returned calls
+    };
+
+    /**
+     * JS calls from any thread, run by the render thread once per frame. push() does not take a lock,
+     * the calls go to a lock-free list the render thread takes as a whole in drain(). Setters of the
+     * same method are coalesced, only the last value reaches the effect, e.g. a slider moved at 120 Hz
+     * costs one call per frame. A command or an eval is a barrier: a setter is not coalesced across
+     * it, so the command sees the values set before it.
+     */
+    class js_call_queue
+    {
+    public:
+        js_call_queue() = default;
+
+        js_call_queue(const js_call_queue&) = delete;
+        js_call_queue& operator=(const js_call_queue&) = delete;
+
+        ~js_call_queue()
+        {
+            delete_list(m_head.exchange(nullptr, std::memory_order_acquire));
+        }
+
+        /// any thread
+        void push(js_call call)
+        {
+            auto* n = new node{std::move(call), m_head.load(std::memory_order_relaxed)};
+            while (!m_head.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+            }
+            m_queued.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * Replaces the content of `calls` with the calls pushed since the last drain, in push order
+         * and coalesced. One consumer thread at a time, the vector keeps its capacity between frames.
+         */
+        void drain(std::vector<js_call>& calls)
+        {
+            calls.clear();
+            node* head = m_head.exchange(nullptr, std::memory_order_acquire);
+            if (head == nullptr) {
+                return;
+            }
+            // the list is newest first, so it is walked the way the coalescing goes: the last value wins
+            m_seen.clear();
+            m_kept.clear();
+            uint64_t coalesced = 0;
+            for (node* n = head; n != nullptr; n = n->next) {
+                if (n->call.kind != js_call_kind::setter) {
+                    m_seen.clear();
+                } else if (!m_seen.insert(n->call.method).second) {
+                    ++coalesced;
+                    continue;
+                }
+                m_kept.push_back(n);
+            }
+            for (auto it = m_kept.rbegin(); it != m_kept.rend(); ++it) {
+                calls.push_back(std::move((*it)->call));
+            }
+            delete_list(head);
+            m_coalesced.fetch_add(coalesced, std::memory_order_relaxed);
+            m_flushes.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        js_call_stats stats() const
+        {
+            return {m_queued.load(std::memory_order_relaxed), m_coalesced.load(std::memory_order_relaxed),
+                    m_flushes.load(std::memory_order_relaxed)};
+        }
+
+    private:
+        struct node
+        {
+            js_call call;
+            node* next;
+        };
+
+        static void delete_list(node* n)
+        {
+            while (n != nullptr) {
+                delete std::exchange(n, n->next);
+            }
+        }
+
+        std::atomic<node*> m_head{nullptr};
+        // setters met since the last barrier, views into the nodes of the drained list
+        std::unordered_set<std::string_view> m_seen;
+        std::vector<node*> m_kept;
+
+        std::atomic<uint64_t> m_queued{0};
+        std::atomic<uint64_t> m_coalesced{0};
+        std::atomic<uint64_t> m_flushes{0};
+    };
+} // namespace bnb
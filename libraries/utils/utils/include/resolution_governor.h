@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace bnb
+{
+    struct resolution_governor_config
+    {
+        /// frame time budget in milliseconds, 30 fps by default
+        double target_ms{33.3};
+        /// render scales per side, from the full size down, the first one is the start
+        std::vector<float> scales{1.0f, 0.85f, 0.7f, 0.5f};
+        /// weight of the newest frame in the smoothed frame time
+        double smoothing{0.1};
+        /// frames in a row the smoothed time is over the target before the scale drops a step
+        uint32_t downscale_after{10};
+        /// the frame time predicted for the next larger scale must stay below `headroom * target_ms`
+        double headroom{0.75};
+        /// frames in a row with that headroom before the scale goes up a step
+        uint32_t upscale_after{90};
+        /// decisions kept by the log, the oldest are dropped
+        size_t log_capacity{64};
+    };
+
+    /// One change of the render scale
+    struct resolution_decision
+    {
+        uint64_t frame;  // frames recorded before the decision
+        float from_scale;
+        float to_scale;
+        double frame_ms; // the smoothed frame time the decision was based on
+    };
+
+    /**
+     * Picks the render scale of the effect from the measured frame times. A sustained miss of the
+     * budget drops the scale a step, the scale goes back up only when the frame time predicted for
+     * the larger size leaves headroom for longer than it took to drop it: a frame time close to the
+     * budget does not make the scale oscillate.
+     * The prediction is the cost ratio measured when the scale dropped to the current step, until
+     * then the pixel ratio (square of the scale ratio). Passes that do not scale with the effect size,
+     * e.g. the upscale to the output, make the measured ratio the smaller one.
+     * record() is called by the render thread, scale() and decisions() from any thread.
+     */
+    class resolution_governor
+    {
+    public:
+        explicit resolution_governor(resolution_governor_config config = {})
+            : m_config(std::move(config))
+        {
+            if (m_config.scales.empty()) {
+                m_config.scales.push_back(1.0f);
+            }
+            m_scale = m_config.scales.front();
+            m_ratios.resize(m_config.scales.size(), 0.0);
+        }
+
+        resolution_governor(const resolution_governor&) = delete;
+        resolution_governor& operator=(const resolution_governor&) = delete;
+
+        /// the time of one frame rendered at scale(), returns true when the scale changed
+        bool record(double frame_ms)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_frames;
+            ++m_frames_at_step;
+            m_average = m_seeded ? m_average + m_config.smoothing * (frame_ms - m_average) : frame_ms;
+            m_seeded = true;
+            if (m_frames_at_step == m_config.downscale_after && m_left_ms > 0) {
+                // settled at the step the scale dropped to, under the load that made it drop
+                m_ratios[m_step] = std::clamp(m_left_ms / m_average, 1.0, pixel_ratio(m_step - 1));
+                m_left_ms = 0;
+            }
+
+            if (m_average > m_config.target_ms) {
+                m_over = m_step + 1 < m_config.scales.size() ? m_over + 1 : 0;
+                m_under = 0;
+            } else {
+                m_over = 0;
+                const bool fits = m_step > 0 && predicted(m_step - 1) < m_config.headroom * m_config.target_ms;
+                m_under = fits ? m_under + 1 : 0;
+            }
+
+            if (m_over >= m_config.downscale_after) {
+                change(m_step + 1);
+                return true;
+            }
+            if (m_under >= m_config.upscale_after) {
+                change(m_step - 1);
+                return true;
+            }
+            return false;
+        }
+
+        /// render scale per side, 1 is the full size
+        float scale() const
+        {
+            return m_scale;
+        }
+
+        float min_scale() const
+        {
+            return m_config.scales.back();
+        }
+
+        /// the decisions since the construction or the last reset, the oldest first
+        std::vector<resolution_decision> decisions() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return {m_log.begin(), m_log.end()};
+        }
+
+        /// back to the first scale, the log is cleared
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_step = 0;
+            m_scale = m_config.scales.front();
+            m_frames = 0;
+            m_frames_at_step = 0;
+            m_left_ms = 0;
+            std::fill(m_ratios.begin(), m_ratios.end(), 0.0);
+            m_seeded = false;
+            m_over = 0;
+            m_under = 0;
+            m_log.clear();
+        }
+
+    private:
+        /// frame time at the next larger `step`
+        double predicted(size_t step) const
+        {
+            return m_average * (m_ratios[m_step] > 0 ? m_ratios[m_step] : pixel_ratio(step));
+        }
+
+        double pixel_ratio(size_t step) const
+        {
+            const double ratio = m_config.scales[step] / m_config.scales[m_step];
+            return ratio * ratio;
+        }
+
+        void change(size_t step)
+        {
+            if (m_config.log_capacity > 0) {
+                if (m_log.size() == m_config.log_capacity) {
+                    m_log.pop_front();
+                }
+                m_log.push_back({m_frames, m_config.scales[m_step], m_config.scales[step], m_average});
+            }
+            // what the step cost when it was left, measured against the next one once that settled
+            m_left_ms = step > m_step ? m_average : 0;
+            // the smoothing goes on from the frame time predicted for the new step
+            m_average *= pixel_ratio(step);
+            m_frames_at_step = 0;
+            m_step = step;
+            m_scale = m_config.scales[m_step];
+            m_over = 0;
+            m_under = 0;
+        }
+
+        resolution_governor_config m_config;
+        std::atomic<float> m_scale{1.0f};
+
+        mutable std::mutex m_mutex;
+        size_t m_step{0};
+        uint64_t m_frames{0};
+        uint64_t m_frames_at_step{0};
+        double m_average{0};
+        double m_left_ms{0};
+        // measured cost of the next larger step relative to this one, 0 until measured
+        std::vector<double> m_ratios;
+        bool m_seeded{false};
+        uint32_t m_over{0};
+        uint32_t m_under{0};
+        std::deque<resolution_decision> m_log;
+    };
+} // namespace bnb
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Stage timing is compiled in only with BNB_OEP_PROFILING defined
+ * (cmake -DBNB_OEP_PROFILING=ON). Without it the BNB_PROFILE_* macros
+ * do not read the clock and the snapshots stay empty.
+ */
+#if defined(BNB_OEP_PROFILING)
+    #define BNB_PROFILE_CONCAT_IMPL(a, b) a##b
+    #define BNB_PROFILE_CONCAT(a, b) BNB_PROFILE_CONCAT_IMPL(a, b)
+    /// times the rest of the enclosing scope
+    #define BNB_PROFILE_STAGE(stage) ::bnb::scoped_stage_timer BNB_PROFILE_CONCAT(bnb_stage_timer_, __LINE__)(stage)
+    /// records the time passed since `start`, a bnb::stage_profiler::time_point
+    #define BNB_PROFILE_RECORD(stage, start) ::bnb::stage_profiler::instance().record(stage, start)
+    /// start point for BNB_PROFILE_RECORD
+    #define BNB_PROFILE_NOW() ::bnb::stage_profiler::now()
+#else
+    #define BNB_PROFILE_STAGE(stage) ((void) 0)
+    #define BNB_PROFILE_RECORD(stage, start) ((void) (start))
+    #define BNB_PROFILE_NOW() ::bnb::stage_profiler::time_point()
+#endif
+
+namespace bnb
+{
+    /// Stage boundaries of the frame path, in the order a frame passes them
+    enum class pipeline_stage
+    {
+        convert_input,  // CVPixelBuffer -> pixel_buffer
+        push_frame,     // effect_player::push_frame
+        draw,           // effect_player::draw
+        orient_image,   // offscreen_render_target::orient_image
+        read_texture,   // offscreen_render_target::get_current_buffer_texture
+        convert_output, // render target -> output CVPixelBuffer
+        completion,     // user completion block
+        end_to_end,     // processImage call -> completion block returned
+        count
+    };
+
+    inline const char* to_string(pipeline_stage stage)
+    {
+        switch (stage) {
+            case pipeline_stage::convert_input:     return "convert_input";
+            case pipeline_stage::push_frame:        return "push_frame";
+            case pipeline_stage::draw:              return "draw";
+            case pipeline_stage::orient_image:      return "orient_image";
+            case pipeline_stage::read_texture:      return "read_texture";
+            case pipeline_stage::convert_output:    return "convert_output";
+            case pipeline_stage::completion:        return "completion";
+            case pipeline_stage::end_to_end:        return "end_to_end";
+            case pipeline_stage::count:             break;
+        }
+        return "unknown";
+    }
+
+    /// Latencies in nanoseconds. Percentiles are upper bounds of their buckets, within 12.5%.
+    struct latency_snapshot
+    {
+        uint64_t count{0};
+        uint64_t mean{0};
+        uint64_t p50{0};
+        uint64_t p95{0};
+        uint64_t p99{0};
+        uint64_t max{0};
+    };
+
+    /**
+     * Log-linear histogram: 8 buckets per power of two. `record` is a couple of
+     * relaxed atomic increments, so any number of threads can record concurrently.
+     */
+    class latency_histogram
+    {
+    public:
+        void record(uint64_t value)
+        {
+            m_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_sum.fetch_add(value, std::memory_order_relaxed);
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+            while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        /// not atomic as a whole, values recorded meanwhile may be partially included
+        latency_snapshot snapshot() const
+        {
+            latency_snapshot s;
+            std::array<uint64_t, bucket_count> counts;
+            uint64_t total = 0;
+            for (size_t i = 0; i < bucket_count; ++i) {
+                counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+                total += counts[i];
+            }
+            if (total == 0) {
+                return s;
+            }
+            s.count = total;
+            s.mean = m_sum.load(std::memory_order_relaxed) / std::max<uint64_t>(m_count.load(std::memory_order_relaxed), 1);
+            s.max = m_max.load(std::memory_order_relaxed);
+            s.p50 = std::min(percentile(counts, total, 50), s.max);
+            s.p95 = std::min(percentile(counts, total, 95), s.max);
+            s.p99 = std::min(percentile(counts, total, 99), s.max);
+            return s;
+        }
+
+        void reset()
+        {
+            for (auto& bucket : m_buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            m_count.store(0, std::memory_order_relaxed);
+            m_sum.store(0, std::memory_order_relaxed);
+            m_max.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr uint32_t sub_bits = 3;
+        static constexpr uint32_t sub_count = 1u << sub_bits;
+        // values up to 2^40 ns (~18 minutes), larger ones land in the last bucket
+        static constexpr uint32_t max_bits = 40;
+        static constexpr size_t bucket_count = (max_bits - sub_bits + 1) * sub_count;
+
+        /// `v` is not 0
+        static uint32_t msb(uint64_t v)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return 63u - static_cast<uint32_t>(__builtin_clzll(v));
+#else
+            uint32_t n = 0;
+            while (v >>= 1) {
+                ++n;
+            }
+            return n;
+#endif
+        }
+
+        static size_t bucket_of(uint64_t value)
+        {
+            if (value < sub_count) {
+                return static_cast<size_t>(value);
+            }
+            const uint32_t bits = msb(value);
+            if (bits >= max_bits) {
+                return bucket_count - 1;
+            }
+            const uint32_t shift = bits - sub_bits;
+            return static_cast<size_t>((shift + 1) * sub_count + ((value >> shift) & (sub_count - 1)));
+        }
+
+        /// the largest value that falls into the bucket
+        static uint64_t upper_bound_of(size_t bucket)
+        {
+            if (bucket < sub_count) {
+                return bucket;
+            }
+            const uint64_t shift = bucket / sub_count - 1;
+            const uint64_t sub = bucket % sub_count;
+            return ((sub_count + sub + 1) << shift) - 1;
+        }
+
+        static uint64_t percentile(const std::array<uint64_t, bucket_count>& counts, uint64_t total, uint32_t p)
+        {
+            const uint64_t rank = (total * p + 99) / 100;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; ++i) {
+                seen += counts[i];
+                if (seen >= rank) {
+                    return upper_bound_of(i);
+                }
+            }
+            return upper_bound_of(bucket_count - 1);
+        }
+
+        std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_sum{0};
+        std::atomic<uint64_t> m_max{0};
+    };
+
+    /**
+     * Process wide per stage histograms. The instrumentation points use the
+     * BNB_PROFILE_* macros, the snapshots are available in any build.
+     */
+    class stage_profiler
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+        using time_point = clock::time_point;
+
+        static stage_profiler& instance()
+        {
+            static stage_profiler profiler;
+            return profiler;
+        }
+
+        static constexpr bool enabled()
+        {
+#if defined(BNB_OEP_PROFILING)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        static time_point now()
+        {
+            return clock::now();
+        }
+
+        void record(pipeline_stage stage, uint64_t nanoseconds)
+        {
+            m_stages[static_cast<size_t>(stage)].record(nanoseconds);
+        }
+
+        void record(pipeline_stage stage, time_point start)
+        {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+            record(stage, static_cast<uint64_t>(elapsed > 0 ? elapsed : 0));
+        }
+
+        latency_snapshot snapshot(pipeline_stage stage) const
+        {
+            return m_stages[static_cast<size_t>(stage)].snapshot();
+        }
+
+        std::array<latency_snapshot, static_cast<size_t>(pipeline_stage::count)> snapshot_all() const
+        {
+            std::array<latency_snapshot, static_cast<size_t>(pipeline_stage::count)> all;
+            for (size_t i = 0; i < all.size(); ++i) {
+                all[i] = m_stages[i].snapshot();
+            }
+            return all;
+        }
+
+        void reset()
+        {
+            for (auto& stage : m_stages) {
+                stage.reset();
+            }
+        }
+
+    private:
+        stage_profiler() = default;
+
+        std::array<latency_histogram, static_cast<size_t>(pipeline_stage::count)> m_stages;
+    };
+
+    /// Records the lifetime of the object into the stage histogram
+    class scoped_stage_timer
+    {
+    public:
+        explicit scoped_stage_timer(pipeline_stage stage)
+            : m_stage(stage)
+            , m_start(stage_profiler::now())
+        {
+        }
+
+        ~scoped_stage_timer()
+        {
+            stage_profiler::instance().record(m_stage, m_start);
+        }
+
+        scoped_stage_timer(const scoped_stage_timer&) = delete;
+        scoped_stage_timer& operator=(const scoped_stage_timer&) = delete;
+
+    private:
+        pipeline_stage m_stage;
+        stage_profiler::time_point m_start;
+    };
+
+} // namespace bnb
@@ -19,68 +19,228 @@
 //    3. This notice may not be removed or altered from any source
 //    distribution.
 
+// Altered: the single shared queue was replaced with per-worker deques and
+// work stealing, tasks are stored in a move-only small buffer. External
+// submissions are spread over per-worker FIFO inboxes, idle workers park.
+
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
 
 namespace bnb {
+
+    /**
+     * Move-only type-erased `void()` callable. Callables that fit into
+     * `inline_size` bytes are stored in place, bigger ones go to the heap.
+     */
+    class task
+    {
+    public:
+        static constexpr size_t inline_size = 6 * sizeof(void*);
+
+        task() noexcept = default;
+
+        template<class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, task>>>
+        task(F&& f)
+        {
+            using functor_t = std::decay_t<F>;
+            if constexpr (fits_inline<functor_t>()) {
+                new (m_storage) functor_t(std::forward<F>(f));
+                m_ops = &inline_ops<functor_t>;
+            } else {
+                new (m_storage) functor_t*(new functor_t(std::forward<F>(f)));
+                m_ops = &heap_ops<functor_t>;
+            }
+        }
+
+        task(task&& other) noexcept
+        {
+            move_from(other);
+        }
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other) {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task()
+        {
+            reset();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return m_ops != nullptr;
+        }
+
+        void operator()()
+        {
+            m_ops->invoke(m_storage);
+        }
+
+    private:
+        struct ops_t
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* dst, void* src) noexcept;
+            void (*destroy)(void* storage) noexcept;
+        };
+
+        template<class F>
+        static constexpr bool fits_inline()
+        {
+            return sizeof(F) <= inline_size
+                   && alignof(F) <= alignof(std::max_align_t)
+                   && std::is_nothrow_move_constructible_v<F>;
+        }
+
+        template<class F>
+        static constexpr ops_t inline_ops{
+            [](void* s) { (*static_cast<F*>(s))(); },
+            [](void* dst, void* src) noexcept {
+                new (dst) F(std::move(*static_cast<F*>(src)));
+                static_cast<F*>(src)->~F();
+            },
+            [](void* s) noexcept { static_cast<F*>(s)->~F(); }};
+
+        template<class F>
+        static constexpr ops_t heap_ops{
+            [](void* s) { (**static_cast<F**>(s))(); },
+            [](void* dst, void* src) noexcept {
+                *static_cast<F**>(dst) = *static_cast<F**>(src);
+            },
+            [](void* s) noexcept { delete *static_cast<F**>(s); }};
+
+        void move_from(task& other) noexcept
+        {
+            if (other.m_ops) {
+                other.m_ops->move(m_storage, other.m_storage);
+                m_ops = other.m_ops;
+                other.m_ops = nullptr;
+            }
+        }
+
+        void reset() noexcept
+        {
+            if (m_ops) {
+                m_ops->destroy(m_storage);
+                m_ops = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char m_storage[inline_size];
+        const ops_t* m_ops{nullptr};
+    };
+
+    /**
+     * Work-stealing thread pool. Every worker owns a deque, the owner takes
+     * the newest task from the back and idle workers steal the oldest task
+     * from the front of the others. Only tasks submitted from a worker thread
+     * go into that worker's deque, external submissions are dealt round-robin
+     * to per-worker FIFO inboxes, so producers do not contend on one mutex.
+     * An inbox starts its tasks in submission order: a pool of one thread is a
+     * serial queue and `enqueue(...).get()` is a barrier for the earlier ones.
+     * A worker that finds nothing to run parks until the next push.
+     */
     class thread_pool {
     public:
-        thread_pool(size_t);
+        explicit thread_pool(size_t);
+
+        /// fire-and-forget submission, no future and no shared state is created
+        template<class F>
+        void execute(F&& f);
 
+        /// compatibility shim returning a future with the result of the call
         template<class F, class... Args>
-        auto enqueue(F&& f, Args&&... args) 
-            -> std::future<typename std::result_of<F(Args...)>::type>;
+        auto enqueue(F&& f, Args&&... args)
+            -> std::future<std::invoke_result_t<F, Args...>>;
+
+        size_t size() const { return workers.size(); }
 
         ~thread_pool();
     private:
+        struct worker_queue
+        {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        void worker_loop(size_t index);
+        void push(task&& t);
+        bool try_pop(size_t index, task& t);
+        bool try_pop_inbox(size_t index, task& t);
+        bool try_steal(size_t index, task& t, bool blocking);
+
         // need to keep track of threads so we can join them
         std::vector< std::thread > workers;
-        // the task queue
-        std::queue< std::function<void()> > tasks;
-        
-        // synchronization
-        std::mutex queue_mutex;
+        // one task deque per worker
+        std::vector< std::unique_ptr<worker_queue> > queues;
+        // one inbox of submissions from outside the pool per worker, taken from the front
+        std::vector< std::unique_ptr<worker_queue> > inboxes;
+        // the inbox of the next external submission
+        std::atomic<size_t> next_inbox{0};
+
+        // number of tasks pushed, counted once the task is in its queue: a parked worker waits for it to change
+        std::atomic<uint64_t> pushes{0};
+        // number of tasks taken by the workers, all are done when it catches up with `pushes`
+        std::atomic<uint64_t> taken{0};
+        // number of workers blocked on the condition and not notified yet
+        std::atomic<size_t> sleeping{0};
+
+        // synchronization for idle workers only
+        std::mutex sleep_mutex;
+        // notified workers that have not woken up yet, guarded by `sleep_mutex`
+        size_t wakeups{0};
         std::condition_variable condition;
-        bool stop;
+        std::atomic<bool> stop{false};
+
+        // the pool and the deque index of the worker running on this thread
+        static inline thread_local const thread_pool* current_pool{nullptr};
+        static inline thread_local size_t current_index{0};
     };
 
     // the constructor just launches some amount of workers
     inline thread_pool::thread_pool(size_t threads)
-        :   stop(false)
     {
+        if (threads == 0) {
+            threads = 1;
+        }
+        queues.reserve(threads);
+        inboxes.reserve(threads);
         for (size_t i = 0; i < threads; ++i) {
-            workers.emplace_back([this] {
-                for(;;) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this]{ return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty()) {
-                            return;
-                        }
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-                    task();
-                }
-            });
+            queues.emplace_back(std::make_unique<worker_queue>());
+            inboxes.emplace_back(std::make_unique<worker_queue>());
+        }
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this, i] { worker_loop(i); });
         }
     }
 
-    // the destructor joins all threads
+    // the destructor runs the remaining tasks and joins all threads
     inline thread_pool::~thread_pool()
     {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::unique_lock<std::mutex> lock(sleep_mutex);
             stop = true;
         }
         condition.notify_all();
@@ -91,28 +251,146 @@ namespace bnb {
         }
     }
 
-    // add new work item to the pool
-    template<class F, class... Args>
-    auto thread_pool::enqueue(F&& f, Args&&... args) 
-        -> std::future<typename std::result_of<F(Args...)>::type>
+    inline void thread_pool::worker_loop(size_t index)
     {
-        using return_type = typename std::result_of<F(Args...)>::type;
+        current_pool = this;
+        current_index = index;
+        for (;;) {
+            // a task pushed after this load wakes the worker up, one pushed before is in a queue already
+            const uint64_t seen = pushes.load();
+            task t;
+            // the first pass skips the busy queues, the second one waits for them:
+            // a task left behind a lock held by a busy owner is not worth parking for
+            if (try_pop(index, t) || try_pop_inbox(index, t) || try_steal(index, t, false) || try_steal(index, t, true)) {
+                taken.fetch_add(1);
+                t();
+                continue;
+            }
 
-        auto task = std::make_shared< std::packaged_task<return_type()> >(
-                std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-            
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            // a task pushing from a worker finds its task in its own deque before it stops
+            if (stop && taken.load() == pushes.load()) {
+                return;
+            }
+            sleeping.fetch_add(1);
+            condition.wait(lock, [this, seen] { return stop || pushes.load() != seen; });
+            // a notifier has already stopped counting one of the sleepers, maybe this one
+            if (wakeups != 0) {
+                --wakeups;
+            } else {
+                sleeping.fetch_sub(1);
+            }
+        }
+    }
+
+    inline void thread_pool::push(task&& t)
+    {
+        // don't allow enqueueing after stopping the pool, except from the tasks being drained
+        if (stop && current_pool != this) {
+            throw std::runtime_error("enqueue on stopped thread_pool");
+        }
 
-            // don't allow enqueueing after stopping the pool
-            if (stop) {
-                throw std::runtime_error("enqueue on stopped thread_pool");
+        worker_queue* q = nullptr;
+        if (current_pool == this) {
+            q = queues[current_index].get();
+        } else {
+            // racing producers may pick the same inbox, the spread only has to be roughly even,
+            // a load and a store are cheaper than an atomic increment on every push
+            const size_t inbox = next_inbox.load(std::memory_order_relaxed);
+            next_inbox.store(inbox + 1, std::memory_order_relaxed);
+            q = inboxes[inbox % inboxes.size()].get();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(q->mutex);
+            q->tasks.push_back(std::move(t));
+        }
+        // `pushes` is published before `sleeping` is read, a worker going to sleep
+        // does it in the opposite order, so at least one side observes the other
+        pushes.fetch_add(1);
+        if (sleeping.load() != 0) {
+            bool wake = false;
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                // the woken worker is not counted any more, the pushes until it runs do not notify it again
+                if (sleeping.load() != 0) {
+                    sleeping.fetch_sub(1);
+                    ++wakeups;
+                    wake = true;
+                }
+            }
+            if (wake) {
+                condition.notify_one();
             }
+        }
+    }
 
-            tasks.emplace([task](){ (*task)(); });
+    inline bool thread_pool::try_pop(size_t index, task& t)
+    {
+        auto& q = *queues[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    inline bool thread_pool::try_pop_inbox(size_t index, task& t)
+    {
+        auto& q = *inboxes[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) {
+            return false;
         }
-        condition.notify_one();
+        t = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+    }
+
+    inline bool thread_pool::try_steal(size_t index, task& t, bool blocking)
+    {
+        const size_t count = queues.size();
+        for (size_t i = 1; i < count; ++i) {
+            // the external submissions first, they have waited the longest
+            for (auto* victim : {inboxes[(index + i) % count].get(), queues[(index + i) % count].get()}) {
+                std::unique_lock<std::mutex> lock(victim->mutex, std::defer_lock);
+                if (blocking) {
+                    lock.lock();
+                } else if (!lock.try_lock()) {
+                    continue;
+                }
+                if (victim->tasks.empty()) {
+                    continue;
+                }
+                t = std::move(victim->tasks.front());
+                victim->tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // add new fire-and-forget work item to the pool
+    template<class F>
+    void thread_pool::execute(F&& f)
+    {
+        push(task(std::forward<F>(f)));
+    }
+
+    // add new work item to the pool
+    template<class F, class... Args>
+    auto thread_pool::enqueue(F&& f, Args&&... args)
+        -> std::future<std::invoke_result_t<F, Args...>>
+    {
+        using return_type = std::invoke_result_t<F, Args...>;
+
+        std::packaged_task<return_type()> pt(
+                std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+        std::future<return_type> res = pt.get_future();
+        push(task(std::move(pt)));
         return res;
     }
 
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "video_file.hpp"
+
+#include <cstdint>
+#include <functional>
+
+namespace bnb::video
+{
+    /**
+     * @addtogroup utils
+     * @{
+     */
+
+    struct pipeline_stats
+    {
+        uint64_t frames{0};
+        double seconds{0};
+        /// time spent inside the process callback
+        double process_seconds{0};
+        /// time the processing waited for the reader and for a free output buffer
+        double input_wait_seconds{0};
+        double output_wait_seconds{0};
+        /// all frame buffers of the pipeline, does not depend on the length of the clip
+        size_t buffer_bytes{0};
+    };
+
+    /**
+     * Streams a clip through a processing step at constant memory:
+     * reader thread -> `read_ahead` input frames -> process on the caller's thread
+     * -> `write_behind` output frames -> writer thread.
+     * The frame buffers are allocated once, file I/O overlaps with the processing.
+     */
+    class file_pipeline
+    {
+    public:
+        /// `input` may be modified, e.g. used as scratch space
+        using process_fn = std::function<void(uint8_t* input, uint8_t* output)>;
+
+        file_pipeline(frame_reader& reader, frame_writer& writer, size_t read_ahead = 4, size_t write_behind = 4);
+
+        /// `max_frames` equal to 0 processes the whole stream; the first error of any stage is rethrown
+        pipeline_stats run(const process_fn& process, uint64_t max_frames = 0);
+
+    private:
+        frame_reader& m_reader;
+        frame_writer& m_writer;
+        size_t m_read_ahead;
+        size_t m_write_behind;
+    };
+
+    /** @} */ // endgroup utils
+} // namespace bnb::video
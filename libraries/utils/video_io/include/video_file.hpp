@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace bnb::video
+{
+    /**
+     * @addtogroup utils
+     * @{
+     */
+
+    /// Memory layout of one frame, the planes are tightly packed one after another
+    enum class pixel_layout
+    {
+        i420,
+        nv12,
+        bgra
+    };
+
+    struct frame_format
+    {
+        int32_t width{0};
+        int32_t height{0};
+        pixel_layout layout{pixel_layout::i420};
+        int32_t fps_num{30};
+        int32_t fps_den{1};
+    };
+
+    struct frame_plane
+    {
+        uint8_t* data{nullptr};
+        int32_t stride{0};
+        int32_t rows{0};
+    };
+
+    /// 1 for bgra, 2 for nv12, 3 for i420
+    int32_t plane_count(pixel_layout layout);
+
+    /// bytes of one frame
+    size_t frame_size(const frame_format& format);
+
+    /// planes of the frame stored at `frame`, the unused ones are empty
+    std::array<frame_plane, 3> frame_planes(const frame_format& format, uint8_t* frame);
+
+    /// "i420", "nv12" or "bgra", throws std::invalid_argument for anything else
+    pixel_layout parse_pixel_layout(const std::string& name);
+    const char* to_string(pixel_layout layout);
+
+    /**
+     * Sequential frame source. Files are read in large chunks straight into the
+     * caller's buffer, nothing is kept besides the stdio buffer.
+     */
+    class frame_reader
+    {
+    public:
+        virtual ~frame_reader() = default;
+
+        virtual const frame_format& format() const = 0;
+
+        /// reads the next frame into `frame` (frame_size bytes), false at the end of the stream
+        virtual bool read(uint8_t* frame) = 0;
+    };
+
+    class frame_writer
+    {
+    public:
+        virtual ~frame_writer() = default;
+
+        virtual const frame_format& format() const = 0;
+
+        virtual void write(const uint8_t* frame) = 0;
+
+        /// flushes the file, further writes are not allowed
+        virtual void close() = 0;
+    };
+
+    /**
+     * `.y4m` files are YUV4MPEG2 with 4:2:0 chroma (read as i420), the format is taken from
+     * the header. Any other file is raw, `raw_format` describes it then.
+     * Errors are reported with std::runtime_error.
+     */
+    std::unique_ptr<frame_reader> open_reader(const std::string& path, const frame_format& raw_format = {});
+
+    /// `.y4m` files accept i420 frames only, any other file is written raw
+    std::unique_ptr<frame_writer> open_writer(const std::string& path, const frame_format& format);
+
+    /** @} */ // endgroup utils
+} // namespace bnb::video
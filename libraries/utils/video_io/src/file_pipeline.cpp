@@ -0,0 +1,214 @@
+#include "file_pipeline.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace bnb::video
+{
+    namespace
+    {
+        using pipeline_clock = std::chrono::steady_clock;
+
+        double seconds_since(pipeline_clock::time_point start)
+        {
+            return std::chrono::duration<double>(pipeline_clock::now() - start).count();
+        }
+
+        /**
+         * Indices of the frame buffers handed between two stages. It holds at most
+         * `capacity` entries, which is the number of buffers, so push never waits.
+         */
+        class slot_queue
+        {
+        public:
+            explicit slot_queue(size_t capacity)
+                : m_slots(capacity)
+            {
+            }
+
+            void push(size_t slot)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_slots[(m_head + m_size) % m_slots.size()] = slot;
+                    ++m_size;
+                }
+                m_not_empty.notify_one();
+            }
+
+            /// nullopt once the queue is closed and drained
+            std::optional<size_t> pop()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_not_empty.wait(lock, [this] { return m_closed || m_size != 0; });
+                if (m_size == 0) {
+                    return std::nullopt;
+                }
+                const size_t slot = m_slots[m_head];
+                m_head = (m_head + 1) % m_slots.size();
+                --m_size;
+                return slot;
+            }
+
+            /// the queued entries can still be popped
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_closed = true;
+                }
+                m_not_empty.notify_all();
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_not_empty;
+            std::vector<size_t> m_slots;
+            size_t m_head{0};
+            size_t m_size{0};
+            bool m_closed{false};
+        };
+
+        /* fixed set of equally sized frame buffers */
+        struct frame_slots
+        {
+            frame_slots(size_t count, size_t frame_bytes)
+                : frame_bytes(frame_bytes)
+                , storage(count * frame_bytes)
+                , free(count)
+                , full(count)
+            {
+                for (size_t i = 0; i < count; ++i) {
+                    free.push(i);
+                }
+            }
+
+            uint8_t* data(size_t slot)
+            {
+                return storage.data() + slot * frame_bytes;
+            }
+
+            void close()
+            {
+                free.close();
+                full.close();
+            }
+
+            const size_t frame_bytes;
+            std::vector<uint8_t> storage;
+            slot_queue free;
+            slot_queue full;
+        };
+
+        /* the first error wins, the pipeline is shut down so no stage waits forever */
+        struct error_state
+        {
+            void set(std::exception_ptr e)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = e;
+                }
+            }
+
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+    } // namespace
+
+    file_pipeline::file_pipeline(frame_reader& reader, frame_writer& writer, size_t read_ahead, size_t write_behind)
+        : m_reader(reader)
+        , m_writer(writer)
+        , m_read_ahead(std::max<size_t>(read_ahead, 1))
+        , m_write_behind(std::max<size_t>(write_behind, 1))
+    {
+    }
+
+    pipeline_stats file_pipeline::run(const process_fn& process, uint64_t max_frames)
+    {
+        frame_slots input(m_read_ahead, frame_size(m_reader.format()));
+        frame_slots output(m_write_behind, frame_size(m_writer.format()));
+        error_state errors;
+
+        auto shutdown = [&input, &output] {
+            input.close();
+            output.close();
+        };
+
+        std::thread reader([this, &input, &errors, &shutdown] {
+            try {
+                while (auto slot = input.free.pop()) {
+                    if (!m_reader.read(input.data(*slot))) {
+                        break;
+                    }
+                    input.full.push(*slot);
+                }
+            } catch (...) {
+                errors.set(std::current_exception());
+                shutdown();
+            }
+            input.full.close();
+        });
+
+        std::thread writer([this, &output, &errors, &shutdown] {
+            try {
+                while (auto slot = output.full.pop()) {
+                    m_writer.write(output.data(*slot));
+                    output.free.push(*slot);
+                }
+                m_writer.close();
+            } catch (...) {
+                errors.set(std::current_exception());
+                shutdown();
+            }
+        });
+
+        pipeline_stats stats;
+        stats.buffer_bytes = input.storage.size() + output.storage.size();
+        const auto start = pipeline_clock::now();
+        try {
+            while (max_frames == 0 || stats.frames < max_frames) {
+                auto wait_start = pipeline_clock::now();
+                const auto in = input.full.pop();
+                stats.input_wait_seconds += seconds_since(wait_start);
+                if (!in) {
+                    break;
+                }
+                wait_start = pipeline_clock::now();
+                const auto out = output.free.pop();
+                stats.output_wait_seconds += seconds_since(wait_start);
+                if (!out) {
+                    break;
+                }
+
+                const auto process_start = pipeline_clock::now();
+                process(input.data(*in), output.data(*out));
+                stats.process_seconds += seconds_since(process_start);
+
+                input.free.push(*in);
+                output.full.push(*out);
+                ++stats.frames;
+            }
+        } catch (...) {
+            errors.set(std::current_exception());
+            shutdown();
+        }
+        // stops the reader after max_frames, the writer drains the processed frames
+        input.free.close();
+        output.full.close();
+        reader.join();
+        writer.join();
+        stats.seconds = seconds_since(start);
+
+        if (errors.error) {
+            std::rethrow_exception(errors.error);
+        }
+        return stats;
+    }
+} // namespace bnb::video
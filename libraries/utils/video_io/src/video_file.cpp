@@ -0,0 +1,347 @@
+#include "video_file.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace bnb::video
+{
+    namespace
+    {
+        /* big enough to read a 1080p frame in a few calls */
+        constexpr size_t io_chunk_size = 1 << 20;
+
+        /* the stdio buffer is the only copy of the data between the file and the frame */
+        struct file_handle
+        {
+            explicit file_handle(const std::string& path, const char* mode)
+                : m_file(std::fopen(path.c_str(), mode))
+            {
+                if (m_file == nullptr) {
+                    throw std::runtime_error("can not open " + path);
+                }
+                std::setvbuf(m_file, nullptr, _IOFBF, io_chunk_size);
+            }
+
+            ~file_handle()
+            {
+                close();
+            }
+
+            file_handle(const file_handle&) = delete;
+            file_handle& operator=(const file_handle&) = delete;
+
+            void close()
+            {
+                if (m_file != nullptr) {
+                    std::fclose(m_file);
+                    m_file = nullptr;
+                }
+            }
+
+            std::FILE* get() const
+            {
+                return m_file;
+            }
+
+        private:
+            std::FILE* m_file;
+        };
+
+        bool ends_with(const std::string& s, const std::string& suffix)
+        {
+            return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        bool is_y4m(const std::string& path)
+        {
+            return ends_with(path, ".y4m") || ends_with(path, ".Y4M");
+        }
+
+        void check_format(const frame_format& format)
+        {
+            if (format.width <= 0 || format.height <= 0) {
+                throw std::runtime_error("frame size is not set");
+            }
+            if (format.fps_num <= 0 || format.fps_den <= 0) {
+                throw std::runtime_error("bad frame rate");
+            }
+        }
+
+        /* reads one '\n' terminated line, false at the end of the file */
+        bool read_line(std::FILE* file, std::string& line, size_t max_size)
+        {
+            line.clear();
+            int c = 0;
+            while ((c = std::fgetc(file)) != EOF) {
+                if (c == '\n') {
+                    return true;
+                }
+                if (line.size() == max_size) {
+                    throw std::runtime_error("y4m: header line is too long");
+                }
+                line.push_back(static_cast<char>(c));
+            }
+            if (!line.empty()) {
+                throw std::runtime_error("y4m: truncated header");
+            }
+            return false;
+        }
+
+        class raw_reader : public frame_reader
+        {
+        public:
+            raw_reader(const std::string& path, const frame_format& format)
+                : m_file(path, "rb")
+                , m_format(format)
+                , m_frame_size(frame_size(format))
+            {
+                check_format(format);
+            }
+
+            const frame_format& format() const override
+            {
+                return m_format;
+            }
+
+            bool read(uint8_t* frame) override
+            {
+                const size_t n = std::fread(frame, 1, m_frame_size, m_file.get());
+                if (n == 0) {
+                    return false;
+                }
+                if (n != m_frame_size) {
+                    throw std::runtime_error("raw: truncated frame");
+                }
+                return true;
+            }
+
+        private:
+            file_handle m_file;
+            frame_format m_format;
+            size_t m_frame_size;
+        };
+
+        class y4m_reader : public frame_reader
+        {
+        public:
+            explicit y4m_reader(const std::string& path)
+                : m_file(path, "rb")
+            {
+                std::string header;
+                if (!read_line(m_file.get(), header, 1024) || header.compare(0, 10, "YUV4MPEG2 ") != 0) {
+                    throw std::runtime_error("y4m: bad signature in " + path);
+                }
+                parse_header(header);
+                check_format(m_format);
+                m_frame_size = frame_size(m_format);
+            }
+
+            const frame_format& format() const override
+            {
+                return m_format;
+            }
+
+            bool read(uint8_t* frame) override
+            {
+                if (!read_line(m_file.get(), m_line, 1024)) {
+                    return false;
+                }
+                if (m_line.compare(0, 5, "FRAME") != 0) {
+                    throw std::runtime_error("y4m: FRAME marker expected");
+                }
+                if (std::fread(frame, 1, m_frame_size, m_file.get()) != m_frame_size) {
+                    throw std::runtime_error("y4m: truncated frame");
+                }
+                return true;
+            }
+
+        private:
+            void parse_header(const std::string& header)
+            {
+                m_format.layout = pixel_layout::i420;
+                size_t pos = 10;
+                while (pos < header.size()) {
+                    size_t end = header.find(' ', pos);
+                    if (end == std::string::npos) {
+                        end = header.size();
+                    }
+                    const std::string token = header.substr(pos, end - pos);
+                    pos = end + 1;
+                    if (token.empty()) {
+                        continue;
+                    }
+                    const std::string value = token.substr(1);
+                    switch (token[0]) {
+                        case 'W':
+                            m_format.width = std::atoi(value.c_str());
+                            break;
+                        case 'H':
+                            m_format.height = std::atoi(value.c_str());
+                            break;
+                        case 'F':
+                            if (std::sscanf(value.c_str(), "%d:%d", &m_format.fps_num, &m_format.fps_den) != 2) {
+                                throw std::runtime_error("y4m: bad frame rate " + value);
+                            }
+                            break;
+                        case 'C':
+                            // 4:2:0 with any chroma siting has the i420 memory layout
+                            if (value.compare(0, 3, "420") != 0) {
+                                throw std::runtime_error("y4m: unsupported colour space C" + value);
+                            }
+                            break;
+                        case 'I':
+                            if (value != "p" && value != "?") {
+                                throw std::runtime_error("y4m: interlaced input is not supported");
+                            }
+                            break;
+                        default:
+                            // aspect ratio, comments and extensions do not change the frame layout
+                            break;
+                    }
+                }
+            }
+
+            file_handle m_file;
+            frame_format m_format;
+            size_t m_frame_size{0};
+            std::string m_line;
+        };
+
+        class raw_writer : public frame_writer
+        {
+        public:
+            raw_writer(const std::string& path, const frame_format& format)
+                : m_file(path, "wb")
+                , m_format(format)
+                , m_frame_size(frame_size(format))
+            {
+                check_format(format);
+            }
+
+            const frame_format& format() const override
+            {
+                return m_format;
+            }
+
+            void write(const uint8_t* frame) override
+            {
+                if (std::fwrite(frame, 1, m_frame_size, m_file.get()) != m_frame_size) {
+                    throw std::runtime_error("raw: write failed");
+                }
+            }
+
+            void close() override
+            {
+                m_file.close();
+            }
+
+        protected:
+            file_handle m_file;
+            frame_format m_format;
+            size_t m_frame_size;
+        };
+
+        class y4m_writer : public raw_writer
+        {
+        public:
+            y4m_writer(const std::string& path, const frame_format& format)
+                : raw_writer(path, format)
+            {
+                if (format.layout != pixel_layout::i420) {
+                    throw std::runtime_error("y4m: only i420 frames can be written");
+                }
+                std::fprintf(m_file.get(), "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", format.width, format.height, format.fps_num, format.fps_den);
+            }
+
+            void write(const uint8_t* frame) override
+            {
+                std::fputs("FRAME\n", m_file.get());
+                raw_writer::write(frame);
+            }
+        };
+    } // namespace
+
+    int32_t plane_count(pixel_layout layout)
+    {
+        switch (layout) {
+            case pixel_layout::i420: return 3;
+            case pixel_layout::nv12: return 2;
+            case pixel_layout::bgra: return 1;
+        }
+        return 0;
+    }
+
+    std::array<frame_plane, 3> frame_planes(const frame_format& format, uint8_t* frame)
+    {
+        const int32_t chroma_width = (format.width + 1) / 2;
+        const int32_t chroma_height = (format.height + 1) / 2;
+        std::array<frame_plane, 3> planes{};
+        switch (format.layout) {
+            case pixel_layout::bgra:
+                planes[0] = {frame, format.width * 4, format.height};
+                break;
+            case pixel_layout::nv12:
+                planes[0] = {frame, format.width, format.height};
+                planes[1] = {frame + static_cast<size_t>(format.width) * format.height, chroma_width * 2, chroma_height};
+                break;
+            case pixel_layout::i420:
+                planes[0] = {frame, format.width, format.height};
+                planes[1] = {planes[0].data + static_cast<size_t>(format.width) * format.height, chroma_width, chroma_height};
+                planes[2] = {planes[1].data + static_cast<size_t>(chroma_width) * chroma_height, chroma_width, chroma_height};
+                break;
+        }
+        return planes;
+    }
+
+    size_t frame_size(const frame_format& format)
+    {
+        size_t size = 0;
+        for (const auto& plane : frame_planes(format, nullptr)) {
+            size += static_cast<size_t>(plane.stride) * plane.rows;
+        }
+        return size;
+    }
+
+    pixel_layout parse_pixel_layout(const std::string& name)
+    {
+        if (name == "i420") {
+            return pixel_layout::i420;
+        }
+        if (name == "nv12") {
+            return pixel_layout::nv12;
+        }
+        if (name == "bgra") {
+            return pixel_layout::bgra;
+        }
+        throw std::invalid_argument("unknown pixel layout " + name);
+    }
+
+    const char* to_string(pixel_layout layout)
+    {
+        switch (layout) {
+            case pixel_layout::i420: return "i420";
+            case pixel_layout::nv12: return "nv12";
+            case pixel_layout::bgra: return "bgra";
+        }
+        return "unknown";
+    }
+
+    std::unique_ptr<frame_reader> open_reader(const std::string& path, const frame_format& raw_format)
+    {
+        if (is_y4m(path)) {
+            return std::make_unique<y4m_reader>(path);
+        }
+        return std::make_unique<raw_reader>(path, raw_format);
+    }
+
+    std::unique_ptr<frame_writer> open_writer(const std::string& path, const frame_format& format)
+    {
+        if (is_y4m(path)) {
+            return std::make_unique<y4m_writer>(path, format);
+        }
+        return std::make_unique<raw_writer>(path, format);
+    }
+} // namespace bnb::video
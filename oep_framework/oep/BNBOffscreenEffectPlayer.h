@@ -9,12 +9,169 @@ typedef NS_ENUM(NSUInteger, EPOrientation) {
     EPOrientationAngles270
 };
 
+/**
+ * BNBOrientationStrategyGPUPass rotates the rendered frame with an extra draw into a second render target.
+ * BNBOrientationStrategyCPUFused skips the draw and rotates the frame while converting it to the output format.
+ * BNBOrientationStrategyInRender has the SDK draw the camera frame rotated, no extra pass at all; the effect
+ * is rendered in the rotated frame, so screen space elements of an effect (text, UI) are not rotated.
+ * GPUPass is the default, InRender is opt-in through orientationStrategy for effects without screen space elements.
+ */
+typedef NS_ENUM(NSUInteger, BNBOrientationStrategy) {
+    BNBOrientationStrategyGPUPass,
+    BNBOrientationStrategyCPUFused,
+    BNBOrientationStrategyInRender
+};
+
+/**
+ * Pixel format of the output images. BGRA and NV12 are rendered by the GPU, the completion receives
+ * the render target itself. RGBA is converted on the CPU, so are all formats with
+ * BNBOrientationStrategyCPUFused and a rotated output. NV12 uses the BT.709 matrix
+ */
+typedef NS_ENUM(NSUInteger, BNBOutputFormat) {
+    BNBOutputFormatBGRA,
+    BNBOutputFormatNV12VideoRange,
+    BNBOutputFormatNV12FullRange,
+    BNBOutputFormatRGBA
+};
+
+/**
+ * What processImage does with a frame when the effect player has not taken the previous ones yet.
+ * BNBBackpressurePolicyLatestWins - one waiting frame, it is replaced by the newest one (the default)
+ * BNBBackpressurePolicyDropOldest - up to `capacity` waiting frames, the oldest one is dropped
+ * BNBBackpressurePolicyBlock - up to `capacity` waiting frames, processImage waits for a free slot
+ */
+typedef NS_ENUM(NSUInteger, BNBBackpressurePolicy) {
+    BNBBackpressurePolicyLatestWins,
+    BNBBackpressurePolicyDropOldest,
+    BNBBackpressurePolicyBlock
+};
+
+/**
+ * BNBProcessingModeSync - face recognition runs inside the draw of a frame, every frame costs recognition + rendering (the default)
+ * BNBProcessingModeAsync - the next frames are recognised on a thread of the effect player while a frame is drawn.
+ *                          With `pipelineDepth` N the completion of a frame carries the oldest recognised frame, up to
+ *                          N - 1 frames behind, and the first completions have no image while the pipeline fills
+ */
+typedef NS_ENUM(NSUInteger, BNBProcessingMode) {
+    BNBProcessingModeSync,
+    BNBProcessingModeAsync
+};
+
+typedef NS_ENUM(NSUInteger, BNBFrameStatus) {
+    BNBFrameStatusProcessed,
+    BNBFrameStatusDroppedCoalesced,         // replaced by a newer frame
+    BNBFrameStatusDroppedQueueFull,         // pushed out of the full queue
+    BNBFrameStatusDroppedUnsupportedFormat, // the pixel format of the input is not supported
+    BNBFrameStatusDroppedShutdown,          // the player was destroyed before the frame was processed
+    BNBFrameStatusFailed                    // the effect player did not return an image
+};
+
+/**
+ * Stages of the frame path timed when the framework is built with BNB_OEP_PROFILING
+ */
+typedef NS_ENUM(NSUInteger, BNBPipelineStage) {
+    BNBPipelineStageConvertInput,
+    BNBPipelineStagePushFrame,
+    BNBPipelineStageDraw,
+    BNBPipelineStageOrientImage,
+    BNBPipelineStageReadTexture,
+    BNBPipelineStageConvertOutput,
+    BNBPipelineStageCompletion,
+    BNBPipelineStageEndToEnd
+};
+
+/**
+ * Latencies in nanoseconds, percentiles are accurate within 12.5%.
+ * All zero when the framework is built without BNB_OEP_PROFILING
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p95;
+    uint64_t p99;
+    uint64_t max;
+} BNBStageLatency;
+
+typedef struct {
+    NSUInteger accepted;
+    NSUInteger dropped;
+    NSUInteger coalesced;
+    NSUInteger queued;
+} BNBFrameStats;
+
+typedef struct {
+    NSUInteger renderTargets;
+    NSUInteger frames;
+    NSUInteger exhausted;   // every render target was still held, the frame got fresh buffers
+    NSUInteger fenceWaits;  // the frame was still on the GPU when it was done, the completion waited off the render thread
+    NSUInteger resizes;       // the surface changed size, the render targets were replaced
+    NSUInteger reallocations; // a resize the pool had no render targets of the new size for
+} BNBRenderTargetStats;
+
+/**
+ * A change of the effect render scale, see setRenderScaleGovernorTarget
+ */
+typedef struct {
+    NSUInteger frame;   // live frames measured before the change
+    float fromScale;
+    float toScale;
+    double frameTimeMs; // the smoothed frame time of the decision
+} BNBRenderScaleDecision;
+
+/**
+ * Effects prepared by preloadEffect, see effectCacheStats
+ */
+typedef struct {
+    NSUInteger hits;      // loaded effects that were prepared
+    NSUInteger misses;    // loaded effects read from storage by loadEffect
+    NSUInteger preloads;
+    NSUInteger evictions;
+    NSUInteger effects;   // prepared effects held
+    NSUInteger bytes;     // memory of the prepared effects
+    NSUInteger capacity;
+} BNBEffectCacheStats;
+
+/**
+ * Pacing of the rendering, see setTargetFrameRate
+ */
+typedef struct {
+    NSUInteger ticks;
+    NSUInteger renders;
+    NSUInteger staleFrames;  // replaced by a fresher frame before a tick, completed as BNBFrameStatusDroppedCoalesced
+    NSUInteger idleTicks;    // no new frame, the previous output stays current
+    NSUInteger busyTicks;    // the previous frame was still rendering
+    NSUInteger missedTicks;  // passed before the pacer thread got to them
+    double jitterMeanMs;     // |time between two renders - the frame interval|
+    double jitterMaxMs;
+    double latenessMeanMs;   // a tick ran after its time
+    double latenessMaxMs;
+    double latencyMeanMs;    // processImage to render
+    double latencyMaxMs;
+} BNBFramePacingStats;
+
 /**
  * block to return resulted image after processing
  * NOTE: pixelBuffer can be null if frame dropped because of queue or because of passed unsupported image format for target image
+ * NOTE: pixelBuffer is usually one of the render targets, leased to the caller: the GPU has finished it when
+ *       the block runs and no frame is rendered into it while it is retained. Retain it to keep it past the block and release it as soon as it is consumed,
+ *       while the caller holds every render target each frame costs a new one (see renderTargetStats)
  */
 typedef void (^BNBOEPImageReadyBlock)(_Nullable CVPixelBufferRef pixelBuffer);
 
+/**
+ * Same as BNBOEPImageReadyBlock, `status` tells why pixelBuffer is null.
+ * pixelBuffer is not null only for BNBFrameStatusProcessed
+ */
+typedef void (^BNBOEPImageStatusBlock)(_Nullable CVPixelBufferRef pixelBuffer, BNBFrameStatus status);
+
+/**
+ * Called once for every frame of a batch, in input order. `index` is the position of the frame in the batch
+ */
+typedef void (^BNBOEPBatchFrameBlock)(NSUInteger index, _Nullable CVPixelBufferRef pixelBuffer, BNBFrameStatus status);
+
+typedef void (^BNBOEPBatchCompletionBlock)(void);
+
 
 @interface BNBOffscreenEffectPlayer : NSObject
 
@@ -28,17 +185,132 @@ typedef void (^BNBOEPImageReadyBlock)(_Nullable CVPixelBufferRef pixelBuffer);
                   manualAudio:(BOOL)manual
                         token:(NSString*)token
                 resourcePaths:(nonnull NSArray<NSString *> *)resourcePaths;
+
+/**
+ * Same as above, `processingMode` and `pipelineDepth` are fixed for the life of the player, see BNBProcessingMode.
+ * The initializer above is BNBProcessingModeSync with a depth of 1
+ */
+- (instancetype)initWithWidth:(NSUInteger)width
+                       height:(NSUInteger)height
+                  manualAudio:(BOOL)manual
+                        token:(NSString*)token
+                resourcePaths:(nonnull NSArray<NSString *> *)resourcePaths
+               processingMode:(BNBProcessingMode)processingMode
+                pipelineDepth:(NSUInteger)pipelineDepth;
 // /**
 //  * Async processImage method
 //  */
 - (void)processImage:(CVPixelBufferRef)pixelBuffer inputOrientation:(EPOrientation)orientation completion:(BNBOEPImageReadyBlock _Nonnull)completion;
 
+/**
+ * Async processImage method, the completion is called exactly once for every frame
+ */
+- (void)processImage:(CVPixelBufferRef)pixelBuffer inputOrientation:(EPOrientation)orientation statusCompletion:(BNBOEPImageStatusBlock _Nonnull)completion;
+
+/**
+ * Offline processing of a frame sequence, e.g. the export of a recorded clip. No frame is dropped,
+ * several frames are in flight at once and the GL context stays current for the whole batch.
+ * The buffers are retained, the arrays may be freed as soon as the call returns.
+ * Frames passed to processImage wait until the batch is done.
+ */
+- (void)processImages:(const CVPixelBufferRef _Nonnull * _Nonnull)pixelBuffers
+         orientations:(const EPOrientation* _Nonnull)orientations
+                count:(NSUInteger)count
+      frameCompletion:(BNBOEPBatchFrameBlock _Nonnull)frameCompletion
+           completion:(BNBOEPBatchCompletionBlock _Nullable)completion;
+
+/**
+ * Input stage policy, capacity is ignored for BNBBackpressurePolicyLatestWins
+ * NOTE: set it before processing starts
+ */
+- (void)setBackpressurePolicy:(BNBBackpressurePolicy)policy capacity:(NSUInteger)capacity;
+
+/**
+ * Counters of the input stage since the last setBackpressurePolicy
+ */
+- (BNBFrameStats)frameStats;
+
+/**
+ * Renders at `framesPerSecond` instead of on every processImage: the frames wait for the next tick of
+ * the pacer, a fresher one replaces the waiting frame. A camera out of phase with the display then
+ * neither renders two frames of which only one is shown nor skips a refresh because two frames came
+ * within one interval. A frame waits up to one interval longer. 0 turns pacing off, every processImage
+ * renders again and the backpressure policy applies
+ */
+- (void)setTargetFrameRate:(double)framesPerSecond;
+
+/**
+ * Counters and frame pacing jitter since the last setTargetFrameRate, all zero while pacing is off
+ */
+- (BNBFramePacingStats)framePacingStats;
+
+/**
+ * Format and orientation of the output images, BNBOutputFormatBGRA and EPOrientationAngles270 by default.
+ * Any thread, applies from the next frame submitted to the effect player
+ */
+- (void)setOutputFormat:(BNBOutputFormat)format orientation:(EPOrientation)orientation;
+
+/**
+ * Number of render targets frames are rendered into in turn, 2 to 4, 2 by default.
+ * The next frame is rendered while the previous one is still converted or read by the completion.
+ * More targets help when the completion keeps the pixel buffers for longer than a frame
+ */
+- (void)setRenderTargetCount:(NSUInteger)count;
+
+/**
+ * Counters of the render targets since the last setRenderTargetCount
+ */
+- (BNBRenderTargetStats)renderTargetStats;
+
+/**
+ * Lets the player lower the resolution the effect is rendered at while the frames take longer than
+ * `milliseconds`, e.g. on a thermally throttled device: the scale per side drops in steps
+ * (100%, 85%, 70%, 50%) after a sustained miss and goes back up once the larger size fits with
+ * headroom. The output images keep the surface size, the frame is upscaled by the output pass.
+ * A frame is measured from the effect draw until the GPU has finished it. Batches are not measured,
+ * they run at the scale of the moment. 0 turns the governor off and renders at the full size again.
+ */
+- (void)setRenderScaleGovernorTarget:(double)milliseconds;
+
+/**
+ * Scale per side the effect is rendered at, 1 without the governor
+ */
+- (float)renderScale;
+
+/**
+ * Copies up to `maxCount` of the last changes of the render scale into `decisions`, the oldest first.
+ * Returns the number copied
+ */
+- (NSUInteger)renderScaleDecisions:(BNBRenderScaleDecision* _Nonnull)decisions maxCount:(NSUInteger)maxCount;
+
+/**
+ * Latency histogram snapshot of the stage, shared by all players of the process
+ */
+- (BNBStageLatency)latencyOfStage:(BNBPipelineStage)stage;
+
+- (void)resetStageLatencies;
+
 // /**
 //  * Load effect with specified name (used folder name)
 //  * effectName - usually it is folder name with effect resources on local storage
 //  */
 - (void)loadEffect:(NSString*)effectName;
 
+/**
+ * Reads the effect ahead on a background thread, e.g. the effects next to the selected one, so a later
+ * loadEffect with the same name does not wait for storage. The effect is found like loadEffect finds it,
+ * in the resource paths or by a full path. The prepared effects are held up to the capacity of the cache,
+ * the least recently loaded ones are dropped first
+ */
+- (void)preloadEffect:(NSString*)effectName;
+
+/**
+ * Memory the prepared effects may take, 64 MB by default
+ */
+- (void)setEffectCacheCapacity:(NSUInteger)bytes;
+
+- (BNBEffectCacheStats)effectCacheStats;
+
 /**
  * Deactivate current effect, the same can be reached by loading effect with the empty name via loadEffect
  */
@@ -46,9 +318,29 @@ typedef void (^BNBOEPImageReadyBlock)(_Nullable CVPixelBufferRef pixelBuffer);
 
 /**
  * Let you call methods defined in the active effect's script passing additional data or changing effect's behaviour
+ * NOTE: the call runs before the next frame is drawn. Calls of the same method made in between are treated as
+ *       setters, only the last param reaches the effect, e.g. a slider moved faster than the frame rate.
+ *       Use callJsCommand for methods every call of which must run
  */
 - (void)callJsMethod:(NSString*)method withParam:(NSString*)param;
 
+/**
+ * Like callJsMethod, the call runs in order with the others and is never coalesced
+ */
+- (void)callJsCommand:(NSString*)method withParam:(NSString*)param;
+
+/**
+ * Evaluates the script in the active effect before the next frame is drawn. `resultCallback` gets the result
+ * on the effect's thread, an empty string when no effect is loaded
+ */
+- (void)evalJs:(NSString*)script resultCallback:(void (^ _Nullable)(NSString* _Nonnull result))resultCallback;
+
 - (void)surfaceChanged:(NSUInteger)width withHeight:(NSUInteger)height;
 
+/**
+ * Where the output image is rotated, BNBOrientationStrategyGPUPass by default.
+ * Any thread, applies from the next frame submitted to the effect player
+ */
+@property (nonatomic) BNBOrientationStrategy orientationStrategy;
+
 @end
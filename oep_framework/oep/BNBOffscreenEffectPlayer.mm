@@ -7,17 +7,343 @@
 #include "offscreen_render_target.h"
 #include "utils.h"
 
+#include "frame_mailbox.h"
+#include "stage_profiler.h"
+#include "block_pool.h"
+#include "resolution_governor.h"
+#include "effect_cache.h"
+#include "frame_pacer.h"
+
 #include <bnb/utility_manager.h>
 
-@implementation BNBOffscreenEffectPlayer
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <mutex>
+
+namespace
 {
-    NSUInteger _width;
-    NSUInteger _height;
+    /// owns one reference to the pixel buffer
+    class retained_pixel_buffer
+    {
+    public:
+        retained_pixel_buffer()
+            : m_buffer(nullptr)
+        {
+        }
+
+        explicit retained_pixel_buffer(CVPixelBufferRef buffer)
+            : m_buffer(CVPixelBufferRetain(buffer))
+        {
+        }
+
+        /// a second reference, blocks copy what they capture
+        retained_pixel_buffer(const retained_pixel_buffer& other)
+            : m_buffer(CVPixelBufferRetain(other.m_buffer))
+        {
+        }
+
+        retained_pixel_buffer(retained_pixel_buffer&& other) noexcept
+            : m_buffer(other.m_buffer)
+        {
+            other.m_buffer = nullptr;
+        }
+
+        retained_pixel_buffer& operator=(const retained_pixel_buffer& other)
+        {
+            retained_pixel_buffer copy(other);
+            std::swap(m_buffer, copy.m_buffer);
+            return *this;
+        }
+
+        retained_pixel_buffer& operator=(retained_pixel_buffer&& other) noexcept
+        {
+            std::swap(m_buffer, other.m_buffer);
+            return *this;
+        }
+
+        ~retained_pixel_buffer()
+        {
+            CVPixelBufferRelease(m_buffer);
+        }
+
+        CVPixelBufferRef get() const
+        {
+            return m_buffer;
+        }
+
+    private:
+        CVPixelBufferRef m_buffer;
+    };
+
+    struct pending_frame
+    {
+        retained_pixel_buffer pixel_buffer;
+        EPOrientation orientation;
+        // one of them is set, kept apart to not wrap the legacy block into a new block every frame
+        BNBOEPImageReadyBlock ready_completion;
+        BNBOEPImageStatusBlock status_completion;
+        bnb::stage_profiler::time_point enqueued;
+    };
+
+    void complete(BNBOEPImageReadyBlock ready, BNBOEPImageStatusBlock status, CVPixelBufferRef buffer, BNBFrameStatus frameStatus)
+    {
+        if (status) {
+            status(buffer, frameStatus);
+        } else if (ready) {
+            ready(buffer);
+        }
+    }
+
+    using frame_mailbox_t = bnb::frame_mailbox<pending_frame>;
+    using frame_pacer_t = bnb::frame_pacer<pending_frame>;
+
+    bnb::backpressure_policy make_backpressure_policy(BNBBackpressurePolicy policy)
+    {
+        switch (policy) {
+            case BNBBackpressurePolicyLatestWins:   return bnb::backpressure_policy::latest_wins;
+            case BNBBackpressurePolicyDropOldest:   return bnb::backpressure_policy::drop_oldest;
+            case BNBBackpressurePolicyBlock:        return bnb::backpressure_policy::block;
+        }
+        return bnb::backpressure_policy::latest_wins;
+    }
+
+    void complete_dropped(pending_frame&& frame, bnb::frame_drop_reason reason)
+    {
+        BNBFrameStatus status = BNBFrameStatusDroppedShutdown;
+        switch (reason) {
+            case bnb::frame_drop_reason::coalesced: status = BNBFrameStatusDroppedCoalesced; break;
+            case bnb::frame_drop_reason::evicted:   status = BNBFrameStatusDroppedQueueFull; break;
+            case bnb::frame_drop_reason::closed:    status = BNBFrameStatusDroppedShutdown; break;
+        }
+        complete(frame.ready_completion, frame.status_completion, nullptr, status);
+    }
+
+    /* what render_frame hands to the completion */
+    struct output_config
+    {
+        bnb::oep::interfaces::image_format format{bnb::oep::interfaces::image_format::bpc8_bgra};
+        bnb::oep::interfaces::rotation orientation{bnb::oep::interfaces::rotation::deg270};
+        bnb::orientation_strategy strategy{bnb::orientation_strategy::gpu_pass};
+        // the render target has the format and the orientation already, its lease is handed out as is
+        bool zero_copy{true};
+    };
+
+    bnb::oep::interfaces::image_format to_image_format(BNBOutputFormat format)
+    {
+        using ns = bnb::oep::interfaces::image_format;
+        switch (format) {
+            case BNBOutputFormatBGRA: return ns::bpc8_bgra;
+            case BNBOutputFormatNV12VideoRange: return ns::nv12_bt709_video;
+            case BNBOutputFormatNV12FullRange: return ns::nv12_bt709_full;
+            case BNBOutputFormatRGBA: return ns::bpc8_rgba;
+        }
+        return ns::bpc8_bgra;
+    }
+
+    bool is_transposed(bnb::oep::interfaces::rotation orientation)
+    {
+        return orientation == bnb::oep::interfaces::rotation::deg90 || orientation == bnb::oep::interfaces::rotation::deg270;
+    }
+
+    /* even, the NV12 output needs it */
+    NSUInteger scaled_size(NSUInteger size, float scale)
+    {
+        const auto scaled = static_cast<NSUInteger>(std::lround(size * scale)) & ~NSUInteger(1);
+        return std::max<NSUInteger>(scaled, 2);
+    }
+
+    bnb::orientation_strategy to_render_strategy(BNBOrientationStrategy strategy)
+    {
+        switch (strategy) {
+            case BNBOrientationStrategyGPUPass: return bnb::orientation_strategy::gpu_pass;
+            case BNBOrientationStrategyCPUFused: return bnb::orientation_strategy::cpu_fused;
+            case BNBOrientationStrategyInRender: return bnb::orientation_strategy::in_render;
+        }
+        return bnb::orientation_strategy::gpu_pass;
+    }
+
+    /**
+     * Sends the frame to the offscreen effect player and hands out the render target, or a conversion
+     * of it when the GPU did not produce the output format and orientation.
+     * `finish(buffer, status)` is called exactly once, in frame order and never concurrently: on the render
+     * thread, or on the fence queue of the render target when the GPU had not finished the frame yet.
+     */
+    template<class Finish>
+    void render_frame(const offscreen_effect_player_sptr& oep, const std::shared_ptr<bnb::offscreen_render_target>& ort,
+                      const pixel_buffer_sptr& image, bnb::oep::interfaces::rotation input_orientation,
+                      const std::shared_ptr<bnb::frame_buffer_pool>& output_pool, const output_config& output, Finish finish)
+    {
+        // in_render: the SDK has drawn the frame rotated already
+        const auto target_orientation = output.strategy == bnb::orientation_strategy::in_render ? bnb::oep::interfaces::rotation::deg0 : output.orientation;
+        // cpu_fused: the render target was not rotated, see orient_image
+        const auto cpu_orientation = output.strategy == bnb::orientation_strategy::cpu_fused ? target_orientation : bnb::oep::interfaces::rotation::deg0;
+        auto get_pixel_buffer_callback = [ort, finish, output_pool, output, cpu_orientation](image_processing_result_sptr result) {
+            if (result == nullptr) {
+                finish(nullptr, BNBFrameStatusFailed);
+                return;
+            }
+            auto render_callback = [ort, finish, output_pool, output, cpu_orientation](std::optional<rendered_texture_t> texture_id) {
+                if (!texture_id.has_value() || texture_id.value() == nullptr) {
+                    finish(nullptr, BNBFrameStatusFailed);
+                    return;
+                }
+                CVPixelBufferRef textureBuffer = (CVPixelBufferRef)texture_id.value();
+
+                // the GPU may still draw into the buffer, nobody reads it before the fence of the frame
+                ort->when_rendered([textureBuffer, finish, output_pool, output, cpu_orientation](bool rendered) {
+                    if (!rendered) {
+                        CVPixelBufferRelease(textureBuffer);
+                        finish(nullptr, BNBFrameStatusFailed);
+                        return;
+                    }
+
+                    if (output.zero_copy) {
+                        // the lease of get_current_buffer_texture, past its fence like the converted frames: the
+                        // caller's references keep the slot out of the ring until the last one is released
+                        finish(textureBuffer, BNBFrameStatusProcessed);
+                        CVPixelBufferRelease(textureBuffer);
+                        return;
+                    }
+
+                    auto convert_start = BNB_PROFILE_NOW();
+                    CVPixelBufferRef returnedBuffer = bnb::convertAndOrient(textureBuffer, cpu_orientation, output.format, output_pool);
+                    BNB_PROFILE_RECORD(bnb::pipeline_stage::convert_output, convert_start);
+
+                    CVPixelBufferRelease(textureBuffer);
+
+                    finish(returnedBuffer, returnedBuffer != nullptr ? BNBFrameStatusProcessed : BNBFrameStatusFailed);
+                    CVPixelBufferRelease(returnedBuffer);
+                });
+            };
+            result->get_texture(render_callback);
+        };
+
+        oep->process_image_async(image, input_orientation, true, get_pixel_buffer_callback, target_orientation);
+    }
+
+    /* frames the batch keeps in the offscreen effect player at once, one is rendered while the next are queued */
+    constexpr size_t batch_window = 3;
+
+    /* frames of one processImages call, the results are handed out in input order */
+    struct batch_state
+    {
+        std::vector<retained_pixel_buffer> inputs;
+        std::vector<EPOrientation> orientations;
+        BNBOEPBatchFrameBlock frame_completion;
+        BNBOEPBatchCompletionBlock completion;
+        // taken when the batch starts, one for all of its frames
+        output_config output;
+
+        // used on the submission queue only
+        std::vector<bnb::oep::interfaces::pixel_buffer::plane_data> planes;
+
+        std::mutex mutex;
+        std::vector<retained_pixel_buffer> outputs;
+        std::vector<BNBFrameStatus> statuses;
+        std::vector<bool> finished;
+        size_t next_submit{0};
+        size_t next_delivery{0};
+        size_t in_flight{0};
+        bool completed{false};
+
+        // the completion blocks are called one at a time
+        std::mutex delivery_mutex;
+    };
+
+    using batch_state_sptr = std::shared_ptr<batch_state>;
 
+    void finish_batch_frame(batch_state& batch, size_t index, CVPixelBufferRef buffer, BNBFrameStatus status)
+    {
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        batch.outputs[index] = retained_pixel_buffer(buffer);
+        batch.statuses[index] = status;
+        batch.finished[index] = true;
+        --batch.in_flight;
+    }
+
+    /* the frames that were not submitted yet are dropped, the player is gone */
+    void abandon_batch_frames(batch_state& batch)
+    {
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        for (; batch.next_submit < batch.inputs.size(); ++batch.next_submit) {
+            batch.statuses[batch.next_submit] = BNBFrameStatusDroppedShutdown;
+            batch.finished[batch.next_submit] = true;
+        }
+    }
+
+    /* hands out the finished frames in input order, returns true to the one call that handed out the last frame */
+    bool deliver_batch_frames(batch_state& batch)
+    {
+        std::lock_guard<std::mutex> delivery_lock(batch.delivery_mutex);
+        while (true) {
+            size_t index = 0;
+            retained_pixel_buffer buffer;
+            BNBFrameStatus status = BNBFrameStatusFailed;
+            {
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                if (batch.next_delivery == batch.inputs.size()) {
+                    return !std::exchange(batch.completed, true);
+                }
+                if (!batch.finished[batch.next_delivery]) {
+                    return false;
+                }
+                index = batch.next_delivery++;
+                buffer = std::move(batch.outputs[index]);
+                status = batch.statuses[index];
+                batch.inputs[index] = retained_pixel_buffer();
+            }
+            batch.frame_completion(index, buffer.get(), status);
+        }
+    }
+} // namespace
+
+@implementation BNBOffscreenEffectPlayer
+{
     effect_player_sptr m_ep;
     offscreen_render_target_sptr m_ort;
     offscreen_effect_player_sptr m_oep;
 
+    // conversions of the render target, when the GPU does not produce the output format and orientation
+    std::shared_ptr<bnb::frame_buffer_pool> m_output_pool;
+
+    // Frames are submitted from this serial queue only. The completions of the frames and the
+    // setters hand their work to it, so the ivars below up to m_planes have no other thread
+    dispatch_queue_t m_submitQueue;
+
+    NSUInteger _width;
+    NSUInteger _height;
+    BNBOutputFormat _outputFormat;
+    bnb::oep::interfaces::rotation _outputOrientation;
+    // the strategy the frames are submitted with, the orientationStrategy property belongs to the caller
+    BNBOrientationStrategy _appliedStrategy;
+    bool _zeroCopy;
+    // the scale the surface was last sized for
+    float _appliedScale;
+    // the size or the strategy changed, the surface is resized before the next frame is submitted
+    bool _surfaceDirty;
+    // the output format, orientation or strategy changed, the render target gets it before the next frame
+    bool _outputDirty;
+    // reused by convertImage for the live frames, they are submitted one at a time
+    std::vector<bnb::oep::interfaces::pixel_buffer::plane_data> m_planes;
+
+    // frames wait here while the effect player is busy, so the policy applies to them
+    std::shared_ptr<frame_mailbox_t> m_mailbox;
+    // a frame or a batch is in the effect player, any thread
+    std::atomic<bool> m_busy;
+    // set by setTargetFrameRate, takes the frames instead of the mailbox and renders them on its ticks
+    std::shared_ptr<frame_pacer_t> m_pacer;
+
+    // batches wait here for the frame in progress, a started batch keeps m_busy until its last frame
+    std::mutex m_batches_mutex;
+    std::deque<batch_state_sptr> m_batches;
+
+    // set by setRenderScaleGovernorTarget, fed by the live frames on the render thread
+    std::shared_ptr<bnb::resolution_governor> m_governor;
+
+    // effects read ahead by preloadEffect, from the resource paths of the utility manager
+    std::shared_ptr<bnb::effect_cache> m_effect_cache;
+
     utility_manager_holder_t* m_utility;
 }
 
@@ -33,6 +359,23 @@
                   manualAudio:(BOOL)manual
                         token:(NSString*)token
                 resourcePaths:(NSArray<NSString *> *)resourcePaths;
+{
+    return [self initWithWidth:width
+                        height:height
+                   manualAudio:manual
+                         token:token
+                 resourcePaths:resourcePaths
+                processingMode:BNBProcessingModeSync
+                 pipelineDepth:1];
+}
+
+- (instancetype)initWithWidth:(NSUInteger)width
+                       height:(NSUInteger)height
+                  manualAudio:(BOOL)manual
+                        token:(NSString*)token
+                resourcePaths:(NSArray<NSString *> *)resourcePaths
+               processingMode:(BNBProcessingMode)processingMode
+                pipelineDepth:(NSUInteger)pipelineDepth
 {
     _width = width;
     _height = height;
@@ -46,49 +389,385 @@
     res_paths.get()[path_to_resources.size()] = nullptr;
     m_utility = bnb_utility_manager_init(res_paths.get(), [token UTF8String], nullptr);
 
-    m_ep = bnb::oep::effect_player::create(width, height);
+    const auto mode = processingMode == BNBProcessingModeAsync ? bnb::oep::processing_mode::async : bnb::oep::processing_mode::sync;
+    m_ep = std::make_shared<bnb::oep::effect_player>(width, height, mode, pipelineDepth);
+    m_effect_cache = std::make_shared<bnb::effect_cache>(path_to_resources, 64 * 1024 * 1024);
+    std::static_pointer_cast<bnb::oep::effect_player>(m_ep)->set_effect_cache(m_effect_cache);
     m_ort = std::make_shared<bnb::offscreen_render_target>();
     m_oep = bnb::oep::interfaces::offscreen_effect_player::create(m_ep, m_ort, width, height);
-    
-    m_oep->surface_changed(width, height);
+    m_output_pool = bnb::makePixelBufferPool(3);
+    m_mailbox = std::make_shared<frame_mailbox_t>(bnb::backpressure_policy::latest_wins);
+    m_busy = false;
+    m_submitQueue = dispatch_queue_create("com.banuba.oep.submit", DISPATCH_QUEUE_SERIAL);
+    _outputFormat = BNBOutputFormatBGRA;
+    _outputOrientation = bnb::oep::interfaces::rotation::deg270;
+    _orientationStrategy = BNBOrientationStrategyGPUPass;
+    _appliedStrategy = BNBOrientationStrategyGPUPass;
+    _zeroCopy = true;
+    _appliedScale = 1.0f;
+    _surfaceDirty = true;
+    _outputDirty = true;
     return self;
 }
 
 - (void)processImage:(CVPixelBufferRef)pixelBuffer inputOrientation:(EPOrientation)orientation completion:(BNBOEPImageReadyBlock _Nonnull)completion
 {
-    pixel_buffer_sptr pixelBuffer_sprt([self convertImage:pixelBuffer]);
+    [self enqueueImage:pixelBuffer inputOrientation:orientation readyCompletion:completion statusCompletion:nil];
+}
+
+- (void)processImage:(CVPixelBufferRef)pixelBuffer inputOrientation:(EPOrientation)orientation statusCompletion:(BNBOEPImageStatusBlock _Nonnull)completion
+{
+    [self enqueueImage:pixelBuffer inputOrientation:orientation readyCompletion:nil statusCompletion:completion];
+}
+
+- (void)enqueueImage:(CVPixelBufferRef)pixelBuffer
+    inputOrientation:(EPOrientation)orientation
+     readyCompletion:(BNBOEPImageReadyBlock)readyCompletion
+    statusCompletion:(BNBOEPImageStatusBlock)statusCompletion
+{
+    pending_frame frame{
+        retained_pixel_buffer(pixelBuffer),
+        orientation,
+        readyCompletion,
+        statusCompletion,
+        BNB_PROFILE_NOW()};
+
+    if (auto pacer = std::atomic_load(&m_pacer)) {
+        // rendered on the next tick unless a fresher frame comes first
+        pacer->submit(std::move(frame));
+        return;
+    }
+
+    auto mailbox = std::atomic_load(&m_mailbox);
+    mailbox->push(std::move(frame), &complete_dropped);
+    [self schedulePump];
+}
+
+/* runs `block` on the submission queue, not at all once the player is gone */
+- (void)onSubmitQueue:(void (^)(BNBOffscreenEffectPlayer* player))block
+{
+    __weak BNBOffscreenEffectPlayer* weakSelf = self;
+    dispatch_async(m_submitQueue, ^{
+        if (BNBOffscreenEffectPlayer* player = weakSelf) {
+            block(player);
+        }
+    });
+}
+
+/* any thread, the mailbox is pumped on the submission queue */
+- (void)schedulePump
+{
+    [self onSubmitQueue:^(BNBOffscreenEffectPlayer* player) {
+        [player pumpMailbox];
+    }];
+}
+
+/*
+ * On the pacer thread at a tick, NO keeps the frame for the next one. Only m_busy and the batch list
+ * are touched here, the frame is submitted on the submission queue like every other one.
+ */
+- (BOOL)renderPacedFrame:(pending_frame&)frame
+{
+    bool expected = false;
+    if (!m_busy.compare_exchange_strong(expected, true)) {
+        return NO;
+    }
+    // batches go first, as in pumpMailbox: the pump starts it, the frame waits for the next tick
+    if ([self hasPendingBatch]) {
+        m_busy = false;
+        [self schedulePump];
+        return NO;
+    }
+    auto paced = std::make_shared<pending_frame>(std::move(frame));
+    __weak BNBOffscreenEffectPlayer* weakSelf = self;
+    dispatch_async(m_submitQueue, ^{
+        if (BNBOffscreenEffectPlayer* player = weakSelf) {
+            [player submitFrame:*paced];
+        } else {
+            complete_dropped(std::move(*paced), bnb::frame_drop_reason::closed);
+        }
+    });
+    return YES;
+}
+
+/* on the submission queue */
+- (void)pumpMailbox
+{
+    // The effect player gets one frame at a time, the rest wait in the mailbox
+    bool expected = false;
+    while (m_busy.compare_exchange_strong(expected, true)) {
+        if (auto batch = [self popBatch]) {
+            [self startBatch:batch];
+            return;
+        }
+        auto mailbox = std::atomic_load(&m_mailbox);
+        if (auto frame = mailbox->try_pop()) {
+            [self submitFrame:*frame];
+            return;
+        }
+        m_busy = false;
+        // a frame pushed after try_pop might have lost its own pump to us
+        if (mailbox->empty() && ![self hasPendingBatch]) {
+            return;
+        }
+        expected = false;
+    }
+}
+
+/* from the completion of a processed frame, after when_rendered measured it */
+- (void)measureFrame
+{
+    if (auto governor = std::atomic_load(&m_governor)) {
+        const auto ns = std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->last_frame_time_ns();
+        governor->record(ns / 1e6);
+    }
+}
+
+/* any thread, the next frame is not submitted from the completion of this one */
+- (void)frameFinished
+{
+    m_busy = false;
+    [self schedulePump];
+}
+
+- (void)submitFrame:(pending_frame&)frame
+{
+    __weak BNBOffscreenEffectPlayer* weakSelf = self;
+    auto finish = [weakSelf, ready = frame.ready_completion, completion = frame.status_completion, enqueued = frame.enqueued](CVPixelBufferRef resultBuffer, BNBFrameStatus status) {
+        {
+            BNB_PROFILE_STAGE(bnb::pipeline_stage::completion);
+            complete(ready, completion, resultBuffer, status);
+        }
+        if (status == BNBFrameStatusProcessed) {
+            BNB_PROFILE_RECORD(bnb::pipeline_stage::end_to_end, enqueued);
+            [weakSelf measureFrame];
+        }
+        [weakSelf frameFinished];
+    };
+
+    [self applyPendingChanges];
+
+    auto convert_start = BNB_PROFILE_NOW();
+    pixel_buffer_sptr pixelBuffer_sprt([self convertImage:frame.pixel_buffer.get() planes:m_planes]);
+    BNB_PROFILE_RECORD(bnb::pipeline_stage::convert_input, convert_start);
     if (pixelBuffer_sprt == nullptr) {
+        finish(nullptr, BNBFrameStatusDroppedUnsupportedFormat);
         return;
     }
 
-    auto get_pixel_buffer_callback = [pixelBuffer, completion](image_processing_result_sptr result) {
-        if (result != nullptr) {
-            OSType pixelFormatType = CVPixelBufferGetPixelFormatType(pixelBuffer);
-            auto render_callback = [pixelFormatType, completion](std::optional<rendered_texture_t> texture_id) {
-                if (texture_id.has_value()) {
-                    CVPixelBufferRef textureBuffer = (CVPixelBufferRef)texture_id.value();
+    render_frame(m_oep, std::static_pointer_cast<bnb::offscreen_render_target>(m_ort), pixelBuffer_sprt, [self getInputOrientation:frame.orientation],
+                 m_output_pool, [self outputConfig], finish);
+}
 
-                    CVPixelBufferRef returnedBuffer = nullptr;
+- (void)processImages:(const CVPixelBufferRef _Nonnull *)pixelBuffers
+         orientations:(const EPOrientation*)orientations
+                count:(NSUInteger)count
+      frameCompletion:(BNBOEPBatchFrameBlock)frameCompletion
+           completion:(BNBOEPBatchCompletionBlock)completion
+{
+    auto batch = std::make_shared<batch_state>();
+    batch->inputs.reserve(count);
+    for (NSUInteger i = 0; i < count; ++i) {
+        batch->inputs.emplace_back(pixelBuffers[i]);
+    }
+    batch->orientations.assign(orientations, orientations + count);
+    batch->frame_completion = frameCompletion;
+    batch->completion = completion;
+    batch->outputs.resize(count);
+    batch->statuses.resize(count, BNBFrameStatusFailed);
+    batch->finished.resize(count, false);
 
-                    returnedBuffer = bnb::convertBGRAtoRGBA(textureBuffer);
+    {
+        std::lock_guard<std::mutex> lock(m_batches_mutex);
+        m_batches.push_back(std::move(batch));
+    }
+    [self schedulePump];
+}
 
-                    CVPixelBufferRelease(textureBuffer);
+- (batch_state_sptr)popBatch
+{
+    std::lock_guard<std::mutex> lock(m_batches_mutex);
+    if (m_batches.empty()) {
+        return nullptr;
+    }
+    auto batch = std::move(m_batches.front());
+    m_batches.pop_front();
+    return batch;
+}
+
+- (BOOL)hasPendingBatch
+{
+    std::lock_guard<std::mutex> lock(m_batches_mutex);
+    return !m_batches.empty();
+}
 
-                    if (completion) {
-                        completion(returnedBuffer);
+- (void)startBatch:(const batch_state_sptr&)batch
+{
+    // the frames of the batch are rendered at one size and with one output configuration
+    [self applyPendingChanges];
+    batch->output = [self outputConfig];
+    std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->begin_batch();
+    if (batch->inputs.empty()) {
+        deliver_batch_frames(*batch);
+        [self finishBatch:batch];
+        return;
+    }
+    [self submitBatchFrames:batch];
+}
+
+- (void)submitBatchFrames:(batch_state_sptr)batch
+{
+    // `batch` is taken by value, the block would capture a reference parameter by reference.
+    // One submitter at a time keeps the frames in input order, the input conversion overlaps the rendering
+    __weak BNBOffscreenEffectPlayer* weakSelf = self;
+    dispatch_async(m_submitQueue, ^{
+        BNBOffscreenEffectPlayer* strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            abandon_batch_frames(*batch);
+            if (deliver_batch_frames(*batch) && batch->completion) {
+                batch->completion();
+            }
+            return;
+        }
+        bool delivered_all = false;
+        while (true) {
+            size_t index = 0;
+            {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                if (batch->next_submit == batch->inputs.size() || batch->in_flight == batch_window) {
+                    break;
+                }
+                index = batch->next_submit++;
+                ++batch->in_flight;
+            }
+
+            auto convert_start = BNB_PROFILE_NOW();
+            pixel_buffer_sptr image([strongSelf convertImage:batch->inputs[index].get() planes:batch->planes]);
+            BNB_PROFILE_RECORD(bnb::pipeline_stage::convert_input, convert_start);
+            if (image == nullptr) {
+                finish_batch_frame(*batch, index, nullptr, BNBFrameStatusDroppedUnsupportedFormat);
+                delivered_all = deliver_batch_frames(*batch);
+                continue;
+            }
+
+            auto finish = [weakSelf, batch, index](CVPixelBufferRef resultBuffer, BNBFrameStatus status) {
+                finish_batch_frame(*batch, index, resultBuffer, status);
+                BNBOffscreenEffectPlayer* player = weakSelf;
+                if (player != nil) {
+                    [player submitBatchFrames:batch];
+                } else {
+                    abandon_batch_frames(*batch);
+                }
+                if (deliver_batch_frames(*batch)) {
+                    if (player != nil) {
+                        [player finishBatch:batch];
+                    } else if (batch->completion) {
+                        batch->completion();
                     }
-                     CVPixelBufferRelease(returnedBuffer);
                 }
             };
-            result->get_texture(render_callback);
+            render_frame(strongSelf->m_oep, std::static_pointer_cast<bnb::offscreen_render_target>(strongSelf->m_ort), image, [strongSelf getInputOrientation:batch->orientations[index]], strongSelf->m_output_pool,
+                         batch->output, finish);
         }
-    };
-    
-    auto input_orientation = [self getInputOrientation:orientation];
-    m_oep->process_image_async(pixelBuffer_sprt, input_orientation, true, get_pixel_buffer_callback, bnb::oep::interfaces::rotation::deg270);
+        if (delivered_all) {
+            [strongSelf finishBatch:batch];
+        }
+    });
 }
 
-- (pixel_buffer_sptr)convertImage:(CVPixelBufferRef)pixelBuffer
+- (void)finishBatch:(const batch_state_sptr&)batch
+{
+    std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->end_batch();
+    if (batch->completion) {
+        batch->completion();
+    }
+    [self frameFinished];
+}
+
+- (void)setBackpressurePolicy:(BNBBackpressurePolicy)policy capacity:(NSUInteger)capacity
+{
+    auto previous = std::atomic_exchange(&m_mailbox, std::make_shared<frame_mailbox_t>(make_backpressure_policy(policy), capacity));
+    previous->close(&complete_dropped);
+}
+
+- (BNBFrameStats)frameStats
+{
+    auto stats = std::atomic_load(&m_mailbox)->stats();
+    return {
+        static_cast<NSUInteger>(stats.accepted),
+        static_cast<NSUInteger>(stats.dropped),
+        static_cast<NSUInteger>(stats.coalesced),
+        static_cast<NSUInteger>(stats.queued)};
+}
+
+- (void)setTargetFrameRate:(double)framesPerSecond
+{
+    std::shared_ptr<frame_pacer_t> pacer;
+    if (framesPerSecond > 0) {
+        // not retained: a release on the pacer thread would make dealloc join the thread it runs on,
+        // dealloc stops the pacer before anything the ticks use goes away
+        __unsafe_unretained BNBOffscreenEffectPlayer* player = self;
+        auto render = [player](pending_frame& frame) -> bool {
+            return [player renderPacedFrame:frame];
+        };
+        pacer = std::make_shared<frame_pacer_t>(std::make_shared<bnb::steady_pacing_clock>(), static_cast<int64_t>(1e9 / framesPerSecond),
+                                                render, &complete_dropped);
+        pacer->start();
+    }
+    if (auto previous = std::atomic_exchange(&m_pacer, pacer)) {
+        previous->stop();
+        // the frame waiting for the tick is rendered the way the next ones are
+        if (auto frame = previous->take()) {
+            if (pacer != nullptr) {
+                pacer->submit(std::move(*frame));
+            } else {
+                std::atomic_load(&m_mailbox)->push(std::move(*frame), &complete_dropped);
+                [self schedulePump];
+            }
+        }
+    }
+}
+
+- (BNBFramePacingStats)framePacingStats
+{
+    auto pacer = std::atomic_load(&m_pacer);
+    if (pacer == nullptr) {
+        return {};
+    }
+    const auto stats = pacer->stats();
+    return {
+        static_cast<NSUInteger>(stats.ticks),
+        static_cast<NSUInteger>(stats.renders),
+        static_cast<NSUInteger>(stats.stale),
+        static_cast<NSUInteger>(stats.idle_ticks),
+        static_cast<NSUInteger>(stats.busy_ticks),
+        static_cast<NSUInteger>(stats.missed_ticks),
+        stats.jitter_mean_ms,
+        stats.jitter_max_ms,
+        stats.lateness_mean_ms,
+        stats.lateness_max_ms,
+        stats.latency_mean_ms,
+        stats.latency_max_ms};
+}
+
+- (void)setRenderTargetCount:(NSUInteger)count
+{
+    std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->set_ring_size(count);
+}
+
+- (BNBRenderTargetStats)renderTargetStats
+{
+    auto stats = std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->ring_stats();
+    return {
+        static_cast<NSUInteger>(stats.slots),
+        static_cast<NSUInteger>(stats.frames),
+        static_cast<NSUInteger>(stats.exhausted),
+        static_cast<NSUInteger>(stats.fence_waits),
+        static_cast<NSUInteger>(stats.resizes),
+        static_cast<NSUInteger>(stats.reallocations)};
+}
+
+- (pixel_buffer_sptr)convertImage:(CVPixelBufferRef)pixelBuffer planes:(std::vector<bnb::oep::interfaces::pixel_buffer::plane_data>&)planes
 {
     OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
     pixel_buffer_sptr img;
@@ -106,29 +785,30 @@
             CVPixelBufferRetain(pixelBuffer);
             CVPixelBufferRetain(pixelBuffer);
 
+            // control blocks of the plane pointers are recycled through the block pool
             using ns = bnb::oep::interfaces::pixel_buffer;
-            ns::plane_data y_plane{
+            planes.push_back(ns::plane_data{
                 std::shared_ptr<uint8_t>(lumo, [pixelBuffer](uint8_t*) {
                     CVPixelBufferRelease(pixelBuffer);
-                }),
+                }, bnb::pool_allocator<uint8_t>()),
                 0,
                 static_cast<int32_t>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0))
-            };
+            });
             
-            ns::plane_data uv_plane{
+            planes.push_back(ns::plane_data{
                 std::shared_ptr<uint8_t>(chromo, [pixelBuffer](uint8_t*) {
                     CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
                     CVPixelBufferRelease(pixelBuffer);
-                }),
+                }, bnb::pool_allocator<uint8_t>()),
                 0,
                 static_cast<int32_t>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1))
-            };
+            });
 
-            std::vector<ns::plane_data> planes{y_plane, uv_plane};
             img = ns::create(planes, pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange ?
                              bnb::oep::interfaces::image_format::nv12_bt709_video :
                              bnb::oep::interfaces::image_format::nv12_bt709_full,
                              bufferWidth, bufferHeight);
+            planes.clear();
         } break;
         default:
             NSLog(@"ERROR TYPE : %d", pixelFormat);
@@ -143,6 +823,23 @@
     m_oep->load_effect(std::string([effectName UTF8String]));
 }
 
+- (void)preloadEffect:(NSString* _Nonnull)effectName
+{
+    m_effect_cache->preload(std::string([effectName UTF8String]));
+}
+
+- (void)setEffectCacheCapacity:(NSUInteger)bytes
+{
+    m_effect_cache->set_capacity(bytes);
+}
+
+- (BNBEffectCacheStats)effectCacheStats
+{
+    const auto stats = m_effect_cache->stats();
+    return {static_cast<NSUInteger>(stats.hits), static_cast<NSUInteger>(stats.misses), static_cast<NSUInteger>(stats.preloads),
+            static_cast<NSUInteger>(stats.evictions), stats.entries, stats.bytes, stats.capacity};
+}
+
 - (void)unloadEffect
 {
     NSAssert(self->m_oep != nil, @"No OffscreenEffectPlayer");
@@ -155,8 +852,91 @@
     m_oep->call_js_method(std::string([method UTF8String]), std::string([param UTF8String]));
 }
 
+- (void)callJsCommand:(NSString* _Nonnull)method withParam:(NSString* _Nonnull)param
+{
+    std::static_pointer_cast<bnb::oep::effect_player>(m_ep)->call_js_method(
+        std::string([method UTF8String]), std::string([param UTF8String]), bnb::js_call_kind::command);
+}
+
+- (void)evalJs:(NSString* _Nonnull)script resultCallback:(void (^ _Nullable)(NSString* _Nonnull result))resultCallback
+{
+    oep_eval_js_result_cb callback;
+    if (resultCallback != nil) {
+        callback = [resultCallback](std::string result) {
+            resultCallback([NSString stringWithUTF8String:result.c_str()] ?: @"");
+        };
+    }
+    m_ep->eval_js(std::string([script UTF8String]), std::move(callback));
+}
+
+- (void)setRenderScaleGovernorTarget:(double)milliseconds
+{
+    std::shared_ptr<bnb::resolution_governor> governor;
+    if (milliseconds > 0) {
+        bnb::resolution_governor_config config;
+        config.target_ms = milliseconds;
+        governor = std::make_shared<bnb::resolution_governor>(config);
+    }
+    std::atomic_store(&m_governor, governor);
+    [self onSubmitQueue:^(BNBOffscreenEffectPlayer* player) {
+        player->_surfaceDirty = true;
+    }];
+}
+
+- (float)renderScale
+{
+    auto governor = std::atomic_load(&m_governor);
+    return governor != nullptr ? governor->scale() : 1.0f;
+}
+
+- (NSUInteger)renderScaleDecisions:(BNBRenderScaleDecision*)decisions maxCount:(NSUInteger)maxCount
+{
+    auto governor = std::atomic_load(&m_governor);
+    if (governor == nullptr) {
+        return 0;
+    }
+    const auto log = governor->decisions();
+    const NSUInteger count = std::min<NSUInteger>(log.size(), maxCount);
+    const auto first = log.end() - count;
+    for (NSUInteger i = 0; i < count; ++i) {
+        const auto& d = first[i];
+        decisions[i] = {static_cast<NSUInteger>(d.frame), d.from_scale, d.to_scale, d.frame_ms};
+    }
+    return count;
+}
+
+- (BNBStageLatency)latencyOfStage:(BNBPipelineStage)stage
+{
+    static_assert(static_cast<NSUInteger>(bnb::pipeline_stage::end_to_end) == BNBPipelineStageEndToEnd, "BNBPipelineStage mirrors bnb::pipeline_stage");
+    if (stage > BNBPipelineStageEndToEnd) {
+        return {};
+    }
+    auto snapshot = bnb::stage_profiler::instance().snapshot(static_cast<bnb::pipeline_stage>(stage));
+    return {snapshot.count, snapshot.mean, snapshot.p50, snapshot.p95, snapshot.p99, snapshot.max};
+}
+
+- (void)resetStageLatencies
+{
+    bnb::stage_profiler::instance().reset();
+}
+
 - (void)dealloc
 {
+    if (auto pacer = std::atomic_exchange(&m_pacer, std::shared_ptr<frame_pacer_t>())) {
+        // waits for a tick in progress, the waiting frame is dropped with the pacer
+        pacer->stop();
+    }
+    if (m_mailbox) {
+        m_mailbox->close(&complete_dropped);
+    }
+    for (auto& batch : m_batches) {
+        abandon_batch_frames(*batch);
+        deliver_batch_frames(*batch);
+        if (batch->completion) {
+            batch->completion();
+        }
+    }
+    m_batches.clear();
     if (m_ep) {
         m_ep->surface_destroyed();
     }
@@ -168,10 +948,121 @@
 
 - (void)surfaceChanged:(NSUInteger)width withHeight:(NSUInteger)height
 {
-    if (m_oep) {
+    [self onSubmitQueue:^(BNBOffscreenEffectPlayer* player) {
+        player->_width = width;
+        player->_height = height;
+        player->_surfaceDirty = true;
+    }];
+}
+
+/*
+ * On the submission queue before a frame or a batch is submitted, no frame of the player is in flight then.
+ * The setters only mark what changed, a resize or a new output configuration never lands between
+ * the draw of a frame and its completion
+ */
+- (void)applyPendingChanges
+{
+    if (_outputDirty) {
+        [self applyOutputConfig];
+    }
+    // the next frame is rendered at the scale the governor picked
+    auto governor = std::atomic_load(&m_governor);
+    const float scale = governor != nullptr ? governor->scale() : 1.0f;
+    if (_surfaceDirty || scale != _appliedScale) {
+        [self applySurfaceSize];
+    }
+}
+
+/*
+ * The surface has the output size when the SDK renders the frame rotated. With the governor the effect
+ * is rendered at its scale into the same render targets, the output pass scales the frame back up
+ */
+- (void)applySurfaceSize
+{
+    if (!m_oep) {
+        return;
+    }
+    const bool swap = _appliedStrategy == BNBOrientationStrategyInRender && is_transposed(_outputOrientation);
+    const NSUInteger width = swap ? _height : _width;
+    const NSUInteger height = swap ? _width : _height;
+    auto governor = std::atomic_load(&m_governor);
+    _appliedScale = governor != nullptr ? governor->scale() : 1.0f;
+    _surfaceDirty = false;
+
+    auto ort = std::static_pointer_cast<bnb::offscreen_render_target>(m_ort);
+    if (governor == nullptr) {
+        ort->set_output_size(0, 0);
         m_oep->surface_changed(width, height);
+        return;
     }
+    // the output size stays fixed while the governor is on, a frame already drawn at the previous scale is scaled too
+    ort->set_output_size(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    m_oep->surface_changed(_appliedScale < 1.0f ? scaled_size(width, _appliedScale) : width,
+                           _appliedScale < 1.0f ? scaled_size(height, _appliedScale) : height);
+}
+
+- (void)setOrientationStrategy:(BNBOrientationStrategy)orientationStrategy
+{
+    _orientationStrategy = orientationStrategy;
+    [self onSubmitQueue:^(BNBOffscreenEffectPlayer* player) {
+        [player updateOrientationStrategy:orientationStrategy];
+    }];
 }
+
+- (void)updateOrientationStrategy:(BNBOrientationStrategy)orientationStrategy
+{
+    const bool surface_changes = (_appliedStrategy == BNBOrientationStrategyInRender) != (orientationStrategy == BNBOrientationStrategyInRender);
+    _appliedStrategy = orientationStrategy;
+    _outputDirty = true;
+    if (surface_changes) {
+        _surfaceDirty = true;
+    }
+}
+
+- (void)setOutputFormat:(BNBOutputFormat)format orientation:(EPOrientation)orientation
+{
+    const auto rotation = [self getInputOrientation:orientation];
+    [self onSubmitQueue:^(BNBOffscreenEffectPlayer* player) {
+        [player updateOutputFormat:format rotation:rotation];
+    }];
+}
+
+- (void)updateOutputFormat:(BNBOutputFormat)format rotation:(bnb::oep::interfaces::rotation)rotation
+{
+    const bool surface_changes = _appliedStrategy == BNBOrientationStrategyInRender && is_transposed(rotation) != is_transposed(_outputOrientation);
+    _outputFormat = format;
+    _outputOrientation = rotation;
+    _outputDirty = true;
+    if (surface_changes) {
+        _surfaceDirty = true;
+    }
+}
+
+/*
+ * At a frame boundary, see applyPendingChanges. The render target is handed out as is when the GPU renders
+ * the output format and rotates the frame
+ */
+- (void)applyOutputConfig
+{
+    _outputDirty = false;
+    std::static_pointer_cast<bnb::offscreen_render_target>(m_ort)->set_orientation_strategy(to_render_strategy(_appliedStrategy));
+    std::static_pointer_cast<bnb::oep::effect_player>(m_ep)->set_output_rotation(
+        _appliedStrategy == BNBOrientationStrategyInRender ? _outputOrientation : bnb::oep::interfaces::rotation::deg0);
+    const bool rotated = _appliedStrategy != BNBOrientationStrategyCPUFused || _outputOrientation == bnb::oep::interfaces::rotation::deg0;
+    auto ort = std::static_pointer_cast<bnb::offscreen_render_target>(m_ort);
+    _zeroCopy = ort->set_output_format(rotated ? to_image_format(_outputFormat) : bnb::oep::interfaces::image_format::bpc8_bgra) && rotated;
+}
+
+- (output_config)outputConfig
+{
+    output_config config;
+    config.format = to_image_format(_outputFormat);
+    config.orientation = _outputOrientation;
+    config.strategy = to_render_strategy(_appliedStrategy);
+    config.zero_copy = _zeroCopy;
+    return config;
+}
+
 - (bnb::oep::interfaces::rotation)getInputOrientation:(EPOrientation)orientation{
     switch (orientation) {
         case EPOrientationAngles0:      return bnb::oep::interfaces::rotation::deg0;
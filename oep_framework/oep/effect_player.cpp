@@ -1,5 +1,9 @@
 #include "effect_player.hpp"
 
+#include "stage_profiler.h"
+#include "block_pool.h"
+#include "image_format_traits.hpp"
+
 #include <iostream>
 #include <thread>
 #include <optional>
@@ -7,6 +11,8 @@
 #include <algorithm>
 #include <map>
 #include <array>
+#include <utility>
+#include <memory>
 #include <sys/utsname.h>
 
 namespace  {
@@ -19,18 +25,124 @@ namespace  {
         }
     }
     
-    using planes_holder_t = std::array<bnb::oep::interfaces::pixel_buffer::plane_sptr, 3>;
-    
-    auto planes_holder(pixel_buffer_sptr image) {
-        auto holder = new planes_holder_t;
-        for (int i = 0; i < image->get_plane_count(); ++i) {
-            holder->at(i) = image->get_base_sptr_of_plane(i);
+    // owns the callback of one eval_js until the SDK delivers the result
+    [[maybe_unused]] void eval_js_result(const char* result, void* user_data)
+    {
+        std::unique_ptr<oep_eval_js_result_cb> callback(static_cast<oep_eval_js_result_cb*>(user_data));
+        if (*callback) {
+            (*callback)(result != nullptr ? result : "");
         }
-        return holder;
+    }
+
+    // keeps the planes alive while the SDK uses the image, one reference for all of them
+    struct planes_holder_t
+    {
+        pixel_buffer_sptr image;
+    };
+
+    // holders come from a free list, the per frame push does not touch the heap
+    auto planes_holder(const pixel_buffer_sptr& image) {
+        bnb::pool_allocator<planes_holder_t> allocator;
+        return new (allocator.allocate(1)) planes_holder_t{image};
     }
     void planes_holder_release(void* holder) {
-        delete reinterpret_cast<planes_holder_t*>(holder);
+        auto* h = reinterpret_cast<planes_holder_t*>(holder);
+        h->~planes_holder_t();
+        bnb::pool_allocator<planes_holder_t>().deallocate(h, 1);
     }
+
+    using bnb::oep::image_layout;
+    using bnb::oep::image_format_table;
+
+    using full_image_factory_t = full_image_holder_t* (*)(const pixel_buffer_sptr& image, bnb_image_format_t& format, bnb_error** error);
+
+    /* Push path of one image format, everything but the plane pointers is known at compile time */
+    template<bnb::oep::interfaces::image_format F>
+    full_image_holder_t* make_full_image(const pixel_buffer_sptr& image, bnb_image_format_t& format, bnb_error** error)
+    {
+        constexpr const auto& traits = bnb::oep::image_format_traits_of<F>();
+        if constexpr (traits.layout == image_layout::bpc8) {
+            return bnb_full_image_from_bpc8_img_no_copy(
+                format,
+                traits.pixel_format,
+                image->get_base_sptr().get(),
+                image->get_bytes_per_row(),
+                &planes_holder_release,
+                planes_holder(image),
+                error);
+        } else if constexpr (traits.layout == image_layout::nv12) {
+            return bnb_full_image_from_yuv_nv12_img_no_copy_ex(
+                &format,
+                traits.range,
+                traits.space,
+                image->get_base_sptr_of_plane(0).get(),
+                image->get_bytes_per_row_of_plane(0),
+                image->get_base_sptr_of_plane(1).get(),
+                image->get_bytes_per_row_of_plane(1),
+                &planes_holder_release,
+                planes_holder(image),
+                error);
+        } else {
+            static_assert(traits.layout == image_layout::i420);
+            return bnb_full_image_from_yuv_i420_img_no_copy_ex(
+                &format,
+                traits.range,
+                traits.space,
+                image->get_base_sptr_of_plane(0).get(),
+                image->get_bytes_per_row_of_plane(0),
+                1,
+                image->get_base_sptr_of_plane(1).get(),
+                image->get_bytes_per_row_of_plane(1),
+                1,
+                image->get_base_sptr_of_plane(2).get(),
+                image->get_bytes_per_row_of_plane(2),
+                1,
+                &planes_holder_release,
+                planes_holder(image),
+                error);
+        }
+    }
+
+    template<size_t... I>
+    constexpr std::array<full_image_factory_t, sizeof...(I)> make_full_image_factories(std::index_sequence<I...>)
+    {
+        return {&make_full_image<image_format_table[I].format>...};
+    }
+
+    /* indexed like image_format_table */
+    constexpr auto full_image_factories = make_full_image_factories(std::make_index_sequence<image_format_table.size()>());
+
+    /* The descriptors the SDK gets for every format */
+    template<bnb::oep::interfaces::image_format F>
+    constexpr bool describes_yuv(image_layout layout, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space)
+    {
+        constexpr const auto& t = bnb::oep::image_format_traits_of<F>();
+        const int32_t planes = layout == image_layout::nv12 ? 2 : 3;
+        return t.layout == layout && t.range == range && t.space == space && t.plane_count == planes
+               && t.chroma_shift_x == 1 && t.chroma_shift_y == 1;
+    }
+
+    template<bnb::oep::interfaces::image_format F>
+    constexpr bool describes_packed(bnb_pixel_format_t pixel_format)
+    {
+        constexpr const auto& t = bnb::oep::image_format_traits_of<F>();
+        return t.layout == image_layout::bpc8 && t.pixel_format == pixel_format && t.plane_count == 1;
+    }
+
+    using fmt = bnb::oep::interfaces::image_format;
+    static_assert(describes_packed<fmt::bpc8_rgb>(BNB_RGB));
+    static_assert(describes_packed<fmt::bpc8_bgr>(BNB_BGR));
+    static_assert(describes_packed<fmt::bpc8_rgba>(BNB_RGBA));
+    static_assert(describes_packed<fmt::bpc8_bgra>(BNB_BGRA));
+    static_assert(describes_packed<fmt::bpc8_argb>(BNB_ARGB));
+    static_assert(describes_yuv<fmt::nv12_bt601_full>(image_layout::nv12, bnb_yuv_full_range, bnb_bt601));
+    static_assert(describes_yuv<fmt::nv12_bt601_video>(image_layout::nv12, bnb_yuv_video_range, bnb_bt601));
+    static_assert(describes_yuv<fmt::nv12_bt709_full>(image_layout::nv12, bnb_yuv_full_range, bnb_bt709));
+    static_assert(describes_yuv<fmt::nv12_bt709_video>(image_layout::nv12, bnb_yuv_video_range, bnb_bt709));
+    static_assert(describes_yuv<fmt::i420_bt601_full>(image_layout::i420, bnb_yuv_full_range, bnb_bt601));
+    static_assert(describes_yuv<fmt::i420_bt601_video>(image_layout::i420, bnb_yuv_video_range, bnb_bt601));
+    static_assert(describes_yuv<fmt::i420_bt709_full>(image_layout::i420, bnb_yuv_full_range, bnb_bt709));
+    static_assert(describes_yuv<fmt::i420_bt709_video>(image_layout::i420, bnb_yuv_video_range, bnb_bt709));
 };
 
 namespace bnb::oep
@@ -43,10 +155,15 @@ namespace bnb::oep
     }
 
     /* effect_player::effect_player CONSTRUCTOR */
-    effect_player::effect_player(int32_t width, int32_t height)
+    effect_player::effect_player(int32_t width, int32_t height, processing_mode mode, size_t pipeline_depth)
+        : m_mode(mode)
+        , m_pipeline_depth(std::max<size_t>(pipeline_depth, 1))
     {
+        m_in_flight.reserve(m_pipeline_depth + 1);
+        m_recognized.reserve(m_pipeline_depth + 1);
         bnb_effect_player_set_render_backend(bnb_render_backend_opengl, nullptr);
-        bnb_effect_player_configuration_t ep_cfg{1, 1, bnb_nn_mode_enable, bnb_good, false, false};
+        // the effect is laid out for the size of the surface, surface_changed resizes it
+        bnb_effect_player_configuration_t ep_cfg{width, height, bnb_nn_mode_enable, bnb_good, false, false};
         m_ep = bnb_effect_player_create(&ep_cfg, nullptr);
         if (m_ep == nullptr) {
             throw std::runtime_error("Failed to create effect player holder.");
@@ -57,6 +174,7 @@ namespace bnb::oep
         auto config = bnb_processor_configuration_create(nullptr);
         
         bnb_processor_configuration_set_use_future_filter(config, false, nullptr);
+        // async mode pops the sync processor on its own thread, see recognition_loop
         m_fp = bnb_frame_processor_create_realtime_processor(bnb_realtime_processor_mode_sync, config, &error);
         check_error(error);
         
@@ -64,11 +182,27 @@ namespace bnb::oep
         check_error(error);
         
         bnb_processor_configuration_destroy(config, nullptr);
+
+        if (m_mode == processing_mode::async) {
+            m_recognition_thread = std::thread([this] { recognition_loop(); });
+        }
     }
 
     /* effect_player::~effect_player */
     effect_player::~effect_player()
     {
+        if (m_recognition_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_recognition_mutex);
+                m_stop_recognition = true;
+            }
+            m_frame_pushed.notify_all();
+            m_recognition_thread.join();
+        }
+        for (auto* fd : m_recognized) {
+            bnb_frame_data_release(fd, nullptr);
+        }
+        m_recognized.clear();
         if (m_ep) {
             bnb_effect_player_destroy(m_ep, nullptr);
             m_ep = nullptr;
@@ -103,6 +237,12 @@ namespace bnb::oep
     bool effect_player::load_effect(const std::string& effect)
     {
         if (auto e_manager = bnb_effect_player_get_effect_manager(m_ep, nullptr)) {
+            // the calls made before the switch are meant for the previous effect
+            flush_js_calls();
+            if (m_effect_cache != nullptr && !effect.empty()) {
+                // a prepared effect is in memory, the SDK parses it without waiting for storage
+                m_effect_cache->activate(effect);
+            }
             bnb_effect_manager_load_effect(e_manager, effect.c_str(), nullptr);
             return true;
         }
@@ -113,22 +253,70 @@ namespace bnb::oep
     /* effect_player::call_js_method */
     bool effect_player::call_js_method(const std::string& method, const std::string& param)
     {
-        if (auto e_manager = bnb_effect_player_get_effect_manager(m_ep, nullptr)) {
-            if (auto effect = bnb_effect_manager_get_current_effect(e_manager, nullptr)) {
-                bnb_effect_call_js_method(effect, method.c_str(), param.c_str(), nullptr);
-            } else {
-                std::cout << "[Error] effect not loaded" << std::endl;
-                return false;
-            }
-        } else {
-            std::cout << "[Error] effect manager not initialized" << std::endl;
-            return false;
-        }
+        return call_js_method(method, param, js_call_kind::setter);
+    }
+
+    /* effect_player::call_js_method */
+    bool effect_player::call_js_method(const std::string& method, const std::string& param, js_call_kind kind)
+    {
+        m_js_calls.push({kind == js_call_kind::eval ? js_call_kind::command : kind, method, param, nullptr});
         return true;
     }
 
-    void effect_player::eval_js(const std::string& script, oep_eval_js_result_cb result_callback){
-        std::cout << "[Error] eval_js is not implemented" << std::endl;
+    /* effect_player::eval_js */
+    void effect_player::eval_js(const std::string& script, oep_eval_js_result_cb result_callback)
+    {
+        m_js_calls.push({js_call_kind::eval, script, {}, std::move(result_callback)});
+    }
+
+    /* effect_player::flush_js_calls */
+    void effect_player::flush_js_calls()
+    {
+        m_js_calls.drain(m_js_batch);
+        if (m_js_batch.empty()) {
+            return;
+        }
+
+        effect_holder_t* effect = nullptr;
+        if (auto e_manager = bnb_effect_player_get_effect_manager(m_ep, nullptr)) {
+            effect = bnb_effect_manager_get_current_effect(e_manager, nullptr);
+        }
+        if (effect == nullptr) {
+            std::cout << "[Error] effect not loaded, " << m_js_batch.size() << " JS calls dropped" << std::endl;
+        }
+
+        for (auto& call : m_js_batch) {
+            if (call.kind != js_call_kind::eval) {
+                if (effect != nullptr) {
+                    bnb_effect_call_js_method(effect, call.method.c_str(), call.param.c_str(), nullptr);
+                }
+                continue;
+            }
+            if (effect == nullptr) {
+                if (call.result) {
+                    call.result({});
+                }
+                continue;
+            }
+#if defined(BNB_SDK_HAS_EVAL_JS)
+            bnb_error* error = nullptr;
+            auto* callback = new oep_eval_js_result_cb(std::move(call.result));
+            bnb_effect_eval_js(effect, call.method.c_str(), &eval_js_result, callback, &error);
+            if (error) {
+                // the SDK did not take the callback
+                std::cout << "[Error] eval_js: " << bnb_error_get_message(error) << std::endl;
+                bnb_error_destroy(error);
+                eval_js_result(nullptr, callback);
+            }
+#else
+            // the C API of this SDK evaluates no scripts, the caller still gets its callback in order
+            std::cout << "[Error] eval_js: the SDK has no bnb_effect_eval_js, the script is not run" << std::endl;
+            if (call.result) {
+                call.result({});
+            }
+#endif
+        }
+        m_js_batch.clear();
     }
 
     /* effect_player::pause */
@@ -150,92 +338,24 @@ namespace bnb::oep
     /* effect_player::push_frame */
     void effect_player::push_frame(pixel_buffer_sptr image, bnb::oep::interfaces::rotation image_orientation, bool require_mirroring)
     {
-        full_image_holder_t * bnb_image {nullptr};
+        push_frame(image, image_orientation, require_mirroring, 0);
+    }
 
-        bnb_error* error{nullptr};
-        bnb_yuv_color_range_t range;
-        bnb_yuv_color_space_t space;
+    /* effect_player::push_frame */
+    frame_identity effect_player::push_frame(const pixel_buffer_sptr& image, bnb::oep::interfaces::rotation image_orientation, bool require_mirroring, int64_t timestamp)
+    {
+        BNB_PROFILE_STAGE(pipeline_stage::push_frame);
 
-        using ns = bnb::oep::interfaces::image_format;
-        auto bnb_image_format = make_bnb_image_format(image, image_orientation, require_mirroring);
-        switch (image->get_image_format()) {
-            case ns::bpc8_rgb:
-            case ns::bpc8_bgr:
-            case ns::bpc8_rgba:
-            case ns::bpc8_bgra:
-            case ns::bpc8_argb:
-                bnb_image = bnb_full_image_from_bpc8_img_no_copy(
-                    bnb_image_format,
-                    make_bnb_pixel_format(image),
-                    image->get_base_sptr().get(),
-                    image->get_bytes_per_row(),
-                    &planes_holder_release,
-                    planes_holder(image),
-                    &error);
-                break;
-                
-                
-            case ns::nv12_bt601_full:
-                range = bnb_yuv_full_range;
-                space = bnb_bt601;
-            case ns::nv12_bt601_video:
-                range = bnb_yuv_video_range;
-                space = bnb_bt601;
-            case ns::nv12_bt709_full:
-                range = bnb_yuv_full_range;
-                space = bnb_bt709;
-            case ns::nv12_bt709_video:
-                range = bnb_yuv_video_range;
-                space = bnb_bt709;
-            
-                bnb_image = bnb_full_image_from_yuv_nv12_img_no_copy_ex(
-                    &bnb_image_format,
-                    range,
-                    space,
-                    image->get_base_sptr_of_plane(0).get(),
-                    image->get_bytes_per_row_of_plane(0),
-                    image->get_base_sptr_of_plane(1).get(),
-                    image->get_bytes_per_row_of_plane(1),
-                    &planes_holder_release,
-                    planes_holder(image),
-                    &error);
-                break;
-                
-                
-            case ns::i420_bt601_full:
-                range = bnb_yuv_full_range;
-                space = bnb_bt601;
-            case ns::i420_bt601_video:
-                range = bnb_yuv_video_range;
-                space = bnb_bt601;
-            case ns::i420_bt709_full:
-                range = bnb_yuv_full_range;
-                space = bnb_bt709;
-            case ns::i420_bt709_video:
-                range = bnb_yuv_video_range;
-                space = bnb_bt709;
-            
-                bnb_image = bnb_full_image_from_yuv_i420_img_no_copy_ex(
-                    &bnb_image_format,
-                    range,
-                    space,
-                    image->get_base_sptr_of_plane(0).get(),
-                    image->get_bytes_per_row_of_plane(0),
-                    1,
-                    image->get_base_sptr_of_plane(1).get(),
-                    image->get_bytes_per_row_of_plane(1),
-                    1,
-                    image->get_base_sptr_of_plane(2).get(),
-                    image->get_bytes_per_row_of_plane(2),
-                    1,
-                    &planes_holder_release,
-                    planes_holder(image),
-                    &error);
-                break;
-            default:
-                break;
+        const size_t format_index = image_format_index(image->get_image_format());
+        if (format_index == image_format_table.size()) {
+            throw std::runtime_error("unsupported image format");
         }
 
+        bnb_error* error{nullptr};
+        auto bnb_image_format = make_bnb_image_format(image, image_orientation, require_mirroring);
+        full_image_holder_t* bnb_image = full_image_factories[format_index](image, bnb_image_format, &error);
+        check_error(error);
+
         if (!bnb_image) {
             throw std::runtime_error("no image was created");
         }
@@ -246,38 +366,147 @@ namespace bnb::oep
         bnb_frame_data_add_full_img(fd, bnb_image, &error);
         check_error(error);
         
+        frame_identity frame;
+        {
+            // registered before the push, the async processor may finish the frame before it returns
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            frame = {m_next_frame_id++, timestamp};
+            m_in_flight.push_back({fd, frame});
+        }
+
         bnb_frame_processor_push(m_fp, fd, &error);
-        check_error(error);
 
         bnb_frame_data_release(fd, nullptr);
         bnb_full_image_release(bnb_image, nullptr);
+
+        if (error) {
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            m_in_flight.pop_back();
+        }
+        check_error(error);
+
+        if (m_mode == processing_mode::async) {
+            {
+                std::lock_guard<std::mutex> lock(m_recognition_mutex);
+                ++m_unrecognized;
+            }
+            m_frame_pushed.notify_one();
+        }
+        return frame;
     }
 
     /* effect_player::draw */
     int64_t effect_player::draw()
     {
+        return draw_frame().frame_number;
+    }
+
+    /* effect_player::draw_frame */
+    draw_frame_result effect_player::draw_frame()
+    {
+        BNB_PROFILE_STAGE(pipeline_stage::draw);
+
+        // the effect sees the parameters set since the previous frame
+        flush_js_calls();
+
         bnb_error * error{nullptr};
-        int64_t ret = -1;
-         
-        auto result = bnb_frame_processor_pop(m_fp, &error);
-        check_error(error);
+        draw_frame_result ret;
+
+        // a full pipeline waits for its oldest frame, this bounds the latency by pipeline_depth frames
+        const bool wait = m_mode == processing_mode::async && frames_in_flight() >= m_pipeline_depth;
+
+        bnb_processor_result_t result{nullptr, bnb_processor_status_empty};
+        if (m_mode == processing_mode::async) {
+            std::unique_lock<std::mutex> lock(m_recognition_mutex);
+            if (wait) {
+                // woken by the recognition thread as soon as a frame is recognised
+                m_frame_recognized.wait_for(lock, m_max_draw_wait, [this] { return !m_recognized.empty(); });
+            }
+            if (!m_recognized.empty()) {
+                result = {m_recognized.front(), bnb_processor_status_ok};
+                m_recognized.erase(m_recognized.begin());
+            }
+        } else {
+            // the sync processor recognises the frame inside the pop
+            result = bnb_frame_processor_pop(m_fp, &error);
+            check_error(error);
+        }
         if (result.status != bnb_processor_status_ok) {
             bnb_frame_data_release(result.frame_data, nullptr);
-            return -1;
+            return ret;
         }
-        
-        ret = bnb_effect_player_draw_with_external_frame_data(m_ep, result.frame_data, &error);
+
+        {
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            // a pointer freed by a dropped frame may be reused by a later push, the live one is the newest
+            auto it = std::find_if(m_in_flight.rbegin(), m_in_flight.rend(), [&result](const in_flight_frame& f) {
+                return f.data == result.frame_data;
+            });
+            if (it != m_in_flight.rend()) {
+                ret.frame = it->identity;
+                // results come in push order, the older frames were dropped by the processor
+                m_in_flight.erase(m_in_flight.begin(), it.base());
+            }
+        }
+
+        ret.frame_number = bnb_effect_player_draw_with_external_frame_data(m_ep, result.frame_data, &error);
     
         bnb_frame_data_release(result.frame_data, nullptr);
         
         check_error(error);
+        return ret;
+    }
+
+    /* effect_player::recognition_loop */
+    void effect_player::recognition_loop()
+    {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_recognition_mutex);
+                m_frame_pushed.wait(lock, [this] { return m_stop_recognition || m_unrecognized != 0; });
+                if (m_stop_recognition) {
+                    return;
+                }
+                --m_unrecognized;
+            }
+
+            bnb_error* error = nullptr;
+            auto result = bnb_frame_processor_pop(m_fp, &error);
+            if (error) {
+                std::cout << "[Error] frame recognition: " << bnb_error_get_message(error) << std::endl;
+                bnb_error_destroy(error);
+            }
+            if (result.status != bnb_processor_status_ok) {
+                // the processor dropped the frame, draw_frame drops its identity with the next drawn one
+                bnb_frame_data_release(result.frame_data, nullptr);
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_recognition_mutex);
+                m_recognized.push_back(result.frame_data);
+            }
+            m_frame_recognized.notify_all();
+        }
+    }
+
+    /* effect_player::frames_in_flight */
+    size_t effect_player::frames_in_flight() const
+    {
+        std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+        return m_in_flight.size();
     }
 
     /* effect_player::make_bnb_image_format */
-    bnb_image_format_t effect_player::make_bnb_image_format(pixel_buffer_sptr image, interfaces::rotation orientation, bool require_mirroring)
+    bnb_image_format_t effect_player::make_bnb_image_format(const pixel_buffer_sptr& image, interfaces::rotation orientation, bool require_mirroring)
     {
         bnb_image_orientation_t camera_orient {BNB_DEG_0};
         using ns = bnb::oep::interfaces::rotation;
+        // the SDK mirrors after the rotation, a rotation after the mirror turns the other way:
+        // rotate(r) * mirror * rotate(o) == mirror * rotate(o - r)
+        const auto output_rotation = static_cast<int32_t>(m_output_rotation.load());
+        const int32_t added_rotation = require_mirroring ? (4 - output_rotation) % 4 : output_rotation;
+        orientation = static_cast<ns>((static_cast<int32_t>(orientation) + added_rotation) % 4);
         switch (orientation) {
             case ns::deg0:
                 break;
@@ -291,32 +520,6 @@ namespace bnb::oep
                 camera_orient = BNB_DEG_270;
                 break;
         }
-        return {static_cast<uint32_t>(image->get_width()), static_cast<uint32_t>(image->get_height()), camera_orient, require_mirroring, 0};
-    }
-
-    /* effect_player::make_bnb_pixel_format */
-    bnb_pixel_format_t effect_player::make_bnb_pixel_format(pixel_buffer_sptr image)
-    {
-        bnb_pixel_format_t fmt {BNB_RGB};
-        using ns = bnb::oep::interfaces::image_format;
-        switch (image->get_image_format()) {
-            case ns::bpc8_rgb:
-                break;
-            case ns::bpc8_bgr:
-                fmt = BNB_BGR;
-                break;
-            case ns::bpc8_rgba:
-                fmt = BNB_RGBA;
-                break;
-            case ns::bpc8_bgra:
-                fmt = BNB_BGRA;
-                break;
-            case ns::bpc8_argb:
-                fmt = BNB_ARGB;
-                break;
-            default:
-                break;
-        }
-        return fmt;
+        return {static_cast<uint32_t>(image->get_width()), static_cast<uint32_t>(image->get_height()), camera_orient, require_mirroring, added_rotation * 90};
     }
 } /* namespace bnb::oep */
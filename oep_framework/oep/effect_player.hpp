@@ -4,13 +4,56 @@
 #include <bnb/common_types.h>
 #include <bnb/effect_player.h>
 
+#include "effect_cache.h"
+#include "js_call_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace bnb::oep
 {
 
+    /**
+     * sync: recognition runs inside draw(), every frame costs recognition + rendering.
+     * async: recognition runs on the recognition thread of the effect player, frame N + 1 is
+     *        recognised while frame N is drawn. Up to `pipeline_depth` frames may be in flight.
+     */
+    enum class processing_mode
+    {
+        sync,
+        async
+    };
+
+    struct frame_identity
+    {
+        uint64_t id{0};
+        /* caller supplied, e.g. the presentation time of the camera frame */
+        int64_t timestamp{0};
+    };
+
+    struct draw_frame_result
+    {
+        /* result of bnb_effect_player_draw_with_external_frame_data, -1 if nothing was drawn */
+        int64_t frame_number{-1};
+        /* identity of the pushed frame the drawn frame was made from, valid if drawn() */
+        frame_identity frame;
+
+        bool drawn() const
+        {
+            return frame_number >= 0;
+        }
+    };
+
     class effect_player : public bnb::oep::interfaces::effect_player
     {
     public:
-        effect_player(int32_t width, int32_t height);
+        effect_player(int32_t width, int32_t height, processing_mode mode = processing_mode::sync, size_t pipeline_depth = 1);
 
         ~effect_player();
 
@@ -22,10 +65,38 @@ namespace bnb::oep
 
         bool load_effect(const std::string& effect) override;
 
+        /**
+         * Queues a setter call for the next frame, see the overload. Returns true, a call made
+         * while no effect is loaded is dropped when it runs.
+         */
         bool call_js_method(const std::string& method, const std::string& param) override;
 
+        /**
+         * Queues the call, draw_frame runs the queued calls before the next draw on the render thread.
+         * Setters of the same method are coalesced until a command or an eval, the last value is set,
+         * see bnb::js_call_queue, `eval` is queued as a command. Any thread, does not take a lock.
+         */
+        bool call_js_method(const std::string& method, const std::string& param, js_call_kind kind);
+
+        /**
+         * Queues the script like a command. `result_callback` gets the result on the thread the SDK
+         * evaluates the script on, an empty string when no effect is loaded or the evaluation failed.
+         * Needs an SDK with bnb_effect_eval_js (BNB_SDK_HAS_EVAL_JS), without it the script is not run
+         * and the callback gets an empty string on the render thread.
+         */
         void eval_js(const std::string& script, oep_eval_js_result_cb result_callback) override;
 
+        /**
+         * Runs the queued JS calls on the current effect, the effect is looked up once for all of them.
+         * draw_frame calls it before the draw, load_effect before the switch. Render thread.
+         */
+        void flush_js_calls();
+
+        js_call_stats js_stats() const
+        {
+            return m_js_calls.stats();
+        }
+
         void pause() override;
 
         void resume() override;
@@ -36,13 +107,115 @@ namespace bnb::oep
 
         int64_t draw() override;
 
+        /**
+         * Same as push_frame, returns the identity the frame gets in draw_frame.
+         * In async mode the push does not wait for recognition.
+         */
+        frame_identity push_frame(const pixel_buffer_sptr& image, bnb::oep::interfaces::rotation image_orientation, bool require_mirroring, int64_t timestamp);
+
+        /**
+         * Draws the oldest recognised frame. In async mode it returns without drawing
+         * while the frame is in recognition and fewer than `pipeline_depth` frames are
+         * in flight, otherwise it waits for the recognition thread to finish the oldest
+         * one, at most max_draw_wait().
+         * The drawn frame is matched to its push by the frame data, frames the processor
+         * dropped in between leave frames_in_flight() when a later one is drawn.
+         */
+        draw_frame_result draw_frame();
+
+        /* the longest draw_frame waits for a full pipeline, then it returns without drawing */
+        void set_max_draw_wait(std::chrono::nanoseconds wait)
+        {
+            m_max_draw_wait = wait;
+        }
+
+        std::chrono::nanoseconds max_draw_wait() const
+        {
+            return m_max_draw_wait;
+        }
+
+        processing_mode mode() const
+        {
+            return m_mode;
+        }
+
+        size_t pipeline_depth() const
+        {
+            return m_pipeline_depth;
+        }
+
+        /* number of pushed frames that are not drawn yet */
+        size_t frames_in_flight() const;
+
+        /**
+         * Rotation added to the orientation of every pushed image, so the SDK draws the frame
+         * already rotated to the output orientation and no rotation pass is needed
+         * (orientation_strategy::in_render). The surface must have the rotated size.
+         * The SDK mirrors after it rotates, so for a mirrored image the rotation is subtracted
+         * from the orientation instead. The face detector gets the rotation added to the
+         * orientation as the face orientation hint, it keeps looking for faces upright in the
+         * unrotated frame.
+         */
+        void set_output_rotation(interfaces::rotation rotation)
+        {
+            m_output_rotation = rotation;
+        }
+
+        /**
+         * Effects prepared by `cache` ahead of load_effect, the load counts as a hit or a miss of it.
+         * NOTE: set it before the first load_effect
+         */
+        void set_effect_cache(std::shared_ptr<bnb::effect_cache> cache)
+        {
+            m_effect_cache = std::move(cache);
+        }
+
     private:
-        bnb_image_format_t make_bnb_image_format(pixel_buffer_sptr image, interfaces::rotation orientation, bool require_mirroring);
-        bnb_pixel_format_t make_bnb_pixel_format(pixel_buffer_sptr image);
+        bnb_image_format_t make_bnb_image_format(const pixel_buffer_sptr& image, interfaces::rotation orientation, bool require_mirroring);
+
+        /* async mode: pops the pushed frames from the sync frame processor, the pop recognises them */
+        void recognition_loop();
 
     private:
         effect_player_holder_t* m_ep {nullptr};
         frame_processor_t* m_fp {nullptr};
+
+        const processing_mode m_mode;
+        const size_t m_pipeline_depth;
+        std::atomic<interfaces::rotation> m_output_rotation {interfaces::rotation::deg0};
+        std::shared_ptr<bnb::effect_cache> m_effect_cache;
+
+        js_call_queue m_js_calls;
+        /* the calls of one flush, reused every frame */
+        std::vector<js_call> m_js_batch;
+
+        struct in_flight_frame
+        {
+            /* held by the processor until the frame is popped, so no two frames in flight share it */
+            const frame_data_t* data;
+            frame_identity identity;
+        };
+
+        /* in push order, a few entries, reserved up front */
+        mutable std::mutex m_in_flight_mutex;
+        std::vector<in_flight_frame> m_in_flight;
+        uint64_t m_next_frame_id {0};
+        std::chrono::nanoseconds m_max_draw_wait {std::chrono::milliseconds(100)};
+
+        /*
+         * async mode. The SDK has no blocking pop, so the frame processor runs in sync mode
+         * and the recognition thread pops it: draw_frame waits for m_frame_recognized
+         * instead of polling the processor.
+         */
+        std::mutex m_recognition_mutex;
+        std::condition_variable m_frame_pushed;
+        std::condition_variable m_frame_recognized;
+        /* pushed, not popped by the recognition thread yet */
+        size_t m_unrecognized {0};
+        /* recognised, in push order, reserved up front */
+        std::vector<frame_data_t*> m_recognized;
+        bool m_stop_recognition {false};
+        std::thread m_recognition_thread;
     }; /* class effect_player */
 
 } /* namespace bnb::oep */
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <interfaces/pixel_buffer.hpp>
+#include <bnb/common_types.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace bnb::oep
+{
+
+    /* Memory layout family, selects the SDK image constructor */
+    enum class image_layout
+    {
+        bpc8, /* packed 8 bit per channel, one plane */
+        nv12, /* Y plane + interleaved UV plane */
+        i420  /* Y, U and V planes */
+    };
+
+    /**
+     * Everything the push path needs to know about an image_format.
+     * `chroma_shift_*` is the log2 of the chroma subsampling, 0 for packed formats.
+     * `range` and `space` are meaningful for YUV formats only, `pixel_format` for bpc8 only.
+     */
+    struct image_format_traits
+    {
+        interfaces::image_format format;
+        image_layout layout;
+        int32_t plane_count;
+        int32_t chroma_shift_x;
+        int32_t chroma_shift_y;
+        bnb_yuv_color_range_t range;
+        bnb_yuv_color_space_t space;
+        bnb_pixel_format_t pixel_format;
+    };
+
+    namespace detail
+    {
+        using fmt = interfaces::image_format;
+
+        constexpr image_format_traits packed(fmt format, bnb_pixel_format_t pixel_format)
+        {
+            return {format, image_layout::bpc8, 1, 0, 0, bnb_yuv_full_range, bnb_bt601, pixel_format};
+        }
+
+        constexpr image_format_traits yuv420(fmt format, image_layout layout, bnb_yuv_color_range_t range, bnb_yuv_color_space_t space)
+        {
+            return {format, layout, layout == image_layout::nv12 ? 2 : 3, 1, 1, range, space, BNB_RGB};
+        }
+    } /* namespace detail */
+
+    /* One row per supported format, a new format needs a new row only */
+    inline constexpr std::array<image_format_traits, 13> image_format_table{{
+        detail::packed(detail::fmt::bpc8_rgb, BNB_RGB),
+        detail::packed(detail::fmt::bpc8_bgr, BNB_BGR),
+        detail::packed(detail::fmt::bpc8_rgba, BNB_RGBA),
+        detail::packed(detail::fmt::bpc8_bgra, BNB_BGRA),
+        detail::packed(detail::fmt::bpc8_argb, BNB_ARGB),
+        detail::yuv420(detail::fmt::nv12_bt601_full, image_layout::nv12, bnb_yuv_full_range, bnb_bt601),
+        detail::yuv420(detail::fmt::nv12_bt601_video, image_layout::nv12, bnb_yuv_video_range, bnb_bt601),
+        detail::yuv420(detail::fmt::nv12_bt709_full, image_layout::nv12, bnb_yuv_full_range, bnb_bt709),
+        detail::yuv420(detail::fmt::nv12_bt709_video, image_layout::nv12, bnb_yuv_video_range, bnb_bt709),
+        detail::yuv420(detail::fmt::i420_bt601_full, image_layout::i420, bnb_yuv_full_range, bnb_bt601),
+        detail::yuv420(detail::fmt::i420_bt601_video, image_layout::i420, bnb_yuv_video_range, bnb_bt601),
+        detail::yuv420(detail::fmt::i420_bt709_full, image_layout::i420, bnb_yuv_full_range, bnb_bt709),
+        detail::yuv420(detail::fmt::i420_bt709_video, image_layout::i420, bnb_yuv_video_range, bnb_bt709),
+    }};
+
+    /* Index of the format in image_format_table, image_format_table.size() if it is not supported */
+    constexpr size_t image_format_index(interfaces::image_format format)
+    {
+        for (size_t i = 0; i < image_format_table.size(); ++i) {
+            if (image_format_table[i].format == format) {
+                return i;
+            }
+        }
+        return image_format_table.size();
+    }
+
+    /* nullptr if the format is not supported */
+    constexpr const image_format_traits* find_image_format_traits(interfaces::image_format format)
+    {
+        const size_t i = image_format_index(format);
+        return i < image_format_table.size() ? &image_format_table[i] : nullptr;
+    }
+
+    /* Traits of a format known at compile time, does not compile for an unsupported one */
+    template<interfaces::image_format F>
+    constexpr const image_format_traits& image_format_traits_of()
+    {
+        static_assert(image_format_index(F) < image_format_table.size(), "image_format has no row in image_format_table");
+        return image_format_table[image_format_index(F)];
+    }
+
+} /* namespace bnb::oep */
@@ -4,6 +4,9 @@
 
 #include <interfaces/offscreen_render_target.hpp>
 #include "program.hpp"
+#include "yuv_readback.hpp"
+#include "nv12_renderer.hpp"
+#include "frame_buffer_pool.h"
 
 #import <OpenGLES/EAGL.h>
 #import <OpenGLES/ES3/gl.h>
@@ -12,10 +15,41 @@
 
 #import <CoreMedia/CoreMedia.h>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace bnb
 {
     class ort_frame_surface_handler;
 
+    /**
+     * Where the rendered frame is rotated to the output orientation.
+     * `gpu_pass` draws it into a second render target, `cpu_fused` skips the draw
+     * and leaves the rotation to convertAndOrient, fused with the readback conversion,
+     * `in_render` skips the draw because the SDK renders the frame rotated already
+     * (see effect_player::set_output_rotation), the render target has the rotated size.
+     */
+    enum class orientation_strategy
+    {
+        gpu_pass,
+        cpu_fused,
+        in_render
+    };
+
+    /// Counters of the render target ring since the last set_ring_size
+    struct render_ring_stats
+    {
+        size_t slots{0};
+        uint64_t frames{0};
+        uint64_t exhausted{0};   // every slot was still held by the consumer, the next one got fresh buffers
+        uint64_t fence_waits{0}; // the GPU had not finished the frame when it was handed out, when_rendered waited on its queue
+        uint64_t resizes{0};       // the surface changed size, the ring got render targets of the new size
+        uint64_t reallocations{0}; // a resize the pool had no targets of the new size for, new surfaces were created
+    };
+
 class offscreen_render_target : public oep::interfaces::offscreen_render_target
     {
     public:
@@ -30,48 +64,177 @@ class offscreen_render_target : public oep::interfaces::offscreen_render_target
         void surface_changed(int32_t width, int32_t height) override;
         void orient_image(bnb::oep::interfaces::rotation orientation) override;
         
+        /**
+         * NV12 and I420 formats only, converted on the GPU. Returns the previous frame, the
+         * readback of the current one runs meanwhile. nullptr for the first frame and for
+         * other formats or sizes yuv_readback does not support.
+         */
         pixel_buffer_sptr read_current_buffer(bnb::oep::interfaces::image_format format) override;
+
+        /**
+         * The render target of the frame (the BGRA, oriented or NV12 one), +1 retained. It is a lease:
+         * the slot is not rendered into again until the last reference to it is released, whichever
+         * output path hands it on, zero-copy or a CPU conversion. It is returned without waiting for
+         * the GPU, the consumer must not read it before when_rendered reported the frame rendered.
+         */
         rendered_texture_t get_current_buffer_texture() override;
 
+        /**
+         * Calls `done(true)` once the GPU has finished the frame get_current_buffer_texture handed out last,
+         * right away on the render thread when it is finished already, otherwise on the fence queue of the
+         * render target, in frame order either way. `done(false)` when the frame was not finished within a
+         * second, it must not be read then. Render thread, once per frame after get_current_buffer_texture.
+         */
+        void when_rendered(std::function<void(bool rendered)> done);
+
+        /// The frame read_current_buffer has not returned yet, e.g. at the end of a clip. nullptr when there is none
+        pixel_buffer_sptr flush_read_buffer();
+
+        void set_orientation_strategy(orientation_strategy strategy);
+
+        /**
+         * Pixel format of the buffers get_current_buffer_texture returns, takes effect with the next frame.
+         * bpc8_bgra (the default) is the render target itself, for the NV12 formats the GPU draws the
+         * frame into the planes of a biplanar buffer. Returns false for the other formats, they are
+         * converted by the caller, the render target stays BGRA then.
+         */
+        bool set_output_format(bnb::oep::interfaces::image_format format);
+
+        /**
+         * Offline processing of a frame sequence. While a batch is open the context stays
+         * current between frames, deactivate_context does nothing. Calls may be nested.
+         */
+        void begin_batch();
+        void end_batch();
+
+        /**
+         * Number of render targets frames are rendered into in turn, clamped to [2, 4].
+         * Frame N+1 is rendered into the next free one while the consumer still reads frame N.
+         * Takes effect with the next frame.
+         */
+        void set_ring_size(size_t size);
+        render_ring_stats ring_stats() const;
+
+        /**
+         * Size of the frames handed out when it differs from the surface, e.g. the effect renders at a
+         * lower resolution: the output pass scales the frame, it runs for every orientation strategy then.
+         * 0 x 0 (the default) hands out frames of the surface size. Takes effect with the next frame.
+         */
+        void set_output_size(uint32_t width, uint32_t height);
+
+        /**
+         * Nanoseconds of the last frame from prepare_rendering until when_rendered saw it finished:
+         * the effect draw, the output passes and the GPU work of them.
+         */
+        uint64_t last_frame_time_ns() const;
+
     private:
+        /**
+         * One render target of the ring. `fence` is signalled when the GPU has finished the last
+         * draw of the frame. `leases` counts the buffers of the slot handed out and not released
+         * yet, the slot is rendered into again only when it is 0.
+         */
+        struct render_slot
+        {
+            CVPixelBufferRef buffer{nullptr};
+            CVOpenGLESTextureRef texture{nullptr};
+
+            CVPixelBufferRef post_buffer{nullptr};
+            CVOpenGLESTextureRef post_texture{nullptr};
+
+            CVPixelBufferRef yuv_buffer{nullptr};
+            CVOpenGLESTextureRef y_texture{nullptr};
+            CVOpenGLESTextureRef uv_texture{nullptr};
+
+            // shared with the release callbacks of the leases, a recreated slot starts a new one
+            std::shared_ptr<std::atomic<int32_t>> leases;
+
+            // when_rendered takes it, the wait deletes it
+            GLsync fence{nullptr};
+            bool oriented{false};
+            bool yuv{false};
+            // of the frame handed out, the size of the target get_image returns
+            uint32_t width{0};
+            uint32_t height{0};
+        };
+
         void setupRenderBuffers();
         void cleanupRenderBuffers();
 
         void createContext();
 
         std::tuple<int, int> getWidthHeight(bnb::oep::interfaces::rotation orientation);
+        std::tuple<uint32_t, uint32_t> outputSize() const;
 
         void setupTextureCache();
-        void setupOffscreenPixelBuffer();
-        void setupOffscreenRenderTarget();
-        void setupOffscreenPostProcessingPixelBuffer(bnb::oep::interfaces::rotation orientation);
-
-        void setupOffscreenPostProcessingRenderTarget(bnb::oep::interfaces::rotation orientation);
-        void cleanPostProcessRenderingTargets();
-
-        void preparePostProcessingRendering(bnb::oep::interfaces::rotation orientation);
+        void setupRing();
+        void cleanupRing();
+        void setupOffscreenRenderTarget(render_slot& slot);
+        void cleanupOffscreenRenderTarget(render_slot& slot);
+        size_t acquireSlot();
+        bool isSlotFree(const render_slot& slot) const;
+
+        void setupOffscreenPostProcessingRenderTarget(render_slot& slot, size_t width, size_t height);
+        void cleanPostProcessRenderingTargets(render_slot& slot);
+
+        void preparePostProcessingRendering(const render_slot& slot);
+        void renderOutputFormat(render_slot& slot);
+        void setupYuvRenderTarget(render_slot& slot, size_t width, size_t height, const image::yuv_format& yuv);
+        void cleanYuvRenderTarget(render_slot& slot);
+        void finishFrame(render_slot& slot);
         
         void* get_image();
 
+        pixel_buffer_sptr makeYuvBuffer(const gl::yuv_readback::frame& frame);
+
         uint32_t m_width{0};
         uint32_t m_height{0};
+        // width << 32 | height, 0 follows the surface
+        std::atomic<uint64_t> m_output_size{0};
+
+        // one per instance, in the share group of all render targets of the process: programs and
+        // vertex data are shared, render targets and the state cache are not, instances render concurrently
+        EAGLContext* m_GLContext{nil};
+        gl::state_cache m_glState;
 
         CVOpenGLESTextureCacheRef m_videoTextureCache{nullptr};
 
+        // render targets of a ring resized to a new size or given away by an exhausted ring are recycled
+        std::shared_ptr<frame_buffer_pool> m_pixelBufferPool;
+
         GLuint m_framebuffer{0};
         GLuint m_postProcessingFramebuffer{0};
 
-        CVPixelBufferRef m_offscreenRenderPixelBuffer{nullptr};
-        CVPixelBufferRef m_offscreenPostProcessingPixelBuffer{nullptr};
+        std::vector<render_slot> m_slots;
+        size_t m_current{0};
+        std::atomic<size_t> m_ring_size{2};
 
-        CVOpenGLESTextureRef m_offscreenRenderTexture{nullptr};
-        CVOpenGLESTextureRef m_offscreenPostProcessingRenderTexture{nullptr};
+        std::atomic<uint64_t> m_frames{0};
+        std::atomic<uint64_t> m_exhausted{0};
+        std::atomic<uint64_t> m_fence_waits{0};
+        std::atomic<uint64_t> m_resizes{0};
+        std::atomic<uint64_t> m_reallocations{0};
 
-        bool m_oriented{false};
+        std::chrono::steady_clock::time_point m_frame_start;
+        std::atomic<uint64_t> m_last_frame_ns{0};
+
+        // when_rendered waits for the fences here, not on the render thread. Created with the first wait
+        dispatch_queue_t m_fenceQueue{nil};
+        EAGLContext* m_fenceContext{nil};
+        std::atomic<uint32_t> m_pending_fence_waits{0};
+
+        std::atomic<orientation_strategy> m_orientation_strategy{orientation_strategy::gpu_pass};
+        std::atomic<int32_t> m_batch_depth{0};
 
         std::unique_ptr<program> m_program;
         std::unique_ptr<ort_frame_surface_handler> m_frameSurfaceHandler;
-        
-        bnb::oep::interfaces::rotation m_prev_orientation{0};
+
+        std::atomic<bnb::oep::interfaces::image_format> m_output_format{bnb::oep::interfaces::image_format::bpc8_bgra};
+        std::unique_ptr<gl::nv12_renderer> m_nv12Renderer;
+
+        // created with the first read_current_buffer
+        std::unique_ptr<gl::yuv_readback> m_yuvReadback;
+        // planes of the returned YUV buffers, back to the pool when the consumer drops them
+        std::shared_ptr<frame_buffer_pool> m_yuvPool;
     };
 } // bnb
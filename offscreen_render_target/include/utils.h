@@ -1,7 +1,14 @@
 #include <functional>
+#include <memory>
 
 #import <Accelerate/Accelerate.h>
 
+#include <interfaces/pixel_buffer.hpp>
+
+#include "frame_buffer_pool.h"
+#include "color_conversion.hpp"
+#include "orientation.hpp"
+
 namespace bnb
 {
     enum class vrange
@@ -10,8 +17,59 @@ namespace bnb
         full_range
     };
 
+    /**
+     * IOSurface backed CVPixelBuffers for the frame_buffer_pool. `format` is the OSType,
+     * a non-zero `stride` is used as the bytes per row alignment. The pool keeps these buffers,
+     * the users get leases of them, see createPixelBuffer.
+     */
+    class cv_pixel_buffer_allocator : public frame_buffer_allocator
+    {
+    public:
+        void* allocate(const frame_buffer_desc& desc) override;
+        void deallocate(void* buffer) override;
+
+        bool reference_counted() const override
+        {
+            return true;
+        }
+    };
+
+    std::shared_ptr<frame_buffer_pool> makePixelBufferPool(size_t high_water_mark);
+
+    /**
+     * Returns a +1 retained lease of the IOSurface of `pixelBuffer`: a pixel buffer object of its own
+     * sharing the surface and the propagated attachments, no pixels are copied. `onRelease` is called
+     * once, on the thread that drops the last reference to the lease (also when the lease can not be made,
+     * nullptr is returned then). As CVPixelBufferPool does, every lease is a new object, so the end of the
+     * lease is known exactly instead of guessed from a retain count.
+     */
+    CVPixelBufferRef makeLeasedBuffer(CVPixelBufferRef pixelBuffer, std::function<void()> onRelease);
+
+    /**
+     * Returns a +1 retained IOSurface backed pixel buffer, the caller releases it as usual.
+     * With a pool it is a lease of a pooled buffer (makeLeasedBuffer), the buffer goes back to the pool
+     * when the last reference to the lease is dropped; without a pool a new buffer is created.
+     */
+    CVPixelBufferRef createPixelBuffer(size_t width, size_t height, OSType format, const std::shared_ptr<frame_buffer_pool>& pool);
+
     void runOnMainQueue(std::function<void()> f);
 
-    CVPixelBufferRef convertBGRAtoNV12(CVPixelBufferRef inputPixelBuffer, vrange range);
-    CVPixelBufferRef convertBGRAtoRGBA(CVPixelBufferRef inputPixelBuffer);
+    /// biplanar OSType for NV12, planar for I420
+    OSType yuvPixelFormat(const image::yuv_format& yuv);
+    void attachYCbCrMatrix(CVPixelBufferRef pixelBuffer, const image::yuv_format& yuv);
+
+    /// BT.601 NV12 in the requested range
+    CVPixelBufferRef convertBGRAtoNV12(CVPixelBufferRef inputPixelBuffer, vrange range, const std::shared_ptr<frame_buffer_pool>& pool = nullptr);
+    /// any of the NV12/I420 formats, the YCbCr matrix is attached to the result; nullptr for non-YUV formats
+    CVPixelBufferRef convertBGRAtoYUV(CVPixelBufferRef inputPixelBuffer, bnb::oep::interfaces::image_format format, const std::shared_ptr<frame_buffer_pool>& pool = nullptr);
+    /// the result is kCVPixelFormatType_32RGBA
+    CVPixelBufferRef convertBGRAtoRGBA(CVPixelBufferRef inputPixelBuffer, const std::shared_ptr<frame_buffer_pool>& pool = nullptr);
+
+    /**
+     * Single pass replacement of offscreen_render_target::orient_image followed by the conversion above:
+     * rotates the render target exactly like the post-processing GL pass does and writes `format`
+     * (bpc8_bgra, bpc8_rgba or any NV12/I420 format); nullptr for the other formats.
+     */
+    CVPixelBufferRef convertAndOrient(CVPixelBufferRef inputPixelBuffer, bnb::oep::interfaces::rotation orientation,
+                                      bnb::oep::interfaces::image_format format, const std::shared_ptr<frame_buffer_pool>& pool = nullptr);
 } // namespace bnb
@@ -1,7 +1,15 @@
 #include "offscreen_render_target.h"
 
 #include "opengl.hpp"
+#include "program_cache.hpp"
 #include "utils.h"
+#include "stage_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <utility>
 
 namespace bnb
 {
@@ -11,10 +19,12 @@ const char* vs_default_base =
         " layout (location = 0) in vec3 aPos; \n"
         " layout (location = 1) in vec2 aTexCoord; \n"
         "out vec2 vTexCoord;\n"
+        "uniform vec2 uTexScale;\n"
+        "uniform vec2 uTexOffset;\n"
         "void main()\n"
         "{\n"
             " gl_Position = vec4(aPos, 1.0); \n"
-            " vTexCoord = aTexCoord; \n"
+            " vTexCoord = uTexOffset + aTexCoord * uTexScale; \n"
         "}\n";
 
 const char* ps_default_base =
@@ -29,10 +39,74 @@ const char* ps_default_base =
 
 
 
+    /**
+     * The vertices and indices of all quads of ort_frame_surface_handler, immutable, so one copy
+     * serves every context of the share group. Vertex arrays are not shared, each handler has its own.
+     */
+    class ort_quad_buffers
+    {
+    public:
+        ort_quad_buffers(const void* vertices, GLsizeiptr vertices_size, const void* indices, GLsizeiptr indices_size)
+        {
+            glGenBuffers(1, &m_vbo);
+            glGenBuffers(1, &m_ebo);
+            // the element buffer binding belongs to the bound vertex array
+            glBindVertexArray(0);
+            gl::context_info::instance().state().invalidate();
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            // the upload must reach the share group before another context uses the buffers
+            glFlush();
+        }
+
+        ~ort_quad_buffers()
+        {
+            glDeleteBuffers(1, &m_vbo);
+            glDeleteBuffers(1, &m_ebo);
+        }
+
+        ort_quad_buffers(const ort_quad_buffers&) = delete;
+        ort_quad_buffers& operator=(const ort_quad_buffers&) = delete;
+
+        /// the live buffers of the process, or new ones made with `make`
+        template<class Make>
+        static std::shared_ptr<ort_quad_buffers> acquire(Make make)
+        {
+            static std::mutex mutex;
+            static std::weak_ptr<ort_quad_buffers> shared;
+            std::lock_guard<std::mutex> lock(mutex);
+            auto buffers = shared.lock();
+            if (buffers == nullptr) {
+                buffers = make();
+                shared = buffers;
+            }
+            return buffers;
+        }
+
+        GLuint vbo() const
+        {
+            return m_vbo;
+        }
+
+        GLuint ebo() const
+        {
+            return m_ebo;
+        }
+
+    private:
+        GLuint m_vbo{0};
+        GLuint m_ebo{0};
+    };
+
     class ort_frame_surface_handler
     {
     private:
         static const auto v_size = static_cast<uint32_t>(bnb::oep::interfaces::rotation::deg270) + 1;
+        static const auto quad_count = 2 * v_size;
 
     public:
         /**
@@ -46,28 +120,27 @@ const char* ps_default_base =
             : m_orientation(static_cast<uint32_t>(orientation))
             , m_y_flip(static_cast<uint32_t>(is_y_flip))
         {
-            glGenVertexArrays(1, &m_vao);
-            glGenBuffers(1, &m_vbo);
-            glGenBuffers(1, &m_ebo);
+            // every flip and orientation at once, uploaded once per process, draw() picks the quad
+            m_buffers = ort_quad_buffers::acquire([]() {
+                // the two triangles of every quad, offset to its 4 vertices (no base vertex in GLES 3.0)
+                unsigned int indices[quad_count * 6];
+                for (unsigned int quad = 0; quad < quad_count; ++quad) {
+                    const unsigned int first = quad * 4;
+                    const unsigned int quad_indices[] = {
+                        // clang-format off
+                        first + 0, first + 1, first + 3, // first triangle
+                        first + 1, first + 2, first + 3  // second triangle
+                        // clang-format on
+                    };
+                    std::copy(std::begin(quad_indices), std::end(quad_indices), indices + quad * 6);
+                }
+                return std::make_shared<ort_quad_buffers>(vertices, sizeof(vertices), indices, sizeof(indices));
+            });
 
+            glGenVertexArrays(1, &m_vao);
             glBindVertexArray(m_vao);
-
-            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[m_y_flip][m_orientation]), vertices[m_y_flip][m_orientation], GL_STATIC_DRAW);
-
-            // clang-format off
-
-            unsigned int indices[] = {
-                // clang-format off
-                0, 1, 3, // first triangle
-                1, 2, 3  // second triangle
-                // clang-format on
-            };
-
-            // clang-format on
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffers->vbo());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffers->ebo());
 
             // position attribute
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*) 0);
@@ -86,15 +159,7 @@ const char* ps_default_base =
             if (m_vao != 0)
                 glDeleteVertexArrays(1, &m_vao);
 
-            if (m_vbo != 0)
-                glDeleteBuffers(1, &m_vbo);
-
-            if (m_ebo != 0)
-                glDeleteBuffers(1, &m_ebo);
-
             m_vao = 0;
-            m_vbo = 0;
-            m_ebo = 0;
         }
 
         ort_frame_surface_handler(const ort_frame_surface_handler&) = delete;
@@ -103,40 +168,31 @@ const char* ps_default_base =
         ort_frame_surface_handler& operator=(const ort_frame_surface_handler&) = delete;
         ort_frame_surface_handler& operator=(ort_frame_surface_handler&&) = delete;
 
-        void update_vertices_buffer()
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[m_y_flip][m_orientation]), vertices[m_y_flip][m_orientation], GL_STATIC_DRAW);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-        }
-
         void set_orientation(bnb::oep::interfaces::rotation orientation)
         {
-            if (m_orientation != static_cast<uint32_t>(orientation)) {
-                m_orientation = static_cast<uint32_t>(orientation);
-            }
+            m_orientation = static_cast<uint32_t>(orientation);
         }
 
         void set_y_flip(bool y_flip)
         {
-            if (m_y_flip != static_cast<uint32_t>(y_flip)) {
-                m_y_flip = static_cast<uint32_t>(y_flip);
-            }
+            m_y_flip = static_cast<uint32_t>(y_flip);
         }
 
         void draw()
         {
-            glBindVertexArray(m_vao);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-            glBindVertexArray(0);
+            auto& state = gl::context_info::instance().state();
+            const uintptr_t first_index = (m_y_flip * v_size + m_orientation) * 6;
+            state.bind_vertex_array(m_vao);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, reinterpret_cast<const void*>(first_index * sizeof(unsigned int)));
+            // unbound, an element buffer bound by the SDK must not end up in this VAO
+            state.bind_vertex_array(0);
         }
 
     private:
         uint32_t m_orientation = 0;
         uint32_t m_y_flip = 0;
         unsigned int m_vao = 0;
-        unsigned int m_vbo = 0;
-        unsigned int m_ebo = 0;
+        std::shared_ptr<ort_quad_buffers> m_buffers;
     };
 
     const float ort_frame_surface_handler::vertices[2][ort_frame_surface_handler::v_size][5 * 4] =
@@ -202,11 +258,28 @@ const char* ps_default_base =
     }};
 } // bnb
 
-EAGLContext* m_GLContext{nullptr};
-
 namespace bnb
 {
-    offscreen_render_target::offscreen_render_target() {}
+    namespace
+    {
+        std::mutex share_group_mutex;
+        // the group lives as long as one of its contexts
+        __weak EAGLSharegroup* share_group{nil};
+
+        // a frame the GPU has not finished by then is reported failed by when_rendered, it is never read
+        constexpr GLuint64 max_fence_wait_ns = 1'000'000'000;
+
+        bool has_size(CVPixelBufferRef buffer, size_t width, size_t height)
+        {
+            return buffer != nullptr && CVPixelBufferGetWidth(buffer) == width && CVPixelBufferGetHeight(buffer) == height;
+        }
+    } // namespace
+
+    offscreen_render_target::offscreen_render_target()
+        : m_pixelBufferPool(makePixelBufferPool(4))
+        , m_yuvPool(std::make_shared<frame_buffer_pool>(std::make_shared<heap_frame_buffer_allocator>(1)))
+    {
+    }
     offscreen_render_target::~offscreen_render_target() {}
 
     void offscreen_render_target::init(int32_t width, int32_t height)
@@ -225,10 +298,18 @@ namespace bnb
     }
 
     void offscreen_render_target::deinit(){
+        if (m_fenceQueue != nil) {
+            // the waits still running call back into the consumer, none of them outlives the render target
+            dispatch_sync(m_fenceQueue, ^{});
+            m_fenceQueue = nil;
+            m_fenceContext = nil;
+        }
         activate_context();
 
         m_program.reset();
         m_frameSurfaceHandler.reset();
+        m_yuvReadback.reset();
+        m_nv12Renderer.reset();
         if (m_videoTextureCache) {
             CFRelease(m_videoTextureCache);
             m_videoTextureCache = nullptr;
@@ -236,6 +317,7 @@ namespace bnb
         cleanupRenderBuffers();
 
         deactivate_context();
+        m_GLContext = nil;
     }
 
     void offscreen_render_target::activate_context()
@@ -245,109 +327,317 @@ namespace bnb
                 [EAGLContext setCurrentContext:m_GLContext];
             } else {
                 NSLog(@"Error: The OpenGLES context has not been created yet");
+                return;
             }
         }
+        gl::context_info::bind_state(&m_glState);
     }
 
     void offscreen_render_target::deactivate_context()
     {
+        if (m_batch_depth > 0) {
+            return;
+        }
         if ([EAGLContext currentContext] == m_GLContext) {
             [EAGLContext setCurrentContext:nil];
+            gl::context_info::bind_state(nullptr);
         }
     }
 
     void offscreen_render_target::prepare_rendering()
     {
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer));
-        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                       CVOpenGLESTextureGetTarget(m_offscreenRenderTexture),
-                                       CVOpenGLESTextureGetName(m_offscreenRenderTexture), 0));
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-            std::cout << "[ERROR] Failed to make complete framebuffer object " << status << std::endl;
+        m_frame_start = std::chrono::steady_clock::now();
+        auto& state = gl::context_info::instance().state();
+        // the SDK has drawn since the last call
+        state.invalidate();
+        if (m_slots.size() != m_ring_size) {
+            cleanupRing();
+            setupRing();
+        }
+        m_current = acquireSlot();
+        ++m_frames;
+
+        auto& slot = m_slots[m_current];
+        slot.width = m_width;
+        slot.height = m_height;
+        state.bind_framebuffer(m_framebuffer);
+        if (!state.attach_color_texture(CVOpenGLESTextureGetTarget(slot.texture),
+                                        CVOpenGLESTextureGetName(slot.texture))) {
+            std::cout << "[ERROR] Failed to make complete framebuffer object " << glCheckFramebufferStatus(GL_FRAMEBUFFER) << std::endl;
             return;
         }
+        state.viewport(0, 0, GLsizei(m_width), GLsizei(m_height));
     }
 
     void offscreen_render_target::surface_changed(int32_t width, int32_t height)
     {
+        if (m_width == uint32_t(width) && m_height == uint32_t(height)) {
+            return;
+        }
+        ++m_resizes;
         m_width = width;
         m_height = height;
 
-        cleanupRenderBuffers();
-        setupRenderBuffers();
+        // the render targets have the frame size exactly, they are handed out zero-copy as they are.
+        // The pool keeps the released ones, a rotation back to the previous size or a quality step
+        // back gets them again instead of new surfaces
+        const uint64_t misses = m_pixelBufferPool->stats().misses;
+        cleanupRing();
+        setupRing();
+        if (m_pixelBufferPool->stats().misses != misses) {
+            ++m_reallocations;
+        }
+        // the cache keeps the released textures and thus the pixel buffers alive until flushed
+        CVOpenGLESTextureCacheFlush(m_videoTextureCache, 0);
     }
 
     void offscreen_render_target::orient_image(bnb::oep::interfaces::rotation orientation)
     {
-        glFlush();
-        if (orientation != bnb::oep::interfaces::rotation::deg0) {
-            if (m_prev_orientation != orientation) {
-                if (m_offscreenPostProcessingPixelBuffer != nullptr) {
-                    cleanPostProcessRenderingTargets();
-                }
-                m_prev_orientation = orientation;
-            }
+        BNB_PROFILE_STAGE(pipeline_stage::orient_image);
+
+        auto& slot = m_slots[m_current];
+        const auto [output_width, output_height] = outputSize();
+        const bool scaled = output_width != m_width || output_height != m_height;
+        const bool rotated = m_orientation_strategy == orientation_strategy::gpu_pass && orientation != bnb::oep::interfaces::rotation::deg0;
+        if (!rotated && !scaled) {
+            // get_image returns the unrotated render target
+            renderOutputFormat(slot);
+            finishFrame(slot);
+            return;
+        }
+        // cpu_fused and in_render rotate elsewhere, the pass only scales the frame for them
+        auto [width, height] = getWidthHeight(rotated ? orientation : bnb::oep::interfaces::rotation::deg0);
+        if (slot.post_buffer != nullptr && !has_size(slot.post_buffer, width, height)) {
+            cleanPostProcessRenderingTargets(slot);
+        }
+        if (slot.post_buffer == nullptr) {
+            setupOffscreenPostProcessingRenderTarget(slot, width, height);
+        }
+        slot.width = width;
+        slot.height = height;
+
+        auto& state = gl::context_info::instance().state();
+        // the SDK has drawn since prepare_rendering
+        state.invalidate();
+        preparePostProcessingRendering(slot);
+        // not unused after the draw, the SDK binds its own programs
+        m_program->use();
+        if (rotated) {
+            m_program->set_uniform("uTexScale", 1.0f, 1.0f);
+            m_program->set_uniform("uTexOffset", 0.0f, 0.0f);
+            m_frameSurfaceHandler->set_orientation(orientation);
+        } else {
+            // the deg0 quad turns the frame upside down, a scaled only frame is mirrored back
+            m_program->set_uniform("uTexScale", 1.0f, -1.0f);
+            m_program->set_uniform("uTexOffset", 0.0f, 1.0f);
+            m_frameSurfaceHandler->set_orientation(bnb::oep::interfaces::rotation::deg0);
+        }
+        m_frameSurfaceHandler->set_y_flip(false);
+        m_frameSurfaceHandler->draw();
+        slot.oriented = true;
+        renderOutputFormat(slot);
+        finishFrame(slot);
+    }
 
-            if (m_offscreenPostProcessingPixelBuffer == nullptr) {
-                setupOffscreenPostProcessingPixelBuffer(orientation);
-                setupOffscreenPostProcessingRenderTarget(orientation);
-            }
+    void offscreen_render_target::renderOutputFormat(render_slot& slot)
+    {
+        image::yuv_format yuv;
+        if (!image::to_yuv_format(m_output_format, yuv)) {
+            return;
+        }
+        const auto texture = slot.oriented ? slot.post_texture : slot.texture;
+        const auto buffer = slot.oriented ? slot.post_buffer : slot.buffer;
+        const auto width = slot.width;
+        const auto height = slot.height;
+        if (width % 2 != 0 || height % 2 != 0) {
+            std::cout << "[ERROR] NV12 output needs an even frame size, the frame stays BGRA" << std::endl;
+            return;
+        }
+        if (slot.yuv_buffer != nullptr
+            && (!has_size(slot.yuv_buffer, width, height) || CVPixelBufferGetPixelFormatType(slot.yuv_buffer) != yuvPixelFormat(yuv))) {
+            cleanYuvRenderTarget(slot);
+        }
+        if (slot.yuv_buffer == nullptr) {
+            setupYuvRenderTarget(slot, width, height, yuv);
+        }
+        if (m_nv12Renderer == nullptr) {
+            m_nv12Renderer = std::make_unique<gl::nv12_renderer>();
+        }
 
-            preparePostProcessingRendering(orientation);
-            m_program->use();
-            m_frameSurfaceHandler->set_orientation(orientation);
-            m_frameSurfaceHandler->set_y_flip(false);
-            // Call once for perf
-            m_frameSurfaceHandler->update_vertices_buffer();
-            m_frameSurfaceHandler->draw();
-            m_program->unuse();
-            m_oriented = true;
-            glFlush();
+        auto& state = gl::context_info::instance().state();
+        // the SDK has drawn since prepare_rendering unless the rotation pass ran
+        state.invalidate();
+        slot.yuv = m_nv12Renderer->draw(CVOpenGLESTextureGetTarget(texture), CVOpenGLESTextureGetName(texture),
+                                        static_cast<int32_t>(width), static_cast<int32_t>(height), yuv,
+                                        CVOpenGLESTextureGetTarget(slot.y_texture), CVOpenGLESTextureGetName(slot.y_texture),
+                                        CVOpenGLESTextureGetTarget(slot.uv_texture), CVOpenGLESTextureGetName(slot.uv_texture));
+        if (!slot.yuv) {
+            std::cout << "[ERROR] Failed to render the NV12 planes, the frame stays BGRA" << std::endl;
         }
     }
 
+    void offscreen_render_target::finishFrame(render_slot& slot)
+    {
+        // one fence and one flush per frame, after the last draw into the frame
+        if (slot.fence != nullptr) {
+            glDeleteSync(slot.fence);
+        }
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+
     pixel_buffer_sptr offscreen_render_target::read_current_buffer(bnb::oep::interfaces::image_format format)
     {
-        // Not implemented. See conversion in BNBOffscreenEffectPlayer.
-        return nullptr;
+        BNB_PROFILE_STAGE(pipeline_stage::read_texture);
+
+        image::yuv_format yuv;
+        if (!image::to_yuv_format(format, yuv)) {
+            // RGB output goes through get_current_buffer_texture, the IOSurface needs no readback
+            return nullptr;
+        }
+        const auto& slot = m_slots[m_current];
+        const auto texture = slot.oriented ? slot.post_texture : slot.texture;
+        const auto width = static_cast<int32_t>(slot.width);
+        const auto height = static_cast<int32_t>(slot.height);
+        if (!gl::yuv_readback::supports(width, height, yuv.layout)) {
+            return nullptr;
+        }
+        if (m_yuvReadback == nullptr) {
+            m_yuvReadback = std::make_unique<gl::yuv_readback>();
+        }
+
+        auto& state = gl::context_info::instance().state();
+        // the SDK may have drawn since orient_image
+        state.invalidate();
+        m_yuvReadback->convert(CVOpenGLESTextureGetTarget(texture), CVOpenGLESTextureGetName(texture), width, height, yuv, static_cast<uint64_t>(format));
+
+        // the previous frame, finished by the GPU while this one rendered
+        pixel_buffer_sptr result;
+        if (m_yuvReadback->pending() == m_yuvReadback->depth()) {
+            m_yuvReadback->consume(true, [this, &result](const gl::yuv_readback::frame& frame) {
+                result = makeYuvBuffer(frame);
+            });
+        }
+        return result;
+    }
+
+    pixel_buffer_sptr offscreen_render_target::flush_read_buffer()
+    {
+        pixel_buffer_sptr result;
+        if (m_yuvReadback != nullptr) {
+            m_yuvReadback->consume(true, [this, &result](const gl::yuv_readback::frame& frame) {
+                result = makeYuvBuffer(frame);
+            });
+        }
+        return result;
+    }
+
+    pixel_buffer_sptr offscreen_render_target::makeYuvBuffer(const gl::yuv_readback::frame& frame)
+    {
+        const frame_buffer_desc desc{static_cast<uint32_t>(frame.size), 1, 0, 0};
+        auto* storage = static_cast<uint8_t*>(m_yuvPool->acquire(desc));
+        if (storage == nullptr) {
+            return nullptr;
+        }
+        std::memcpy(storage, frame.data, frame.size);
+        std::shared_ptr<uint8_t> owner(storage, [pool = m_yuvPool, desc](uint8_t* p) {
+            pool->release(p, desc);
+        });
+
+        // the planes are back to back with tight strides, see yuv_readback
+        using ns = bnb::oep::interfaces::pixel_buffer;
+        const size_t luma = static_cast<size_t>(frame.width) * frame.height;
+        std::vector<ns::plane_data> planes;
+        planes.push_back({ns::plane_sptr(owner, storage), luma, frame.width});
+        if (frame.format.layout == image::yuv_layout::nv12) {
+            planes.push_back({ns::plane_sptr(owner, storage + luma), luma / 2, frame.width});
+        } else {
+            planes.push_back({ns::plane_sptr(owner, storage + luma), luma / 4, frame.width / 2});
+            planes.push_back({ns::plane_sptr(owner, storage + luma + luma / 4), luma / 4, frame.width / 2});
+        }
+        return ns::create(planes, static_cast<bnb::oep::interfaces::image_format>(frame.tag), frame.width, frame.height);
     }
 
     rendered_texture_t offscreen_render_target::get_current_buffer_texture() {
+        BNB_PROFILE_STAGE(pipeline_stage::read_texture);
         return get_image();
     }
 
+    void offscreen_render_target::set_orientation_strategy(orientation_strategy strategy)
+    {
+        m_orientation_strategy = strategy;
+    }
+
+    bool offscreen_render_target::set_output_format(bnb::oep::interfaces::image_format format)
+    {
+        image::yuv_format yuv;
+        const bool native = format == bnb::oep::interfaces::image_format::bpc8_bgra
+                            || (image::to_yuv_format(format, yuv) && yuv.layout == image::yuv_layout::nv12);
+        m_output_format = native ? format : bnb::oep::interfaces::image_format::bpc8_bgra;
+        return native;
+    }
+
+    void offscreen_render_target::begin_batch()
+    {
+        ++m_batch_depth;
+    }
+
+    void offscreen_render_target::end_batch()
+    {
+        --m_batch_depth;
+    }
+
+    void offscreen_render_target::set_ring_size(size_t size)
+    {
+        m_ring_size = std::clamp<size_t>(size, 2, 4);
+        m_frames = 0;
+        m_exhausted = 0;
+        m_fence_waits = 0;
+        m_resizes = 0;
+        m_reallocations = 0;
+    }
+
+    void offscreen_render_target::set_output_size(uint32_t width, uint32_t height)
+    {
+        m_output_size = uint64_t(width) << 32 | height;
+    }
+
+    uint64_t offscreen_render_target::last_frame_time_ns() const
+    {
+        return m_last_frame_ns;
+    }
+
+    render_ring_stats offscreen_render_target::ring_stats() const
+    {
+        return {m_ring_size, m_frames, m_exhausted, m_fence_waits, m_resizes, m_reallocations};
+    }
+
     void offscreen_render_target::setupRenderBuffers()
     {
         GL_CALL(glGenFramebuffers(1, &m_framebuffer));
         GL_CALL(glGenFramebuffers(1, &m_postProcessingFramebuffer));
 
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer));
-
-        setupOffscreenPixelBuffer();
-        setupOffscreenRenderTarget();
+        setupRing();
     }
 
     void offscreen_render_target::cleanupRenderBuffers()
     {
-        if (m_offscreenRenderPixelBuffer) {
-            CFRelease(m_offscreenRenderPixelBuffer);
-            m_offscreenRenderPixelBuffer = nullptr;
-        }
-        if (m_offscreenRenderTexture) {
-            CFRelease(m_offscreenRenderTexture);
-            m_offscreenRenderTexture = nullptr;
-        }
+        cleanupRing();
+        auto& state = gl::context_info::instance().state();
         if (m_framebuffer != 0) {
+            state.forget_framebuffer(m_framebuffer);
             glDeleteFramebuffers(1, &m_framebuffer);
             m_framebuffer = 0;
         }
-        cleanPostProcessRenderingTargets();
         if (m_postProcessingFramebuffer != 0) {
+            state.forget_framebuffer(m_postProcessingFramebuffer);
             glDeleteFramebuffers(1, &m_postProcessingFramebuffer);
             m_postProcessingFramebuffer = 0;
         }
+        // The cache keeps the released textures and thus the pixel buffers alive until flushed
+        if (m_videoTextureCache) {
+            CVOpenGLESTextureCacheFlush(m_videoTextureCache, 0);
+        }
     }
 
     void offscreen_render_target::createContext()
@@ -356,18 +646,43 @@ namespace bnb
             return;
         }
             
-        m_GLContext = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES3];
-        if (m_GLContext == nil) {
-            NSLog(@"Unable to create an OpenGLES context. The GPUImage framework requires OpenGLES support to work.");
+        {
+            std::lock_guard<std::mutex> lock(share_group_mutex);
+            EAGLSharegroup* group = share_group;
+            m_GLContext = group != nil ? [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES3 sharegroup:group]
+                                       : [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES3];
+            if (m_GLContext == nil) {
+                NSLog(@"Unable to create an OpenGLES context. The GPUImage framework requires OpenGLES support to work.");
+                return;
+            }
+            share_group = m_GLContext.sharegroup;
         }
         [EAGLContext setCurrentContext:m_GLContext];
+        gl::context_info::bind_state(&m_glState);
+
+        // linked programs survive restarts in the app caches, the OS may purge them at any time
+        NSString* caches = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject;
+        NSString* programs = [caches stringByAppendingPathComponent:@"bnb_gl_programs"];
+        if ([[NSFileManager defaultManager] createDirectoryAtPath:programs withIntermediateDirectories:YES attributes:nil error:nil]) {
+            gl::program_cache::instance().set_directory(programs.UTF8String);
+        }
     }
 
     std::tuple<int, int> offscreen_render_target::getWidthHeight(bnb::oep::interfaces::rotation orientation)
     {
-        auto width = orientation == bnb::oep::interfaces::rotation::deg90 || orientation == bnb::oep::interfaces::rotation::deg270 ? m_height : m_width;
-        auto height = orientation == bnb::oep::interfaces::rotation::deg90 || orientation == bnb::oep::interfaces::rotation::deg270  ? m_width : m_height;
-        return {width, height};
+        const auto [output_width, output_height] = outputSize();
+        auto width = orientation == bnb::oep::interfaces::rotation::deg90 || orientation == bnb::oep::interfaces::rotation::deg270 ? output_height : output_width;
+        auto height = orientation == bnb::oep::interfaces::rotation::deg90 || orientation == bnb::oep::interfaces::rotation::deg270  ? output_width : output_height;
+        return {int(width), int(height)};
+    }
+
+    std::tuple<uint32_t, uint32_t> offscreen_render_target::outputSize() const
+    {
+        const uint64_t size = m_output_size;
+        if (size == 0) {
+            return {m_width, m_height};
+        }
+        return {uint32_t(size >> 32), uint32_t(size & 0xffffffffu)};
     }
 
     void offscreen_render_target::setupTextureCache()
@@ -384,51 +699,103 @@ namespace bnb
         }
     }
 
-    void offscreen_render_target::setupOffscreenPixelBuffer()
+    void offscreen_render_target::setupRing()
     {
-        CFDictionaryRef empty = CFDictionaryCreate(kCFAllocatorDefault, NULL, NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        CFMutableDictionaryRef attrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        CFDictionarySetValue(attrs, kCVPixelBufferIOSurfacePropertiesKey, empty);
-        CVReturn err = CVPixelBufferCreate(kCFAllocatorDefault, m_width, m_height, kCVPixelFormatType_32BGRA, attrs, &m_offscreenRenderPixelBuffer);
+        const size_t size = m_ring_size;
+        // the ring with its post processing and YUV targets at two sizes, so a rotation or a quality step
+        // back finds the previous targets in the pool, plus fresh buffers for an exhausted ring
+        m_pixelBufferPool->set_high_water_mark(2 * 3 * size + 2);
+        m_slots.resize(size);
+        for (auto& slot : m_slots) {
+            setupOffscreenRenderTarget(slot);
+        }
+        m_current = size - 1;
+    }
 
-        if (err != noErr) {
+    void offscreen_render_target::cleanupRing()
+    {
+        for (auto& slot : m_slots) {
+            cleanupOffscreenRenderTarget(slot);
+        }
+        m_slots.clear();
+        m_current = 0;
+    }
+
+    void offscreen_render_target::setupOffscreenRenderTarget(render_slot& slot)
+    {
+        slot.buffer = createPixelBuffer(m_width, m_height, kCVPixelFormatType_32BGRA, m_pixelBufferPool);
+
+        if (slot.buffer == nullptr) {
             @throw [NSException exceptionWithName:NSInternalInconsistencyException
                             reason:@"Cannot create offscreen pixel buffer"
                             userInfo:nil];
         }
-        CFRelease(empty);
-        CFRelease(attrs);
-    }
 
-    void offscreen_render_target::setupOffscreenRenderTarget()
-    {
-        CVReturn err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, m_offscreenRenderPixelBuffer, NULL, GL_TEXTURE_2D, GL_RGBA, (GLsizei) m_width, (GLsizei) m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0, &m_offscreenRenderTexture);
+        CVReturn err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, slot.buffer, NULL, GL_TEXTURE_2D, GL_RGBA, (GLsizei) m_width, (GLsizei) m_height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, 0, &slot.texture);
 
         if (err != noErr) {
             @throw [NSException exceptionWithName:NSInternalInconsistencyException
                     reason:@"Cannot create GL texture from pixel buffer"
                     userInfo:nil];
         }
+        slot.leases = std::make_shared<std::atomic<int32_t>>(0);
     }
 
-    void offscreen_render_target::setupOffscreenPostProcessingPixelBuffer(bnb::oep::interfaces::rotation orientation){
-        auto [width, height] = getWidthHeight(orientation);
-        CFDictionaryRef empty = CFDictionaryCreate(kCFAllocatorDefault, NULL, NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        CFMutableDictionaryRef attrs = CFDictionaryCreateMutable(kCFAllocatorDefault, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        CFDictionarySetValue(attrs, kCVPixelBufferIOSurfacePropertiesKey, empty);
-        CVReturn err = CVPixelBufferCreate(kCFAllocatorDefault, width, height, kCVPixelFormatType_32BGRA, attrs, &m_offscreenPostProcessingPixelBuffer);
-        if (err != noErr) {
+    void offscreen_render_target::cleanupOffscreenRenderTarget(render_slot& slot)
+    {
+        if (slot.fence != nullptr) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.buffer) {
+            CFRelease(slot.buffer);
+            slot.buffer = nullptr;
+        }
+        if (slot.texture) {
+            // the texture cache hands out the name again
+            gl::context_info::instance().state().forget_texture(CVOpenGLESTextureGetName(slot.texture));
+            CFRelease(slot.texture);
+            slot.texture = nullptr;
+        }
+        cleanPostProcessRenderingTargets(slot);
+        cleanYuvRenderTarget(slot);
+        slot.oriented = false;
+        slot.yuv = false;
+    }
+
+    bool offscreen_render_target::isSlotFree(const render_slot& slot) const
+    {
+        return slot.leases->load(std::memory_order_acquire) == 0;
+    }
+
+    size_t offscreen_render_target::acquireSlot()
+    {
+        for (size_t i = 1; i <= m_slots.size(); ++i) {
+            const auto index = (m_current + i) % m_slots.size();
+            if (isSlotFree(m_slots[index])) {
+                m_slots[index].oriented = false;
+                m_slots[index].yuv = false;
+                return index;
+            }
+        }
+        // the consumer keeps the old buffers of the slot, rendering does not wait for it
+        ++m_exhausted;
+        const auto index = (m_current + 1) % m_slots.size();
+        cleanupOffscreenRenderTarget(m_slots[index]);
+        setupOffscreenRenderTarget(m_slots[index]);
+        return index;
+    }
+
+    void offscreen_render_target::setupOffscreenPostProcessingRenderTarget(render_slot& slot, size_t width, size_t height)
+    {
+        slot.post_buffer = createPixelBuffer(width, height, kCVPixelFormatType_32BGRA, m_pixelBufferPool);
+        if (slot.post_buffer == nullptr) {
             @throw [NSException exceptionWithName:NSInternalInconsistencyException
                                            reason:@"Cannot create offscreen pixel buffer 2 for the class BNBOffscreenEffectPlayer"
                                          userInfo:nil];
         }
-        CFRelease(empty);
-        CFRelease(attrs);
-    }
 
-    void offscreen_render_target::setupOffscreenPostProcessingRenderTarget(bnb::oep::interfaces::rotation orientation){
-        auto [width, height] = getWidthHeight(orientation);
-        CVReturn err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, m_offscreenPostProcessingPixelBuffer, NULL, GL_TEXTURE_2D, GL_RGBA, (GLsizei) width, (GLsizei) height, GL_RGBA, GL_UNSIGNED_BYTE, 0, &m_offscreenPostProcessingRenderTexture);
+        CVReturn err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, slot.post_buffer, NULL, GL_TEXTURE_2D, GL_RGBA, (GLsizei) width, (GLsizei) height, GL_BGRA_EXT, GL_UNSIGNED_BYTE, 0, &slot.post_texture);
 
         if (err != noErr) {
             @throw [NSException exceptionWithName:NSInternalInconsistencyException
@@ -437,53 +804,139 @@ namespace bnb
         }
     }
 
-    void offscreen_render_target::cleanPostProcessRenderingTargets()
+    void offscreen_render_target::cleanPostProcessRenderingTargets(render_slot& slot)
     {
-        if (m_offscreenPostProcessingPixelBuffer) {
-            CFRelease(m_offscreenPostProcessingPixelBuffer);
-            m_offscreenPostProcessingPixelBuffer = nullptr;
+        if (slot.post_buffer) {
+            CFRelease(slot.post_buffer);
+            slot.post_buffer = nullptr;
         }
-        if (m_offscreenPostProcessingRenderTexture) {
-            CFRelease(m_offscreenPostProcessingRenderTexture);
-            m_offscreenPostProcessingRenderTexture = nullptr;
+        if (slot.post_texture) {
+            gl::context_info::instance().state().forget_texture(CVOpenGLESTextureGetName(slot.post_texture));
+            CFRelease(slot.post_texture);
+            slot.post_texture = nullptr;
         }
     }
 
-    void offscreen_render_target::preparePostProcessingRendering(bnb::oep::interfaces::rotation orientation)
+    void offscreen_render_target::setupYuvRenderTarget(render_slot& slot, size_t width, size_t height, const image::yuv_format& yuv)
     {
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, m_postProcessingFramebuffer));
-        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                       CVOpenGLESTextureGetTarget(m_offscreenPostProcessingRenderTexture),
-                                       CVOpenGLESTextureGetName(m_offscreenPostProcessingRenderTexture), 0));
+        slot.yuv_buffer = createPixelBuffer(width, height, yuvPixelFormat(yuv), m_pixelBufferPool);
+        if (slot.yuv_buffer == nullptr) {
+            @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                           reason:@"Cannot create the NV12 output pixel buffer"
+                                         userInfo:nil];
+        }
+        attachYCbCrMatrix(slot.yuv_buffer, yuv);
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-            std::cout << "[ERROR] Failed to make complete post processing framebuffer object " << status << std::endl;
-            return;
+        // the planes are rendered to as R8 and RG8 textures
+        CVReturn err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, slot.yuv_buffer, NULL, GL_TEXTURE_2D, GL_R8, (GLsizei) width, (GLsizei) height, GL_RED, GL_UNSIGNED_BYTE, 0, &slot.y_texture);
+        if (err == noErr) {
+            err = CVOpenGLESTextureCacheCreateTextureFromImage(kCFAllocatorDefault, m_videoTextureCache, slot.yuv_buffer, NULL, GL_TEXTURE_2D, GL_RG8, (GLsizei) width / 2, (GLsizei) height / 2, GL_RG, GL_UNSIGNED_BYTE, 1, &slot.uv_texture);
         }
+        if (err != noErr) {
+            @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                           reason:@"Cannot create GL textures from the NV12 output pixel buffer"
+                                         userInfo:nil];
+        }
+    }
 
-        auto width = CVPixelBufferGetWidth(m_offscreenPostProcessingPixelBuffer);
-        auto height = CVPixelBufferGetHeight(m_offscreenPostProcessingPixelBuffer);
+    void offscreen_render_target::cleanYuvRenderTarget(render_slot& slot)
+    {
+        auto& state = gl::context_info::instance().state();
+        for (auto* texture : {&slot.y_texture, &slot.uv_texture}) {
+            if (*texture) {
+                state.forget_texture(CVOpenGLESTextureGetName(*texture));
+                CFRelease(*texture);
+                *texture = nullptr;
+            }
+        }
+        if (slot.yuv_buffer) {
+            CFRelease(slot.yuv_buffer);
+            slot.yuv_buffer = nullptr;
+        }
+    }
 
-        GL_CALL(glViewport(0, 0, GLsizei(width), GLsizei(height)));
+    void offscreen_render_target::preparePostProcessingRendering(const render_slot& slot)
+    {
+        auto& state = gl::context_info::instance().state();
+        state.bind_framebuffer(m_postProcessingFramebuffer);
+        if (!state.attach_color_texture(CVOpenGLESTextureGetTarget(slot.post_texture),
+                                        CVOpenGLESTextureGetName(slot.post_texture))) {
+            std::cout << "[ERROR] Failed to make complete post processing framebuffer object " << glCheckFramebufferStatus(GL_FRAMEBUFFER) << std::endl;
+            return;
+        }
 
-        GL_CALL(glActiveTexture(GLenum(GL_TEXTURE0)));
+        state.viewport(0, 0, GLsizei(slot.width), GLsizei(slot.height));
+        state.active_texture(GL_TEXTURE0);
 
-        GL_CALL(glBindTexture(CVOpenGLESTextureGetTarget(m_offscreenRenderTexture), CVOpenGLESTextureGetName(m_offscreenRenderTexture)));
-        glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MIN_FILTER), GL_LINEAR);
-        glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MAG_FILTER), GL_LINEAR);
-        glTexParameterf(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_WRAP_S), GLfloat(GL_CLAMP_TO_EDGE));
-        glTexParameterf(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_WRAP_T), GLfloat(GL_CLAMP_TO_EDGE));
+        const GLenum target = CVOpenGLESTextureGetTarget(slot.texture);
+        state.bind_texture(target, CVOpenGLESTextureGetName(slot.texture));
+        // texture object state, set once per render texture
+        state.tex_parameter(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        state.tex_parameter(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
 
     void* offscreen_render_target::get_image()
     {
-        if (m_oriented) {
-            m_oriented = false;
-            CVPixelBufferRetain(m_offscreenPostProcessingPixelBuffer);
-            return (void*)m_offscreenPostProcessingPixelBuffer;
+        auto& slot = m_slots[m_current];
+        // the targets have the frame size, the IOSurface of the target is handed out as is
+        auto* buffer = slot.yuv ? slot.yuv_buffer : slot.oriented ? slot.post_buffer : slot.buffer;
+        // the lease keeps the pooled target of the slot as well, the pool hands it out again only after both
+        slot.leases->fetch_add(1, std::memory_order_relaxed);
+        CVPixelBufferRetain(buffer);
+        auto* lease = makeLeasedBuffer(buffer, [leases = slot.leases, buffer]() {
+            CVPixelBufferRelease(buffer);
+            leases->fetch_sub(1, std::memory_order_release);
+        });
+        return (void*)lease;
+    }
+
+    void offscreen_render_target::when_rendered(std::function<void(bool rendered)> done)
+    {
+        auto& slot = m_slots[m_current];
+        const auto frame_start = std::exchange(m_frame_start, {});
+        auto measure = [this, frame_start]() {
+            if (frame_start != std::chrono::steady_clock::time_point()) {
+                m_last_frame_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - frame_start).count();
+            }
+        };
+        GLsync fence = std::exchange(slot.fence, nullptr);
+        // a frame finished already goes out right away, unless an earlier one still waits on the queue
+        if (fence == nullptr || (m_pending_fence_waits == 0 && glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED)) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+            }
+            measure();
+            done(true);
+            return;
+        }
+
+        ++m_fence_waits;
+        if (m_fenceQueue == nil) {
+            m_fenceQueue = dispatch_queue_create("com.banuba.oep.fence", DISPATCH_QUEUE_SERIAL);
+            // fences are shared by the contexts of a share group
+            m_fenceContext = [[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES3 sharegroup:m_GLContext.sharegroup];
         }
-        CVPixelBufferRetain(m_offscreenRenderPixelBuffer);
-        return (void*)m_offscreenRenderPixelBuffer;
+        ++m_pending_fence_waits;
+        EAGLContext* context = m_fenceContext;
+        auto wait = [this, fence, context, measure, done = std::move(done)]() {
+            [EAGLContext setCurrentContext:context];
+            // finishFrame flushed the commands of the frame on the render thread
+            const GLenum status = glClientWaitSync(fence, 0, max_fence_wait_ns);
+            glDeleteSync(fence);
+            [EAGLContext setCurrentContext:nil];
+            const bool rendered = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+            if (rendered) {
+                measure();
+            } else {
+                std::cout << "[ERROR] The GPU did not finish the frame in time, it is not handed out" << std::endl;
+            }
+            done(rendered);
+            --m_pending_fence_waits;
+        };
+        dispatch_async(m_fenceQueue, ^{
+            wait();
+        });
     }
 } // bnb
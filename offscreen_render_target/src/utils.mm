@@ -1,10 +1,155 @@
 #include "utils.h"
 
 #import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
 #import <mach-o/dyld.h>
 
+/* attached to a lease of a pooled pixel buffer, the lease releases it when it is destroyed */
+@interface BNBPixelBufferLease : NSObject
+- (instancetype)initWithRelease:(std::function<void()>)onRelease;
+@end
+
+@implementation BNBPixelBufferLease
+{
+    std::function<void()> _onRelease;
+}
+
+- (instancetype)initWithRelease:(std::function<void()>)onRelease
+{
+    if (self = [super init]) {
+        _onRelease = std::move(onRelease);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_onRelease) {
+        _onRelease();
+    }
+}
+@end
+
 namespace bnb
 {
+    namespace
+    {
+        const CFStringRef lease_attachment_key = CFSTR("com.banuba.oep.lease");
+    } // namespace
+
+    void* cv_pixel_buffer_allocator::allocate(const frame_buffer_desc& desc)
+    {
+        NSMutableDictionary* pixelAttributes = [NSMutableDictionary dictionaryWithObject:@{} forKey:(id) kCVPixelBufferIOSurfacePropertiesKey];
+        if (desc.stride != 0) {
+            pixelAttributes[(id) kCVPixelBufferBytesPerRowAlignmentKey] = @(desc.stride);
+        }
+        CVPixelBufferRef pixelBuffer = NULL;
+        auto result = CVPixelBufferCreate(
+            kCFAllocatorDefault,
+            desc.width,
+            desc.height,
+            desc.format,
+            (__bridge CFDictionaryRef)(pixelAttributes),
+            &pixelBuffer);
+        if (result != kCVReturnSuccess) {
+            return nullptr;
+        }
+        return pixelBuffer;
+    }
+
+    void cv_pixel_buffer_allocator::deallocate(void* buffer)
+    {
+        CVPixelBufferRelease(static_cast<CVPixelBufferRef>(buffer));
+    }
+
+    std::shared_ptr<frame_buffer_pool> makePixelBufferPool(size_t high_water_mark)
+    {
+        return std::make_shared<frame_buffer_pool>(std::make_shared<cv_pixel_buffer_allocator>(), high_water_mark);
+    }
+
+    CVPixelBufferRef makeLeasedBuffer(CVPixelBufferRef pixelBuffer, std::function<void()> onRelease)
+    {
+        IOSurfaceRef surface = CVPixelBufferGetIOSurface(pixelBuffer);
+        CVPixelBufferRef lease = nullptr;
+        if (surface == nullptr || CVPixelBufferCreateWithIOSurface(kCFAllocatorDefault, surface, nullptr, &lease) != kCVReturnSuccess) {
+            onRelease();
+            return nullptr;
+        }
+        // the YCbCr matrix and the color space
+        CVBufferPropagateAttachments(pixelBuffer, lease);
+        // the only reference to the token is the attachment, it goes with the lease
+        BNBPixelBufferLease* token = [[BNBPixelBufferLease alloc] initWithRelease:std::move(onRelease)];
+        CVBufferSetAttachment(lease, lease_attachment_key, (__bridge CFTypeRef) token, kCVAttachmentMode_ShouldNotPropagate);
+        return lease;
+    }
+
+    CVPixelBufferRef createPixelBuffer(size_t width, size_t height, OSType format, const std::shared_ptr<frame_buffer_pool>& pool)
+    {
+        frame_buffer_desc desc{static_cast<uint32_t>(width), static_cast<uint32_t>(height), format, 0};
+        if (pool == nullptr) {
+            cv_pixel_buffer_allocator allocator;
+            return static_cast<CVPixelBufferRef>(allocator.allocate(desc));
+        }
+
+        void* pooled = pool->acquire(desc);
+        if (pooled == nullptr) {
+            return nullptr;
+        }
+        // a lease outliving the pool leaves the surface to the lease, the pool has dropped its buffer already
+        std::weak_ptr<frame_buffer_pool> weak_pool = pool;
+        return makeLeasedBuffer(static_cast<CVPixelBufferRef>(pooled), [weak_pool, pooled, desc]() {
+            if (auto owner = weak_pool.lock()) {
+                owner->release(pooled, desc);
+            }
+        });
+    }
+
+    namespace
+    {
+        /* The pixel buffer must be locked */
+        image::yuv_planes yuvPlanes(CVPixelBufferRef pixelBuffer, const image::yuv_format& yuv)
+        {
+            image::yuv_planes planes;
+            planes.y = static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0));
+            planes.y_stride = static_cast<int32_t>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0));
+            planes.u = static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1));
+            planes.u_stride = static_cast<int32_t>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1));
+            if (yuv.layout == image::yuv_layout::i420) {
+                planes.v = static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 2));
+                planes.v_stride = static_cast<int32_t>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 2));
+            }
+            return planes;
+        }
+
+        /* The GL pass samples the bottom-up render texture, in memory terms it is a mirrored rotation */
+        image::orientation glPassOrientation(bnb::oep::interfaces::rotation orientation)
+        {
+            using ns = bnb::oep::interfaces::rotation;
+            switch (orientation) {
+                case ns::deg0:   return {image::rotation::deg0, false};
+                case ns::deg90:  return {image::rotation::deg90, true};
+                case ns::deg180: return {image::rotation::deg0, true};
+                case ns::deg270: return {image::rotation::deg270, true};
+            }
+            return {};
+        }
+    } // namespace
+
+    OSType yuvPixelFormat(const image::yuv_format& yuv)
+    {
+        const bool video = yuv.range == image::yuv_range::video;
+        return yuv.layout == image::yuv_layout::nv12
+                   ? (video ? kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange : kCVPixelFormatType_420YpCbCr8BiPlanarFullRange)
+                   : (video ? kCVPixelFormatType_420YpCbCr8Planar : kCVPixelFormatType_420YpCbCr8PlanarFullRange);
+    }
+
+    void attachYCbCrMatrix(CVPixelBufferRef pixelBuffer, const image::yuv_format& yuv)
+    {
+        CVBufferSetAttachment(pixelBuffer, kCVImageBufferYCbCrMatrixKey,
+                              yuv.matrix == image::yuv_matrix::bt709 ? kCVImageBufferYCbCrMatrix_ITU_R_709_2 : kCVImageBufferYCbCrMatrix_ITU_R_601_4,
+                              kCVAttachmentMode_ShouldPropagate);
+    }
+
     void runOnMainQueue(std::function<void()> f)
     {
         if ([NSThread isMainThread]) {
@@ -16,81 +161,42 @@ namespace bnb
         }
     }
 
-    CVPixelBufferRef convertBGRAtoNV12(CVPixelBufferRef inputPixelBuffer, vrange range)
+    CVPixelBufferRef convertBGRAtoNV12(CVPixelBufferRef inputPixelBuffer, vrange range, const std::shared_ptr<frame_buffer_pool>& pool)
     {
-        CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
-        unsigned char* baseAddress = (unsigned char*) CVPixelBufferGetBaseAddress(inputPixelBuffer);
+        using ns = bnb::oep::interfaces::image_format;
+        return convertBGRAtoYUV(inputPixelBuffer, range == vrange::video_range ? ns::nv12_bt601_video : ns::nv12_bt601_full, pool);
+    }
+
+    CVPixelBufferRef convertBGRAtoYUV(CVPixelBufferRef inputPixelBuffer, bnb::oep::interfaces::image_format format, const std::shared_ptr<frame_buffer_pool>& pool)
+    {
+        image::yuv_format yuv;
+        if (!image::to_yuv_format(format, yuv)) {
+            return nullptr;
+        }
+
         auto width = CVPixelBufferGetWidth(inputPixelBuffer);
         auto height = CVPixelBufferGetHeight(inputPixelBuffer);
         auto bytesPerRow = CVPixelBufferGetBytesPerRow(inputPixelBuffer);
 
-        NSDictionary* pixelAttributes = @{(id) kCVPixelBufferIOSurfacePropertiesKey: @{}};
-        CVPixelBufferRef pixelBuffer = NULL;
-        auto result = CVPixelBufferCreate(
-            kCFAllocatorDefault,
-            width,
-            height,
-            kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange,
-            (__bridge CFDictionaryRef)(pixelAttributes),
-            &pixelBuffer);
-        if (result != kCVReturnSuccess || pixelBuffer == NULL) {
+        CVPixelBufferRef pixelBuffer = createPixelBuffer(width, height, yuvPixelFormat(yuv), pool);
+        if (pixelBuffer == NULL) {
             return nullptr;
         }
+        attachYCbCrMatrix(pixelBuffer, yuv);
 
+        CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
         CVPixelBufferLockBaseAddress(pixelBuffer, 0);
-        void* yDestPlane = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0);
-        size_t yWidth = CVPixelBufferGetWidthOfPlane(pixelBuffer, 0);
-        size_t yHeight = CVPixelBufferGetHeightOfPlane(pixelBuffer, 0);
-        size_t yBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0);
 
-        void* uvDestPlane = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1);
-        size_t uvWidth = CVPixelBufferGetWidthOfPlane(pixelBuffer, 1);
-        size_t uvHeight = CVPixelBufferGetHeightOfPlane(pixelBuffer, 1);
-        size_t uvBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1);
-
-        vImage_Buffer sourceBufferInfo = {
-            .width = static_cast<vImagePixelCount>(width),
-            .height = static_cast<vImagePixelCount>(height),
-            .rowBytes = bytesPerRow,
-            .data = baseAddress};
-        vImage_Buffer yBufferInfo = {
-            .width = yWidth,
-            .height = yHeight,
-            .rowBytes = yBytesPerRow,
-            .data = yDestPlane};
-        vImage_Buffer uvBufferInfo = {
-            .width = uvWidth,
-            .height = uvHeight,
-            .rowBytes = uvBytesPerRow,
-            .data = uvDestPlane};
-
-        const uint8_t permuteMap[4] = {3, 0, 1, 2};
-
-        static vImage_ARGBToYpCbCr info;
-        static dispatch_once_t onceToken;
-        dispatch_once(&onceToken, ^{
-          vImage_YpCbCrPixelRange pixelRange;
-          if (range == vrange::video_range) {
-              pixelRange = (vImage_YpCbCrPixelRange){16, 128, 235, 240, 255, 0, 255, 1};
-          } else if (range == vrange::full_range) {
-              pixelRange = (vImage_YpCbCrPixelRange){0, 128, 255, 255, 255, 1, 255, 0};
-          }
-          vImageConvert_ARGBToYpCbCr_GenerateConversion(
-              kvImage_ARGBToYpCbCrMatrix_ITU_R_601_4,
-              &pixelRange,
-              &info,
-              kvImageARGB8888,
-              kvImage420Yp8_CbCr8,
-              0);
-        });
+        image::yuv_planes planes = yuvPlanes(pixelBuffer, yuv);
 
-        vImageConvert_ARGB8888To420Yp8_CbCr8(
-            &sourceBufferInfo,
-            &yBufferInfo,
-            &uvBufferInfo,
-            &info,
-            permuteMap,
-            kvImageDoNotTile);
+        image::rgb_to_yuv(
+            static_cast<const uint8_t*>(CVPixelBufferGetBaseAddress(inputPixelBuffer)),
+            static_cast<int32_t>(bytesPerRow),
+            image::rgb_layout::bgra,
+            static_cast<int32_t>(width),
+            static_cast<int32_t>(height),
+            planes,
+            yuv);
 
         CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
 
@@ -99,27 +205,20 @@ namespace bnb
         return pixelBuffer;
     }
 
-    CVPixelBufferRef convertBGRAtoRGBA(CVPixelBufferRef inputPixelBuffer)
+    CVPixelBufferRef convertBGRAtoRGBA(CVPixelBufferRef inputPixelBuffer, const std::shared_ptr<frame_buffer_pool>& pool)
     {
-        CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
-        unsigned char* baseAddress = (unsigned char*) CVPixelBufferGetBaseAddress(inputPixelBuffer);
         auto width = CVPixelBufferGetWidth(inputPixelBuffer);
         auto height = CVPixelBufferGetHeight(inputPixelBuffer);
         auto bytesPerRow = CVPixelBufferGetBytesPerRow(inputPixelBuffer);
 
-        NSDictionary* pixelAttributes = @{(id) kCVPixelBufferIOSurfacePropertiesKey: @{}};
-        CVPixelBufferRef pixelBuffer = NULL;
-        auto result = CVPixelBufferCreate(
-            kCFAllocatorDefault,
-            width,
-            height,
-            kCVPixelFormatType_32BGRA,
-            (__bridge CFDictionaryRef)(pixelAttributes),
-            &pixelBuffer);
-        if (result != kCVReturnSuccess || pixelBuffer == NULL) {
+        CVPixelBufferRef pixelBuffer = createPixelBuffer(width, height, kCVPixelFormatType_32RGBA, pool);
+        if (pixelBuffer == NULL) {
             return nullptr;
         }
 
+        CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
+        unsigned char* baseAddress = (unsigned char*) CVPixelBufferGetBaseAddress(inputPixelBuffer);
+
         CVPixelBufferLockBaseAddress(pixelBuffer, 0);
         void* rgbOut = CVPixelBufferGetBaseAddress(pixelBuffer);
         size_t rgbOutWidth = CVPixelBufferGetWidthOfPlane(pixelBuffer, 0);
@@ -137,7 +236,7 @@ namespace bnb
             .rowBytes = rgbOutBytesPerRow,
             .data = rgbOut};
 
-        const uint8_t permuteMap[4] = {2, 1, 0, 3}; // Convert to BGRA pixel format
+        const uint8_t permuteMap[4] = {2, 1, 0, 3}; // Convert to RGBA pixel format
 
         vImagePermuteChannels_ARGB8888(&sourceBufferInfo, &outputBufferInfo, permuteMap, kvImageNoFlags);
 
@@ -147,4 +246,60 @@ namespace bnb
 
         return pixelBuffer;
     }
+
+    CVPixelBufferRef convertAndOrient(CVPixelBufferRef inputPixelBuffer, bnb::oep::interfaces::rotation orientation,
+                                      bnb::oep::interfaces::image_format format, const std::shared_ptr<frame_buffer_pool>& pool)
+    {
+        using ns = bnb::oep::interfaces::image_format;
+
+        image::yuv_format yuv;
+        const bool is_yuv = image::to_yuv_format(format, yuv);
+        OSType pixelFormat;
+        if (is_yuv) {
+            pixelFormat = yuvPixelFormat(yuv);
+        } else if (format == ns::bpc8_bgra) {
+            pixelFormat = kCVPixelFormatType_32BGRA;
+        } else if (format == ns::bpc8_rgba) {
+            pixelFormat = kCVPixelFormatType_32RGBA;
+        } else {
+            return nullptr;
+        }
+
+        const auto orient = glPassOrientation(orientation);
+        const bool transposed = orient.angle == image::rotation::deg90 || orient.angle == image::rotation::deg270;
+
+        auto width = CVPixelBufferGetWidth(inputPixelBuffer);
+        auto height = CVPixelBufferGetHeight(inputPixelBuffer);
+        auto bytesPerRow = CVPixelBufferGetBytesPerRow(inputPixelBuffer);
+
+        CVPixelBufferRef pixelBuffer = createPixelBuffer(transposed ? height : width, transposed ? width : height, pixelFormat, pool);
+        if (pixelBuffer == NULL) {
+            return nullptr;
+        }
+        if (is_yuv) {
+            attachYCbCrMatrix(pixelBuffer, yuv);
+        }
+
+        CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
+        CVPixelBufferLockBaseAddress(pixelBuffer, 0);
+
+        auto src = static_cast<const uint8_t*>(CVPixelBufferGetBaseAddress(inputPixelBuffer));
+        if (is_yuv) {
+            image::orient_rgb_to_yuv(src, static_cast<int32_t>(bytesPerRow), image::rgb_layout::bgra,
+                                     static_cast<int32_t>(width), static_cast<int32_t>(height), orient,
+                                     yuvPlanes(pixelBuffer, yuv), yuv);
+        } else {
+            image::orient_rgb(src, static_cast<int32_t>(bytesPerRow), image::rgb_layout::bgra,
+                              static_cast<int32_t>(width), static_cast<int32_t>(height), orient,
+                              static_cast<uint8_t*>(CVPixelBufferGetBaseAddress(pixelBuffer)),
+                              static_cast<int32_t>(CVPixelBufferGetBytesPerRow(pixelBuffer)),
+                              format == ns::bpc8_bgra ? image::rgb_layout::bgra : image::rgb_layout::rgba);
+        }
+
+        CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
+
+        CVPixelBufferUnlockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
+
+        return pixelBuffer;
+    }
 } // bnb